@@ -0,0 +1,179 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+#include "uv.h"
+#include "BenchHarness.h"
+
+#ifdef _WIN32
+#include <windows.h>
+static volatile LONG allocations = 0;
+#define COUNT_ALLOCATION() InterlockedIncrement(&allocations)
+#else
+static volatile unsigned long allocations = 0;
+#define COUNT_ALLOCATION() __sync_fetch_and_add(&allocations, 1)
+#endif
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+void *operator new(size_t size) throw(std::bad_alloc){
+	COUNT_ALLOCATION();
+	void *p = malloc(size > 0 ? size : 1);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size) throw(std::bad_alloc){
+	return operator new(size);
+}
+
+void operator delete(void *p) throw(){
+	free(p);
+}
+
+void operator delete[](void *p) throw(){
+	free(p);
+}
+
+unsigned long Bench::Allocations(){
+	return (unsigned long) allocations;
+}
+
+/*
+ * Counts last level cache misses of this thread and the threads it starts
+ * while enabled.
+ */
+class CacheMissCounter {
+public:
+	CacheMissCounter() : fd(-1){
+#ifdef __linux__
+		struct perf_event_attr attr;
+		memset(&attr, 0, sizeof(attr));
+		attr.type = PERF_TYPE_HARDWARE;
+		attr.size = sizeof(attr);
+		attr.config = PERF_COUNT_HW_CACHE_MISSES;
+		attr.disabled = 1;
+		attr.inherit = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd = (int) syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+	}
+
+	~CacheMissCounter(){
+#ifdef __linux__
+		if (fd >= 0)
+			close(fd);
+#endif
+	}
+
+	void Start(){
+#ifdef __linux__
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	/* Misses since Start(), or -1 if they cannot be counted. */
+	long long Stop(){
+#ifdef __linux__
+		long long count;
+		if (fd >= 0) {
+			ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd, &count, sizeof(count)) == (ssize_t) sizeof(count))
+				return count;
+		}
+#endif
+		return -1;
+	}
+
+private:
+	int fd;
+};
+
+Bench::Result Bench::Measure(const char *name, Stage stage, void *context, double targetMs){
+	const double targetNs = targetMs * 1e6;
+
+	/* Warm caches and lazily built state, then find a batch size that runs
+	 * long enough to time. */
+	stage(context, 1);
+	size_t iterations = 1;
+	double elapsed;
+	for (;;) {
+		uint64_t start = uv_hrtime();
+		stage(context, iterations);
+		elapsed = (double) (uv_hrtime() - start);
+		if (elapsed >= targetNs / 8 || iterations >= ((size_t) 1 << 30))
+			break;
+		iterations *= 2;
+	}
+	if (elapsed > 0 && elapsed < targetNs)
+		iterations = (size_t) (iterations * (targetNs / elapsed));
+
+	return Once(name, stage, context, iterations);
+}
+
+Bench::Result Bench::Once(const char *name, Stage stage, void *context, size_t iterations){
+	CacheMissCounter misses;
+	unsigned long allocationsBefore = Allocations();
+	misses.Start();
+	uint64_t start = uv_hrtime();
+	stage(context, iterations);
+	double elapsed = (double) (uv_hrtime() - start);
+	long long missCount = misses.Stop();
+	unsigned long allocationCount = Allocations() - allocationsBefore;
+
+	Result result;
+	result.name = name;
+	result.iterations = iterations;
+	result.nsPerOp = elapsed / iterations;
+	result.allocationsPerOp = (double) allocationCount / iterations;
+	result.cacheMissesPerOp = missCount < 0 ? -1 : (double) missCount / iterations;
+	return result;
+}
+
+void Bench::PrintHeader(){
+	printf("%-40s %12s %10s %12s %12s\n", "stage", "iterations", "ns/op", "allocs/op", "misses/op");
+}
+
+void Bench::Print(const Result &result){
+	char misses[32];
+	if (result.cacheMissesPerOp < 0)
+		strcpy(misses, "n/a");
+	else
+		sprintf(misses, "%.2f", result.cacheMissesPerOp);
+
+	printf("%-40s %12llu %10.1f %12.2f %12s\n", result.name.c_str(), result.iterations,
+	       result.nsPerOp, result.allocationsPerOp, misses);
+	fflush(stdout);
+}
+
+void Bench::Skip(const char *name, const char *reason){
+	printf("%-40s skipped: %s\n", name, reason);
+}
@@ -0,0 +1,59 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_BENCHHARNESS_H
+#define GMSECJS_BENCHHARNESS_H
+
+#include <stddef.h>
+#include <string>
+
+/*
+ * Minimal harness for the native stage benchmarks. A stage is a function
+ * run for a given number of iterations. It is calibrated in doubling
+ * batches, then measured once for about the target time with the
+ * allocation and cache miss counters around that run.
+ *
+ * Allocations are counted by replacing the global operator new, so memory
+ * allocated inside the GMSEC library is only seen where it shares the
+ * C++ runtime (Linux, not the Windows DLL). Cache misses come from
+ * perf_event_open on Linux and show as n/a elsewhere or when the kernel
+ * does not allow it.
+ */
+class Bench {
+public:
+	typedef void (*Stage)(void *context, size_t iterations);
+
+	struct Result {
+		std::string name;
+		unsigned long long iterations;
+		double nsPerOp;
+		double allocationsPerOp;
+		double cacheMissesPerOp;    /* negative when unavailable */
+	};
+
+	static Result Measure(const char *name, Stage stage, void *context, double targetMs);
+
+	/* Times a single run of exactly the given iterations, for stages that
+	 * build or tear down state and cannot be repeated. */
+	static Result Once(const char *name, Stage stage, void *context, size_t iterations);
+
+	static void PrintHeader();
+	static void Print(const Result &result);
+	static void Skip(const char *name, const char *reason);
+
+	static unsigned long Allocations();
+};
+
+#endif
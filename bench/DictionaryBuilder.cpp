@@ -0,0 +1,252 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Builds the frame compression dictionary from a recording and writes it
+ * as the C string literal src/FrameDictionary.inc holds.
+ *
+ *     gmsec-dictionary [recording.txt] [dictionary bytes] > FrameDictionary.inc
+ *
+ * The samples are every message's XML and JSON form, the two payloads the
+ * route compresses. Segments of SEGMENT bytes are picked greedily: each
+ * round takes the segment whose distinct DMER byte substrings, not yet
+ * covered by an earlier pick, occur in the most samples. The first pick
+ * goes last, since zlib reaches the end of the dictionary with the
+ * shortest distances. Ties go to the earliest segment, so the same
+ * recording always gives the same dictionary.
+ *
+ * The compressed size of the samples with and without the dictionary goes
+ * to stderr.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "zlib.h"
+
+#include "MessageRecord.h"
+
+using namespace std;
+
+static const size_t DMER = 8;
+static const size_t SEGMENT = 48;
+
+static bool LoadSamples(const char *path, vector<string> &samples){
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	string text;
+	char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, n);
+	fclose(file);
+
+	const string close = "</MESSAGE>";
+	size_t count = 0;
+	for (size_t pos = text.find("<MESSAGE"); pos != string::npos; pos = text.find("<MESSAGE", pos)) {
+		size_t end = text.find(close, pos);
+		if (end == string::npos)
+			break;
+		end += close.size();
+
+		string xml = text.substr(pos, end - pos);
+		MessageRecord record;
+		string json;
+		if (record.FromXML(xml))
+			record.ToJSON((double) count, json);
+
+		samples.push_back(xml);
+		if (!json.empty())
+			samples.push_back(json);
+		count++;
+		pos = end;
+	}
+	return !samples.empty();
+}
+
+/*
+ * Numbers every distinct DMER substring. samples[s]'s substring at i has
+ * id ids[s][i], and frequency[id] counts the samples that contain it.
+ */
+static void CountDmers(const vector<string> &samples, vector<vector<size_t> > &ids,
+                       vector<unsigned> &frequency){
+	map<string, size_t> numbers;
+	vector<size_t> lastSample;
+
+	ids.resize(samples.size());
+	for (size_t s = 0; s < samples.size(); s++) {
+		const string &sample = samples[s];
+		for (size_t i = 0; i + DMER <= sample.size(); i++) {
+			map<string, size_t>::iterator it =
+				numbers.insert(make_pair(sample.substr(i, DMER), numbers.size())).first;
+			size_t id = it->second;
+			if (id == frequency.size()) {
+				frequency.push_back(0);
+				lastSample.push_back((size_t) -1);
+			}
+			if (lastSample[id] != s) {
+				lastSample[id] = s;
+				frequency[id]++;
+			}
+			ids[s].push_back(id);
+		}
+	}
+}
+
+/* Slides a SEGMENT byte window over every sample, scoring each by the
+ * frequencies of the distinct uncovered substrings it holds. */
+static bool BestSegment(const vector<string> &samples, const vector<vector<size_t> > &ids,
+                        const vector<unsigned> &frequency, const vector<bool> &covered,
+                        vector<unsigned> &inWindow, size_t &bestSample, size_t &bestStart){
+	const size_t width = SEGMENT - DMER + 1;
+	unsigned long long best = 0;
+
+	for (size_t s = 0; s < samples.size(); s++) {
+		const vector<size_t> &sample = ids[s];
+		if (sample.size() < width)
+			continue;
+
+		unsigned long long score = 0;
+		for (size_t i = 0; i < sample.size(); i++) {
+			size_t id = sample[i];
+			if (inWindow[id]++ == 0 && !covered[id])
+				score += frequency[id];
+
+			if (i >= width) {
+				size_t old = sample[i - width];
+				if (--inWindow[old] == 0 && !covered[old])
+					score -= frequency[old];
+			}
+
+			if (i + 1 >= width && score > best) {
+				best = score;
+				bestSample = s;
+				bestStart = i + 1 - width;
+			}
+		}
+
+		for (size_t i = sample.size() - width; i < sample.size(); i++)
+			inWindow[sample[i]]--;
+	}
+	return best > 0;
+}
+
+static string Build(const vector<string> &samples, size_t bytes){
+	vector<vector<size_t> > ids;
+	vector<unsigned> frequency;
+	CountDmers(samples, ids, frequency);
+
+	vector<bool> covered(frequency.size(), false);
+	vector<unsigned> inWindow(frequency.size(), 0);
+
+	string dictionary;
+	size_t sample, start;
+	while (dictionary.size() + SEGMENT <= bytes &&
+	       BestSegment(samples, ids, frequency, covered, inWindow, sample, start)) {
+		for (size_t i = start; i + DMER <= start + SEGMENT; i++)
+			covered[ids[sample][i]] = true;
+		dictionary = samples[sample].substr(start, SEGMENT) + dictionary;
+	}
+	return dictionary;
+}
+
+static unsigned long long CompressedBytes(const vector<string> &samples, const string &dictionary){
+	unsigned long long total = 0;
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return 0;
+
+	string out;
+	for (size_t s = 0; s < samples.size(); s++) {
+		deflateReset(&stream);
+		if (!dictionary.empty())
+			deflateSetDictionary(&stream, (const Bytef*) dictionary.data(), (uInt) dictionary.size());
+		out.resize(deflateBound(&stream, (uLong) samples[s].size()));
+		stream.next_in = (Bytef*) samples[s].data();
+		stream.avail_in = (uInt) samples[s].size();
+		stream.next_out = (Bytef*) &out[0];
+		stream.avail_out = (uInt) out.size();
+		deflate(&stream, Z_FINISH);
+		total += out.size() - stream.avail_out;
+	}
+	deflateEnd(&stream);
+	return total;
+}
+
+/* Splits the literal at newlines and about every 64 bytes. */
+static void PrintLiteral(const string &dictionary){
+	string line;
+	for (size_t i = 0; i < dictionary.size(); i++) {
+		unsigned char c = (unsigned char) dictionary[i];
+		if (c == '"' || c == '\\') {
+			line += '\\';
+			line += (char) c;
+		} else if (c == '\n') {
+			line += "\\n";
+		} else if (c == '\t') {
+			line += "\\t";
+		} else if (c < 0x20 || c >= 0x7f) {
+			/* Octal, so a following digit cannot extend the escape. */
+			char escape[8];
+			sprintf(escape, "\\%03o", c);
+			line += escape;
+		} else {
+			line += (char) c;
+		}
+
+		if (c == '\n' || line.size() >= 64 || i + 1 == dictionary.size()) {
+			printf("\t\"%s\"\n", line.c_str());
+			line.clear();
+		}
+	}
+}
+
+int main(int argc, char **argv){
+	const char *path = argc > 1 ? argv[1] : "examples/Data Recorder/recording.txt";
+	size_t bytes = argc > 2 ? (size_t) atol(argv[2]) : 2048;
+
+	vector<string> samples;
+	if (!LoadSamples(path, samples)) {
+		fprintf(stderr, "No messages in %s\n", path);
+		return 1;
+	}
+
+	string dictionary = Build(samples, bytes);
+	if (dictionary.empty()) {
+		fprintf(stderr, "Nothing recurs in %s\n", path);
+		return 1;
+	}
+
+	unsigned long long raw = 0;
+	for (size_t s = 0; s < samples.size(); s++)
+		raw += samples[s].size();
+	unsigned long long plain = CompressedBytes(samples, "");
+	unsigned long long primed = CompressedBytes(samples, dictionary);
+	fprintf(stderr, "%lu samples, %llu bytes: %llu deflated, %llu with the %lu byte dictionary\n",
+	        (unsigned long) samples.size(), raw, plain, primed, (unsigned long) dictionary.size());
+
+	printf("/* Generated by gmsec-dictionary from %lu samples; make dictionary rebuilds it. */\n",
+	       (unsigned long) samples.size());
+	PrintLiteral(dictionary);
+	return 0;
+}
@@ -0,0 +1,140 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Checks that merging by PUBLISH-TIME follows the publish times of a
+ * captured recording rather than falling back to receive time.
+ *
+ *     gmsec-merge-check [recording.txt] [scratch directory]
+ *
+ * The messages are dealt in turn into two recordings with receive times
+ * that run backwards, so a merge by receive time comes out reversed.
+ * Merged by PUBLISH-TIME every key must be that field's parsed value, in
+ * order. Exits non-zero on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "EphemerisStore.h"
+#include "RecordingMerge.h"
+
+using namespace std;
+
+static const char *FIELD = "PUBLISH-TIME";
+
+static bool LoadMessages(const char *path, vector<string> &xml){
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	string text;
+	char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, n);
+	fclose(file);
+
+	const string close = "</MESSAGE>";
+	for (size_t pos = text.find("<MESSAGE"); pos != string::npos; pos = text.find("<MESSAGE", pos)) {
+		size_t end = text.find(close, pos);
+		if (end == string::npos)
+			break;
+		end += close.size();
+		xml.push_back(text.substr(pos, end - pos));
+		pos = end;
+	}
+	return !xml.empty();
+}
+
+static bool Fail(const string &error){
+	fprintf(stderr, "%s\n", error.c_str());
+	return false;
+}
+
+static bool Check(const vector<string> &xml, const string &scratch){
+	string error;
+	if (!Segment::MakeDirectory(scratch, error))
+		return Fail(error);
+
+	RecordingWriter::Options options[2];
+	RecordingWriter *writers[2];
+	for (int i = 0; i < 2; i++) {
+		options[i].directory = scratch + (i == 0 ? "/a" : "/b");
+		writers[i] = new RecordingWriter(options[i]);
+		if (!writers[i]->Open(error))
+			return Fail(error);
+	}
+
+	for (size_t i = 0; i < xml.size(); i++) {
+		RecordedMessage message;
+		message.time = 1e12 - (double) i * 1000;
+		message.subject = "GMSEC.MERGE.CHECK";
+		message.xml = xml[i];
+		if (!writers[i % 2]->Append(message, error))
+			return Fail(error);
+	}
+	for (int i = 0; i < 2; i++) {
+		if (!writers[i]->Close(error))
+			return Fail(error);
+		delete writers[i];
+	}
+
+	SegmentSet sets[2];
+	vector<const SegmentSet*> inputs;
+	for (int i = 0; i < 2; i++) {
+		if (!sets[i].Open(options[i].directory, error))
+			return Fail(error);
+		inputs.push_back(&sets[i]);
+	}
+
+	RecordingMerge merge(inputs, RecordingQuery(), FIELD);
+	RecordedMessage message;
+	string value;
+	size_t merged = 0;
+	double previous = -1e300;
+	while (merge.Next(message, error)) {
+		double expected;
+		if (!MessageRecord::FieldFromXML(message.xml, FIELD, value) ||
+		    !EphemerisStore::ParseEpoch(value, expected))
+			return Fail("message " + value + " has no usable " + FIELD);
+		if (merge.LastKey() != expected)
+			return Fail("merge keyed " + value + " by another time");
+		if (expected < previous)
+			return Fail("merge put " + value + " out of order");
+		previous = expected;
+		merged++;
+	}
+	if (!error.empty())
+		return Fail(error);
+	if (merged != xml.size())
+		return Fail("merge lost messages");
+
+	printf("%lu messages merged in %s order\n", (unsigned long) merged, FIELD);
+	return true;
+}
+
+int main(int argc, char **argv){
+	const char *path = argc > 1 ? argv[1] : "examples/Data Recorder/recording.txt";
+	string scratch = argc > 2 ? argv[2] : "merge-check";
+
+	vector<string> xml;
+	if (!LoadMessages(path, xml)) {
+		fprintf(stderr, "No messages in %s\n", path);
+		return 1;
+	}
+	return Check(xml, scratch) ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Subscription scale benchmark for the router: subscribing, routing and
+ * unsubscribing with 10, 1k and 100k routes, with wildcards that either
+ * match nothing else or overlap heavily, and with routes churning while
+ * messages flow.
+ *
+ *     gmsec-router-bench [target ms per stage] [largest route count]
+ *
+ * Every middleware operation is reported back as successful at once, so
+ * the numbers are the router's own bookkeeping and matching. Routing goes
+ * through Replay(), which matches like the dispatch path without needing
+ * messages from a middleware.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BenchHarness.h"
+#include "Router.h"
+
+using namespace std;
+
+struct CountingTarget : public Router::Target {
+	CountingTarget() : delivered(0) {}
+	void Deliver(Router::Delivery &delivery) { delivered++; }
+	unsigned long long delivered;
+};
+
+struct Sweep {
+	Sweep() : router(NULL), wildcards(0), churnEvery(0), cursor(0) {}
+
+	Router *router;
+	CountingTarget target;
+	vector<string> patterns;
+	vector<string> subjects;
+	size_t wildcards;
+	size_t churnEvery;    /* messages per churned route, 0 for none */
+	size_t cursor;
+};
+
+/* Reports every operation as done, along with whatever follows from it. */
+static void Complete(Router &router, vector<Router::Operation> &ops){
+	while (!ops.empty()) {
+		vector<Router::Operation> followUp;
+		for (size_t i = 0; i < ops.size(); i++)
+			router.Completed(ops[i], true, followUp);
+		ops.swap(followUp);
+	}
+}
+
+/*
+ * Telemetry subjects GMSEC.M<mission>.SC<craft>.TLM.P<point>. Overlapping
+ * wildcards are the kinds a display subscribes with: everything from a
+ * craft, one point across craft, one point across missions.
+ */
+static void MakeRoutes(Sweep &sweep, size_t count, bool overlap){
+	char buffer[128];
+	size_t exact = overlap ? count - count / 10 : count - count / 100;
+
+	for (size_t i = 0; i < exact; i++) {
+		sprintf(buffer, "GMSEC.M%lu.SC%lu.TLM.P%lu", (unsigned long) (i / 1000),
+		        (unsigned long) (i / 50 % 20), (unsigned long) (i % 50));
+		sweep.patterns.push_back(buffer);
+	}
+
+	set<string> wildcards;
+	size_t missions = exact / 1000 + 1;
+	for (size_t j = 0; wildcards.size() < count - exact && j < 8 * count; j++) {
+		unsigned long m = (unsigned long) (j / 4 % missions), craft = (unsigned long) (j / 4 / missions % 20),
+		              point = (unsigned long) (j / 4 / missions / 20 % 50);
+		if (!overlap)
+			sprintf(buffer, "GMSEC.W%lu.*.TLM", (unsigned long) j);
+		else if (j % 4 == 0)
+			sprintf(buffer, "GMSEC.M%lu.SC%lu.>", m, craft);
+		else if (j % 4 == 1)
+			sprintf(buffer, "GMSEC.M%lu.*.TLM.P%lu", m, point);
+		else if (j % 4 == 2)
+			sprintf(buffer, "GMSEC.*.SC%lu.TLM.P%lu", craft, point);
+		else
+			sprintf(buffer, "GMSEC.M%lu.SC%lu.*.P%lu", m, craft, point);
+		wildcards.insert(buffer);
+	}
+	sweep.wildcards = wildcards.size();
+	sweep.patterns.insert(sweep.patterns.end(), wildcards.begin(), wildcards.end());
+
+	/* Messages visit the subjects out of order. */
+	for (size_t i = 0; i < exact; i++)
+		sweep.subjects.push_back(sweep.patterns[i * 7919 % exact]);
+}
+
+static void Subscribe(void *context, size_t iterations){
+	Sweep &sweep = *static_cast<Sweep*>(context);
+	vector<Router::Operation> ops;
+	for (size_t i = 0; i < iterations; i++) {
+		sweep.router->Add(sweep.patterns[i], &sweep.target, ops);
+		Complete(*sweep.router, ops);
+	}
+}
+
+static void Unsubscribe(void *context, size_t iterations){
+	Sweep &sweep = *static_cast<Sweep*>(context);
+	vector<Router::Operation> ops;
+	for (size_t i = 0; i < iterations; i++) {
+		sweep.router->Remove(sweep.patterns[i], ops);
+		Complete(*sweep.router, ops);
+	}
+}
+
+/* Removes a route and adds it back. */
+static void Churn(Sweep &sweep){
+	const string &pattern = sweep.patterns[sweep.cursor++ % sweep.patterns.size()];
+	vector<Router::Operation> ops;
+	sweep.router->Remove(pattern, ops);
+	Complete(*sweep.router, ops);
+	sweep.router->Add(pattern, &sweep.target, ops);
+	Complete(*sweep.router, ops);
+}
+
+static void ChurnRoutes(void *context, size_t iterations){
+	Sweep &sweep = *static_cast<Sweep*>(context);
+	for (size_t i = 0; i < iterations; i++)
+		Churn(sweep);
+}
+
+static void RouteMessages(void *context, size_t iterations){
+	Sweep &sweep = *static_cast<Sweep*>(context);
+	static const string xml;
+	for (size_t i = 0; i < iterations; i++) {
+		sweep.router->Replay(sweep.subjects[i % sweep.subjects.size()], xml);
+		if (sweep.churnEvery > 0 && i % sweep.churnEvery == 0)
+			Churn(sweep);
+	}
+}
+
+static string Count(size_t n){
+	char buffer[32];
+	if (n >= 1000 && n % 1000 == 0)
+		sprintf(buffer, "%luk", (unsigned long) (n / 1000));
+	else
+		sprintf(buffer, "%lu", (unsigned long) n);
+	return buffer;
+}
+
+static void Run(size_t count, bool overlap, double targetMs){
+	Sweep sweep;
+	MakeRoutes(sweep, count, overlap);
+	sweep.router = new Router();
+
+	char label[64], name[96];
+	sprintf(label, "%s/%s%s", Count(sweep.patterns.size()).c_str(), Count(sweep.wildcards).c_str(),
+	        overlap ? " overlap" : "");
+
+	sprintf(name, "%s: subscribe", label);
+	Bench::Print(Bench::Once(name, Subscribe, &sweep, sweep.patterns.size()));
+
+	Router::Stats stats = sweep.router->GetStats();
+	printf("    %lu middleware subscriptions, %lu covering, %lu wildcards riding\n",
+	       (unsigned long) stats.subscriptions, (unsigned long) stats.coveringSubscriptions,
+	       (unsigned long) stats.coveredWildcards);
+
+	sprintf(name, "%s: route", label);
+	Bench::Print(Bench::Measure(name, RouteMessages, &sweep, targetMs));
+
+	const size_t churnRates[] = { 1000, 100, 10 };
+	for (size_t i = 0; i < sizeof(churnRates) / sizeof(churnRates[0]); i++) {
+		sweep.churnEvery = churnRates[i];
+		sprintf(name, "%s: route, churn 1/%lu", label, (unsigned long) churnRates[i]);
+		Bench::Print(Bench::Measure(name, RouteMessages, &sweep, targetMs));
+	}
+	sweep.churnEvery = 0;
+
+	sprintf(name, "%s: churn", label);
+	Bench::Print(Bench::Measure(name, ChurnRoutes, &sweep, targetMs));
+
+	sprintf(name, "%s: unsubscribe", label);
+	Bench::Print(Bench::Once(name, Unsubscribe, &sweep, sweep.patterns.size()));
+
+	delete sweep.router;
+	printf("\n");
+}
+
+int main(int argc, char **argv){
+	double targetMs = argc > 1 ? atof(argv[1]) : 200;
+	size_t largest = argc > 2 ? (size_t) atol(argv[2]) : 100000;
+
+	printf("routes are written total/wildcard\n\n");
+	Bench::PrintHeader();
+	for (size_t count = 10; count <= largest; count *= 100) {
+		Run(count, false, targetMs);
+		Run(count, true, targetMs);
+	}
+	return 0;
+}
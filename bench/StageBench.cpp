@@ -0,0 +1,352 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Microbenchmarks for the hot stages between the middleware and a JS
+ * callback, run over the messages of a recording so field counts and
+ * sizes are realistic:
+ *
+ *     gmsec-bench [recording.txt] [stage filter] [target ms per stage]
+ *
+ * The GMSEC stages need a middleware library to create messages with but
+ * never connect; set GMSEC_BENCH_CONNECTIONTYPE to pick one other than
+ * gmsec_mb.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "uv.h"
+#include "gmsec_cpp.h"
+#include "Sync.h"
+
+#include "BenchHarness.h"
+#include "MessageRecord.h"
+#include "DeltaEncoder.h"
+#include "FrameCompressor.h"
+#include "Router.h"
+#include "Subject.h"
+#include "shim/MiddlewareShim.h"
+
+using namespace std;
+
+struct Corpus {
+	Corpus() : connection(NULL) {}
+
+	vector<string> xml;
+	vector<MessageRecord> records;
+	vector<string> json;
+	gmsec::Connection *connection;
+	vector<gmsec::Message*> messages;
+};
+
+static bool LoadCorpus(const char *path, Corpus &corpus){
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+
+	string text;
+	char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		text.append(buffer, n);
+	fclose(file);
+
+	const string close = "</MESSAGE>";
+	for (size_t pos = text.find("<MESSAGE"); pos != string::npos; pos = text.find("<MESSAGE", pos)) {
+		size_t end = text.find(close, pos);
+		if (end == string::npos)
+			break;
+		end += close.size();
+		corpus.xml.push_back(text.substr(pos, end - pos));
+		pos = end;
+	}
+
+	corpus.records.resize(corpus.xml.size());
+	corpus.json.resize(corpus.xml.size());
+	for (size_t i = 0; i < corpus.xml.size(); i++) {
+		corpus.records[i].FromXML(corpus.xml[i]);
+		corpus.records[i].ToJSON((double) i, corpus.json[i]);
+	}
+	return !corpus.xml.empty();
+}
+
+/* Messages built by the middleware library, if one can be loaded. */
+static string OpenMessages(Corpus &corpus){
+	const char *type = getenv("GMSEC_BENCH_CONNECTIONTYPE");
+
+	/* The shim is linked in; decoding reads the messages through it. */
+	MiddlewareApi::Set(gmsecjs_middleware_api(GMSECJS_MIDDLEWARE_API_VERSION));
+
+	gmsec::Config config;
+	config.AddValue("connectiontype", type != NULL ? type : "gmsec_mb");
+	gmsec::Status result = gmsec::ConnectionFactory::Create(&config, corpus.connection);
+	if (result.isError()) {
+		corpus.connection = NULL;
+		return result.Get();
+	}
+
+	for (size_t i = 0; i < corpus.xml.size(); i++) {
+		gmsec::Message *msg;
+		corpus.connection->CreateMessage(msg);
+		result = msg->FromXML(corpus.xml[i].c_str());
+		if (result.isError())
+			return result.Get();
+		corpus.messages.push_back(msg);
+	}
+	return string();
+}
+
+/*
+ * GMSEC stages.
+ */
+
+static void CloneMessage(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	for (size_t i = 0; i < iterations; i++) {
+		gmsec::Message *copy;
+		corpus.connection->CloneMessage(corpus.messages[i % corpus.messages.size()], copy);
+		corpus.connection->DestroyMessage(copy);
+	}
+}
+
+static void MessageToXML(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	for (size_t i = 0; i < iterations; i++) {
+		const char *xml;
+		corpus.messages[i % corpus.messages.size()]->ToXML(xml);
+	}
+}
+
+static void MessageFromXML(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	for (size_t i = 0; i < iterations; i++) {
+		gmsec::Message *msg;
+		corpus.connection->CreateMessage(msg);
+		msg->FromXML(corpus.xml[i % corpus.xml.size()].c_str());
+		corpus.connection->DestroyMessage(msg);
+	}
+}
+
+static void DecodeMessage(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	MessageRecord record;
+	for (size_t i = 0; i < iterations; i++)
+		record.FromMessage(ToApiMessage(corpus.messages[i % corpus.messages.size()]));
+}
+
+/*
+ * Stages that need no middleware.
+ */
+
+static void DecodeXML(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	MessageRecord record;
+	for (size_t i = 0; i < iterations; i++)
+		record.FromXML(corpus.xml[i % corpus.xml.size()]);
+}
+
+static void EncodeJSON(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	string out;
+	for (size_t i = 0; i < iterations; i++)
+		corpus.records[i % corpus.records.size()].ToJSON((double) i, out);
+}
+
+static void EncodeDelta(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	DeltaEncoder encoder(60);
+	string out;
+	for (size_t i = 0; i < iterations; i++)
+		encoder.Encode(corpus.records[i % corpus.records.size()], (double) i, out);
+}
+
+static void CompressFrame(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	FrameCompressor compressor(true);
+	string out;
+	for (size_t i = 0; i < iterations; i++) {
+		const string &json = corpus.json[i % corpus.json.size()];
+		compressor.Compress(json.data(), json.size(), out);
+	}
+}
+
+/*
+ * The delivery queue: dispatch threads push batons under a mutex and the
+ * node thread swaps out everything queued at once, as Connection does.
+ */
+struct QueueBench {
+	size_t producers;
+	Mutex mutex;
+	deque<void*> items;
+};
+
+struct Producer {
+	QueueBench *bench;
+	size_t count;
+	uv_thread_t thread;
+};
+
+static void Produce(void *arg){
+	Producer *producer = static_cast<Producer*>(arg);
+	for (size_t i = 0; i < producer->count; i++) {
+		AutoMutex lock(producer->bench->mutex);
+		producer->bench->items.push_back(producer);
+	}
+}
+
+static void QueuePushPop(void *context, size_t iterations){
+	QueueBench &bench = *static_cast<QueueBench*>(context);
+
+	vector<Producer> producers(bench.producers);
+	for (size_t i = 0; i < producers.size(); i++) {
+		producers[i].bench = &bench;
+		producers[i].count = iterations / producers.size() + (i == 0 ? iterations % producers.size() : 0);
+		uv_thread_create(&producers[i].thread, Produce, &producers[i]);
+	}
+
+	deque<void*> batch;
+	size_t consumed = 0;
+	while (consumed < iterations) {
+		{
+			AutoMutex lock(bench.mutex);
+			batch.swap(bench.items);
+		}
+		consumed += batch.size();
+		while (!batch.empty())
+			batch.pop_front();
+	}
+
+	for (size_t i = 0; i < producers.size(); i++)
+		uv_thread_join(&producers[i].thread);
+}
+
+/*
+ * Routing: exact routes found by subject, wildcard routes matched locally.
+ */
+struct CountingTarget : public Router::Target {
+	CountingTarget() : delivered(0) {}
+	void Deliver(Router::Delivery &delivery) { delivered++; }
+	unsigned long long delivered;
+};
+
+struct RouteBench {
+	Router router;
+	CountingTarget target;
+	vector<string> subjects;
+};
+
+static void SetUpRoutes(RouteBench &bench, size_t exact, size_t wildcards){
+	vector<Router::Operation> ops;
+	char subject[128];
+	for (size_t i = 0; i < exact; i++) {
+		sprintf(subject, "GMSEC.MISSION%lu.SC%lu.POSITION.UPDATE", (unsigned long) (i / 50), (unsigned long) (i % 50));
+		bench.router.Add(subject, &bench.target, ops);
+		bench.subjects.push_back(subject);
+	}
+	for (size_t i = 0; i < wildcards; i++) {
+		sprintf(subject, "GMSEC.MISSION%lu.*.POSITION.>", (unsigned long) i);
+		bench.router.Add(subject, &bench.target, ops);
+	}
+
+	/* Complete every operation as the middleware would, follow-ups too. */
+	while (!ops.empty()) {
+		vector<Router::Operation> followUp;
+		for (size_t i = 0; i < ops.size(); i++)
+			bench.router.Completed(ops[i], true, followUp);
+		ops.swap(followUp);
+	}
+}
+
+static void RouteReplay(void *context, size_t iterations){
+	RouteBench &bench = *static_cast<RouteBench*>(context);
+	static const string xml;
+	for (size_t i = 0; i < iterations; i++)
+		bench.router.Replay(bench.subjects[i % bench.subjects.size()], xml);
+}
+
+static void MatchSubject(void *context, size_t iterations){
+	Corpus &corpus = *static_cast<Corpus*>(context);
+	static const string pattern = "GMSEC.*.PUBLISHER.*.POSITION.>";
+	size_t matched = 0;
+	for (size_t i = 0; i < iterations; i++)
+		matched += Subject::Matches(pattern, corpus.records[i % corpus.records.size()].subject) ? 1 : 0;
+	if (matched > iterations)
+		printf("unreachable\n");
+}
+
+static void Run(const char *filter, double targetMs, const char *name, Bench::Stage stage, void *context){
+	if (strstr(name, filter) == NULL)
+		return;
+	Bench::Print(Bench::Measure(name, stage, context, targetMs));
+}
+
+int main(int argc, char **argv){
+	const char *path = argc > 1 ? argv[1] : "examples/Data Recorder/recording.txt";
+	const char *filter = argc > 2 ? argv[2] : "";
+	double targetMs = argc > 3 ? atof(argv[3]) : 200;
+
+	Corpus corpus;
+	if (!LoadCorpus(path, corpus)) {
+		fprintf(stderr, "No messages in %s\n", path);
+		return 1;
+	}
+	printf("%lu messages from %s\n\n", (unsigned long) corpus.xml.size(), path);
+
+	Bench::PrintHeader();
+
+	string unavailable = OpenMessages(corpus);
+	const char *gmsecStages[] = { "gmsec clone", "gmsec ToXML", "gmsec create+FromXML", "decode message" };
+	if (!unavailable.empty()) {
+		for (size_t i = 0; i < sizeof(gmsecStages) / sizeof(gmsecStages[0]); i++)
+			if (strstr(gmsecStages[i], filter) != NULL)
+				Bench::Skip(gmsecStages[i], unavailable.c_str());
+	}
+	else {
+		Run(filter, targetMs, gmsecStages[0], CloneMessage, &corpus);
+		Run(filter, targetMs, gmsecStages[1], MessageToXML, &corpus);
+		Run(filter, targetMs, gmsecStages[2], MessageFromXML, &corpus);
+		Run(filter, targetMs, gmsecStages[3], DecodeMessage, &corpus);
+	}
+
+	Run(filter, targetMs, "decode xml", DecodeXML, &corpus);
+	Run(filter, targetMs, "encode json", EncodeJSON, &corpus);
+	Run(filter, targetMs, "encode delta", EncodeDelta, &corpus);
+	Run(filter, targetMs, "compress frame (dictionary)", CompressFrame, &corpus);
+
+	QueueBench single, contended;
+	single.producers = 1;
+	contended.producers = 4;
+	Run(filter, targetMs, "queue push/pop, 1 producer", QueuePushPop, &single);
+	Run(filter, targetMs, "queue push/pop, 4 producers", QueuePushPop, &contended);
+
+	RouteBench exact, wildcard;
+	SetUpRoutes(exact, 1000, 0);
+	SetUpRoutes(wildcard, 1000, 100);
+	Run(filter, targetMs, "route, 1k exact", RouteReplay, &exact);
+	Run(filter, targetMs, "route, 1k exact + 100 wildcard", RouteReplay, &wildcard);
+	Run(filter, targetMs, "subject match", MatchSubject, &corpus);
+
+	for (size_t i = 0; i < corpus.messages.size(); i++)
+		corpus.connection->DestroyMessage(corpus.messages[i]);
+	if (corpus.connection != NULL)
+		gmsec::ConnectionFactory::Destroy(corpus.connection);
+
+	return 0;
+}
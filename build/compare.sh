@@ -0,0 +1,47 @@
+#!/bin/sh
+# Runs the native benchmarks from two builds and reports the speedup of the
+# second over the first, stage by stage and as a geometric mean.
+#
+# Usage: sh compare.sh baseline-dir optimized-dir [recording]
+
+BASE=${1:-Release}
+OPT=${2:-Release-pgo}
+RECORDING=${3:-"../examples/Data Recorder/recording.txt"}
+TARGET_MS=${TARGET_MS:-500}
+
+run() {
+	"$1/gmsec-bench" "$RECORDING" "" "$TARGET_MS"
+	"$1/gmsec-router-bench" "$TARGET_MS"
+}
+
+# Stage names fill the first 40 columns and ns/op is the second number after
+# them. Indented lines are notes, not stages.
+nsPerOp() {
+	awk '/^[^ ]/ && !/ skipped: / && $1 != "stage" && length($0) > 40 {
+		name = substr($0, 1, 40); sub(/ +$/, "", name)
+		split(substr($0, 41), f, " ")
+		print name "\t" f[2]
+	}'
+}
+
+BASE_OUT=$(mktemp)
+OPT_OUT=$(mktemp)
+trap 'rm -f "$BASE_OUT" "$OPT_OUT"' EXIT
+
+run "$BASE" | nsPerOp > "$BASE_OUT" || exit 1
+run "$OPT" | nsPerOp > "$OPT_OUT" || exit 1
+
+awk -F '\t' -v base="$BASE" -v opt="$OPT" '
+	NR == FNR { baseline[$1] = $2; next }
+	!($1 in baseline) || baseline[$1] <= 0 || $2 <= 0 { next }
+	{
+		if (!header++)
+			printf "%-40s %12s %12s %8s\n", "stage", base " ns/op", opt " ns/op", "speedup"
+		ratio = baseline[$1] / $2
+		printf "%-40s %12.1f %12.1f %7.2fx\n", $1, baseline[$1], $2, ratio
+		logSum += log(ratio); n++
+	}
+	END {
+		if (n == 0) { print "No stages ran in both builds"; exit 1 }
+		printf "\nGeometric mean speedup over %d stages: %.2fx\n", n, exp(logSum / n)
+	}' "$BASE_OUT" "$OPT_OUT"
@@ -0,0 +1,99 @@
+/*
+ * Measures cold start: the time from calling Connect() to the first message
+ * delivered to a subscriber, in fresh node processes, with and without the
+ * prewarm option. Each run connects, subscribes to a private subject,
+ * publishes one message on it and waits for it to come back.
+ *
+ * The total is split into connect (Connect() to its callback), subscribe
+ * (SubscribeMany() to its callback) and delivery (Publish() to the message
+ * callback). Prewarming moves work into the connect figure; what matters is
+ * that delivery gets shorter.
+ *
+ * Usage: node coldstart.js [server] [runs]
+ */
+var child_process = require('child_process');
+
+var server = process.argv[2] || '127.0.0.1';
+var runs = parseInt(process.argv[3] || '10', 10);
+
+function elapsedMs(start){
+	var diff = process.hrtime(start);
+	return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+function child(prewarm){
+	var GMSEC = require('../../deps/node.js/Release/gmsec');
+	var subject = 'GMSEC.BENCH.COLDSTART.P' + process.pid;
+	var result = {};
+
+	var connection = new GMSEC.Connection();
+	var start = process.hrtime();
+	connection.Connect(server, {prewarm: prewarm}, function(){
+		result.connectMs = elapsedMs(start);
+
+		var subscribed = process.hrtime();
+		connection.SubscribeMany([{subject: subject}], onMessage, function(){
+			result.subscribeMs = elapsedMs(subscribed);
+
+			published = process.hrtime();
+			connection.Publish('<MESSAGE SUBJECT="' + subject + '" KIND="PUBLISH">' +
+			                   '<FIELD TYPE="I32" NAME="COUNTER">1</FIELD></MESSAGE>');
+		});
+	});
+
+	var published;
+	function onMessage(){
+		result.deliveryMs = elapsedMs(published);
+		result.totalMs = elapsedMs(start);
+		console.log(JSON.stringify(result));
+		process.exit(0);
+	}
+}
+
+function median(values){
+	values = values.slice().sort(function(a, b){ return a - b; });
+	return values[Math.floor(values.length / 2)];
+}
+
+function measure(prewarm, done){
+	var results = [];
+
+	function next(){
+		if (results.length == runs)
+			return done(results);
+
+		child_process.execFile(process.execPath, [__filename, '--child', server, String(prewarm)],
+		                       {cwd: __dirname, timeout: 30000}, function(error, stdout, stderr){
+			if (error) {
+				console.error(stderr || error.message);
+				process.exit(1);
+			}
+			results.push(JSON.parse(stdout));
+			next();
+		});
+	}
+	next();
+}
+
+function report(name, results){
+	var line = name;
+	['connectMs', 'subscribeMs', 'deliveryMs', 'totalMs'].forEach(function(key){
+		line += '  ' + key.replace('Ms', '') + ' ' +
+		        median(results.map(function(r){ return r[key]; })).toFixed(2) + ' ms';
+	});
+	console.log(line);
+}
+
+if (process.argv[2] == '--child') {
+	server = process.argv[3];
+	child(process.argv[4] == 'true');
+}
+else {
+	measure(false, function(cold){
+		measure(true, function(warm){
+			report('cold:   ', cold);
+			report('prewarm:', warm);
+			console.log('(median of ' + runs + ' runs each)');
+		});
+	});
+}
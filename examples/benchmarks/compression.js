@@ -0,0 +1,95 @@
+/*
+ * Compares delivering recorded GMSEC traffic to many subscribers of one
+ * subject through a local connection:
+ *
+ *   - uncompressed XML
+ *   - {compression: 'deflate'} without the preset dictionary
+ *   - {compression: 'deflate'} with it
+ *
+ * Every run subscribes the same number of consumers with the same options,
+ * so the route compresses each message once and shares the frame, then
+ * publishes the recording a few times over and waits until every consumer
+ * has every message. The time covers routing, encoding, compression and the
+ * callbacks; the byte count is what the consumers were handed.
+ *
+ * Usage: node compression.js [recording] [clients] [rounds]
+ */
+var fs = require('fs'),
+	path = require('path'),
+	GMSEC = require('../../deps/node.js/Release/gmsec');
+
+var recording = process.argv[2] || path.join(__dirname, '../Data Recorder/recording.txt');
+var clients = parseInt(process.argv[3] || '200', 10);
+var rounds = parseInt(process.argv[4] || '20', 10);
+
+var messages = fs.readFileSync(recording, 'utf8').split('</MESSAGE>\n')
+	.filter(function(m){ return m.indexOf('<MESSAGE') >= 0; })
+	.map(function(m){ return m + '</MESSAGE>\n'; });
+
+var subjects = {};
+messages.forEach(function(m){
+	var match = /SUBJECT="([^"]*)"/.exec(m);
+	if (match)
+		subjects[match[1]] = true;
+});
+subjects = Object.keys(subjects);
+
+var inputBytes = 0;
+messages.forEach(function(m){ inputBytes += Buffer.byteLength(m); });
+
+function elapsedMs(start){
+	var diff = process.hrtime(start);
+	return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+function run(connection, name, options, done){
+	var expected = messages.length * rounds * clients;
+	var delivered = 0;
+	var deliveredBytes = 0;
+	var start;
+
+	function onMessage(payload){
+		deliveredBytes += payload.length;
+		if (++delivered < expected)
+			return;
+
+		var ms = elapsedMs(start);
+		console.log(name + ': ' + ms.toFixed(1) + ' ms, ' +
+			(ms * 1e6 / (inputBytes * rounds * clients)).toFixed(2) + ' ns per delivered input byte, ' +
+			(deliveredBytes / rounds / 1024).toFixed(0) + ' KiB handed out per round (ratio ' +
+			(inputBytes * rounds * clients / deliveredBytes).toFixed(2) + ')');
+
+		subjects.forEach(function(subject){ connection.Unsubscribe(subject); });
+		setTimeout(done, 100);
+	}
+
+	var entries = [];
+	subjects.forEach(function(subject){
+		for (var i = 0; i < clients; i++)
+			entries.push({subject: subject, options: options});
+	});
+
+	connection.SubscribeMany(entries, onMessage, function(){
+		start = process.hrtime();
+		for (var round = 0; round < rounds; round++)
+			messages.forEach(function(m){ connection.Publish(m); });
+	});
+}
+
+console.log(messages.length + ' messages, ' + inputBytes + ' bytes, ' + clients + ' clients, ' + rounds + ' rounds');
+
+var connection = new GMSEC.Connection();
+connection.ConnectLocal();
+
+var runs = [
+	['uncompressed                  ', {}],
+	['shared deflate                ', {compression: 'deflate', dictionary: false}],
+	['shared deflate, dictionary    ', {compression: 'deflate'}]
+];
+
+(function next(){
+	if (runs.length === 0)
+		return process.exit(0);
+	var params = runs.shift();
+	run(connection, params[0], params[1], next);
+})();
@@ -0,0 +1,64 @@
+/*
+ * Offers FreeFlyer-style traffic at a fixed open-loop rate: position
+ * updates for several spacecraft, a heartbeat per spacecraft and bursts of
+ * maneuver planning iterations. Without a server the load loops back to a
+ * local subscriber, so the handler is measured on its own.
+ *
+ * Lag is measured from when each message was scheduled, not from when the
+ * previous one went out, so stalls show up in the tail instead of quietly
+ * lowering the offered rate.
+ *
+ * Usage: node load.js [server|local] [rate] [seconds]
+ */
+var GMSEC = require('../../deps/node.js/Release/gmsec');
+
+var server = process.argv[2] || 'local';
+var rate = parseFloat(process.argv[3] || '5000');
+var seconds = parseFloat(process.argv[4] || '10');
+
+var profiles = [
+	{subject: 'GMSEC.FREEFLYER.PUBLISHER.SC{n}.POSITION.UPDATE', subjects: 8, rate: rate, fields: [
+		{name: 'SCName', type: 'STRING', text: 6},
+		{name: 'X', type: 'F64', walk: [645, 25]},
+		{name: 'Y', type: 'F64', walk: [-782, 25]},
+		{name: 'Z', type: 'F64', walk: [6999, 25]},
+		{name: 'Latitude', type: 'F64', uniform: [-90, 90]},
+		{name: 'Longitude', type: 'F64', uniform: [-180, 180]},
+		{name: 'PUBLISH-TIME', type: 'STRING', time: true}
+	], extraFields: 8},
+	{subject: 'GMSEC.FREEFLYER.SC{n}.HB', subjects: 8, rate: 8, fields: [
+		{name: 'COUNTER', type: 'I16', sequence: [0, 1]},
+		{name: 'PUBLISH-TIME', type: 'STRING', time: true}
+	]},
+	{subject: 'GMSEC.FREEFLYER.MANEUVER.ITERATION', burst: {size: 500, everyMs: 2000}, fields: [
+		{name: 'ITERATION', type: 'U32', sequence: [0, 1]},
+		{name: 'DELTA-V', type: 'F64', normal: [1.5, 0.2]}
+	]}
+];
+
+var received = 0;
+
+function run(connection){
+	connection.Subscribe('GMSEC.FREEFLYER.>', function(){ received++; });
+
+	connection.Generate(profiles, {durationMs: seconds * 1000, threads: 3}, function(err, stats){
+		console.log('Offered ' + stats.sent + ' messages in ' + stats.elapsedMs.toFixed(0) + ' ms (' +
+			stats.messagesPerSecond.toFixed(0) + '/s), ' + stats.failed + ' failed, ' + stats.late + ' late');
+		console.log('Publish lag ms: p50 ' + stats.lagMs.p50.toFixed(3) + ', p99 ' + stats.lagMs.p99.toFixed(3) +
+			', p99.9 ' + stats.lagMs.p999.toFixed(3) + ', max ' + stats.lagMs.max.toFixed(3));
+
+		setTimeout(function(){
+			console.log('Received ' + received);
+			process.exit(0);
+		}, 1000);
+	});
+}
+
+var connection = new GMSEC.Connection();
+if (server === 'local') {
+	connection.ConnectLocal();
+	run(connection);
+}
+else {
+	connection.Connect(server, function(){ run(connection); });
+}
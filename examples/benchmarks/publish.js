@@ -0,0 +1,101 @@
+/*
+ * Measures publish batching: for each latency ceiling, JS publishes at a
+ * low and a high rate, and each message is timed from Publish() until it
+ * comes back to a subscriber on the same connection. After each run the
+ * publisher's batch sizes and flush reasons are printed, which is what a
+ * deployment tunes maxBatch and maxDelayUs against.
+ *
+ * Rates are offered in 1 ms ticks, so the high rate arrives in small
+ * bursts as it would from a busy event loop.
+ *
+ * Usage: node publish.js [server|local] [seconds]
+ */
+var GMSEC = require('../../deps/node.js/Release/gmsec');
+
+var server = process.argv[2] || 'local';
+var seconds = parseFloat(process.argv[3] || '3');
+
+var CEILINGS_US = [0, 50, 200, 1000];
+var RATES = [1000, 100000];
+var SUBJECT = 'GMSEC.BENCH.PUBLISH.P' + process.pid;
+
+function nowUs(){
+	var time = process.hrtime();
+	return time[0] * 1e6 + time[1] / 1e3;
+}
+
+function percentile(values, q){
+	values.sort(function(a, b){ return a - b; });
+	return values.length > 0 ? values[Math.min(values.length - 1, Math.floor(values.length * q))] : 0;
+}
+
+var latencies = [];
+
+function onMessage(xml){
+	var match = /NAME="SENT">([^<]*)</.exec(xml);
+	if (match)
+		latencies.push(nowUs() - parseFloat(match[1]));
+}
+
+function run(connection, ceiling, rate, done){
+	connection.ConfigurePublishing({maxDelayUs: ceiling});
+	connection.PublishingStats(true);
+	latencies = [];
+
+	var perTick = rate / 1000;
+	var owed = 0;
+	var start = nowUs();
+	var sent = 0;
+
+	function tick(){
+		var elapsed = nowUs() - start;
+		if (elapsed >= seconds * 1e6) {
+			/* Let the last batches come back before reporting. */
+			return setTimeout(function(){ report(ceiling, rate, sent, elapsed, connection.PublishingStats()); done(); }, 200);
+		}
+
+		for (owed += perTick; owed >= 1; owed--, sent++)
+			connection.Publish('<MESSAGE SUBJECT="' + SUBJECT + '" KIND="PUBLISH">' +
+			                   '<FIELD TYPE="F64" NAME="SENT">' + nowUs().toFixed(1) + '</FIELD></MESSAGE>');
+		setTimeout(tick, 1);
+	}
+	tick();
+}
+
+function report(ceiling, rate, sent, elapsedUs, stats){
+	var sizes = stats.batchSizes.map(function(count, i){
+		return (i === 0 ? '1' : Math.pow(2, i) + '-' + (Math.pow(2, i + 1) - 1)) + ':' + count;
+	}).join(' ');
+
+	console.log('ceiling ' + ceiling + ' us, ' + rate + '/s offered: ' +
+		(sent / elapsedUs * 1e6).toFixed(0) + '/s sent, ' + latencies.length + ' received, ' +
+		'latency us p50 ' + percentile(latencies, 0.5).toFixed(0) + ' p99 ' + percentile(latencies, 0.99).toFixed(0));
+	console.log('    ' + stats.batches + ' batches, flushes idle ' + stats.flushes.idle + ' full ' +
+		stats.flushes.full + ' deadline ' + stats.flushes.deadline + ', wait us p50 ' +
+		stats.waitUs.p50.toFixed(0) + ' p99 ' + stats.waitUs.p99.toFixed(0) + ', sizes ' + sizes);
+}
+
+function sweep(connection){
+	var runs = [];
+	CEILINGS_US.forEach(function(ceiling){
+		RATES.forEach(function(rate){ runs.push([ceiling, rate]); });
+	});
+
+	(function next(){
+		if (runs.length === 0)
+			return process.exit(0);
+		var params = runs.shift();
+		run(connection, params[0], params[1], next);
+	})();
+}
+
+var connection = new GMSEC.Connection();
+if (server === 'local') {
+	connection.ConnectLocal();
+	connection.SubscribeMany([{subject: SUBJECT}], onMessage, function(){ sweep(connection); });
+}
+else {
+	connection.Connect(server, function(){
+		connection.SubscribeMany([{subject: SUBJECT}], onMessage, function(){ sweep(connection); });
+	});
+}
@@ -0,0 +1,167 @@
+/*
+ * Runs sustained loopback traffic through a local connection for hours and
+ * watches memory for slow growth: RSS, the native allocator, the V8 heap,
+ * active handles and the connection's native object counts. Subscriptions
+ * churn and messages are published from JS alongside the generated load,
+ * so the subscribe, unsubscribe and publish paths are exercised as well.
+ *
+ * After the warm-up, a least squares line is fitted to each metric. The run
+ * fails (exit code 1) if any slope exceeds its threshold, so a leak of a few
+ * bytes per message is caught long before it would be noticed in production.
+ * Run with --expose-gc so the V8 heap is sampled after a full collection.
+ *
+ * Usage: node --expose-gc soak.js [hours] [rate] [KB per hour] [sample seconds] [samples.csv]
+ */
+var fs = require('fs');
+var GMSEC = require('../../deps/node.js/Release/gmsec');
+
+var hours = parseFloat(process.argv[2] || '4');
+var rate = parseFloat(process.argv[3] || '2000');
+var kbPerHour = parseFloat(process.argv[4] || '1024');
+var sampleSeconds = parseFloat(process.argv[5] || '60');
+var csvPath = process.argv[6];
+
+/* Samples taken during the warm-up only fill caches and pools. */
+var warmupHours = Math.min(0.25, hours / 5);
+
+/* Byte metrics share the KB per hour threshold; counts should not grow at all
+ * on a steady workload, so a few per hour already means a leak. */
+var metrics = [
+	{name: 'rss', unit: 'KB', scale: 1024, limit: kbPerHour},
+	{name: 'allocator.inUse', unit: 'KB', scale: 1024, limit: kbPerHour},
+	{name: 'allocator.heap', unit: 'KB', scale: 1024, limit: 2 * kbPerHour},
+	{name: 'v8.heapUsed', unit: 'KB', scale: 1024, limit: kbPerHour},
+	{name: 'handles', unit: '', scale: 1, limit: 2},
+	{name: 'routes', unit: '', scale: 1, limit: 2},
+	{name: 'consumers', unit: '', scale: 1, limit: 2},
+	{name: 'retiredConsumers', unit: '', scale: 1, limit: 2},
+	{name: 'replayBytes', unit: 'KB', scale: 1024, limit: kbPerHour}
+];
+
+var profiles = [
+	{subject: 'GMSEC.SOAK.SC{n}.POSITION.UPDATE', subjects: 8, rate: rate, fields: [
+		{name: 'SCName', type: 'STRING', text: 6},
+		{name: 'X', type: 'F64', walk: [645, 25]},
+		{name: 'Y', type: 'F64', walk: [-782, 25]},
+		{name: 'Z', type: 'F64', walk: [6999, 25]},
+		{name: 'PUBLISH-TIME', type: 'STRING', time: true}
+	], extraFields: 8},
+	{subject: 'GMSEC.SOAK.MANEUVER.ITERATION', burst: {size: 200, everyMs: 5000}, fields: [
+		{name: 'ITERATION', type: 'U32', sequence: [0, 1]},
+		{name: 'DELTA-V', type: 'F64', normal: [1.5, 0.2]}
+	]}
+];
+
+var churnOptions = [
+	{encoding: 'xml'},
+	{encoding: 'json'},
+	{encoding: 'delta', keyframeInterval: 16},
+	{encoding: 'json', compression: 'deflate'}
+];
+
+var received = 0;
+var samples = [];
+var started = Date.now();
+
+function sample(connection){
+	if (global.gc)
+		global.gc();
+
+	var memory = GMSEC.MemoryStats();
+	var resources = connection.ResourceStats();
+	var values = {
+		hours: (Date.now() - started) / 3600000,
+		'rss': process.memoryUsage().rss,
+		'allocator.inUse': memory.allocator ? memory.allocator.inUseBytes : NaN,
+		'allocator.heap': memory.allocator ? memory.allocator.heapBytes : NaN,
+		'v8.heapUsed': memory.v8.heapUsed,
+		'handles': process._getActiveHandles ? process._getActiveHandles().length : NaN,
+		'routes': resources.routes,
+		'consumers': resources.consumers,
+		'retiredConsumers': resources.retiredConsumers,
+		'replayBytes': resources.replayBytes
+	};
+	samples.push(values);
+
+	if (csvPath) {
+		var columns = ['hours'].concat(metrics.map(function(m){ return m.name; }));
+		if (samples.length === 1)
+			fs.writeFileSync(csvPath, columns.join(',') + '\n');
+		fs.appendFileSync(csvPath, columns.map(function(c){ return values[c]; }).join(',') + '\n');
+	}
+
+	console.log(values.hours.toFixed(3) + 'h rss ' + (values.rss / 1048576).toFixed(1) + ' MB, in use ' +
+		(values['allocator.inUse'] / 1048576).toFixed(1) + ' MB of ' + (values['allocator.heap'] / 1048576).toFixed(1) +
+		' MB, v8 ' + (values['v8.heapUsed'] / 1048576).toFixed(1) + ' MB, ' + values.handles + ' handles, ' +
+		received + ' received');
+}
+
+/* Least squares slope of the metric per hour, over samples after the warm-up. */
+function slope(name){
+	var points = samples.filter(function(s){ return s.hours >= warmupHours && !isNaN(s[name]); });
+	if (points.length < 3)
+		return NaN;
+
+	var n = points.length, sx = 0, sy = 0, sxx = 0, sxy = 0;
+	points.forEach(function(p){
+		sx += p.hours; sy += p[name]; sxx += p.hours * p.hours; sxy += p.hours * p[name];
+	});
+	var d = n * sxx - sx * sx;
+	return d === 0 ? NaN : (n * sxy - sx * sy) / d;
+}
+
+function report(){
+	var failed = false;
+	console.log('Growth after ' + warmupHours.toFixed(2) + 'h warm-up:');
+	metrics.forEach(function(m){
+		var perHour = slope(m.name) / m.scale;
+		var verdict = isNaN(perHour) ? 'n/a' : perHour > m.limit ? 'FAIL' : 'ok';
+		if (verdict === 'FAIL')
+			failed = true;
+		console.log('  ' + m.name + ': ' + (isNaN(perHour) ? '-' : perHour.toFixed(2)) + ' ' + m.unit +
+			'/h (limit ' + m.limit + ') ' + verdict);
+	});
+	process.exit(failed ? 1 : 0);
+}
+
+function run(connection){
+	connection.ConfigureReplay({messages: 256, bytes: 1024 * 1024});
+	connection.Subscribe('GMSEC.SOAK.>', function(){ received++; });
+
+	/* A short-lived consumer every second, each with its own callback and
+	 * delivery options, plus a publish from JS that it receives. */
+	var churn = [];
+	var tick = 0;
+	setInterval(function(){
+		var subject = 'GMSEC.SOAK.CHURN.S' + (tick % 50);
+		var cb = function(){ received++; };
+		connection.Subscribe(subject, churnOptions[tick % churnOptions.length], cb);
+		churn.push({subject: subject, cb: cb});
+		if (churn.length > 5) {
+			var old = churn.shift();
+			connection.Unsubscribe(old.subject, old.cb);
+		}
+		connection.Publish('<MESSAGE SUBJECT="' + subject + '" KIND="PUBLISH">' +
+			'<FIELD TYPE="U32" NAME="TICK">' + tick + '</FIELD></MESSAGE>');
+		tick++;
+	}, 1000);
+
+	sample(connection);
+	setInterval(function(){ sample(connection); }, sampleSeconds * 1000);
+
+	connection.Generate(profiles, {durationMs: hours * 3600000, threads: 2}, function(err, stats){
+		if (err)
+			console.log('Generator failed: ' + err);
+		sample(connection);
+		report();
+	});
+
+	process.on('SIGINT', function(){
+		sample(connection);
+		report();
+	});
+}
+
+var connection = new GMSEC.Connection();
+connection.ConnectLocal();
+run(connection);
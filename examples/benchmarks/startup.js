@@ -0,0 +1,105 @@
+/*
+ * Measures what require() of the addon costs a process that never connects:
+ * load time, the RSS it adds, and whether the GMSEC API was mapped. With a
+ * server argument, each run then connects and reports the same figures after
+ * the first Connect, which is where the API and middleware get loaded.
+ *
+ * Every run is a fresh node process, so the figures are cold module loads;
+ * the medians are printed.
+ *
+ * Usage: node startup.js [runs] [server]
+ */
+var child_process = require('child_process');
+var fs = require('fs');
+
+var ADDON = '../../deps/node.js/Release/gmsec';
+
+function elapsedMs(start){
+	var diff = process.hrtime(start);
+	return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+/* Linux only; elsewhere the addon's own answer has to do. */
+function apiMapped(){
+	try {
+		return /GMSECAPI/i.test(fs.readFileSync('/proc/self/maps', 'utf8'));
+	}
+	catch (e) {
+		return null;
+	}
+}
+
+function child(server){
+	var result = {};
+	var rssBefore = process.memoryUsage().rss;
+	var start = process.hrtime();
+	var GMSEC = require(ADDON);
+	result.requireMs = elapsedMs(start);
+	result.requireKB = (process.memoryUsage().rss - rssBefore) / 1024;
+	result.loaded = GMSEC.MiddlewareLoaded();
+	result.mapped = apiMapped();
+
+	if (!server) {
+		console.log(JSON.stringify(result));
+		return;
+	}
+
+	var connection = new GMSEC.Connection();
+	start = process.hrtime();
+	connection.Connect(server, function(){
+		result.connectMs = elapsedMs(start);
+		result.connectKB = (process.memoryUsage().rss - rssBefore) / 1024;
+		result.connectLoaded = GMSEC.MiddlewareLoaded();
+		result.connectMapped = apiMapped();
+		console.log(JSON.stringify(result));
+		process.exit(0);
+	});
+}
+
+function median(runs, name){
+	var values = runs.map(function(run){ return run[name]; }).sort(function(a, b){ return a - b; });
+	return values[Math.floor(values.length / 2)];
+}
+
+function parent(count, server){
+	var runs = [];
+
+	function next(){
+		if (runs.length == count)
+			return report(runs, server);
+
+		var args = [__filename, '--child'];
+		if (server)
+			args.push(server);
+		child_process.execFile(process.execPath, args, {cwd: __dirname}, function(error, stdout, stderr){
+			if (error) {
+				console.error(stderr || error.message);
+				process.exit(1);
+			}
+			runs.push(JSON.parse(stdout));
+			next();
+		});
+	}
+	next();
+}
+
+function report(runs, server){
+	var first = runs[0];
+	console.log('require():  ' + median(runs, 'requireMs').toFixed(2) + ' ms, +' +
+	            median(runs, 'requireKB').toFixed(0) + ' KB RSS, API loaded: ' + first.loaded +
+	            (first.mapped === null ? '' : ', mapped: ' + first.mapped));
+	if (server)
+		console.log('Connect():  ' + median(runs, 'connectMs').toFixed(2) + ' ms, +' +
+		            median(runs, 'connectKB').toFixed(0) + ' KB RSS since require, API loaded: ' +
+		            first.connectLoaded + (first.connectMapped === null ? '' : ', mapped: ' + first.connectMapped));
+	console.log('(median of ' + runs.length + ' runs)');
+
+	/* Non-connecting processes must not pay for the middleware. */
+	if (first.loaded || first.mapped)
+		process.exit(1);
+}
+
+if (process.argv[2] == '--child')
+	child(process.argv[3]);
+else
+	parent(parseInt(process.argv[2] || '10', 10), process.argv[3]);
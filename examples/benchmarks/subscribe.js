@@ -0,0 +1,69 @@
+/*
+ * Measures subscription setup time for many subjects, one Subscribe() call
+ * each versus a single SubscribeMany() call.
+ *
+ * Subscribe() has no completion callback, so the individual case queues an
+ * empty SubscribeMany() behind the subscriptions and waits for it. The thread
+ * pool runs jobs roughly in order, so this slightly under-reports the time.
+ *
+ * Usage: node subscribe.js [server|local] [subjects]
+ */
+var GMSEC = require('../../deps/node.js/Release/gmsec');
+
+var server = process.argv[2] || '127.0.0.1';
+var count = parseInt(process.argv[3] || '10000', 10);
+
+function elapsedMs(start){
+	var diff = process.hrtime(start);
+	return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+function onMessage(){}
+
+function connect(done){
+	var connection = new GMSEC.Connection();
+	if (server === 'local') {
+		connection.ConnectLocal();
+		done(connection);
+	}
+	else {
+		connection.Connect(server, function(){ done(connection); });
+	}
+}
+
+function individually(done){
+	connect(function(connection){
+		var start = process.hrtime();
+		for (var i = 0; i < count; i++)
+			connection.Subscribe('GMSEC.BENCH.INDIVIDUAL.S' + i, onMessage);
+		var queuedMs = elapsedMs(start);
+
+		connection.SubscribeMany([], function(){
+			console.log('Subscribe x ' + count + ': ' + queuedMs.toFixed(1) + ' ms on the event loop, ' +
+				elapsedMs(start).toFixed(1) + ' ms until subscribed');
+			done();
+		});
+	});
+}
+
+function batched(done){
+	connect(function(connection){
+		var list = [];
+		for (var i = 0; i < count; i++)
+			list.push({subject: 'GMSEC.BENCH.BATCHED.S' + i});
+
+		var start = process.hrtime();
+		connection.SubscribeMany(list, onMessage, function(err, results){
+			var failed = results.filter(function(r){ return r.error !== null; }).length;
+			console.log('SubscribeMany(' + count + '): ' + elapsedMs(start).toFixed(1) + ' ms until subscribed, ' +
+				failed + ' failed');
+			done();
+		});
+	});
+}
+
+individually(function(){
+	batched(function(){
+		process.exit(0);
+	});
+});
@@ -0,0 +1,365 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "ArrowWriter.h"
+#include "Bytes.h"
+
+using namespace std;
+
+static const char MAGIC[] = "ARROW1";
+
+/* Arrow schema enumerations (Schema.fbs, Message.fbs). */
+static const unsigned METADATA_V5 = 4;
+static const unsigned HEADER_SCHEMA = 1;
+static const unsigned HEADER_RECORD_BATCH = 3;
+static const unsigned TYPE_INT = 2;
+static const unsigned TYPE_FLOATING_POINT = 3;
+static const unsigned TYPE_UTF8 = 5;
+static const unsigned TYPE_BOOL = 6;
+static const unsigned TYPE_TIMESTAMP = 10;
+static const unsigned PRECISION_DOUBLE = 2;
+static const unsigned UNIT_MILLISECOND = 1;
+
+/*
+ * Minimal flatbuffer builder. Like the reference implementation it builds
+ * back to front, so bytes are kept reversed and positions are distances
+ * from the end of the buffer.
+ */
+class FlatBuilder {
+public:
+	FlatBuilder() : minAlign(1), tableStart(0) {}
+
+	unsigned Size() const { return (unsigned) reversed.size(); }
+
+	unsigned String(const string &value){
+		Prep(4, value.size() + 1);
+		reversed.push_back(0);
+		for (size_t i = value.size(); i-- > 0;)
+			reversed.push_back(value[i]);
+		Push(value.size(), 4);
+		return Size();
+	}
+
+	unsigned OffsetVector(const vector<unsigned> &targets){
+		Prep(4, 4 * targets.size());
+		for (size_t i = targets.size(); i-- > 0;)
+			Offset(targets[i]);
+		Push(targets.size(), 4);
+		return Size();
+	}
+
+	/* data holds count structs already laid out little-endian. */
+	unsigned StructVector(const string &data, size_t count, size_t align){
+		Prep(4, data.size());
+		Prep(align, data.size());
+		for (size_t i = data.size(); i-- > 0;)
+			reversed.push_back(data[i]);
+		Push(count, 4);
+		return Size();
+	}
+
+	void StartTable(){
+		fields.clear();
+		tableStart = Size();
+	}
+
+	void AddScalar(size_t id, unsigned long long value, size_t bytes){
+		Prep(bytes, 0);
+		Push(value, bytes);
+		Mark(id);
+	}
+
+	void AddOffset(size_t id, unsigned target){
+		Offset(target);
+		Mark(id);
+	}
+
+	unsigned EndTable(){
+		Prep(4, 0);
+		Push(0, 4);
+		unsigned object = Size();
+
+		for (size_t i = fields.size(); i-- > 0;)
+			Push(fields[i] != 0 ? object - fields[i] : 0, 2);
+		Push(object - tableStart, 2);
+		Push((fields.size() + 2) * 2, 2);
+
+		/* The table starts with the signed distance back to its vtable. */
+		unsigned soffset = Size() - object;
+		for (size_t k = 0; k < 4; k++)
+			reversed[object - 1 - k] = (unsigned char) (soffset >> (8 * k));
+		return object;
+	}
+
+	void Finish(unsigned root, string &out){
+		Prep(minAlign, 4);
+		Offset(root);
+		out.assign(reversed.rbegin(), reversed.rend());
+	}
+
+private:
+	void Prep(size_t align, size_t additional){
+		if (align > minAlign)
+			minAlign = align;
+		while ((reversed.size() + additional) % align != 0)
+			reversed.push_back(0);
+	}
+
+	/* Little-endian, so the most significant byte goes in first. */
+	void Push(unsigned long long value, size_t bytes){
+		for (size_t i = bytes; i-- > 0;)
+			reversed.push_back((unsigned char) (value >> (8 * i)));
+	}
+
+	void Offset(unsigned target){
+		Prep(4, 0);
+		Push(Size() + 4 - target, 4);
+	}
+
+	void Mark(size_t id){
+		if (fields.size() <= id)
+			fields.resize(id + 1, 0);
+		fields[id] = Size();
+	}
+
+	string reversed;
+	size_t minAlign;
+	unsigned tableStart;
+	vector<unsigned> fields;
+};
+
+static unsigned BuildSchema(FlatBuilder &fb, const vector<ArrowWriter::Column> &columns){
+	vector<unsigned> fields;
+	vector<unsigned> none;
+
+	for (size_t i = 0; i < columns.size(); i++) {
+		const ArrowWriter::Column &column = columns[i];
+		unsigned name = fb.String(column.name);
+		unsigned timezone = column.type == ArrowWriter::TIMESTAMP_MS ? fb.String("UTC") : 0;
+
+		unsigned typeType;
+		fb.StartTable();
+		switch (column.type) {
+		case ArrowWriter::INT64:
+		case ArrowWriter::UINT64:
+			typeType = TYPE_INT;
+			fb.AddScalar(0, 64, 4);
+			fb.AddScalar(1, column.type == ArrowWriter::INT64, 1);
+			break;
+		case ArrowWriter::FLOAT64:
+			typeType = TYPE_FLOATING_POINT;
+			fb.AddScalar(0, PRECISION_DOUBLE, 2);
+			break;
+		case ArrowWriter::BOOL:
+			typeType = TYPE_BOOL;
+			break;
+		case ArrowWriter::TIMESTAMP_MS:
+			typeType = TYPE_TIMESTAMP;
+			fb.AddScalar(0, UNIT_MILLISECOND, 2);
+			fb.AddOffset(1, timezone);
+			break;
+		default:
+			typeType = TYPE_UTF8;
+			break;
+		}
+		unsigned type = fb.EndTable();
+		unsigned children = fb.OffsetVector(none);
+
+		fb.StartTable();
+		fb.AddOffset(0, name);
+		fb.AddScalar(1, 1, 1);
+		fb.AddScalar(2, typeType, 1);
+		fb.AddOffset(3, type);
+		fb.AddOffset(5, children);
+		fields.push_back(fb.EndTable());
+	}
+
+	unsigned fieldVector = fb.OffsetVector(fields);
+
+	fb.StartTable();
+	fb.AddScalar(0, 0, 2);
+	fb.AddOffset(1, fieldVector);
+	return fb.EndTable();
+}
+
+static void BuildMessage(unsigned headerType, unsigned header, size_t bodyLength, FlatBuilder &fb, string &out){
+	fb.StartTable();
+	fb.AddScalar(3, bodyLength, 8);
+	fb.AddOffset(2, header);
+	fb.AddScalar(0, METADATA_V5, 2);
+	fb.AddScalar(1, headerType, 1);
+	fb.Finish(fb.EndTable(), out);
+}
+
+static void PadTo8(string &out){
+	while (out.size() % 8 != 0)
+		out += '\0';
+}
+
+/* Appends one buffer to the body and records where it went. */
+static void AddBuffer(string &body, string &buffers, const string &data){
+	PutU64(buffers, body.size());
+	PutU64(buffers, data.size());
+	body += data;
+	PadTo8(body);
+}
+
+static void PackBits(const vector<unsigned char> &bits, size_t begin, size_t rows, string &out){
+	out.assign((rows + 7) / 8, '\0');
+	for (size_t i = 0; i < rows; i++)
+		if (bits[begin + i])
+			out[i / 8] |= (char) (1 << (i % 8));
+}
+
+static void BuildBatch(const vector<ArrowWriter::Column> &columns, size_t begin, size_t rows,
+                       string &metadata, string &body){
+	string nodes, buffers, data;
+	body.clear();
+
+	for (size_t c = 0; c < columns.size(); c++) {
+		const ArrowWriter::Column &column = columns[c];
+
+		size_t nulls = 0;
+		for (size_t i = 0; i < rows; i++)
+			nulls += column.valid[begin + i] == 0;
+		PutU64(nodes, rows);
+		PutU64(nodes, nulls);
+
+		/* No validity bitmap is needed when every value is present. */
+		if (nulls > 0)
+			PackBits(column.valid, begin, rows, data);
+		else
+			data.clear();
+		AddBuffer(body, buffers, data);
+
+		data.clear();
+		switch (column.type) {
+		case ArrowWriter::FLOAT64:
+			for (size_t i = 0; i < rows; i++)
+				PutF64(data, column.doubles[begin + i]);
+			break;
+		case ArrowWriter::BOOL: {
+			vector<unsigned char> bits(column.ints.begin() + begin, column.ints.begin() + begin + rows);
+			PackBits(bits, 0, rows, data);
+			break;
+		}
+		case ArrowWriter::UTF8: {
+			unsigned base = column.offsets[begin];
+			for (size_t i = 0; i <= rows; i++)
+				PutU32(data, column.offsets[begin + i] - base);
+			AddBuffer(body, buffers, data);
+			data.assign(column.text, base, column.offsets[begin + rows] - base);
+			break;
+		}
+		default:
+			for (size_t i = 0; i < rows; i++)
+				PutU64(data, (unsigned long long) column.ints[begin + i]);
+			break;
+		}
+		AddBuffer(body, buffers, data);
+	}
+
+	FlatBuilder fb;
+	unsigned nodeVector = fb.StructVector(nodes, columns.size(), 8);
+	unsigned bufferVector = fb.StructVector(buffers, buffers.size() / 16, 8);
+	fb.StartTable();
+	fb.AddScalar(0, rows, 8);
+	fb.AddOffset(1, nodeVector);
+	fb.AddOffset(2, bufferVector);
+	unsigned batch = fb.EndTable();
+
+	BuildMessage(HEADER_RECORD_BATCH, batch, body.size(), fb, metadata);
+}
+
+/* Continuation marker, metadata length, metadata padded to 8, body. The
+ * footer locates each message by its file offset, base + out.size(). */
+static void Encapsulate(const string &metadata, const string &body, unsigned long long base,
+                        string &out, string &blocks){
+	unsigned long long offset = base + out.size();
+	size_t padded = (metadata.size() + 7) / 8 * 8;
+
+	PutU32(out, 0xffffffff);
+	PutU32(out, (unsigned) padded);
+	out += metadata;
+	out.append(padded - metadata.size(), '\0');
+	out += body;
+
+	PutU64(blocks, offset);
+	PutU32(blocks, (unsigned) (8 + padded));
+	PutU32(blocks, 0);
+	PutU64(blocks, body.size());
+}
+
+bool ArrowWriter::Write(const string &path, const vector<Column> &columns, size_t rows,
+                        size_t batchRows, string &error){
+	FILE *file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		error = "Unable to open " + path;
+		return false;
+	}
+
+	string out(MAGIC, 6), metadata, body, blocks, unused;
+	out.append(2, '\0');
+	unsigned long long offset = 0;
+
+	FlatBuilder schemaBuilder;
+	BuildMessage(HEADER_SCHEMA, BuildSchema(schemaBuilder, columns), 0, schemaBuilder, metadata);
+	Encapsulate(metadata, string(), offset, out, unused);
+
+	/* Batches go out as they are built so only one is held in memory. */
+	bool written = true;
+	size_t batches = 0;
+	for (size_t begin = 0; written && begin < rows; begin += batchRows) {
+		BuildBatch(columns, begin, rows - begin < batchRows ? rows - begin : batchRows, metadata, body);
+		Encapsulate(metadata, body, offset, out, blocks);
+		batches++;
+
+		written = fwrite(out.data(), 1, out.size(), file) == out.size();
+		offset += out.size();
+		out.clear();
+	}
+
+	/* End of stream marker, then the footer repeating the schema with the
+	 * location of every batch. */
+	PutU32(out, 0xffffffff);
+	PutU32(out, 0);
+
+	FlatBuilder fb;
+	unsigned schema = BuildSchema(fb, columns);
+	unsigned dictionaries = fb.StructVector(string(), 0, 8);
+	unsigned recordBatches = fb.StructVector(blocks, batches, 8);
+	fb.StartTable();
+	fb.AddScalar(0, METADATA_V5, 2);
+	fb.AddOffset(1, schema);
+	fb.AddOffset(2, dictionaries);
+	fb.AddOffset(3, recordBatches);
+	fb.Finish(fb.EndTable(), metadata);
+
+	out += metadata;
+	PutU32(out, (unsigned) metadata.size());
+	out.append(MAGIC, 6);
+
+	written = written && fwrite(out.data(), 1, out.size(), file) == out.size();
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		remove(path.c_str());
+		error = "Unable to write " + path;
+		return false;
+	}
+
+	return true;
+}
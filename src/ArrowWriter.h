@@ -0,0 +1,50 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_ARROWWRITER_H
+#define GMSECJS_ARROWWRITER_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Writes a table as an Apache Arrow IPC file (format version 5), which
+ * pyarrow, DuckDB, Polars and Spark read directly. Only the column types
+ * the exporter needs are supported, all nullable; the flatbuffer metadata
+ * is encoded here so no Arrow library is required.
+ */
+class ArrowWriter {
+public:
+	enum Type { INT64, UINT64, FLOAT64, BOOL, UTF8, TIMESTAMP_MS };
+
+	struct Column {
+		Column() : type(UTF8) {}
+
+		std::string name;
+		Type type;
+		std::vector<unsigned char> valid;   /* one per row */
+
+		std::vector<long long> ints;        /* INT64, UINT64, BOOL, TIMESTAMP_MS */
+		std::vector<double> doubles;        /* FLOAT64 */
+		std::vector<unsigned> offsets;      /* UTF8, rows + 1 entries */
+		std::string text;
+	};
+
+	/* Writes rows in record batches of at most batchRows. */
+	static bool Write(const std::string &path, const std::vector<Column> &columns, size_t rows,
+	                  size_t batchRows, std::string &error);
+};
+
+#endif
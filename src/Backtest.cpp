@@ -0,0 +1,125 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Backtest.h"
+
+using namespace std;
+
+Backtest::Backtest(RecordingMerge *merge, Target *target, const Options &options)
+	: merge(merge),
+	  target(target),
+	  options(options),
+	  condition(mutex),
+	  running(false),
+	  stopping(false),
+	  finished(false){
+}
+
+Backtest::~Backtest(){
+	Stop();
+	delete merge;
+}
+
+bool Backtest::Start(string &error){
+	if (uv_thread_create(&thread, Run, this) != 0) {
+		error = "Unable to create backtest thread";
+		return false;
+	}
+
+	running = true;
+	return true;
+}
+
+void Backtest::Stop(){
+	if (!running)
+		return;
+
+	mutex.Enter();
+	stopping = true;
+	condition.Signal(Condition::USER);
+	mutex.Leave();
+
+	uv_thread_join(&thread);
+	running = false;
+}
+
+void Backtest::Consumed(){
+	AutoMutex lock(mutex);
+	condition.Signal(Condition::USER);
+}
+
+bool Backtest::IsFinished(){
+	AutoMutex lock(mutex);
+	return finished;
+}
+
+bool Backtest::Wait(long ms){
+	AutoMutex lock(mutex);
+	if (!stopping)
+		condition.Wait(ms < 1 ? 1 : ms);
+	return !stopping;
+}
+
+/* The count is checked under the mutex so a Consumed() signal cannot slip
+ * in between the check and the wait. */
+bool Backtest::WaitForConsumers(){
+	AutoMutex lock(mutex);
+	while (!stopping && target->InFlight() >= options.maxInFlight)
+		condition.Wait(100);
+	return !stopping;
+}
+
+void Backtest::Run(void *arg){
+	Backtest *backtest = static_cast<Backtest*>(arg);
+
+	backtest->Replay();
+
+	{
+		AutoMutex lock(backtest->mutex);
+		backtest->finished = true;
+	}
+	backtest->target->Finished();
+}
+
+void Backtest::Replay(){
+	RecordedMessage message;
+	uint64_t started = 0;
+	bool replaying = true;
+
+	while (replaying && merge->Next(message, error)) {
+		double key = merge->LastKey();
+		if (stats.messages == 0) {
+			stats.firstKey = key;
+			started = uv_hrtime();
+		}
+
+		/* Keys are milliseconds; messages recorded out of order go out
+		 * immediately rather than waiting for time to run backwards. */
+		if (options.speed > 0) {
+			uint64_t due = started + (uint64_t) ((key > stats.firstKey ? key - stats.firstKey : 0) / options.speed * 1000000);
+			for (uint64_t now = uv_hrtime(); replaying && now < due; now = uv_hrtime())
+				replaying = Wait((long) ((due - now + 999999) / 1000000));
+		}
+
+		if (!replaying || !WaitForConsumers())
+			break;
+
+		target->Inject(message.subject, message.xml);
+		stats.messages++;
+		stats.lastKey = key;
+	}
+
+	stats.scan = merge->GetStats();
+}
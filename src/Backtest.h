@@ -0,0 +1,105 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_BACKTEST_H
+#define GMSECJS_BACKTEST_H
+
+#include <string>
+
+#include "uv.h"
+#include "Sync.h"
+
+#include "RecordingMerge.h"
+
+/*
+ * Feeds a merged recording into a connection's local dispatch path from a
+ * dedicated native thread, with no middleware involved.
+ *
+ * With speed 0 messages go out as fast as the consumers take them: the
+ * thread waits whenever more than maxInFlight deliveries are still queued
+ * for the node thread. Any other speed replays the recorded spacing scaled
+ * by that factor, so 1 is real time and 10 ten times faster; consumers
+ * that fall behind still hold the replay back rather than letting the
+ * queue grow.
+ */
+class Backtest {
+public:
+	class Target {
+	public:
+		virtual ~Target() {}
+		virtual void Inject(const std::string &subject, const std::string &xml) = 0;
+
+		/* Deliveries handed out but not yet consumed. */
+		virtual unsigned long long InFlight() = 0;
+
+		/* Called on the replay thread once it has stopped. */
+		virtual void Finished() = 0;
+	};
+
+	struct Options {
+		Options() : speed(0), maxInFlight(1024) {}
+		double speed;
+		unsigned long long maxInFlight;
+	};
+
+	struct Stats {
+		Stats() : messages(0), firstKey(0), lastKey(0) {}
+		unsigned long long messages;
+		double firstKey;
+		double lastKey;
+		RecordingQuery::Stats scan;
+	};
+
+	/* Takes ownership of the merge. */
+	Backtest(RecordingMerge *merge, Target *target, const Options &options);
+	~Backtest();
+
+	bool Start(std::string &error);
+
+	/* Stops early. Safe to call more than once. */
+	void Stop();
+
+	/* Wakes a replay waiting for consumers to catch up. */
+	void Consumed();
+
+	bool IsFinished();
+
+	/* Only meaningful once finished. */
+	const Stats &GetStats() const { return stats; }
+	const std::string &Error() const { return error; }
+
+private:
+	static void Run(void *arg);
+	void Replay();
+
+	/* Waits up to ms, returning false once stopping. */
+	bool Wait(long ms);
+	bool WaitForConsumers();
+
+	RecordingMerge *merge;
+	Target *target;
+	Options options;
+	Stats stats;
+	std::string error;
+
+	Mutex mutex;
+	Condition condition;
+	uv_thread_t thread;
+	bool running;
+	bool stopping;
+	bool finished;
+};
+
+#endif
@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_BYTES_H
+#define GMSECJS_BYTES_H
+
+#include <string.h>
+#include <string>
+
+/*
+ * Little-endian encoding for the on-disk formats. Getters advance pos and
+ * return false instead of reading past the end of the input.
+ */
+inline void PutU16(std::string &out, unsigned value){
+	out += (char) (value & 0xff);
+	out += (char) ((value >> 8) & 0xff);
+}
+
+inline void PutU32(std::string &out, unsigned value){
+	PutU16(out, value & 0xffff);
+	PutU16(out, (value >> 16) & 0xffff);
+}
+
+inline void PutU64(std::string &out, unsigned long long value){
+	PutU32(out, (unsigned) (value & 0xffffffffULL));
+	PutU32(out, (unsigned) (value >> 32));
+}
+
+inline void PutF64(std::string &out, double value){
+	unsigned long long bits;
+	memcpy(&bits, &value, sizeof(bits));
+	PutU64(out, bits);
+}
+
+inline bool GetU16(const std::string &in, size_t &pos, unsigned &value){
+	if (pos + 2 > in.size())
+		return false;
+	value = (unsigned char) in[pos] | ((unsigned char) in[pos + 1] << 8);
+	pos += 2;
+	return true;
+}
+
+inline bool GetU32(const std::string &in, size_t &pos, unsigned &value){
+	unsigned low, high;
+	if (!GetU16(in, pos, low) || !GetU16(in, pos, high))
+		return false;
+	value = low | (high << 16);
+	return true;
+}
+
+inline bool GetU64(const std::string &in, size_t &pos, unsigned long long &value){
+	unsigned low, high;
+	if (!GetU32(in, pos, low) || !GetU32(in, pos, high))
+		return false;
+	value = (unsigned long long) low | ((unsigned long long) high << 32);
+	return true;
+}
+
+inline bool GetF64(const std::string &in, size_t &pos, double &value){
+	unsigned long long bits;
+	if (!GetU64(in, pos, bits))
+		return false;
+	memcpy(&value, &bits, sizeof(value));
+	return true;
+}
+
+#endif
@@ -0,0 +1,277 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ColumnarExport.h"
+
+using namespace std;
+
+void ColumnarExport::Stats::Add(const Stats &other){
+	blocksRead += other.blocksRead;
+	blocksSkipped += other.blocksSkipped;
+	rows += other.rows;
+	files += other.files;
+}
+
+ArrowWriter::Type ColumnarExport::ColumnType(GMSEC_TYPE type){
+	switch (type) {
+	case GMSEC_TYPE_I8:
+	case GMSEC_TYPE_I16:
+	case GMSEC_TYPE_I32:
+	case GMSEC_TYPE_I64:
+	case GMSEC_TYPE_U8:
+	case GMSEC_TYPE_U16:
+	case GMSEC_TYPE_U32:
+		return ArrowWriter::INT64;
+	case GMSEC_TYPE_U64:
+		return ArrowWriter::UINT64;
+	case GMSEC_TYPE_F32:
+	case GMSEC_TYPE_F64:
+		return ArrowWriter::FLOAT64;
+	case GMSEC_TYPE_BOOL:
+		return ArrowWriter::BOOL;
+	default:
+		return ArrowWriter::UTF8;
+	}
+}
+
+/* Integers of either sign meet in double; anything else meets in text. */
+static ArrowWriter::Type Unify(ArrowWriter::Type a, ArrowWriter::Type b){
+	if (a == b)
+		return a;
+	bool aNumber = a == ArrowWriter::INT64 || a == ArrowWriter::UINT64 || a == ArrowWriter::FLOAT64;
+	bool bNumber = b == ArrowWriter::INT64 || b == ArrowWriter::UINT64 || b == ArrowWriter::FLOAT64;
+	return aNumber && bNumber ? ArrowWriter::FLOAT64 : ArrowWriter::UTF8;
+}
+
+/* Rewrites the rows already in the column as the wider type. */
+void ColumnarExport::Promote(ArrowWriter::Column &column, ArrowWriter::Type type){
+	size_t rows = column.valid.size();
+
+	if (type == ArrowWriter::FLOAT64) {
+		column.doubles.resize(rows);
+		for (size_t i = 0; i < rows; i++)
+			column.doubles[i] = column.type == ArrowWriter::UINT64 ? (double) (unsigned long long) column.ints[i]
+			                                                       : (double) column.ints[i];
+	}
+	else {
+		column.offsets.assign(1, 0);
+		column.text.clear();
+		for (size_t i = 0; i < rows; i++) {
+			if (column.valid[i]) {
+				char buffer[32];
+				switch (column.type) {
+				case ArrowWriter::FLOAT64: sprintf(buffer, "%.15g", column.doubles[i]); break;
+				case ArrowWriter::UINT64:  sprintf(buffer, "%llu", (unsigned long long) column.ints[i]); break;
+				case ArrowWriter::BOOL:    sprintf(buffer, "%s", column.ints[i] ? "TRUE" : "FALSE"); break;
+				default:                   sprintf(buffer, "%lld", column.ints[i]); break;
+				}
+				column.text += buffer;
+			}
+			column.offsets.push_back((unsigned) column.text.size());
+		}
+	}
+
+	column.ints.clear();
+	if (type != ArrowWriter::FLOAT64)
+		column.doubles.clear();
+	column.type = type;
+}
+
+/*
+ * Converts one column of a block's rows at a time; cells are the rows
+ * that have the field, in row order.
+ */
+void ColumnarExport::AppendColumn(ArrowWriter::Column &column, size_t rows, const Cells &cells){
+	ArrowWriter::Type type = column.type;
+	for (size_t c = 0; c < cells.size(); c++)
+		type = Unify(type, ColumnType(cells[c].second->type));
+	if (type != column.type)
+		Promote(column, type);
+
+	size_t base = column.valid.size();
+	column.valid.resize(base + rows, 0);
+
+	if (type == ArrowWriter::UTF8) {
+		size_t c = 0;
+		for (size_t k = 0; k < rows; k++) {
+			for (; c < cells.size() && cells[c].first == k; c++) {
+				if (column.valid[base + k])
+					continue;
+				column.valid[base + k] = 1;
+				column.text += cells[c].second->value;
+			}
+			column.offsets.push_back((unsigned) column.text.size());
+		}
+		return;
+	}
+
+	char *end;
+	if (type == ArrowWriter::FLOAT64) {
+		column.doubles.resize(base + rows, 0);
+		for (size_t c = 0; c < cells.size(); c++) {
+			const char *text = cells[c].second->value.c_str();
+			double value = strtod(text, &end);
+			if (end != text) {
+				column.doubles[base + cells[c].first] = value;
+				column.valid[base + cells[c].first] = 1;
+			}
+		}
+		return;
+	}
+
+	column.ints.resize(base + rows, 0);
+	for (size_t c = 0; c < cells.size(); c++) {
+		const string &text = cells[c].second->value;
+		long long value;
+		if (type == ArrowWriter::BOOL) {
+			if (text == "TRUE" || text == "true" || text == "1")
+				value = 1;
+			else if (text == "FALSE" || text == "false" || text == "0")
+				value = 0;
+			else
+				continue;
+		}
+		else {
+			value = type == ArrowWriter::UINT64 ? (long long) strtoull(text.c_str(), &end, 10)
+			                                    : strtoll(text.c_str(), &end, 10);
+			if (end == text.c_str())
+				continue;
+		}
+		column.ints[base + cells[c].first] = value;
+		column.valid[base + cells[c].first] = 1;
+	}
+}
+
+void ColumnarExport::AppendRows(Table &table, const vector<RecordedMessage> &messages,
+                                const vector<MessageRecord> &records, const vector<size_t> &rows){
+	if (table.columns.empty()) {
+		table.columns.push_back(ArrowWriter::Column());
+		table.columns[0].name = "time";
+		table.columns[0].type = ArrowWriter::TIMESTAMP_MS;
+	}
+
+	ArrowWriter::Column &time = table.columns[0];
+	for (size_t k = 0; k < rows.size(); k++) {
+		time.valid.push_back(1);
+		time.ints.push_back((long long) (messages[rows[k]].time + 0.5));
+	}
+
+	/* Gather each field's cells first so conversion runs column by column. */
+	vector<Cells> cells(table.columns.size());
+	for (size_t k = 0; k < rows.size(); k++) {
+		const vector<MessageRecord::Field> &fields = records[rows[k]].fields;
+		for (size_t f = 0; f < fields.size(); f++) {
+			map<string, size_t>::iterator it = table.index.find(fields[f].name);
+			if (it == table.index.end()) {
+				ArrowWriter::Column column;
+				column.name = fields[f].name;
+				column.type = ColumnType(fields[f].type);
+				if (column.type == ArrowWriter::UTF8)
+					column.offsets.assign(table.rows + 1, 0);
+				else if (column.type == ArrowWriter::FLOAT64)
+					column.doubles.assign(table.rows, 0);
+				else
+					column.ints.assign(table.rows, 0);
+				column.valid.assign(table.rows, 0);
+
+				it = table.index.insert(make_pair(fields[f].name, table.columns.size())).first;
+				table.columns.push_back(column);
+				cells.push_back(Cells());
+			}
+			cells[it->second].push_back(make_pair(k, &fields[f]));
+		}
+	}
+
+	for (size_t c = 1; c < table.columns.size(); c++)
+		AppendColumn(table.columns[c], rows.size(), cells[c]);
+
+	table.rows += rows.size();
+}
+
+bool ColumnarExport::ExportSegment(const SegmentReader &reader, Stats &stats, string &error) const{
+	const vector<Segment::Block> &blocks = reader.Blocks();
+
+	map<string, Table> tables;
+	FILE *file = NULL;
+	string raw;
+	vector<RecordedMessage> messages;
+	vector<MessageRecord> records;
+	bool ok = true;
+
+	for (size_t b = 0; b < blocks.size() && ok; b++) {
+		if (!filter.BlockMayMatch(blocks[b])) {
+			stats.blocksSkipped++;
+			continue;
+		}
+
+		if (file == NULL && (file = reader.OpenFile(error)) == NULL)
+			return false;
+
+		messages.clear();
+		ok = reader.ReadBlock(file, b, raw, error) && Segment::ParseRecords(raw, messages);
+		if (!ok) {
+			if (error.empty())
+				error = reader.Path() + " has a malformed block";
+			break;
+		}
+		stats.blocksRead++;
+
+		if (records.size() < messages.size())
+			records.resize(messages.size());
+
+		map< string, vector<size_t> > bySubject;
+		for (size_t i = 0; i < messages.size(); i++) {
+			if (filter.MatchesEnvelope(messages[i]) && records[i].FromXML(messages[i].xml) &&
+			    filter.MatchesFields(records[i]))
+				bySubject[messages[i].subject].push_back(i);
+		}
+
+		for (map< string, vector<size_t> >::iterator it = bySubject.begin(); it != bySubject.end(); ++it)
+			AppendRows(tables[it->first], messages, records, it->second);
+	}
+
+	if (file != NULL)
+		fclose(file);
+	if (!ok)
+		return false;
+
+	/* Files are named after the segment so every segment's output is
+	 * distinct and a rerun replaces it. */
+	string name = reader.Path();
+	size_t slash = name.find_last_of("/\\");
+	if (slash != string::npos)
+		name.erase(0, slash + 1);
+	if (name.size() > strlen(Segment::EXTENSION))
+		name.erase(name.size() - strlen(Segment::EXTENSION));
+
+	if (!tables.empty() && !Segment::MakeDirectory(directory, error))
+		return false;
+
+	for (map<string, Table>::iterator it = tables.begin(); it != tables.end(); ++it) {
+		string subjectDirectory = directory + "/" + it->first;
+		if (!Segment::MakeDirectory(subjectDirectory, error) ||
+		    !ArrowWriter::Write(subjectDirectory + "/" + name + ".arrow", it->second.columns,
+		                        it->second.rows, batchRows, error))
+			return false;
+		stats.files++;
+		stats.rows += it->second.rows;
+	}
+
+	return true;
+}
@@ -0,0 +1,80 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_COLUMNAREXPORT_H
+#define GMSECJS_COLUMNAREXPORT_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Segment.h"
+#include "RecordingQuery.h"
+#include "ArrowWriter.h"
+
+/*
+ * Converts recorded messages into one Arrow file per subject and segment,
+ *
+ *     directory/<subject>/<segment name>.arrow
+ *
+ * with a UTC millisecond "time" column followed by one column per field.
+ * Integer fields become int64 (uint64 for U64), floats double, BOOL bool
+ * and everything else string; a field seen with incompatible types in one
+ * segment falls back to double or string. A message without a field has a
+ * null there.
+ *
+ * Segments are independent, so any number can be exported at once. Each
+ * holds its converted columns in memory until its files are written.
+ */
+class ColumnarExport {
+public:
+	struct Stats {
+		Stats() : blocksRead(0), blocksSkipped(0), rows(0), files(0) {}
+		void Add(const Stats &other);
+
+		size_t blocksRead;
+		size_t blocksSkipped;
+		size_t rows;
+		size_t files;
+	};
+
+	ColumnarExport(const RecordingQuery &filter, const std::string &directory, size_t batchRows)
+		: filter(filter), directory(directory), batchRows(batchRows) {}
+
+	bool ExportSegment(const SegmentReader &reader, Stats &stats, std::string &error) const;
+
+private:
+	struct Table {
+		Table() : rows(0) {}
+
+		size_t rows;
+		std::vector<ArrowWriter::Column> columns;   /* time first */
+		std::map<std::string, size_t> index;
+	};
+
+	typedef std::vector< std::pair<size_t, const MessageRecord::Field*> > Cells;
+
+	static void AppendRows(Table &table, const std::vector<RecordedMessage> &messages,
+	                       const std::vector<MessageRecord> &records, const std::vector<size_t> &rows);
+	static void AppendColumn(ArrowWriter::Column &column, size_t rows, const Cells &cells);
+	static void Promote(ArrowWriter::Column &column, ArrowWriter::Type type);
+	static ArrowWriter::Type ColumnType(GMSEC_TYPE type);
+
+	RecordingQuery filter;
+	std::string directory;
+	size_t batchRows;
+};
+
+#endif
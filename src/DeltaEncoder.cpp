@@ -0,0 +1,94 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "DeltaEncoder.h"
+
+using namespace std;
+
+void DeltaEncoder::Encode(const MessageRecord &record, double seq, string &out){
+	SubjectState &state = subjects[record.subject];
+
+	bool keyframe = state.fields.empty() || state.sinceKeyframe >= keyframeInterval;
+	state.sinceKeyframe = keyframe ? 1 : state.sinceKeyframe + 1;
+
+	/* The generation marks which fields were present in this message so the
+	 * ones that disappeared can be reported without a second lookup pass. */
+	unsigned generation = ++state.generation;
+
+	char seqBuffer[32];
+	sprintf(seqBuffer, "%.0f", seq);
+
+	out.clear();
+	out += "{\"Subject\":";
+	AppendJSONString(out, record.subject);
+	out += ",\"Kind\":\"";
+	out += MessageRecord::KindName(record.kind);
+	out += "\",\"Seq\":";
+	out += seqBuffer;
+	out += keyframe ? ",\"Keyframe\":true" : ",\"Keyframe\":false";
+	out += ",\"Fields\":{";
+
+	bool first = true;
+	for (size_t i = 0; i < record.fields.size(); i++) {
+		const MessageRecord::Field &field = record.fields[i];
+
+		map<string, FieldState>::iterator it = state.fields.find(field.name);
+		bool changed = it == state.fields.end() ||
+		               it->second.type != field.type ||
+		               it->second.value != field.value;
+
+		if (it == state.fields.end())
+			it = state.fields.insert(make_pair(field.name, FieldState())).first;
+
+		it->second.generation = generation;
+
+		if (!changed && !keyframe)
+			continue;
+
+		it->second.type = field.type;
+		it->second.value = field.value;
+
+		if (!first)
+			out += ',';
+		first = false;
+		AppendJSONField(out, field);
+	}
+
+	out += '}';
+
+	/* Fields missing from this message are dropped from the state and, on
+	 * deltas, listed so the consumer can remove them too. */
+	bool firstRemoved = true;
+	for (map<string, FieldState>::iterator it = state.fields.begin(); it != state.fields.end(); ) {
+		if (it->second.generation == generation) {
+			++it;
+			continue;
+		}
+
+		if (!keyframe) {
+			out += firstRemoved ? ",\"Removed\":[" : ",";
+			firstRemoved = false;
+			AppendJSONString(out, it->first);
+		}
+
+		state.fields.erase(it++);
+	}
+	if (!firstRemoved)
+		out += ']';
+
+	out += '}';
+}
@@ -0,0 +1,61 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_DELTAENCODER_H
+#define GMSECJS_DELTAENCODER_H
+
+#include <map>
+#include <string>
+
+#include "MessageRecord.h"
+
+/*
+ * Encodes consecutive messages on a subject as JSON containing only the
+ * fields whose type or value changed since the previous message delivered
+ * to the same consumer. Every keyframeInterval messages, and for the first
+ * message on a subject, the full message is sent with "Keyframe":true.
+ *
+ * State is kept per subject so a wildcard subscription tracks each matching
+ * subject separately. Not thread safe; each consumer owns one encoder and
+ * only the dispatch thread touches it.
+ */
+class DeltaEncoder {
+public:
+	DeltaEncoder(unsigned keyframeInterval) : keyframeInterval(keyframeInterval) {}
+
+	void Encode(const MessageRecord &record, double seq, std::string &out);
+
+	/* Forces the next message on every subject to be a keyframe. */
+	void Reset() { subjects.clear(); }
+
+private:
+	struct FieldState {
+		GMSEC_TYPE type;
+		std::string value;
+		unsigned generation;
+	};
+
+	struct SubjectState {
+		SubjectState() : sinceKeyframe(0), generation(0) {}
+		unsigned sinceKeyframe;
+		unsigned generation;
+		std::map<std::string, FieldState> fields;
+	};
+
+	unsigned keyframeInterval;
+	std::map<std::string, SubjectState> subjects;
+};
+
+#endif
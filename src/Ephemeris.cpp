@@ -0,0 +1,178 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "Ephemeris.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+Persistent<FunctionTemplate> Ephemeris::s_ct;
+
+void Ephemeris::RecordTarget::Deliver(Router::Delivery &delivery){
+	store->Record(delivery);
+}
+
+void Ephemeris::Init(Handle<Object> target){
+	HandleScope scope;
+
+	Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+	s_ct = Persistent<FunctionTemplate>::New(t);
+	s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+	s_ct->SetClassName(String::NewSymbol("Ephemeris"));
+
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "PositionAt", PositionAt);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Coverage", Coverage);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Keys", Keys);
+
+	target->Set(String::NewSymbol("Ephemeris"), s_ct->GetFunction());
+}
+
+Local<Object> Ephemeris::NewInstance(EphemerisStore *store, Local<Object> owner){
+	HandleScope scope;
+
+	Local<Value> argv[1] = { External::New(store) };
+	Local<Object> handle = s_ct->GetFunction()->NewInstance(1, argv);
+	ObjectWrap::Unwrap<Ephemeris>(handle)->owner = Persistent<Object>::New(owner);
+	return scope.Close(handle);
+}
+
+Handle<Value> Ephemeris::New(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsExternal())
+		return ThrowException(Exception::TypeError(
+					  String::New("Use Connection.CreateEphemeris() to create an ephemeris")));
+
+	Ephemeris *ephemeris = new Ephemeris(static_cast<EphemerisStore*>(External::Unwrap(args[0])));
+	ephemeris->Wrap(args.This());
+	return args.This();
+}
+
+Ephemeris::~Ephemeris(){
+	owner.Dispose();
+}
+
+/*
+ * PositionAt(sc, epochs, [{method, order}]) interpolates every epoch (ms
+ * since 1970, an Array or Float64Array) in one call and returns
+ * {x, y, z, vx, vy, vz} as Float64Arrays, or null for an unknown spacecraft.
+ */
+Handle<Value> Ephemeris::PositionAt(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, keyV8Str);
+
+	if (args.Length() < 2 || !args[1]->IsObject())
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 1 must be an array of epochs")));
+
+	OPT_OBJ_ARG(2, options);
+
+	Ephemeris *ephemeris = ObjectWrap::Unwrap<Ephemeris>(args.This());
+
+	EphemerisStore::Method method;
+	string methodName = GetStringOption(options, "method", ephemeris->store->HasVelocity() ? "hermite" : "lagrange");
+	if (methodName == "hermite")
+		method = EphemerisStore::HERMITE;
+	else if (methodName == "lagrange")
+		method = EphemerisStore::LAGRANGE;
+	else
+		return ThrowException(Exception::TypeError(
+					  String::New("Option 'method' must be 'hermite' or 'lagrange'")));
+
+	if (method == EphemerisStore::HERMITE && !ephemeris->store->HasVelocity())
+		return ThrowException(Exception::Error(
+					  String::New("Hermite interpolation needs velocity fields")));
+
+	double order = GetNumberOption(options, "order", 8);
+	if (order < 2 || order > 32)
+		return ThrowException(Exception::RangeError(
+					  String::New("Option 'order' must be between 2 and 32")));
+
+	/* Float64Arrays are read in place; anything else is copied out once. */
+	Local<Object> epochsObj = args[1]->ToObject();
+	const double *epochs;
+	size_t count;
+	vector<double> copy;
+	if (epochsObj->HasIndexedPropertiesInExternalArrayData() &&
+	    epochsObj->GetIndexedPropertiesExternalArrayDataType() == kExternalDoubleArray) {
+		epochs = static_cast<const double*>(epochsObj->GetIndexedPropertiesExternalArrayData());
+		count = epochsObj->GetIndexedPropertiesExternalArrayDataLength();
+	}
+	else if (args[1]->IsArray()) {
+		Local<Array> array = Local<Array>::Cast(args[1]);
+		copy.resize(array->Length());
+		for (uint32_t i = 0; i < array->Length(); i++)
+			copy[i] = array->Get(i)->NumberValue();
+		epochs = copy.empty() ? NULL : &copy[0];
+		count = copy.size();
+	}
+	else {
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 1 must be an array of epochs")));
+	}
+
+	EphemerisStore::Result result;
+	if (!ephemeris->store->PositionAt(*String::Utf8Value(keyV8Str), epochs, count, method, (size_t) order, result))
+		return scope.Close(Null());
+
+	static const char *POSITION[] = { "x", "y", "z" };
+	static const char *VELOCITY[] = { "vx", "vy", "vz" };
+
+	Local<Object> obj = Object::New();
+	for (size_t k = 0; k < 3; k++) {
+		obj->Set(String::NewSymbol(POSITION[k]), NewFloat64Array(count ? &result.position[k][0] : NULL, count));
+		obj->Set(String::NewSymbol(VELOCITY[k]), NewFloat64Array(count ? &result.velocity[k][0] : NULL, count));
+	}
+
+	return scope.Close(obj);
+}
+
+Handle<Value> Ephemeris::Coverage(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, keyV8Str);
+
+	Ephemeris *ephemeris = ObjectWrap::Unwrap<Ephemeris>(args.This());
+
+	EphemerisStore::Coverage coverage;
+	if (!ephemeris->store->GetCoverage(*String::Utf8Value(keyV8Str), coverage))
+		return scope.Close(Null());
+
+	Local<Object> obj = Object::New();
+	obj->Set(String::NewSymbol("start"), Number::New(coverage.start));
+	obj->Set(String::NewSymbol("end"), Number::New(coverage.end));
+	obj->Set(String::NewSymbol("count"), Number::New((double) coverage.count));
+
+	return scope.Close(obj);
+}
+
+Handle<Value> Ephemeris::Keys(const Arguments& args){
+	HandleScope scope;
+
+	Ephemeris *ephemeris = ObjectWrap::Unwrap<Ephemeris>(args.This());
+
+	vector<string> keys = ephemeris->store->Keys();
+	Local<Array> array = Array::New(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		array->Set(i, String::New(keys[i].c_str()));
+
+	return scope.Close(array);
+}
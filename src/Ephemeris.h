@@ -0,0 +1,59 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_EPHEMERIS_H
+#define GMSECJS_EPHEMERIS_H
+
+#include "v8.h"
+#include "node.h"
+
+#include "Router.h"
+#include "EphemerisStore.h"
+
+/*
+ * JS handle onto an EphemerisStore. Instances are created by
+ * Connection.CreateEphemeris(); like histories, the store is owned by the
+ * connection since its router keeps feeding it, and the handle keeps the
+ * connection alive.
+ */
+class Ephemeris : public node::ObjectWrap {
+public:
+	class RecordTarget : public Router::Target {
+	public:
+		RecordTarget(EphemerisStore *store) : store(store) {}
+		void Deliver(Router::Delivery &delivery);
+	private:
+		EphemerisStore *store;
+	};
+
+	static v8::Persistent<v8::FunctionTemplate> s_ct;
+
+	static void Init(v8::Handle<v8::Object> target);
+	static v8::Local<v8::Object> NewInstance(EphemerisStore *store, v8::Local<v8::Object> owner);
+
+private:
+	Ephemeris(EphemerisStore *store) : store(store) {}
+	~Ephemeris();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> PositionAt(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Coverage(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Keys(const v8::Arguments& args);
+
+	EphemerisStore *store;
+	v8::Persistent<v8::Object> owner;
+};
+
+#endif
@@ -0,0 +1,294 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "EphemerisStore.h"
+#include "FieldUtil.h"
+
+using namespace std;
+
+static const size_t NO_BRACKET = (size_t) -1;
+
+EphemerisStore::EphemerisStore(const string &keyField, const string &epochField,
+                               const vector<string> &positionFields,
+                               const vector<string> &velocityFields,
+                               size_t capacity, size_t maxKeys)
+	: keyField(keyField),
+	  epochField(epochField),
+	  positionFields(positionFields),
+	  velocityFields(velocityFields),
+	  capacity(capacity),
+	  maxKeys(maxKeys),
+	  droppedKeys(0){
+}
+
+EphemerisStore::~EphemerisStore(){
+}
+
+/* Days from 1970-01-01 to the given proleptic Gregorian date. */
+static long DaysFromCivil(long y, unsigned m, unsigned d){
+	y -= m <= 2;
+	long era = (y >= 0 ? y : y - 399) / 400;
+	unsigned yoe = (unsigned) (y - era * 400);
+	unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+	unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + (long) doe - 719468;
+}
+
+bool EphemerisStore::ParseEpoch(const string &text, double &epochMs){
+	static const char *MONTHS[] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun",
+	                                "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+	char month[4];
+	int day, year, hour, minute, doy, used;
+	double second;
+
+	/* Both forms must take the whole text; an unknown month name falls
+	 * through to the day of year form rather than failing. */
+	used = -1;
+	if (sscanf(text.c_str(), "%3[A-Za-z] %d %d %d:%d:%lf%n", month, &day, &year, &hour, &minute, &second, &used) == 6 &&
+	    used == (int) text.size()) {
+		for (unsigned m = 0; m < 12; m++) {
+			if (strcmp(month, MONTHS[m]) == 0) {
+				double days = (double) DaysFromCivil(year, m + 1, day);
+				epochMs = ((days * 24 + hour) * 60 + minute) * 60000.0 + second * 1000.0;
+				return true;
+			}
+		}
+	}
+
+	used = -1;
+	if (sscanf(text.c_str(), "%d-%d-%d:%d:%lf%n", &year, &doy, &hour, &minute, &second, &used) == 5 &&
+	    used == (int) text.size() && doy >= 1 && doy <= 366) {
+		double days = (double) DaysFromCivil(year, 1, 1) + doy - 1;
+		epochMs = ((days * 24 + hour) * 60 + minute) * 60000.0 + second * 1000.0;
+		return true;
+	}
+
+	return false;
+}
+
+void EphemerisStore::Record(Router::Delivery &delivery){
+	string key, epochText;
+	if (!GetFieldAsString(delivery, keyField.c_str(), key) ||
+	    !GetFieldAsString(delivery, epochField.c_str(), epochText))
+		return;
+
+	State state;
+	if (!ParseEpoch(epochText, state.epoch)) {
+		/* Numeric epoch fields are taken as milliseconds already. */
+		char *end;
+		state.epoch = strtod(epochText.c_str(), &end);
+		if (end == epochText.c_str() || *end != '\0')
+			return;
+	}
+
+	for (size_t i = 0; i < 3; i++) {
+		state.velocity[i] = numeric_limits<double>::quiet_NaN();
+		if (!GetFieldAsDouble(delivery, positionFields[i].c_str(), state.position[i]))
+			return;
+		if (HasVelocity())
+			GetFieldAsDouble(delivery, velocityFields[i].c_str(), state.velocity[i]);
+	}
+
+	AutoMutex lock(mutex);
+
+	map<string, States>::iterator it = states.find(key);
+	if (it == states.end()) {
+		if (states.size() >= maxKeys) {
+			droppedKeys++;
+			return;
+		}
+		it = states.insert(make_pair(key, States())).first;
+	}
+
+	/* Updates nearly always arrive in epoch order and append; late ones are
+	 * inserted in place and a repeated epoch replaces the earlier state. */
+	States &list = it->second;
+	States::iterator pos = list.end();
+	while (pos != list.begin() && (pos - 1)->epoch > state.epoch)
+		--pos;
+
+	if (pos != list.begin() && (pos - 1)->epoch == state.epoch)
+		*(pos - 1) = state;
+	else
+		list.insert(pos, state);
+
+	while (list.size() > capacity)
+		list.pop_front();
+}
+
+/*
+ * Index i with states[i].epoch <= epoch <= states[i + 1].epoch. Batch
+ * queries are usually ascending, so the previous answer is tried first.
+ */
+size_t EphemerisStore::Bracket(const States &list, double epoch, size_t hint) const{
+	if (list.size() < 2 || epoch < list.front().epoch || epoch > list.back().epoch)
+		return NO_BRACKET;
+
+	if (hint != NO_BRACKET && hint + 1 < list.size() &&
+	    list[hint].epoch <= epoch && epoch <= list[hint + 1].epoch)
+		return hint;
+
+	size_t lo = 0, hi = list.size() - 1;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (list[mid].epoch <= epoch)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+void EphemerisStore::Missing(Result &result) const{
+	double nan = numeric_limits<double>::quiet_NaN();
+	for (size_t k = 0; k < 3; k++) {
+		result.position[k].push_back(nan);
+		result.velocity[k].push_back(nan);
+	}
+}
+
+void EphemerisStore::Hermite(const States &list, size_t i, double epoch, Result &result) const{
+	const State &a = list[i];
+	const State &b = list[i + 1];
+
+	double h = (b.epoch - a.epoch) / 1000.0;
+	double s = (epoch - a.epoch) / (b.epoch - a.epoch);
+	double s2 = s * s, s3 = s2 * s;
+
+	double h00 = 2 * s3 - 3 * s2 + 1, h10 = s3 - 2 * s2 + s;
+	double h01 = -2 * s3 + 3 * s2, h11 = s3 - s2;
+	double d00 = 6 * s2 - 6 * s, d10 = 3 * s2 - 4 * s + 1;
+	double d01 = -6 * s2 + 6 * s, d11 = 3 * s2 - 2 * s;
+
+	for (size_t k = 0; k < 3; k++) {
+		result.position[k].push_back(h00 * a.position[k] + h10 * h * a.velocity[k] +
+		                             h01 * b.position[k] + h11 * h * b.velocity[k]);
+		result.velocity[k].push_back((d00 * a.position[k] + d10 * h * a.velocity[k] +
+		                              d01 * b.position[k] + d11 * h * b.velocity[k]) / h);
+	}
+}
+
+/*
+ * Evaluates the interpolating polynomial through up to order states around
+ * the bracket, and its derivative for the velocity. Times are in seconds
+ * relative to the query epoch to keep the products well conditioned.
+ */
+void EphemerisStore::Lagrange(const States &list, size_t i, double epoch, size_t order, Result &result) const{
+	size_t n = order < list.size() ? order : list.size();
+	size_t start = i + 1 >= n / 2 ? i + 1 - n / 2 : 0;
+	if (start + n > list.size())
+		start = list.size() - n;
+
+	double t[32];
+	for (size_t j = 0; j < n; j++)
+		t[j] = (list[start + j].epoch - epoch) / 1000.0;
+
+	double position[3] = { 0, 0, 0 };
+	double velocity[3] = { 0, 0, 0 };
+
+	for (size_t j = 0; j < n; j++) {
+		double basis = 1;
+		for (size_t m = 0; m < n; m++)
+			if (m != j)
+				basis *= (0 - t[m]) / (t[j] - t[m]);
+
+		double slope = 0;
+		for (size_t r = 0; r < n; r++) {
+			if (r == j)
+				continue;
+			double term = 1 / (t[j] - t[r]);
+			for (size_t m = 0; m < n; m++)
+				if (m != j && m != r)
+					term *= (0 - t[m]) / (t[j] - t[m]);
+			slope += term;
+		}
+
+		const State &state = list[start + j];
+		for (size_t k = 0; k < 3; k++) {
+			position[k] += basis * state.position[k];
+			velocity[k] += slope * state.position[k];
+		}
+	}
+
+	for (size_t k = 0; k < 3; k++) {
+		result.position[k].push_back(position[k]);
+		result.velocity[k].push_back(velocity[k]);
+	}
+}
+
+bool EphemerisStore::PositionAt(const string &key, const double *epochs, size_t count,
+                                Method method, size_t order, Result &result){
+	if (order < 2)
+		order = 2;
+	if (order > 32)
+		order = 32;
+
+	for (size_t k = 0; k < 3; k++) {
+		result.position[k].reserve(count);
+		result.velocity[k].reserve(count);
+	}
+
+	AutoMutex lock(mutex);
+
+	map<string, States>::const_iterator it = states.find(key);
+	if (it == states.end())
+		return false;
+
+	const States &list = it->second;
+	size_t hint = NO_BRACKET;
+	for (size_t e = 0; e < count; e++) {
+		size_t i = Bracket(list, epochs[e], hint);
+		if (i == NO_BRACKET) {
+			Missing(result);
+			continue;
+		}
+		hint = i;
+
+		if (method == HERMITE)
+			Hermite(list, i, epochs[e], result);
+		else
+			Lagrange(list, i, epochs[e], order, result);
+	}
+
+	return true;
+}
+
+bool EphemerisStore::GetCoverage(const string &key, Coverage &coverage){
+	AutoMutex lock(mutex);
+
+	map<string, States>::const_iterator it = states.find(key);
+	if (it == states.end() || it->second.empty())
+		return false;
+
+	coverage.start = it->second.front().epoch;
+	coverage.end = it->second.back().epoch;
+	coverage.count = it->second.size();
+	return true;
+}
+
+vector<string> EphemerisStore::Keys(){
+	AutoMutex lock(mutex);
+
+	vector<string> keys;
+	for (map<string, States>::const_iterator it = states.begin(); it != states.end(); ++it)
+		keys.push_back(it->first);
+	return keys;
+}
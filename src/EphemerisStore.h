@@ -0,0 +1,105 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_EPHEMERISSTORE_H
+#define GMSECJS_EPHEMERISSTORE_H
+
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Router.h"
+#include "Sync.h"
+
+/*
+ * Recent orbit states per spacecraft, ordered by epoch, for interpolating
+ * position and velocity between the discrete position updates.
+ *
+ * States are keyed by a string field (SCName) and stamped with the epoch
+ * field of the message, not the receive time. Epochs are milliseconds since
+ * 1970 UTC; velocities are taken to be per second in the position units.
+ *
+ * Record() runs on the dispatch thread, or whichever thread replays into
+ * the router, queries on the node thread, so every public method takes the
+ * store's mutex.
+ */
+class EphemerisStore {
+public:
+	enum Method {
+		HERMITE,    /* cubic between the bracketing states, uses velocities */
+		LAGRANGE    /* polynomial through the nearest order states */
+	};
+
+	/* One output column per component; epochs outside the covered span,
+	 * or inside a gap the method cannot bridge, come back as NaN. */
+	struct Result {
+		std::vector<double> position[3];
+		std::vector<double> velocity[3];
+	};
+
+	struct Coverage {
+		double start;
+		double end;
+		size_t count;
+	};
+
+	EphemerisStore(const std::string &keyField, const std::string &epochField,
+	               const std::vector<std::string> &positionFields,
+	               const std::vector<std::string> &velocityFields,
+	               size_t capacity, size_t maxKeys);
+	~EphemerisStore();
+
+	void Record(Router::Delivery &delivery);
+
+	bool PositionAt(const std::string &key, const double *epochs, size_t count,
+	                Method method, size_t order, Result &result);
+	bool GetCoverage(const std::string &key, Coverage &coverage);
+	std::vector<std::string> Keys();
+
+	bool HasVelocity() const { return !velocityFields.empty(); }
+	size_t DroppedKeys() const { return droppedKeys; }
+
+	/* Parses "Apr 06 2011 00:02:00.000" and "2011-096-00:02:00.000" epochs
+	 * into milliseconds since 1970 UTC. */
+	static bool ParseEpoch(const std::string &text, double &epochMs);
+
+private:
+	struct State {
+		double epoch;
+		double position[3];
+		double velocity[3];
+	};
+
+	typedef std::deque<State> States;
+
+	size_t Bracket(const States &states, double epoch, size_t hint) const;
+	void Hermite(const States &states, size_t i, double epoch, Result &result) const;
+	void Lagrange(const States &states, size_t i, double epoch, size_t order, Result &result) const;
+	void Missing(Result &result) const;
+
+	std::string keyField;
+	std::string epochField;
+	std::vector<std::string> positionFields;
+	std::vector<std::string> velocityFields;
+	size_t capacity;
+	size_t maxKeys;
+	size_t droppedKeys;
+
+	std::map<std::string, States> states;
+	Mutex mutex;
+};
+
+#endif
@@ -0,0 +1,101 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "FieldUtil.h"
+#include "MessageRecord.h"
+
+using namespace std;
+
+bool FieldToDouble(const MiddlewareApi::Field &field, double &value){
+	if (field.numeric) {
+		value = field.number;
+		return true;
+	}
+
+	if (field.type == GMSEC_TYPE_STRING) {
+		char *end;
+		value = strtod(field.text, &end);
+		return end != field.text;
+	}
+	return false;
+}
+
+bool FieldToString(const MiddlewareApi::Field &field, string &value){
+	if (field.type == GMSEC_TYPE_STRING) {
+		value = field.text;
+		return true;
+	}
+
+	double number;
+	if (!FieldToDouble(field, number))
+		return false;
+
+	char buffer[32];
+	sprintf(buffer, "%.15g", number);
+	value = buffer;
+	return true;
+}
+
+/* Converts the one field visited. */
+class DoubleReader : public MiddlewareApi::FieldVisitor {
+public:
+	DoubleReader(double &value) : value(value), ok(false) {}
+	void Visit(const MiddlewareApi::Field &field){ ok = FieldToDouble(field, value); }
+
+	double &value;
+	bool ok;
+};
+
+class StringReader : public MiddlewareApi::FieldVisitor {
+public:
+	StringReader(string &value) : value(value), ok(false) {}
+	void Visit(const MiddlewareApi::Field &field){ ok = FieldToString(field, value); }
+
+	string &value;
+	bool ok;
+};
+
+bool GetFieldAsDouble(MiddlewareApi::Message *msg, const char *name, double &value){
+	DoubleReader reader(value);
+	return MiddlewareApi::Get()->VisitField(msg, name, reader) && reader.ok;
+}
+
+bool GetFieldAsString(MiddlewareApi::Message *msg, const char *name, string &value){
+	StringReader reader(value);
+	return MiddlewareApi::Get()->VisitField(msg, name, reader) && reader.ok;
+}
+
+bool GetFieldAsDouble(Router::Delivery &delivery, const char *name, double &value){
+	if (delivery.msg != NULL)
+		return GetFieldAsDouble(delivery.msg, name, value);
+
+	string text;
+	if (delivery.recorded == NULL || !MessageRecord::FieldFromXML(*delivery.recorded, name, text))
+		return false;
+
+	char *end;
+	value = strtod(text.c_str(), &end);
+	return end != text.c_str();
+}
+
+bool GetFieldAsString(Router::Delivery &delivery, const char *name, string &value){
+	if (delivery.msg != NULL)
+		return GetFieldAsString(delivery.msg, name, value);
+
+	return delivery.recorded != NULL && MessageRecord::FieldFromXML(*delivery.recorded, name, value);
+}
@@ -0,0 +1,40 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_FIELDUTIL_H
+#define GMSECJS_FIELDUTIL_H
+
+#include <string>
+
+#include "MiddlewareApi.h"
+#include "Router.h"
+
+/*
+ * Typed access to message fields regardless of the GMSEC type they were
+ * published with. Each returns false if the field is missing or cannot be
+ * represented in the requested form.
+ */
+bool FieldToDouble(const MiddlewareApi::Field &field, double &value);
+bool FieldToString(const MiddlewareApi::Field &field, std::string &value);
+
+bool GetFieldAsDouble(MiddlewareApi::Message *msg, const char *name, double &value);
+bool GetFieldAsString(MiddlewareApi::Message *msg, const char *name, std::string &value);
+
+/* The same for a routed message, read from the live message or from the
+ * XML of a replayed one. */
+bool GetFieldAsDouble(Router::Delivery &delivery, const char *name, double &value);
+bool GetFieldAsString(Router::Delivery &delivery, const char *name, std::string &value);
+
+#endif
@@ -0,0 +1,148 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "FrameCompressor.h"
+
+using namespace std;
+
+/*
+ * Built by bench/DictionaryBuilder.cpp from examples/Data Recorder/
+ * recording.txt. Segments written with it carry version 3 or later, so
+ * regenerating it means raising Segment's VERSION and keeping this one for
+ * the older segments, as HAND_WRITTEN_DICTIONARY is kept.
+ */
+static const char DICTIONARY[] =
+#include "FrameDictionary.inc"
+	;
+
+/*
+ * The dictionary before that, written by hand from the same traffic.
+ * Segments up to version 2 were compressed with it.
+ */
+static const char HAND_WRITTEN_DICTIONARY[] =
+	"MANEUVER_NUMBER" "ITERATION_NUMBER" "MANEUVER_DSMA" "SimulationName"
+	"GMSEC.FDS_DEMO.WEB.DATA.MANEUVER_PLANNING_ITERATION"
+	"GMSEC.FREEFLYER.PUBLISHER.SC.POSITION.UPDATE"
+	"\",\"Kind\":\"REQUEST\"" "\",\"Kind\":\"REPLY\""
+	"{\"Subject\":\"GMSEC." "\",\"Kind\":\"PUBLISH\",\"Seq\":" ",\"Keyframe\":false"
+	",\"Fields\":{" "\":{\"Type\":\"U16\",\"Value\":" "\":{\"Type\":\"F64\",\"Value\":"
+	"\":{\"Type\":\"STRING\",\"Value\":\"" "},\""
+	"<MESSAGE SUBJECT=\"GMSEC." "\" KIND=\"REQUEST\">" "\" KIND=\"REPLY\">"
+	"\" KIND=\"PUBLISH\">\n"
+	"\t<FIELD TYPE=\"U16\" NAME=\"CONNECTION-ID\">"
+	"\t<FIELD TYPE=\"U16\" NAME=\"PROCESS-ID\">"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"EpochText\">Apr 06 2011 00:"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"MW-INFO\">gmsec_mb</FIELD>\n"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"NODE\">"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"PUBLISH-TIME\">20"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"SCName\">"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"UNIQUE-ID\">GMSEC_"
+	"\t<FIELD TYPE=\"STRING\" NAME=\"USER-NAME\"></FIELD>\n"
+	"\t<FIELD TYPE=\"F64\" NAME=\"Latitude\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"Longitude\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"DX\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"DY\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"DZ\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"X\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"Y\">"
+	"\t<FIELD TYPE=\"F64\" NAME=\"Z\">"
+	"</FIELD>\n" "</MESSAGE>\n";
+
+const string &FrameCompressor::Dictionary(){
+	static const string dictionary(DICTIONARY, sizeof(DICTIONARY) - 1);
+	return dictionary;
+}
+
+const string &FrameCompressor::HandWrittenDictionary(){
+	static const string dictionary(HAND_WRITTEN_DICTIONARY, sizeof(HAND_WRITTEN_DICTIONARY) - 1);
+	return dictionary;
+}
+
+FrameCompressor::FrameCompressor(bool useDictionary, int level)
+	: useDictionary(useDictionary){
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+
+	/* Negative window bits: raw deflate, no zlib header or checksum. */
+	initialized = deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+FrameCompressor::~FrameCompressor(){
+	if (initialized)
+		deflateEnd(&stream);
+}
+
+bool FrameCompressor::Compress(const char *data, size_t length, string &out){
+	if (!initialized || deflateReset(&stream) != Z_OK)
+		return false;
+
+	if (useDictionary &&
+	    deflateSetDictionary(&stream, (const Bytef*) Dictionary().data(), (uInt) Dictionary().size()) != Z_OK)
+		return false;
+
+	out.resize(deflateBound(&stream, (uLong) length));
+
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = (uInt) length;
+	stream.next_out = (Bytef*) &out[0];
+	stream.avail_out = (uInt) out.size();
+
+	if (deflate(&stream, Z_FINISH) != Z_STREAM_END)
+		return false;
+
+	out.resize(out.size() - stream.avail_out);
+	return true;
+}
+
+bool FrameCompressor::Decompress(const char *data, size_t length, bool useDictionary, string &out){
+	return Decompress(data, length, useDictionary ? &Dictionary() : NULL, out);
+}
+
+bool FrameCompressor::Decompress(const char *data, size_t length, const string *dictionary, string &out){
+	z_stream stream;
+	stream.zalloc = Z_NULL;
+	stream.zfree = Z_NULL;
+	stream.opaque = Z_NULL;
+	stream.next_in = (Bytef*) data;
+	stream.avail_in = (uInt) length;
+
+	if (inflateInit2(&stream, -15) != Z_OK)
+		return false;
+
+	/* Raw inflate never asks for the dictionary, it has to be set up front. */
+	if (dictionary != NULL &&
+	    inflateSetDictionary(&stream, (const Bytef*) dictionary->data(), (uInt) dictionary->size()) != Z_OK) {
+		inflateEnd(&stream);
+		return false;
+	}
+
+	out.clear();
+	char buffer[16384];
+	int result;
+	do {
+		stream.next_out = (Bytef*) buffer;
+		stream.avail_out = sizeof(buffer);
+		result = inflate(&stream, Z_NO_FLUSH);
+		if (result != Z_OK && result != Z_STREAM_END) {
+			inflateEnd(&stream);
+			return false;
+		}
+		out.append(buffer, sizeof(buffer) - stream.avail_out);
+	} while (result != Z_STREAM_END);
+
+	inflateEnd(&stream);
+	return true;
+}
@@ -0,0 +1,55 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_FRAMECOMPRESSOR_H
+#define GMSECJS_FRAMECOMPRESSOR_H
+
+#include <string>
+
+#include "zlib.h"
+
+/*
+ * Raw deflate of delivery payloads, optionally primed with a preset
+ * dictionary of GMSEC XML/JSON boilerplate and field names that
+ * gmsec-dictionary generates from the sample recording. Short messages like
+ * position updates are mostly field names, so the dictionary is what makes
+ * single-message frames compress well.
+ *
+ * The zlib stream is allocated once and reset per frame. An instance is not
+ * thread safe; each dispatch context owns its own.
+ */
+class FrameCompressor {
+public:
+	FrameCompressor(bool useDictionary, int level = Z_DEFAULT_COMPRESSION);
+	~FrameCompressor();
+
+	bool Compress(const char *data, size_t length, std::string &out);
+
+	/* Inverse of Compress() for the same dictionary setting. */
+	static bool Decompress(const char *data, size_t length, bool useDictionary, std::string &out);
+	/* With a given dictionary, or none for NULL. */
+	static bool Decompress(const char *data, size_t length, const std::string *dictionary, std::string &out);
+
+	static const std::string &Dictionary();
+	/* What Dictionary() was before it was generated; old segments use it. */
+	static const std::string &HandWrittenDictionary();
+
+private:
+	z_stream stream;
+	bool useDictionary;
+	bool initialized;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string>
+
+#include "node_buffer.h"
+
+#include "Frames.h"
+#include "FrameCompressor.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+void Frames::Init(Handle<Object> target){
+	HandleScope scope;
+
+	NODE_SET_METHOD(target, "CompressFrame", CompressFrame);
+	NODE_SET_METHOD(target, "DecompressFrame", DecompressFrame);
+
+	const string &dictionary = FrameCompressor::Dictionary();
+	target->Set(String::NewSymbol("CompressionDictionary"),
+	            Local<Object>::New(Buffer::New(dictionary.data(), dictionary.size())->handle_));
+}
+
+Handle<Value> Frames::CompressFrame(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !(args[0]->IsString() || Buffer::HasInstance(args[0])))
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 0 must be a string or a Buffer")));
+
+	OPT_OBJ_ARG(1, options);
+	bool useDictionary = GetBoolOption(options, "dictionary", true);
+
+	string input;
+	if (Buffer::HasInstance(args[0])) {
+		Local<Object> buffer = args[0]->ToObject();
+		input.assign(Buffer::Data(buffer), Buffer::Length(buffer));
+	}
+	else {
+		String::Utf8Value value(args[0]);
+		input.assign(*value, value.length());
+	}
+
+	/* A fresh context per call; this is the per-recipient cost that shared
+	 * frames avoid. */
+	FrameCompressor compressor(useDictionary);
+	string frame;
+	if (!compressor.Compress(input.data(), input.size(), frame))
+		return ThrowException(Exception::Error(String::New("Compression failed")));
+
+	return scope.Close(Local<Object>::New(Buffer::New(frame.data(), frame.size())->handle_));
+}
+
+Handle<Value> Frames::DecompressFrame(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !Buffer::HasInstance(args[0]))
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 0 must be a Buffer")));
+
+	OPT_OBJ_ARG(1, options);
+	bool useDictionary = GetBoolOption(options, "dictionary", true);
+
+	Local<Object> buffer = args[0]->ToObject();
+	string output;
+	if (!FrameCompressor::Decompress(Buffer::Data(buffer), Buffer::Length(buffer), useDictionary, output))
+		return ThrowException(Exception::Error(String::New("Invalid compressed frame")));
+
+	return scope.Close(String::New(output.data(), output.size()));
+}
@@ -0,0 +1,41 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_FRAMES_H
+#define GMSECJS_FRAMES_H
+
+#include "v8.h"
+#include "node.h"
+
+/*
+ * Module level helpers for compressed delivery frames:
+ *
+ *     GMSEC.CompressFrame(stringOrBuffer, [{dictionary: true}])  -> Buffer
+ *     GMSEC.DecompressFrame(buffer, [{dictionary: true}])        -> String
+ *     GMSEC.CompressionDictionary                                -> Buffer
+ *
+ * Browsers need the dictionary to inflate frames delivered with
+ * {compression: 'deflate'}, so it is exported for the server to hand out.
+ */
+class Frames {
+public:
+	static void Init(v8::Handle<v8::Object> target);
+
+private:
+	static v8::Handle<v8::Value> CompressFrame(const v8::Arguments& args);
+	static v8::Handle<v8::Value> DecompressFrame(const v8::Arguments& args);
+};
+
+#endif
@@ -14,33 +14,59 @@
  */
 
 #include <iostream>
+#include <deque>
 #include <map>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
 #include <string.h>
 
 
 #include "v8.h"
 #include "node.h"
-#include "gmsec_cpp.h"
-#include "gmsec\util\Log.h"
-#include "gmsec\util\Mutex.h"
+#include "node_buffer.h"
+#include "Sync.h"
+
+#include "common.h"
+#include "Heartbeat.h"
+#include "History.h"
+#include "Ephemeris.h"
+#include "Recorder.h"
+#include "Recording.h"
+#include "ReplayWindow.h"
+#include "ScatterGather.h"
+#include "MessageRecord.h"
+#include "FieldUtil.h"
+#include "DeltaEncoder.h"
+#include "FrameCompressor.h"
+#include "Frames.h"
+#include "MemoryStats.h"
+#include "Middleware.h"
+#include "MiddlewareApi.h"
+#include "Probes.h"
+#include "PublishQueue.h"
+#include "Trace.h"
+#include "TraceBuffer.h"
+#include "SubscriptionSnapshot.h"
+#include "Router.h"
+#include "Backtest.h"
+#include "Generator.h"
 
 using namespace std;
 using namespace node;
 using namespace v8;
 
-#define REQ_FUN_ARG(I, VAR)                                             \
-  if (args.Length() <= (I) || !args[I]->IsFunction())                   \
-    return ThrowException(Exception::TypeError(                         \
-                  String::New("Argument " #I " must be a function")));  \
-  Local<Function> VAR = Local<Function>::Cast(args[I]);
+/* How long Connect's prewarm waits for its deliveries. */
+static const uint64_t PREWARM_TIMEOUT_MS = 1000;
 
-#define REQ_STR_ARG(I, VAR)                                             \
-  if (args.Length() <= (I) || !args[I]->IsString())                     \
-	return ThrowException(Exception::TypeError(                         \
-				  String::New("Argument " #I " must be a string")));  \
-  Local<String> VAR = Local<String>::Cast(args[I]);
+/* Correlates RequestAll() replies with their request. */
+static const char REQUEST_ID_FIELD[] = "REQUEST-ID";
+
+static const char PREWARM_FIELDS[] =
+	"<FIELD TYPE=\"STRING\" NAME=\"MESSAGE-TYPE\">MSG</FIELD>"
+	"<FIELD TYPE=\"F64\" NAME=\"X\">1.5</FIELD>"
+	"<FIELD TYPE=\"I32\" NAME=\"COUNTER\">1</FIELD>";
 
-static uv_async_t async;
 class Connection: ObjectWrap{
 
 private:
@@ -49,87 +75,777 @@ public:
 	/*
 	 * Forward declarations
 	 */
-	class MessageReceivedCallback;
+	class Route;
+	struct Consumer;
+	struct message_received_cb_baton_t;
+	struct subscribe_batch_baton_t;
+	struct publish_baton_t;
+	struct backtest_state_t;
+	class QueuedPublisher;
+	class ReplaySequencer;
+
+	MiddlewareApi::Connection *gmsecConnection;
+
+	/*
+	 * Local connections never reach a middleware: subscriptions are served
+	 * by the router alone and fed by backtests.
+	 */
+	bool local;
+	backtest_state_t *backtest;
+
+	/*
+	 * One route per subscribed pattern. The router decides which middleware
+	 * subscriptions feed them; its subscribe and unsubscribe operations run
+	 * one batch at a time on the thread pool so they reach the middleware
+	 * in order.
+	 */
+	map<string, Route*> routes;
+	Router router;
+	deque<subscribe_batch_baton_t*> routerBatches;
+	bool routerBusy;
+	uv_timer_t reviewTimer;
+
+	/*
+	 * Serializes publishes between the publisher thread and the heartbeat
+	 * thread.
+	 */
+	Mutex publishMutex;
+	Heartbeat *heartbeat;
+
+	/*
+	 * Publish() and RequestAll() messages go out in adaptive batches from
+	 * one thread per connection. Finished batches come back through the
+	 * delivery async.
+	 */
+	QueuedPublisher *publishTarget;
+	PublishQueue *publisher;
+
+	/* Publishes not yet completed; only touched on the node thread. */
+	size_t publishesQueued;
+	vector<PublishQueue::Job*> unpublished;
+
+	/*
+	 * History stores stay alive for the life of the connection since the
+	 * router keeps feeding them through their routes.
+	 */
+	vector<HistoryStore*> histories;
+	vector<History::RecordTarget*> historyTargets;
+	vector<EphemerisStore*> ephemerides;
+	vector<Ephemeris::RecordTarget*> ephemerisTargets;
+	vector<SegmentRecorder*> recorders;
+	vector<SegmentRecorder::RecordTarget*> recorderTargets;
+
+	/*
+	 * Messages received on the dispatch thread wait here until the node
+	 * thread drains them. Every message is stamped with a per-subject
+	 * sequence number and retained in the replay window for resuming clients;
+	 * the router has the sequencer do that once per message.
+	 */
+	uv_async_t async;
+	Mutex deliveryMutex;
+	deque<message_received_cb_baton_t*> deliveries;
+	ReplayWindow replayWindow;
+	ReplaySequencer *sequencer;
+
+	/*
+	 * Unsubscribed consumers may still be referenced by queued deliveries.
+	 * Each is kept until every delivery queued before it was retired has
+	 * been handed out. Backtests pace themselves on the difference, so both
+	 * counters change under deliveryMutex.
+	 */
+	unsigned long long deliveriesQueued;
+	unsigned long long deliveriesDone;
+	vector< pair<unsigned long long, Consumer*> > retiredConsumers;
+
+	/*
+	 * Open RequestAll() gathers. Replies are claimed by their route on the
+	 * dispatch thread; completions come back through the delivery async and
+	 * deadlines through one timer armed for the earliest of them.
+	 */
+	ScatterGather gathers;
+	map<unsigned long long, Persistent<Function> > gatherCallbacks;
+	uv_timer_t gatherTimer;
+	uint64_t requestEpoch;
+	unsigned long long requestsSent;
+
+	/*
+	 * Set once the object has been collected. The connection then shuts
+	 * down on the thread pool and is deleted when the last of its handles
+	 * has closed.
+	 */
+	bool closing;
+	int openHandles;
 
-	gmsec::Connection *gmsecConnection;
-	map<const char*, MessageReceivedCallback*> subscribeCallbacks;
 	static Persistent<FunctionTemplate> s_ct;
 
 	/*
-	 * Message batons used for callbacks.
+	 * Router operations issued by a single thread pool job. When cb is set
+	 * the subjects are reported back along with the error, if any, of the
+	 * middleware subscription that serves each of them.
 	 */
-	struct message_baton_t {
-			Connection *connection;
-			char *subject;
-			MessageReceivedCallback *gmsecCb;
+	struct subscribe_batch_baton_t {
+		Connection *connection;
+		vector<Router::Operation> ops;
+		vector<string> errors;
+		vector<string> subjects;
+		vector<string> owners;
+		Persistent<Function> cb;
+
+		/* Reports cb(err) for the one subject instead of the list. */
+		bool single;
+
+		/* Requests held back until the subscriptions for their replies are
+		 * in place. */
+		vector<publish_baton_t*> publishes;
+	};
+
+	struct snapshot_baton_t {
+		Connection *connection;
+		string path;
+		vector<SubscriptionSnapshot::Entry> entries;
+		string error;
+		Persistent<Function> cb;
+		Persistent<Function> onMessage;
 	};
 
+	/*
+	 * The middleware connection is built on the thread pool and only handed
+	 * to the Connection once it is connected and dispatching.
+	 */
 	struct connection_baton_t {
 		Connection *connection;
 		Persistent<Function> cb;
 		const char *server;
+		bool prewarm;
+		MiddlewareApi::Connection *gmsecConnection;
+		string error;
 	};
 
-	struct message_received_cb_baton_t {
+	/*
+	 * Connect's prewarm sends one message down the path live traffic takes
+	 * without putting it on the bus: the publisher thread builds it as a
+	 * middleware message, then replays it through the router and sequencer,
+	 * every encoding and the delivery async into throwaway consumers on a
+	 * private subject. Only those local deliveries are waited for.
+	 */
+	struct prewarm_state_t {
+		Connection *connection;
 		Persistent<Function> cb;
-		gmsec::Message *copied_message;
+		string subject;
+		string xml;
+		size_t pending;     /* deliveries still expected */
+		bool finished;
+		uv_timer_t timer;
 	};
 
-	struct publish_baton_t {
+	struct publish_baton_t : PublishQueue::Job {
 		Connection *connection;
 		const char *message_contents;
+
+		/* Set for RequestAll(), whose gather fails with the request. */
+		unsigned long long gather;
+		string error;
+
+		/* Connect's prewarm: built and routed locally, never published. */
+		bool prewarm;
+
+		/* Filled in only while tracing or a tracer watches publish__done. */
+		string subject;
+		uint64_t enqueued;
+	};
+
+	/*
+	 * Hands a backtest's messages to the router and tells it how far the
+	 * node thread has fallen behind.
+	 */
+	class LocalFeed : public Backtest::Target {
+	public:
+		LocalFeed(Connection *connection) : connection(connection) {}
+
+		void Inject(const string &subject, const string &xml){
+			connection->router.Replay(subject, xml);
+		}
+
+		unsigned long long InFlight(){
+			AutoMutex lock(connection->deliveryMutex);
+			return connection->deliveriesQueued - connection->deliveriesDone;
+		}
+
+		void Finished(){
+			uv_async_send(&connection->async);
+		}
+
+	private:
+		Connection *connection;
 	};
 
-	class InfoHandler : public gmsec::util::LogHandler{
+	/*
+	 * Numbers each routed message and keeps it in the replay window. The
+	 * window always keeps XML, so a live message is only rendered here when
+	 * something is being retained.
+	 */
+	class ReplaySequencer : public Router::Sequencer {
 	public:
-		virtual void CALL_TYPE OnMessage(const gmsec::util::LogEntry &entry)
-		{
-			std::cout << "On INFO Message:" << std::endl;
-			char tempBuffer[50];
-			gmsec::util::formatTime_s(entry.time, tempBuffer);
-			std::cout << "  " << tempBuffer << ":" << gmsec::util::Log::ToString(entry.level) << ":" << entry.message << endl;
+		ReplaySequencer(ReplayWindow &window) : window(window) {}
+
+		void Sequence(Router::Delivery &delivery){
+			static const string noXml;
+			delivery.seq = window.Append(delivery.subject, window.Retaining() ? delivery.Xml() : noXml);
 		}
+
+	private:
+		ReplayWindow &window;
+	};
+
+	/*
+	 * Publishes the batches of the connection's PublishQueue. Messages are
+	 * built outside the publish mutex, so the heartbeat thread only waits
+	 * for the middleware calls.
+	 */
+	class QueuedPublisher : public PublishQueue::Target {
+	public:
+		QueuedPublisher(Connection *connection) : connection(connection) {}
+
+		void Publish(const vector<PublishQueue::Job*> &batch){
+			if (TraceBuffer::Enabled()) {
+				uint64_t started = uv_hrtime();
+				for (size_t i = 0; i < batch.size(); i++) {
+					publish_baton_t *baton = static_cast<publish_baton_t*>(batch[i]);
+					if (baton->enqueued != 0)
+						TraceBuffer::Record(TraceBuffer::PUBLISH_WAIT, baton->subject.c_str(), -1, baton->enqueued, started);
+				}
+			}
+
+			if (connection->local) {
+				for (size_t i = 0; i < batch.size(); i++)
+					PublishLocal(static_cast<publish_baton_t*>(batch[i]));
+				return;
+			}
+
+			MiddlewareApi *api = MiddlewareApi::Get();
+			MiddlewareApi::Connection *gmsecConnection = connection->gmsecConnection;
+			messages.resize(batch.size());
+			errors.assign(batch.size(), string());
+			for (size_t i = 0; i < batch.size(); i++) {
+				/* Load the user data into a new message. */
+				publish_baton_t *baton = static_cast<publish_baton_t*>(batch[i]);
+				messages[i] = api->CreateMessage(gmsecConnection, baton->message_contents, errors[i]);
+			}
+
+			{
+				AutoMutex lock(connection->publishMutex);
+				for (size_t i = 0; i < batch.size(); i++) {
+					publish_baton_t *baton = static_cast<publish_baton_t*>(batch[i]);
+					if (baton->prewarm)
+						continue;
+					TraceSpan span(TraceBuffer::PUBLISH, baton->subject.c_str());
+
+					bool published = messages[i] != NULL && api->Publish(gmsecConnection, messages[i], errors[i]);
+					if (!published) {
+						GMSECJS_PROBE2(message__drop, baton->subject.c_str(), PROBE_DROP_PUBLISH);
+						if (baton->gather != 0)
+							baton->error = errors[i];
+					}
+					ProbePublishDone(baton, !published);
+				}
+			}
+
+			for (size_t i = 0; i < batch.size(); i++) {
+				publish_baton_t *baton = static_cast<publish_baton_t*>(batch[i]);
+				if (baton->prewarm && messages[i] != NULL)
+					PrewarmLocal(baton, messages[i]);
+				if (messages[i] != NULL)
+					api->DestroyMessage(gmsecConnection, messages[i]);
+			}
+		}
+
+		void Published(){
+			uv_async_send(&connection->async);
+		}
+
+	private:
+		/* Local connections loop publishes back to their own subscribers. */
+		void PublishLocal(publish_baton_t *baton){
+			TraceSpan span(TraceBuffer::PUBLISH, baton->subject.c_str());
+
+			string xml = baton->message_contents;
+			string subject;
+			bool parsed = MessageRecord::SubjectFromXML(xml, subject);
+			if (parsed)
+				connection->router.Replay(subject, xml);
+			else
+				GMSECJS_PROBE2(message__drop, baton->subject.c_str(), PROBE_DROP_PUBLISH);
+			if (!parsed && baton->gather != 0)
+				baton->error = "Request has no subject";
+			ProbePublishDone(baton, !parsed);
+		}
+
+		/* Renders the built message as the dispatch thread would and routes
+		 * it to the prewarm consumers only. */
+		void PrewarmLocal(publish_baton_t *baton, MiddlewareApi::Message *msg){
+			string xml;
+			MiddlewareApi::Get()->ToXML(msg, xml);
+			connection->router.Replay(MiddlewareApi::Get()->Subject(msg), xml);
+		}
+
+		Connection *connection;
+		vector<MiddlewareApi::Message*> messages;
+		vector<string> errors;
 	};
 
-	class MessageReceivedCallback : public gmsec::Callback {
+	/*
+	 * Publishes generated load through the middleware, or straight to the
+	 * router of a local connection.
+	 */
+	class GeneratorPublisher : public LoadGenerator::Target {
 	public:
+		GeneratorPublisher(Connection *connection) : connection(connection) {}
+
+		bool Publish(const string &subject, const string &xml, string &error){
+			if (connection->local) {
+				connection->router.Replay(subject, xml);
+				return true;
+			}
+
+			MiddlewareApi *api = MiddlewareApi::Get();
+			MiddlewareApi::Connection *gmsecConnection = connection->gmsecConnection;
+			MiddlewareApi::Message *msg = api->CreateMessage(gmsecConnection, xml.c_str(), error);
+			if (msg == NULL)
+				return false;
+
+			bool published;
+			{
+				AutoMutex lock(connection->publishMutex);
+				published = api->Publish(gmsecConnection, msg, error);
+			}
+			api->DestroyMessage(gmsecConnection, msg);
+			return published;
+		}
+
+	private:
+		Connection *connection;
+	};
+
+	/*
+	 * A backtest waits for queued router batches before it starts so that
+	 * every subscription made ahead of it sees the first message.
+	 */
+	struct backtest_state_t {
+		backtest_state_t(Connection *connection) : feed(connection), backtest(NULL), started(0) {}
+		~backtest_state_t(){
+			delete backtest;
+			inputs.Dispose();
+			cb.Dispose();
+		}
+
+		LocalFeed feed;
+		Backtest *backtest;
+		uint64_t started;
+		Persistent<Value> inputs;   /* keeps the recordings alive */
+		Persistent<Function> cb;
+	};
+
+	/*
+	 * How a subscription's messages are handed to its JS callback.
+	 */
+	enum Encoding {
+		ENCODING_XML,
+		ENCODING_JSON,
+		ENCODING_DELTA,
+		ENCODING_COUNT
+	};
+
+	/*
+	 * Compression contexts. Consumers on the same subscription that share an
+	 * encoding and a context receive the very same compressed frame.
+	 */
+	enum Compression {
+		COMPRESSION_NONE,
+		COMPRESSION_DEFLATE,
+		COMPRESSION_DEFLATE_DICTIONARY,
+		COMPRESSION_COUNT
+	};
+
+	/*
+	 * One JS callback registered through Subscribe(). All consumers of a
+	 * subject share one route; each keeps its own delta state since deltas
+	 * are relative to what that consumer last received.
+	 */
+	struct Consumer {
+		Consumer(Encoding encoding, Compression compression, unsigned keyframeInterval)
+			: encoding(encoding), compression(compression), keyframeInterval(keyframeInterval),
+			  deltaEncoder(keyframeInterval), removed(false) {}
+
 		Persistent<Function> cb;
-		void CALL_TYPE OnMessage(gmsec::Connection *conn, gmsec::Message *msg){
+		Encoding encoding;
+		Compression compression;
+		unsigned keyframeInterval;
+		DeltaEncoder deltaEncoder;
+		bool removed;
+	};
+
+	/*
+	 * One received message fanned out to the consumers of a subscription.
+	 * Each distinct payload is encoded (and compressed) once and shared by
+	 * index between the consumers that asked for the same form.
+	 */
+	struct message_received_cb_baton_t {
+		string subject;
+		double seq;
+		vector<string> payloads;
+		vector<bool> compressed;
+		vector<Consumer*> consumers;
+		vector<size_t> payloadIndex;
+		size_t nextConsumer;
+
+		/* Set only while tracing or a tracer watches message__dequeue. */
+		uint64_t enqueued;
+	};
+
+	/*
+	 * Fans the messages of one subscribed pattern out to its consumers. The
+	 * router calls Deliver() on the dispatch thread for every message that
+	 * matches, whichever middleware subscription it arrived through, and
+	 * DeliverRecorded() on the backtest thread for replayed ones.
+	 */
+	class Route : public Router::Target {
+	public:
+		Route(Connection *connection) : connection(connection), gatherers(0){
+			for (int i = 0; i < COMPRESSION_COUNT; i++)
+				compressors[i] = NULL;
+		}
+
+		~Route(){
+			for (int i = 0; i < COMPRESSION_COUNT; i++)
+				delete compressors[i];
+		}
+
+		Connection *connection;
+
+		/* Consumers are added from the node thread while the dispatch thread
+		 * may be fanning out. */
+		Mutex consumersMutex;
+		vector<Consumer*> consumers;
+
+		/* RequestAll() gathers waiting for replies on this route's subject.
+		 * A route with gatherers stays subscribed without consumers. */
+		unsigned gatherers;
+
+		/* Histories, ephemerides and recorders fed from this route. They
+		 * stay for the life of the connection. */
+		vector<Router::Target*> stores;
+
+		/* Whether the route can be dropped. Called under consumersMutex. */
+		bool Unused() const { return consumers.empty() && gatherers == 0 && stores.empty(); }
+
+		/* Dispatch thread scratch space, reused across messages. The router
+		 * never delivers to a route from two threads at once. */
+		MessageRecord record;
+		FrameCompressor *compressors[COMPRESSION_COUNT];
+
+		/* The compressor is set up here rather than on the first message,
+		 * so its zlib state is not allocated on the delivery path. */
+		void AddConsumer(Consumer *consumer){
+			AutoMutex lock(consumersMutex);
+			consumers.push_back(consumer);
+			if (consumer->compression != COMPRESSION_NONE && compressors[consumer->compression] == NULL)
+				compressors[consumer->compression] =
+					new FrameCompressor(consumer->compression == COMPRESSION_DEFLATE_DICTIONARY);
+		}
+
+		void AddStore(Router::Target *store){
+			AutoMutex lock(consumersMutex);
+			stores.push_back(store);
+		}
+
+		/* The delivery arrives sequenced; its XML is shared with the other
+		 * routes the message reaches. */
+		void Deliver(Router::Delivery &delivery){
+			const char *subject = delivery.subject;
+
+			/* Encode here on the dispatch thread instead of cloning the
+			 * message; the node thread only has to build the JS values. */
+			AutoMutex lock(consumersMutex);
+
+			GMSECJS_PROBE2(message__receive, subject, consumers.size());
+
+			if (gatherers > 0)
+				OfferReply(delivery);
+			for (size_t i = 0; i < stores.size(); i++)
+				stores[i]->Deliver(delivery);
+			if (consumers.empty())
+				return;
 
 			message_received_cb_baton_t* baton = new message_received_cb_baton_t();
-			baton->cb = cb;
+			baton->subject = subject;
+			baton->nextConsumer = 0;
+			baton->seq = delivery.seq;
+
+			bool needXml = false;
+			bool needRecord = false;
+			for (size_t i = 0; i < consumers.size(); i++) {
+				if (consumers[i]->encoding == ENCODING_XML)
+					needXml = true;
+				else
+					needRecord = true;
+			}
+
+			static const string noXml;
+			const string &xml = needXml ? delivery.Xml() : noXml;
+
+			if (needRecord) {
+				TraceSpan span(TraceBuffer::DECODE, subject, baton->seq);
+				if (delivery.recorded != NULL)
+					record.FromXML(*delivery.recorded);
+				else
+					record.FromMessage(delivery.msg);
+			}
+
+			uint64_t encodeStarted = TraceBuffer::Enabled() ? uv_hrtime() : 0;
+
+			const size_t NOT_ENCODED = (size_t) -1;
+			size_t shared[ENCODING_COUNT][COMPRESSION_COUNT];
+			for (int e = 0; e < ENCODING_COUNT; e++)
+				for (int c = 0; c < COMPRESSION_COUNT; c++)
+					shared[e][c] = NOT_ENCODED;
+
+			for (size_t i = 0; i < consumers.size(); i++) {
+				Consumer *consumer = consumers[i];
+
+				/* Deltas depend on the consumer's own history and can never
+				 * be shared. */
+				bool shareable = consumer->encoding != ENCODING_DELTA;
+				size_t &sharedRaw = shared[consumer->encoding][COMPRESSION_NONE];
+				size_t &sharedFrame = shared[consumer->encoding][consumer->compression];
+
+				size_t index;
+				if (shareable && sharedFrame != NOT_ENCODED) {
+					index = sharedFrame;
+				}
+				else {
+					if (shareable && sharedRaw != NOT_ENCODED) {
+						index = sharedRaw;
+					}
+					else {
+						index = baton->payloads.size();
+						baton->payloads.push_back(string());
+						baton->compressed.push_back(false);
+						Encode(consumer, xml, baton->seq, baton->payloads.back());
+						if (shareable)
+							sharedRaw = index;
+					}
+
+					if (consumer->compression != COMPRESSION_NONE) {
+						index = Compress(baton, index, consumer->compression);
+						if (shareable)
+							sharedFrame = index;
+					}
+				}
+
+				baton->consumers.push_back(consumer);
+				baton->payloadIndex.push_back(index);
+			}
+
+			if (encodeStarted != 0 && TraceBuffer::Enabled())
+				TraceBuffer::Record(TraceBuffer::ENCODE, subject, baton->seq, encodeStarted, uv_hrtime());
+
+			baton->enqueued = TraceBuffer::Enabled() || GMSECJS_PROBE_ENABLED(message__dequeue) ? uv_hrtime() : 0;
+
+			{
+				AutoMutex lock(connection->deliveryMutex);
+				connection->deliveries.push_back(baton);
+				connection->deliveriesQueued++;
+				GMSECJS_PROBE3(message__enqueue, subject, baton->seq, connection->deliveries.size());
+			}
+
+			/* Sends coalesce, so the async callback drains everything queued. */
+			uv_async_send(&connection->async);
+		}
 
-			conn->CreateMessage(baton->copied_message);
-			conn->CloneMessage(msg, baton->copied_message);
+		void Encode(Consumer *consumer, const string &xml, double seq, string &payload){
+			switch (consumer->encoding) {
+			case ENCODING_XML:
+				payload = xml;
+				break;
+			case ENCODING_JSON:
+				record.ToJSON(seq, payload);
+				break;
+			case ENCODING_DELTA:
+				consumer->deltaEncoder.Encode(record, seq, payload);
+				break;
+			default:
+				break;
+			}
+		}
 
-			uv_work_t* req = new uv_work_t;
-			req->data = baton;
+	private:
+		/* Replies stay visible to the route's consumers as well. Only REPLY
+		 * messages count, so the echo of the request itself, which carries
+		 * the same REQUEST-ID, is not taken for one. */
+		void OfferReply(Router::Delivery &delivery){
+			GMSEC_MSG_KIND kind;
+			if (delivery.recorded != NULL) {
+				if (!MessageRecord::KindFromXML(*delivery.recorded, kind))
+					return;
+			}
+			else {
+				kind = MiddlewareApi::Get()->Kind(delivery.msg);
+			}
+			if (kind != GMSEC_MSG_REPLY)
+				return;
+
+			string correlationId;
+			bool found = delivery.recorded != NULL
+				? MessageRecord::FieldFromXML(*delivery.recorded, REQUEST_ID_FIELD, correlationId)
+				: GetFieldAsString(delivery.msg, REQUEST_ID_FIELD, correlationId);
+			if (!found || !connection->gathers.Expects(correlationId))
+				return;
+
+			if (connection->gathers.Offer(correlationId, delivery.Xml()))
+				uv_async_send(&connection->async);
+		}
 
-			async.data = baton;
-			uv_async_send(&async);
+		/* Returns the index of the compressed copy of payloads[raw], or raw
+		 * itself if compression failed so the consumer still gets the data. */
+		size_t Compress(message_received_cb_baton_t *baton, size_t raw, Compression compression){
+			if (compressors[compression] == NULL)
+				compressors[compression] = new FrameCompressor(compression == COMPRESSION_DEFLATE_DICTIONARY);
+
+			string frame;
+			const string &payload = baton->payloads[raw];
+			if (!compressors[compression]->Compress(payload.data(), payload.size(), frame))
+				return raw;
+
+			baton->payloads.push_back(string());
+			baton->payloads.back().swap(frame);
+			baton->compressed.push_back(true);
+			return baton->payloads.size() - 1;
 		}
 	};
 
 	static void OnMessageAsync(uv_async_t *handle, int status /*UNUSED*/){
 
-		message_received_cb_baton_t* baton = static_cast<message_received_cb_baton_t*>(handle->data);
+		Connection *connection = static_cast<Connection*>(handle->data);
 		HandleScope scope;
 
-		const char *message_contents;
-		baton->copied_message->ToXML(message_contents);
+		/* Whatever a collected connection still has queued goes with it. */
+		if (connection->closing)
+			return;
 
-		Local<Value> argv[1];
-		argv[0] = String::New(message_contents);
-		Local<Function> cb = Local<Function>::New(baton->cb);
+		deque<message_received_cb_baton_t*> batch;
+		{
+			AutoMutex lock(connection->deliveryMutex);
+			batch.swap(connection->deliveries);
+		}
 
-		delete baton;
+		unsigned long long done = 0;
+
+		for (size_t i = 0; i < batch.size(); i++) {
+			message_received_cb_baton_t* baton = batch[i];
+
+			/* Each distinct payload becomes one JS value shared by every
+			 * consumer that receives it. */
+			vector< Local<Value> > values(baton->payloads.size());
+			Local<Value> seq = Number::New(baton->seq);
+			Local<Value> subject = String::New(baton->subject.c_str(), baton->subject.size());
+
+			if (TraceBuffer::Enabled() || GMSECJS_PROBE_ENABLED(message__dequeue)) {
+				uint64_t now = uv_hrtime();
+				GMSECJS_PROBE4(message__dequeue, baton->subject.c_str(), baton->seq, batch.size() - i - 1,
+				               baton->enqueued != 0 ? now - baton->enqueued : 0);
+				if (baton->enqueued != 0 && TraceBuffer::Enabled())
+					TraceBuffer::Record(TraceBuffer::QUEUE_WAIT, baton->subject.c_str(), baton->seq, baton->enqueued, now);
+			}
+
+			while (baton->nextConsumer < baton->consumers.size()) {
+				size_t index = baton->payloadIndex[baton->nextConsumer];
+				Consumer *consumer = baton->consumers[baton->nextConsumer];
+				baton->nextConsumer++;
+
+				if (consumer->removed) {
+					GMSECJS_PROBE2(message__drop, baton->subject.c_str(), PROBE_DROP_UNSUBSCRIBED);
+					continue;
+				}
+
+				if (values[index].IsEmpty()) {
+					const string &payload = baton->payloads[index];
+					if (baton->compressed[index])
+						values[index] = Local<Object>::New(Buffer::New(payload.data(), payload.size())->handle_);
+					else
+						values[index] = String::New(payload.data(), payload.size());
+				}
+
+				Local<Value> argv[3];
+				argv[0] = values[index];
+				argv[1] = seq;
+				argv[2] = subject;
+
+				bool timed = TraceBuffer::Enabled() || GMSECJS_PROBE_ENABLED(callback__end);
+				uint64_t started = timed ? uv_hrtime() : 0;
+				GMSECJS_PROBE2(callback__start, baton->subject.c_str(), baton->seq);
+
+				TryCatch try_catch;
+				consumer->cb->Call(Context::GetCurrent()->Global(), 3, argv);
+
+				if (timed) {
+					uint64_t now = uv_hrtime();
+					GMSECJS_PROBE3(callback__end, baton->subject.c_str(), baton->seq, now - started);
+					if (TraceBuffer::Enabled())
+						TraceBuffer::Record(TraceBuffer::CALLBACK, baton->subject.c_str(), baton->seq, started, now);
+				}
+
+				if (try_catch.HasCaught()) {
+					/* Requeue what is left, this message included, so nothing
+					 * is lost if an uncaughtException listener handles it. */
+					size_t rest = baton->nextConsumer < baton->consumers.size() ? i : i + 1;
+					if (rest > i) {
+						delete baton;
+						done++;
+					}
+
+					AutoMutex lock(connection->deliveryMutex);
+					connection->deliveriesDone += done;
+					connection->deliveries.insert(connection->deliveries.begin(), batch.begin() + rest, batch.end());
+					uv_async_send(&connection->async);
+					FatalException(try_catch);
+					return;
+				}
+			}
+
+			delete baton;
+			done++;
+		}
 
-		TryCatch try_catch;
-		cb->Call(Context::GetCurrent()->Global(), 1, argv);
+		{
+			AutoMutex lock(connection->deliveryMutex);
+			connection->deliveriesDone += done;
+		}
 
-		if (try_catch.HasCaught())
-			FatalException(try_catch);
+		connection->PurgeRetiredConsumers();
+		connection->CheckBacktest();
+		connection->FinishPublishes();
+		connection->FinishGathers();
+	}
+
+	void RetireConsumer(Consumer *consumer){
+		consumer->removed = true;
 
+		AutoMutex lock(deliveryMutex);
+		retiredConsumers.push_back(make_pair(deliveriesQueued, consumer));
+	}
+
+	void PurgeRetiredConsumers(){
+		size_t kept = 0;
+		for (size_t i = 0; i < retiredConsumers.size(); i++) {
+			if (retiredConsumers[i].first <= deliveriesDone) {
+				retiredConsumers[i].second->cb.Dispose();
+				delete retiredConsumers[i].second;
+			}
+			else {
+				retiredConsumers[kept++] = retiredConsumers[i];
+			}
+		}
+		retiredConsumers.resize(kept);
 	}
 
 	static void Init(Handle<Object> target){
@@ -142,18 +858,106 @@ public:
 		s_ct->SetClassName(String::NewSymbol("Connection"));
 
 		NODE_SET_PROTOTYPE_METHOD(s_ct, "Connect", Connect);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "ConnectLocal", ConnectLocal);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "Backtest", RunBacktest);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "Generate", Generate);
 		NODE_SET_PROTOTYPE_METHOD(s_ct, "Subscribe", Subscribe);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "SubscribeMany", SubscribeMany);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "Unsubscribe", Unsubscribe);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "ConfigureRouting", ConfigureRouting);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "RoutingStats", RoutingStats);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "ResourceStats", ResourceStats);
 		NODE_SET_PROTOTYPE_METHOD(s_ct, "Publish", Publish);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "ConfigurePublishing", ConfigurePublishing);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "PublishingStats", PublishingStats);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "RequestAll", RequestAll);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "StartHeartbeat", StartHeartbeat);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "StopHeartbeat", StopHeartbeat);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "HeartbeatStats", HeartbeatStats);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "CreateHistory", CreateHistory);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "CreateEphemeris", CreateEphemeris);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "CreateRecorder", CreateRecorder);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "ConfigureReplay", ConfigureReplay);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "Replay", Replay);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "SaveSubscriptions", SaveSubscriptions);
+		NODE_SET_PROTOTYPE_METHOD(s_ct, "RestoreSubscriptions", RestoreSubscriptions);
 
 		target->Set(String::NewSymbol("Connection"), s_ct->GetFunction());
-
-		uv_async_init(uv_default_loop(), &async, OnMessageAsync);
 	}
 
-	Connection(){
+	Connection() : gmsecConnection(NULL), local(false), backtest(NULL), routerBusy(false), heartbeat(NULL),
+	               publishesQueued(0), deliveriesQueued(0), deliveriesDone(0), requestEpoch(uv_hrtime()),
+	               requestsSent(0), closing(false), openHandles(3){
+		publishTarget = new QueuedPublisher(this);
+		publisher = new PublishQueue(publishTarget);
+
+		sequencer = new ReplaySequencer(replayWindow);
+		router.SetSequencer(sequencer);
 	}
 
 	~Connection(){
+		/* Nothing publishes once the publisher thread has stopped. */
+		publisher->Stop(unpublished);
+		for (size_t i = 0; i < unpublished.size(); i++) {
+			publish_baton_t *baton = static_cast<publish_baton_t*>(unpublished[i]);
+			delete[] baton->message_contents;
+			delete baton;
+		}
+		delete publisher;
+		delete publishTarget;
+
+		router.SetSequencer(NULL);
+		delete sequencer;
+
+		delete heartbeat;
+		delete backtest;
+
+		for (size_t i = 0; i < historyTargets.size(); i++)
+			delete historyTargets[i];
+		for (size_t i = 0; i < histories.size(); i++)
+			delete histories[i];
+
+		for (size_t i = 0; i < ephemerisTargets.size(); i++)
+			delete ephemerisTargets[i];
+		for (size_t i = 0; i < ephemerides.size(); i++)
+			delete ephemerides[i];
+
+		for (size_t i = 0; i < recorderTargets.size(); i++)
+			delete recorderTargets[i];
+		for (size_t i = 0; i < recorders.size(); i++)
+			delete recorders[i];
+
+		/* Queued deliveries only point at consumers, which the routes and
+		 * the retired list own. */
+		for (size_t i = 0; i < deliveries.size(); i++)
+			delete deliveries[i];
+
+		map<string, Route*>::iterator it;
+		for (it = routes.begin(); it != routes.end(); ++it) {
+			for (size_t i = 0; i < it->second->consumers.size(); i++) {
+				it->second->consumers[i]->cb.Dispose();
+				delete it->second->consumers[i];
+			}
+			delete it->second;
+		}
+
+		for (size_t i = 0; i < retiredConsumers.size(); i++) {
+			retiredConsumers[i].second->cb.Dispose();
+			delete retiredConsumers[i].second;
+		}
+
+		for (size_t i = 0; i < routerBatches.size(); i++) {
+			for (size_t j = 0; j < routerBatches[i]->publishes.size(); j++) {
+				delete[] routerBatches[i]->publishes[j]->message_contents;
+				delete routerBatches[i]->publishes[j];
+			}
+			routerBatches[i]->cb.Dispose();
+			delete routerBatches[i];
+		}
+
+		map<unsigned long long, Persistent<Function> >::iterator gather;
+		for (gather = gatherCallbacks.begin(); gather != gatherCallbacks.end(); ++gather)
+			gather->second.Dispose();
 	}
 
 	static Handle<Value> New(const Arguments& args){
@@ -161,10 +965,99 @@ public:
 
 	    Connection *connection = new Connection();
 
+	    uv_async_init(uv_default_loop(), &connection->async, OnMessageAsync);
+	    connection->async.data = connection;
+
+	    /* Consolidation decisions are revisited as traffic is measured; the
+	     * timer alone does not keep the process alive. */
+	    uv_timer_init(uv_default_loop(), &connection->reviewTimer);
+	    connection->reviewTimer.data = connection;
+	    uv_timer_start(&connection->reviewTimer, OnReviewTimer, 1000, 1000);
+	    uv_unref((uv_handle_t*) &connection->reviewTimer);
+
+	    uv_timer_init(uv_default_loop(), &connection->gatherTimer);
+	    connection->gatherTimer.data = connection;
+	    uv_unref((uv_handle_t*) &connection->gatherTimer);
+
 	    connection->Wrap(args.This());
+	    connection->MakeCollectable();
 	    return args.This();
 	}
 
+	/*
+	 * ObjectWrap deletes a collected object straight away, but the dispatch
+	 * thread, the publisher and the loop may all still call into this one.
+	 * It is shut down first instead: no callback reaches it once its
+	 * subscriptions, threads and handles are gone. Thread pool work in
+	 * flight keeps the object referenced.
+	 */
+	void MakeCollectable(){
+		handle_.MakeWeak(this, OnCollected);
+		handle_.MarkIndependent();
+	}
+
+	void Unref(){
+		ObjectWrap::Unref();
+		if (refs_ == 0)
+			MakeCollectable();
+	}
+
+	static void OnCollected(Persistent<Value> value, void *data){
+		Connection *connection = static_cast<Connection*>(data);
+		connection->handle_->SetPointerInInternalField(0, NULL);
+		connection->handle_.Dispose();
+		connection->handle_.Clear();
+		connection->closing = true;
+
+		uv_close((uv_handle_t*) &connection->reviewTimer, OnHandleClosed);
+		uv_close((uv_handle_t*) &connection->gatherTimer, OnHandleClosed);
+
+		uv_work_t *req = new uv_work_t;
+		req->data = connection;
+
+		uv_queue_work(uv_default_loop(), req, EIO_Shutdown, (uv_after_work_cb)EIO_AfterShutdown);
+	}
+
+	static void EIO_Shutdown(uv_work_t *req){
+		Connection *connection = static_cast<Connection*>(req->data);
+
+		connection->publisher->Stop(connection->unpublished);
+		if (connection->heartbeat != NULL)
+			connection->heartbeat->Stop();
+
+		MiddlewareApi::Connection *gmsecConnection = connection->gmsecConnection;
+		if (gmsecConnection == NULL)
+			return;
+
+		/* No callback runs once the dispatch thread has stopped. */
+		MiddlewareApi *api = MiddlewareApi::Get();
+		api->StopDispatch(gmsecConnection);
+
+		string error;
+		vector<Router::Subscription*> subscriptions;
+		connection->router.Active(subscriptions);
+		for (size_t i = 0; i < subscriptions.size(); i++)
+			if (subscriptions[i]->registration != NULL)
+				api->Unsubscribe(gmsecConnection, subscriptions[i]->registration, error);
+
+		api->Disconnect(gmsecConnection);
+		connection->gmsecConnection = NULL;
+	}
+
+	/* Nothing sends to the async any more. */
+	static void EIO_AfterShutdown(uv_work_t *req){
+		Connection *connection = static_cast<Connection*>(req->data);
+		delete req;
+
+		uv_close((uv_handle_t*) &connection->async, OnHandleClosed);
+	}
+
+	static void OnHandleClosed(uv_handle_t *handle){
+		Connection *connection = static_cast<Connection*>(handle->data);
+		if (--connection->openHandles == 0)
+			delete connection;
+	}
+
 	static Handle<Value> Publish(const Arguments& args){
 		HandleScope scope;
 
@@ -172,6 +1065,10 @@ public:
 
 		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
 
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
 		
 		//const char str2 = "string Literal";
 		char *message_contents = new char[ strlen(*String::AsciiValue(subscribeV8Str)) + 1 ];
@@ -187,160 +1084,1664 @@ public:
 		publish_baton_t *baton = new publish_baton_t();
 		baton->connection = connection;
 		baton->message_contents = message_contents;
-
-		 uv_work_t *req = new uv_work_t;
-		 req->data = baton;
-
-		/* Submit the subscription command to the thread pool and return. */
-		uv_queue_work(uv_default_loop(), req, EIO_Publish, (uv_after_work_cb)EIO_AfterPublish);
+		baton->gather = 0;
+		baton->prewarm = false;
+		connection->QueuePublish(baton);
 
 		return Undefined();
 	}
 
-	static void EIO_Publish(uv_work_t *req){
-		gmsec::Status result;
-
-		publish_baton_t *baton = static_cast<publish_baton_t*>(req->data);
+	/*
+	 * RequestAll(xml, {expected, timeoutMs, replySubject}, cb) publishes a
+	 * request once and collects the replies that carry its REQUEST-ID until
+	 * expected of them have arrived or timeoutMs has passed. A REQUEST-ID
+	 * already in the request is used as is; otherwise one is added. Replies
+	 * are taken from replySubject, by default the request's subject with
+	 * ".REPLY" appended, which is subscribed for as long as a gather waits
+	 * on it. Returns the REQUEST-ID and reports once as
+	 * cb(err, {requestId, replies, timedOut}), replies being the XML of each
+	 * reply in arrival order.
+	 */
+	static Handle<Value> RequestAll(const Arguments& args){
+		HandleScope scope;
 
-		/* Load the user data into a new message. */
-		gmsec::Message *msg;
-		baton->connection->gmsecConnection->CreateMessage(msg);
-		msg->FromXML(baton->message_contents);
+		REQ_STR_ARG(0, requestV8Str);
+		int cbIndex = (args.Length() > 1 && args[1]->IsFunction()) ? 1 : 2;
+		Local<Object> options = (cbIndex == 2 && args[1]->IsObject()) ? args[1]->ToObject() : Object::New();
+		REQ_FUN_ARG(cbIndex, cb);
 
-		const char *tmp;
-		msg->GetSubject(tmp);
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
 
-		baton->connection->gmsecConnection->Publish(msg);
-		baton->connection->gmsecConnection->DestroyMessage(msg);
-	}
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		double expected = GetNumberOption(options, "expected", 1);
+		double timeoutMs = GetNumberOption(options, "timeoutMs", 10000);
+		if (expected < 1 || expected != floor(expected))
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'expected' must be a positive integer")));
+		if (!(timeoutMs > 0))
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'timeoutMs' must be positive")));
+
+		string xml = *String::AsciiValue(requestV8Str);
+		string subject;
+		size_t end = xml.rfind("</MESSAGE>");
+		if (end == string::npos || !MessageRecord::SubjectFromXML(xml, subject))
+			return ThrowException(Exception::TypeError(
+						  String::New("Argument 0 must be a GMSEC message")));
+
+		string replySubject = GetStringOption(options, "replySubject", (subject + ".REPLY").c_str());
+
+		string requestId;
+		if (!MessageRecord::FieldFromXML(xml, REQUEST_ID_FIELD, requestId)) {
+			char id[64];
+			sprintf(id, "GMSECJS-%llx-%llu", (unsigned long long) connection->requestEpoch, ++connection->requestsSent);
+			requestId = id;
+			xml.insert(end, string("<FIELD TYPE=\"STRING\" NAME=\"") + REQUEST_ID_FIELD + "\">" + requestId + "</FIELD>");
+		}
 
-	static void EIO_AfterPublish(uv_work_t* req){
-		publish_baton_t *baton = static_cast<publish_baton_t *>(req->data);
+		uint64_t deadline = uv_hrtime() + (uint64_t) (timeoutMs * 1e6);
+		unsigned long long gather = connection->gathers.Begin(requestId, replySubject, (size_t) expected, deadline);
+		if (gather == 0)
+			return ThrowException(Exception::Error(
+						  String::New(("Already collecting replies to " + requestId).c_str())));
+
+		connection->gatherCallbacks[gather] = Persistent<Function>::New(cb);
+
+		vector<Router::Operation> ops;
+		map<string, Route*>::iterator it = connection->routes.find(replySubject);
+		if (it == connection->routes.end()) {
+			Route *route = new Route(connection);
+			route->gatherers = 1;
+			connection->routes.insert(make_pair(replySubject, route));
+			connection->router.Add(replySubject, route, ops);
+		}
+		else {
+			AutoMutex lock(it->second->consumersMutex);
+			it->second->gatherers++;
+		}
 
-		delete baton;
-		delete req;
-	}
+		char *message_contents = new char[xml.size() + 1];
+		strcpy(message_contents, xml.c_str());
 
-	static Handle<Value> Subscribe(const Arguments& args){
-		HandleScope scope;
+		publish_baton_t *baton = new publish_baton_t();
+		baton->connection = connection;
+		baton->message_contents = message_contents;
+		baton->gather = gather;
+		baton->prewarm = false;
 
-		REQ_STR_ARG(0, subscribeV8Str);
-		REQ_FUN_ARG(1, subscribeCb);
+		/* Router batches run in order, so a request held by the last one
+		 * goes out after every subscription queued before it. */
+		if (ops.empty() && !connection->routerBusy && connection->routerBatches.empty()) {
+			connection->QueuePublish(baton);
+		}
+		else if (ops.empty() && !connection->routerBatches.empty()) {
+			connection->routerBatches.back()->publishes.push_back(baton);
+		}
+		else {
+			subscribe_batch_baton_t *batch = new subscribe_batch_baton_t();
+			batch->connection = connection;
+			batch->ops.swap(ops);
+			batch->publishes.push_back(baton);
+			connection->QueueRouterBatch(batch);
+		}
 
-		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+		connection->ArmGatherTimer();
 
-		/* Create a new instance of the generic message callback and add it
-		 * to our collection so that we can track the various callback instances.
-		 * Note that we're going to refer to these when we Unsubscribe so that
-		 *  we can properly delete the instances of GenericPublichBallback.
-		 */
-		MessageReceivedCallback *gmsecCb = new MessageReceivedCallback();
-		gmsecCb->cb = Persistent<Function>::New(subscribeCb);
+		return scope.Close(String::New(requestId.c_str()));
+	}
 
-		/* Extract out the subject string from the V8::String object. */
-		char *subscribeStr = new char[ strlen(*String::AsciiValue(subscribeV8Str)) ];
-		strcpy(subscribeStr, *String::AsciiValue(subscribeV8Str));
+	/*
+	 * Reports finished gathers and lets go of reply routes nothing else
+	 * needs. Runs after deliveries, when the gather timer fires and when a
+	 * request fails to publish.
+	 */
+	void FinishGathers(){
+		HandleScope scope;
 
-		/* Log this subscription with the callback collection. */
-		connection->subscribeCallbacks.insert( make_pair(subscribeStr, gmsecCb) );
+		vector<ScatterGather::Result> results;
+		gathers.Collect(uv_hrtime(), results);
+
+		for (size_t i = 0; i < results.size(); i++) {
+			const ScatterGather::Result &result = results[i];
+
+			map<string, Route*>::iterator it = routes.find(result.replySubject);
+			if (it != routes.end()) {
+				bool empty;
+				{
+					AutoMutex lock(it->second->consumersMutex);
+					it->second->gatherers--;
+					empty = it->second->Unused();
+				}
+				if (empty)
+					DropRoute(it);
+			}
+
+			map<unsigned long long, Persistent<Function> >::iterator callback = gatherCallbacks.find(result.id);
+			if (callback == gatherCallbacks.end())
+				continue;
+			Local<Function> cb = Local<Function>::New(callback->second);
+			callback->second.Dispose();
+			gatherCallbacks.erase(callback);
+
+			Local<Array> replies = Array::New(result.replies.size());
+			for (size_t j = 0; j < result.replies.size(); j++)
+				replies->Set(j, String::New(result.replies[j].data(), result.replies[j].size()));
+
+			Local<Object> outcome = Object::New();
+			outcome->Set(String::NewSymbol("requestId"), String::New(result.correlationId.c_str()));
+			outcome->Set(String::NewSymbol("replies"), replies);
+			outcome->Set(String::NewSymbol("timedOut"), Boolean::New(result.timedOut));
+
+			Local<Value> argv[2];
+			argv[0] = result.error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(result.error.c_str()));
+			argv[1] = outcome;
+
+			TryCatch try_catch;
+			cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+			if (try_catch.HasCaught())
+				FatalException(try_catch);
+		}
 
-		/* Populate a baton to pass it to the eio library. */
-		message_baton_t *baton = new message_baton_t();
-		baton->connection = connection;
-		baton->subject = subscribeStr;
-		baton->gmsecCb = gmsecCb;
+		ArmGatherTimer();
+	}
 
-		 uv_work_t *req = new uv_work_t;
-		 req->data = baton;
+	void ArmGatherTimer(){
+		uint64_t deadline = gathers.NextDeadline();
+		if (deadline == 0) {
+			uv_timer_stop(&gatherTimer);
+			return;
+		}
 
-		/* Submit the subscription command to the thread pool and return. */
-		uv_queue_work(uv_default_loop(), req, EIO_Subscribe, (uv_after_work_cb)EIO_AfterSubscribe);
+		uint64_t now = uv_hrtime();
+		int64_t timeout = deadline > now ? (int64_t) ((deadline - now + 999999) / 1000000) : 0;
+		uv_timer_start(&gatherTimer, OnGatherTimer, timeout, 0);
+	}
 
-		return Undefined();
+	static void OnGatherTimer(uv_timer_t *handle, int status /*UNUSED*/){
+		static_cast<Connection*>(handle->data)->FinishGathers();
 	}
 
-	static void EIO_Subscribe(uv_work_t *req){
-		gmsec::Status result;
+	void QueuePublish(publish_baton_t *baton){
+		baton->enqueued = 0;
 
-		/* Extract out the baton and execute the subscribe command. */
-		message_baton_t *baton = static_cast<message_baton_t*>(req->data);
+		publishesQueued++;
+		if (TraceBuffer::Enabled() || GMSECJS_PROBE_ENABLED(publish__enqueue) || GMSECJS_PROBE_ENABLED(publish__done)) {
+			MessageRecord::SubjectFromXML(baton->message_contents, baton->subject);
+			baton->enqueued = uv_hrtime();
+			GMSECJS_PROBE2(publish__enqueue, baton->subject.c_str(), publishesQueued);
+		}
 
-		baton->connection->gmsecConnection->Subscribe(baton->subject, baton->gmsecCb);
+		/* Hand the publish to the publisher thread and return. */
+		publisher->Push(baton);
 	}
 
-	static void EIO_AfterSubscribe(uv_work_t* req){
-		HandleScope scope;
-
-		/* Extract out the baton */
-		message_baton_t *baton = static_cast<message_baton_t *>(req->data);
-
-		delete baton;
-		delete req;
+	static void ProbePublishDone(publish_baton_t *baton, bool failed){
+		if (GMSECJS_PROBE_ENABLED(publish__done))
+			GMSECJS_PROBE3(publish__done, baton->subject.c_str(),
+			               baton->enqueued != 0 ? uv_hrtime() - baton->enqueued : 0, failed);
 	}
 
-	static Handle<Value> Connect(const Arguments& args){
+	static Handle<Value> StartHeartbeat(const Arguments& args){
 		HandleScope scope;
 
-		REQ_STR_ARG(0, server);
-		REQ_FUN_ARG(1, cb);
+		REQ_STR_ARG(0, templateV8Str);
 
-		/* Extract out the server string from the V8::String object. */
-		char *serverStr = new char[ strlen(*String::AsciiValue(server)) ];
-		strcpy(serverStr, *String::AsciiValue(server));
+		if (args.Length() <= 1 || !args[1]->IsNumber() || args[1]->NumberValue() < 1)
+			return ThrowException(Exception::TypeError(
+						  String::New("Argument 1 must be a period in milliseconds")));
+
+		REQ_STR_ARG(2, counterV8Str);
 
 		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
 
-		connection_baton_t *baton = new connection_baton_t();
-		baton->connection = connection;
-		baton->cb = Persistent<Function>::New(cb);
-		baton->server = serverStr;
+		if (connection->gmsecConnection == NULL)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
 
-		uv_work_t *req = new uv_work_t;
-		req->data = baton;
+		if (connection->heartbeat == NULL)
+			connection->heartbeat = new Heartbeat(connection->gmsecConnection, connection->publishMutex);
 
-		uv_queue_work(uv_default_loop(), req, EIO_Connect, (uv_after_work_cb)EIO_AfterConnect);
+		/* The template is parsed once here; the heartbeat thread only rewrites
+		 * the counter and time fields of the prebuilt message. */
+		string error;
+		if (!connection->heartbeat->Start(*String::AsciiValue(templateV8Str),
+				(long) args[1]->NumberValue(), *String::AsciiValue(counterV8Str), error))
+			return ThrowException(Exception::Error(String::New(error.c_str())));
 
 		return Undefined();
 	}
 
-	static void EIO_Connect(uv_work_t *req){
-		gmsec::Status result;
+	static Handle<Value> StopHeartbeat(const Arguments& args){
+		HandleScope scope;
 
-		connection_baton_t *baton = static_cast<connection_baton_t*>(req->data);
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
 
-		gmsec::Config gmsecConfig = gmsec::Config();
-		gmsecConfig.AddValue("connectiontype", "gmsec_mb");
-		gmsecConfig.AddValue("server", baton->server);
-		gmsecConfig.AddValue("loglevel", "VERBOSE");
+		if (connection->heartbeat != NULL)
+			connection->heartbeat->Stop();
 
-		result = gmsec::ConnectionFactory::Create(&gmsecConfig, baton->connection->gmsecConnection);
-		
-		if(result.isError() == true){
-			printf(result.Get());
-			printf(result.GetString());
-		}
-		
-		result = baton->connection->gmsecConnection->Connect();
-		result = baton->connection->gmsecConnection->StartAutoDispatch();
+		return Undefined();
 	}
 
-	static void EIO_AfterConnect(uv_work_t* req){
-		
+	/*
+	 * HeartbeatStats() returns {running, beats, failures, error}: beats
+	 * published and failed since StartHeartbeat, and the middleware's error
+	 * while publishes are failing, otherwise null.
+	 */
+	static Handle<Value> HeartbeatStats(const Arguments& args){
 		HandleScope scope;
 
-		connection_baton_t *baton = static_cast<connection_baton_t *>(req->data);
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
 
-		TryCatch try_catch;
+		Heartbeat::Stats stats;
+		bool running = false;
+		if (connection->heartbeat != NULL) {
+			stats = connection->heartbeat->GetStats();
+			running = connection->heartbeat->IsRunning();
+		}
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("running"), Boolean::New(running));
+		result->Set(String::NewSymbol("beats"), Number::New((double) stats.beats));
+		result->Set(String::NewSymbol("failures"), Number::New((double) stats.failures));
+		result->Set(String::NewSymbol("error"), stats.error.empty() ?
+		            Local<Value>::New(Null()) : Local<Value>::New(String::New(stats.error.c_str())));
+
+		return scope.Close(result);
+	}
+
+	/*
+	 * Retires the publishes of finished batches. A request that could not
+	 * be published ends its gather.
+	 */
+	void FinishPublishes(){
+		vector<PublishQueue::Job*> done;
+		publisher->TakeDone(done);
+
+		for (size_t i = 0; i < done.size(); i++) {
+			publish_baton_t *baton = static_cast<publish_baton_t*>(done[i]);
+			publishesQueued--;
+
+			if (!baton->error.empty())
+				gathers.Fail(baton->gather, baton->error);
+
+			delete[] baton->message_contents;
+			delete baton;
+		}
+	}
+
+	/*
+	 * ConfigurePublishing({maxBatch, maxDelayUs}) bounds the publisher's
+	 * batches: a batch goes out once it holds maxBatch messages or its
+	 * oldest message has waited maxDelayUs, and at once when the publisher
+	 * was idle.
+	 */
+	static Handle<Value> ConfigurePublishing(const Arguments& args){
+		HandleScope scope;
+
+		OPT_OBJ_ARG(0, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		PublishQueue::Options defaults;
+		double maxBatch = GetNumberOption(options, "maxBatch", (double) defaults.maxBatch);
+		double maxDelayUs = GetNumberOption(options, "maxDelayUs", (double) defaults.maxDelayUs);
+		if (maxBatch < 1 || maxBatch > 65536)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'maxBatch' must be between 1 and 65536")));
+		if (maxDelayUs < 0 || maxDelayUs > 1000000)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'maxDelayUs' must be between 0 and 1000000")));
+
+		PublishQueue::Options publishOptions;
+		publishOptions.maxBatch = (size_t) maxBatch;
+		publishOptions.maxDelayUs = (long) maxDelayUs;
+		connection->publisher->Configure(publishOptions);
+
+		return Undefined();
+	}
+
+	/*
+	 * PublishingStats([reset]) reports how the publisher has been batching
+	 * since the connection was made or the last reset: batch sizes in power
+	 * of two buckets, why batches were flushed, and how long messages waited
+	 * for their batch.
+	 */
+	static Handle<Value> PublishingStats(const Arguments& args){
+		HandleScope scope;
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		bool reset = args.Length() > 0 && args[0]->BooleanValue();
+		PublishQueue::Stats stats = connection->publisher->GetStats(reset);
+		PublishQueue::Options options = connection->publisher->GetOptions();
+
+		/* Bucket i counts batches of 2^i to 2^(i+1) - 1 messages; trailing
+		 * empty buckets are left out. */
+		size_t buckets = PublishQueue::SIZE_BUCKETS;
+		while (buckets > 0 && stats.sizes[buckets - 1] == 0)
+			buckets--;
+		Local<Array> sizes = Array::New(buckets);
+		for (size_t i = 0; i < buckets; i++)
+			sizes->Set(i, Number::New((double) stats.sizes[i]));
+
+		Local<Object> flushes = Object::New();
+		flushes->Set(String::NewSymbol("idle"), Number::New((double) stats.flushes[PublishQueue::FLUSH_IDLE]));
+		flushes->Set(String::NewSymbol("full"), Number::New((double) stats.flushes[PublishQueue::FLUSH_FULL]));
+		flushes->Set(String::NewSymbol("deadline"), Number::New((double) stats.flushes[PublishQueue::FLUSH_DEADLINE]));
+
+		Local<Object> wait = Object::New();
+		wait->Set(String::NewSymbol("p50"), Number::New(stats.wait.Quantile(0.5) / 1e3));
+		wait->Set(String::NewSymbol("p90"), Number::New(stats.wait.Quantile(0.9) / 1e3));
+		wait->Set(String::NewSymbol("p99"), Number::New(stats.wait.Quantile(0.99) / 1e3));
+		wait->Set(String::NewSymbol("max"), Number::New(stats.wait.Max() / 1e3));
+		wait->Set(String::NewSymbol("mean"), Number::New(stats.wait.Mean() / 1e3));
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("maxBatch"), Number::New((double) options.maxBatch));
+		result->Set(String::NewSymbol("maxDelayUs"), Number::New((double) options.maxDelayUs));
+		result->Set(String::NewSymbol("batches"), Number::New((double) stats.batches));
+		result->Set(String::NewSymbol("messages"), Number::New((double) stats.jobs));
+		result->Set(String::NewSymbol("batchSizes"), sizes);
+		result->Set(String::NewSymbol("flushes"), flushes);
+		result->Set(String::NewSymbol("waitUs"), wait);
+
+		return scope.Close(result);
+	}
+
+	static Handle<Value> Subscribe(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, subscribeV8Str);
+
+		/* Options are optional: Subscribe(subject, [options], callback). */
+		int cbIndex = (args.Length() > 1 && args[1]->IsFunction()) ? 1 : 2;
+		Local<Object> options = (cbIndex == 2 && args[1]->IsObject()) ? args[1]->ToObject() : Object::New();
+		REQ_FUN_ARG(cbIndex, subscribeCb);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		string error;
+		Consumer *consumer = NewConsumer(options, subscribeCb, error);
+		if (consumer == NULL)
+			return ThrowException(Exception::TypeError(String::New(error.c_str())));
+
+		string subject = *String::AsciiValue(subscribeV8Str);
+
+		subscribe_batch_baton_t *baton = new subscribe_batch_baton_t();
+		baton->connection = connection;
+		connection->AddConsumer(subject, consumer, baton->ops);
+
+		/* Submit the subscription command to the thread pool and return. */
+		connection->QueueRouterBatch(baton);
+
+		return Undefined();
+	}
+
+	/*
+	 * Unsubscribe(subject, [callback]) removes the consumers registered with
+	 * callback, or all of them, and returns whether any were removed. The
+	 * middleware subscription goes away with the last consumer.
+	 */
+	static Handle<Value> Unsubscribe(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, subjectV8Str);
+
+		Local<Function> callback;
+		if (args.Length() > 1 && args[1]->IsFunction())
+			callback = Local<Function>::Cast(args[1]);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		string subject = *String::AsciiValue(subjectV8Str);
+		return scope.Close(Boolean::New(connection->RemoveConsumers(subject, callback)));
+	}
+
+	/* Retires the subject's consumers with the given callback, or all of
+	 * them without one. */
+	bool RemoveConsumers(const string &subject, Local<Function> callback){
+		map<string, Route*>::iterator it = routes.find(subject);
+		if (it == routes.end())
+			return false;
+
+		Route *route = it->second;
+		bool removed = false;
+		bool empty;
+		{
+			AutoMutex lock(route->consumersMutex);
+
+			size_t kept = 0;
+			for (size_t i = 0; i < route->consumers.size(); i++) {
+				Consumer *consumer = route->consumers[i];
+				if (callback.IsEmpty() || consumer->cb->StrictEquals(callback)) {
+					RetireConsumer(consumer);
+					removed = true;
+				}
+				else {
+					route->consumers[kept++] = consumer;
+				}
+			}
+			route->consumers.resize(kept);
+			empty = route->Unused();
+		}
+
+		if (empty)
+			DropRoute(it);
+
+		PurgeRetiredConsumers();
+
+		return removed;
+	}
+
+	/* For routes left without consumers or gatherers. */
+	void DropRoute(map<string, Route*>::iterator it){
+		/* Once the router lets go of the route no dispatch can reach it. */
+		subscribe_batch_baton_t *baton = new subscribe_batch_baton_t();
+		baton->connection = this;
+		router.Remove(it->first, baton->ops);
+		delete it->second;
+		routes.erase(it);
+
+		QueueRouterBatch(baton);
+	}
+
+	/*
+	 * ConfigureRouting({consolidate, minSiblings, maxOverDelivery, minSamples})
+	 * controls when sibling subjects share one wildcard subscription.
+	 */
+	static Handle<Value> ConfigureRouting(const Arguments& args){
+		HandleScope scope;
+
+		OPT_OBJ_ARG(0, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		bool consolidate = GetBoolOption(options, "consolidate", true);
+		double minSiblings = GetNumberOption(options, "minSiblings", 32);
+		double maxOverDelivery = GetNumberOption(options, "maxOverDelivery", 1.0);
+		double minSamples = GetNumberOption(options, "minSamples", 1000);
+		if (minSiblings < 2)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'minSiblings' must be at least 2")));
+		if (maxOverDelivery < 0 || minSamples < 0)
+			return ThrowException(Exception::RangeError(
+						  String::New("Options 'maxOverDelivery' and 'minSamples' must not be negative")));
+
+		connection->router.Configure(consolidate, (size_t) minSiblings, maxOverDelivery, (unsigned long long) minSamples);
+		connection->ReviewRoutes();
+
+		return Undefined();
+	}
+
+	static Handle<Value> RoutingStats(const Arguments& args){
+		HandleScope scope;
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		Router::Stats stats = connection->router.GetStats();
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("routes"), Number::New((double) stats.routes));
+		result->Set(String::NewSymbol("subscriptions"), Number::New((double) stats.subscriptions));
+		result->Set(String::NewSymbol("coveringSubscriptions"), Number::New((double) stats.coveringSubscriptions));
+		result->Set(String::NewSymbol("coveredWildcards"), Number::New((double) stats.coveredWildcards));
+		result->Set(String::NewSymbol("unmatched"), Number::New((double) stats.unmatched));
+
+		return scope.Close(result);
+	}
+
+	/*
+	 * ResourceStats() counts the native objects the connection holds. On a
+	 * steady workload every count levels off; one that keeps climbing is a
+	 * leak, which is what the soak harness watches for.
+	 */
+	static Handle<Value> ResourceStats(const Arguments& args){
+		HandleScope scope;
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		size_t consumers = 0;
+		map<string, Route*>::iterator it;
+		for (it = connection->routes.begin(); it != connection->routes.end(); ++it) {
+			AutoMutex lock(it->second->consumersMutex);
+			consumers += it->second->consumers.size();
+		}
+
+		size_t queuedDeliveries;
+		{
+			AutoMutex lock(connection->deliveryMutex);
+			queuedDeliveries = connection->deliveries.size();
+		}
+
+		size_t replaySubjects, replayMessages, replayBytes;
+		connection->replayWindow.Usage(replaySubjects, replayMessages, replayBytes);
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("routes"), Number::New((double) connection->routes.size()));
+		result->Set(String::NewSymbol("consumers"), Number::New((double) consumers));
+		result->Set(String::NewSymbol("retiredConsumers"), Number::New((double) connection->retiredConsumers.size()));
+		result->Set(String::NewSymbol("queuedDeliveries"), Number::New((double) queuedDeliveries));
+		result->Set(String::NewSymbol("queuedRouterBatches"), Number::New((double) connection->routerBatches.size()));
+		result->Set(String::NewSymbol("queuedPublishes"), Number::New((double) connection->publishesQueued));
+		result->Set(String::NewSymbol("replaySubjects"), Number::New((double) replaySubjects));
+		result->Set(String::NewSymbol("replayMessages"), Number::New((double) replayMessages));
+		result->Set(String::NewSymbol("replayBytes"), Number::New((double) replayBytes));
+		result->Set(String::NewSymbol("openGathers"), Number::New((double) connection->gathers.Open()));
+
+		return scope.Close(result);
+	}
+
+	static void OnReviewTimer(uv_timer_t *handle, int status /*UNUSED*/){
+		static_cast<Connection*>(handle->data)->ReviewRoutes();
+	}
+
+	void ReviewRoutes(){
+		vector<Router::Operation> ops;
+		router.Review(ops);
+		if (ops.empty())
+			return;
+
+		subscribe_batch_baton_t *baton = new subscribe_batch_baton_t();
+		baton->connection = this;
+		baton->ops.swap(ops);
+		QueueRouterBatch(baton);
+	}
+
+	/*
+	 * Builds a consumer from Subscribe() options, or returns NULL and the
+	 * reason in error.
+	 */
+	static Consumer *NewConsumer(Handle<Object> options, Handle<Function> cb, string &error){
+		Encoding encoding;
+		string encodingName = GetStringOption(options, "encoding", "xml");
+		if (encodingName == "xml")
+			encoding = ENCODING_XML;
+		else if (encodingName == "json")
+			encoding = ENCODING_JSON;
+		else if (encodingName == "delta")
+			encoding = ENCODING_DELTA;
+		else {
+			error = "Option 'encoding' must be 'xml', 'json' or 'delta'";
+			return NULL;
+		}
+
+		double keyframeInterval = GetNumberOption(options, "keyframeInterval", 100);
+		if (keyframeInterval < 1) {
+			error = "Option 'keyframeInterval' must be at least 1";
+			return NULL;
+		}
+
+		Compression compression;
+		string compressionName = GetStringOption(options, "compression", "none");
+		if (compressionName == "none")
+			compression = COMPRESSION_NONE;
+		else if (compressionName == "deflate")
+			compression = GetBoolOption(options, "dictionary", true) ? COMPRESSION_DEFLATE_DICTIONARY : COMPRESSION_DEFLATE;
+		else {
+			error = "Option 'compression' must be 'none' or 'deflate'";
+			return NULL;
+		}
+
+		Consumer *consumer = new Consumer(encoding, compression, (unsigned) keyframeInterval);
+		consumer->cb = Persistent<Function>::New(cb);
+		return consumer;
+	}
+
+	/*
+	 * Registers a consumer for the subject. A subject that is already
+	 * subscribed just gains a consumer; the middleware keeps delivering each
+	 * message once and the fan-out happens natively. Any middleware
+	 * operations a new route needs are appended to ops.
+	 */
+	void AddConsumer(const string &subject, Consumer *consumer, vector<Router::Operation> &ops){
+		map<string, Route*>::iterator existing = routes.find(subject);
+		if (existing != routes.end()) {
+			existing->second->AddConsumer(consumer);
+			return;
+		}
 
-		baton->cb->Call(Context::GetCurrent()->Global(), 0, NULL);
+		Route *route = new Route(this);
+		route->AddConsumer(consumer);
+
+		routes.insert( make_pair(subject, route) );
+		router.Add(subject, route, ops);
+	}
+
+	/* The same for a store, which is fed from the subject's route like a
+	 * consumer and so shares its subscription. */
+	void AddStore(const string &subject, Router::Target *store, vector<Router::Operation> &ops){
+		map<string, Route*>::iterator existing = routes.find(subject);
+		if (existing != routes.end()) {
+			existing->second->AddStore(store);
+			return;
+		}
+
+		Route *route = new Route(this);
+		route->AddStore(store);
+
+		routes.insert( make_pair(subject, route) );
+		router.Add(subject, route, ops);
+	}
+
+	/*
+	 * Subscribes a store through the router, so it shares consolidated
+	 * subscriptions and is fed by local connections and backtests. cb, if
+	 * it is a function, is called as cb(err) once the middleware
+	 * subscription serving the subject is in place or has failed.
+	 */
+	void SubscribeStore(const string &subject, Router::Target *store, Local<Value> cb){
+		subscribe_batch_baton_t *batch = new subscribe_batch_baton_t();
+		batch->connection = this;
+		AddStore(subject, store, batch->ops);
+		if (cb->IsFunction()) {
+			batch->subjects.push_back(subject);
+			batch->cb = Persistent<Function>::New(Local<Function>::Cast(cb));
+			batch->single = true;
+		}
+		QueueRouterBatch(batch);
+	}
+
+	/*
+	 * SubscribeMany([{subject, options, callback}], [onMessage], cb) registers
+	 * every entry up front and hands all new middleware subscriptions to one
+	 * thread pool job. Entries without their own callback use onMessage. The
+	 * outcome is reported once as cb(null, [{subject, error}]).
+	 */
+	static Handle<Value> SubscribeMany(const Arguments& args){
+		HandleScope scope;
+
+		if (args.Length() < 1 || !args[0]->IsArray())
+			return ThrowException(Exception::TypeError(
+						  String::New("Argument 0 must be an array of subscriptions")));
+
+		int cbIndex = (args.Length() > 2 && args[2]->IsFunction()) ? 2 : 1;
+		REQ_FUN_ARG(cbIndex, cb);
+		Local<Function> onMessage;
+		if (cbIndex == 2)
+			onMessage = Local<Function>::Cast(args[1]);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		Local<Array> list = Local<Array>::Cast(args[0]);
+		Local<String> subjectKey = String::NewSymbol("subject");
+		Local<String> optionsKey = String::NewSymbol("options");
+		Local<String> callbackKey = String::NewSymbol("callback");
+
+		/* Validate everything before registering anything so a bad entry
+		 * does not leave half the list subscribed. */
+		vector<Consumer*> consumers;
+		vector<string> subjects;
+		for (uint32_t i = 0; i < list->Length(); i++) {
+			string error;
+			Local<Value> item = list->Get(i);
+			Local<Object> entry = item->IsObject() ? item->ToObject() : Object::New();
+			Local<Value> subject = entry->Get(subjectKey);
+			Local<Value> options = entry->Get(optionsKey);
+			Local<Value> callback = entry->Get(callbackKey);
+
+			if (!subject->IsString())
+				error = "'subject' must be a string";
+			else if (!callback->IsFunction() && onMessage.IsEmpty())
+				error = "'callback' must be a function when no onMessage callback is given";
+
+			Consumer *consumer = NULL;
+			if (error.empty())
+				consumer = NewConsumer(options->IsObject() ? options->ToObject() : Object::New(),
+				                       callback->IsFunction() ? Local<Function>::Cast(callback) : onMessage, error);
+
+			if (consumer == NULL) {
+				for (size_t j = 0; j < consumers.size(); j++) {
+					consumers[j]->cb.Dispose();
+					delete consumers[j];
+				}
+
+				char index[16];
+				sprintf(index, "%u", i);
+				return ThrowException(Exception::TypeError(
+							  String::New(("Subscription " + string(index) + ": " + error).c_str())));
+			}
+
+			consumers.push_back(consumer);
+			subjects.push_back(*String::AsciiValue(subject));
+		}
+
+		subscribe_batch_baton_t *baton = new subscribe_batch_baton_t();
+		baton->connection = connection;
+		baton->cb = Persistent<Function>::New(cb);
+		baton->subjects = subjects;
+
+		/* Registering the whole list before anything is issued lets the
+		 * router cover sibling subjects without subscribing them one by one. */
+		for (size_t i = 0; i < consumers.size(); i++)
+			connection->AddConsumer(subjects[i], consumers[i], baton->ops);
+
+		connection->QueueRouterBatch(baton);
+
+		return Undefined();
+	}
+
+	/*
+	 * SaveSubscriptions(path, cb) writes the subjects and delivery options
+	 * of every Subscribe() consumer to a compact file on the thread pool.
+	 */
+	static Handle<Value> SaveSubscriptions(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, pathV8Str);
+		REQ_FUN_ARG(1, cb);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		snapshot_baton_t *baton = new snapshot_baton_t();
+		baton->connection = connection;
+		baton->path = *String::Utf8Value(pathV8Str);
+		baton->cb = Persistent<Function>::New(cb);
+
+		/* The table is only modified on this thread, so it is copied here and
+		 * the file is written without holding anything. */
+		map<string, Route*>::iterator it;
+		for (it = connection->routes.begin(); it != connection->routes.end(); ++it) {
+			AutoMutex lock(it->second->consumersMutex);
+			for (size_t i = 0; i < it->second->consumers.size(); i++) {
+				Consumer *consumer = it->second->consumers[i];
+				SubscriptionSnapshot::Entry entry;
+				entry.subject = it->first;
+				entry.encoding = (unsigned char) consumer->encoding;
+				entry.compression = (unsigned char) consumer->compression;
+				entry.keyframeInterval = consumer->keyframeInterval;
+				baton->entries.push_back(entry);
+			}
+		}
+
+		uv_work_t *req = new uv_work_t;
+		req->data = baton;
+
+		uv_queue_work(uv_default_loop(), req, EIO_SaveSubscriptions, (uv_after_work_cb)EIO_AfterSaveSubscriptions);
+
+		return Undefined();
+	}
+
+	static void EIO_SaveSubscriptions(uv_work_t *req){
+		snapshot_baton_t *baton = static_cast<snapshot_baton_t*>(req->data);
+
+		SubscriptionSnapshot::Write(baton->path, baton->entries, baton->error);
+	}
+
+	static void EIO_AfterSaveSubscriptions(uv_work_t *req){
+		HandleScope scope;
+
+		snapshot_baton_t *baton = static_cast<snapshot_baton_t*>(req->data);
+
+		Local<Value> argv[2];
+		argv[0] = baton->error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(baton->error.c_str()));
+		argv[1] = Integer::NewFromUnsigned((uint32_t) baton->entries.size());
+
+		TryCatch try_catch;
+		baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+		if (try_catch.HasCaught())
+			FatalException(try_catch);
+
+		baton->cb.Dispose();
+		delete baton;
+		delete req;
+	}
+
+	/*
+	 * RestoreSubscriptions(path, onMessage, cb) reads a snapshot, registers
+	 * every entry with onMessage as its callback and issues all resulting
+	 * middleware subscriptions in one thread pool job. onMessage receives
+	 * the subject as its third argument to tell the subscriptions apart.
+	 */
+	static Handle<Value> RestoreSubscriptions(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, pathV8Str);
+		REQ_FUN_ARG(1, onMessage);
+		REQ_FUN_ARG(2, cb);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		snapshot_baton_t *baton = new snapshot_baton_t();
+		baton->connection = connection;
+		baton->path = *String::Utf8Value(pathV8Str);
+		baton->cb = Persistent<Function>::New(cb);
+		baton->onMessage = Persistent<Function>::New(onMessage);
+		connection->Ref();
+
+		uv_work_t *req = new uv_work_t;
+		req->data = baton;
+
+		uv_queue_work(uv_default_loop(), req, EIO_RestoreSubscriptions, (uv_after_work_cb)EIO_AfterRestoreSubscriptions);
+
+		return Undefined();
+	}
+
+	static void EIO_RestoreSubscriptions(uv_work_t *req){
+		snapshot_baton_t *baton = static_cast<snapshot_baton_t*>(req->data);
+
+		SubscriptionSnapshot::Read(baton->path, baton->entries, baton->error);
+	}
+
+	static void EIO_AfterRestoreSubscriptions(uv_work_t *req){
+		HandleScope scope;
+
+		snapshot_baton_t *baton = static_cast<snapshot_baton_t*>(req->data);
+		Connection *connection = baton->connection;
+
+		if (!baton->error.empty()) {
+			Local<Value> argv[1] = { Exception::Error(String::New(baton->error.c_str())) };
+
+			TryCatch try_catch;
+			baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
+			if (try_catch.HasCaught())
+				FatalException(try_catch);
+
+			baton->cb.Dispose();
+			baton->onMessage.Dispose();
+			delete baton;
+			delete req;
+			connection->Unref();
+			return;
+		}
+
+		subscribe_batch_baton_t *batch = new subscribe_batch_baton_t();
+		batch->connection = connection;
+		batch->cb = baton->cb;
+		batch->subjects.reserve(baton->entries.size());
+
+		for (size_t i = 0; i < baton->entries.size(); i++) {
+			const SubscriptionSnapshot::Entry &entry = baton->entries[i];
+
+			/* Entries from a newer build with options this one does not know
+			 * fall back to plain XML rather than failing the whole restore. */
+			Encoding encoding = entry.encoding < ENCODING_COUNT ? (Encoding) entry.encoding : ENCODING_XML;
+			Compression compression = entry.compression < COMPRESSION_COUNT ? (Compression) entry.compression : COMPRESSION_NONE;
+			unsigned keyframeInterval = entry.keyframeInterval > 0 ? entry.keyframeInterval : 1;
+
+			Consumer *consumer = new Consumer(encoding, compression, keyframeInterval);
+			consumer->cb = Persistent<Function>::New(baton->onMessage);
+
+			batch->subjects.push_back(entry.subject);
+			connection->AddConsumer(entry.subject, consumer, batch->ops);
+		}
+
+		baton->onMessage.Dispose();
+		delete baton;
+		delete req;
+
+		connection->QueueRouterBatch(batch);
+		connection->Unref();
+	}
+
+	/*
+	 * Batches run strictly one after another; an unsubscribe must never
+	 * overtake the subscribe it undoes.
+	 */
+	void QueueRouterBatch(subscribe_batch_baton_t *baton){
+		if (baton->ops.empty() && baton->cb.IsEmpty() && baton->publishes.empty()) {
+			delete baton;
+			return;
+		}
+
+		routerBatches.push_back(baton);
+		RunRouterBatch();
+	}
+
+	void RunRouterBatch(){
+		if (routerBusy)
+			return;
+
+		if (routerBatches.empty()) {
+			StartBacktest();
+			return;
+		}
+
+		subscribe_batch_baton_t *baton = routerBatches.front();
+		routerBatches.pop_front();
+		routerBusy = true;
+		Ref();
+
+		/* Owners are looked up once all of the batch's routes are in place,
+		 * so subjects that were folded into one covering subscription share
+		 * its outcome. */
+		for (size_t i = 0; i < baton->subjects.size(); i++)
+			baton->owners.push_back(router.OwnerPattern(baton->subjects[i]));
+
+		uv_work_t *req = new uv_work_t;
+		req->data = baton;
+
+		uv_queue_work(uv_default_loop(), req, EIO_SubscribeBatch, (uv_after_work_cb)EIO_AfterSubscribeBatch);
+	}
+
+	static void EIO_SubscribeBatch(uv_work_t *req){
+		subscribe_batch_baton_t *baton = static_cast<subscribe_batch_baton_t*>(req->data);
+		MiddlewareApi::Connection *gmsecConnection = baton->connection->gmsecConnection;
+
+		baton->errors.resize(baton->ops.size());
+		for (size_t i = 0; i < baton->ops.size(); i++) {
+			Router::Subscription *subscription = baton->ops[i].subscription;
+
+			/* Nothing to tell a middleware; the router's bookkeeping is all
+			 * a local connection needs. */
+			if (baton->connection->local)
+				continue;
+
+			if (gmsecConnection == NULL) {
+				baton->errors[i] = "Connection is not connected";
+				continue;
+			}
+
+			MiddlewareApi *api = MiddlewareApi::Get();
+			if (baton->ops[i].kind == Router::Operation::SUBSCRIBE) {
+				subscription->registration = api->Subscribe(gmsecConnection, subscription->Pattern().c_str(),
+				                                            subscription, baton->errors[i]);
+			}
+			else if (subscription->registration != NULL &&
+			         api->Unsubscribe(gmsecConnection, subscription->registration, baton->errors[i])) {
+				subscription->registration = NULL;
+			}
+		}
+	}
+
+	/*
+	 * Hands the results to the router, which may answer with more work, and
+	 * reports the batch as cb(null, [{subject, error}]) where error is null
+	 * for subjects that subscribed successfully.
+	 */
+	static void EIO_AfterSubscribeBatch(uv_work_t *req){
+		HandleScope scope;
+
+		subscribe_batch_baton_t *baton = static_cast<subscribe_batch_baton_t*>(req->data);
+		Connection *connection = baton->connection;
+
+		map<string, string> failed;
+		vector<Router::Operation> followUp;
+		for (size_t i = 0; i < baton->ops.size(); i++) {
+			const Router::Operation &op = baton->ops[i];
+			if (op.kind == Router::Operation::SUBSCRIBE && !baton->errors[i].empty())
+				failed[op.subscription->Pattern()] = baton->errors[i];
+
+			connection->router.Completed(op, baton->errors[i].empty(), followUp);
+		}
+
+		/* The batch's subscriptions have completed, so replies to the held
+		 * requests have somewhere to go. */
+		for (size_t i = 0; i < baton->publishes.size(); i++)
+			connection->QueuePublish(baton->publishes[i]);
+
+		connection->routerBusy = false;
+		if (!followUp.empty()) {
+			subscribe_batch_baton_t *next = new subscribe_batch_baton_t();
+			next->connection = connection;
+			next->ops.swap(followUp);
+			connection->routerBatches.push_front(next);
+		}
+		connection->RunRouterBatch();
+
+		Local<Array> results = Array::New(baton->subjects.size());
+		for (size_t i = 0; i < baton->subjects.size(); i++) {
+			map<string, string>::iterator error = failed.find(baton->owners[i]);
+
+			Local<Object> result = Object::New();
+			result->Set(String::NewSymbol("subject"), String::New(baton->subjects[i].c_str()));
+			result->Set(String::NewSymbol("error"), error == failed.end() ?
+			            Local<Value>::New(Null()) : Local<Value>::New(String::New(error->second.c_str())));
+			results->Set(i, result);
+		}
+
+		if (!baton->cb.IsEmpty()) {
+			Local<Value> argv[2];
+			argv[0] = Local<Value>::New(Null());
+			argv[1] = results;
+			if (baton->single) {
+				map<string, string>::iterator error = failed.find(baton->owners[0]);
+				if (error != failed.end())
+					argv[0] = Exception::Error(String::New(error->second.c_str()));
+			}
+
+			TryCatch try_catch;
+			baton->cb->Call(Context::GetCurrent()->Global(), baton->single ? 1 : 2, argv);
+
+			if (try_catch.HasCaught())
+				FatalException(try_catch);
+
+			baton->cb.Dispose();
+		}
+
+		delete baton;
+		delete req;
+		connection->Unref();
+	}
+
+	/*
+	 * CreateHistory(subject, options, [cb]) keeps recent messages of the
+	 * subject per key. cb(err) reports whether the subscription feeding it
+	 * came up.
+	 */
+	static Handle<Value> CreateHistory(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, subjectV8Str);
+		OPT_OBJ_ARG(1, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		string keyField = GetStringOption(options, "key", "");
+		if (keyField.empty())
+			return ThrowException(Exception::TypeError(
+						  String::New("Option 'key' must name the field to group history by")));
+
+		vector<string> fields;
+		Local<Value> fieldsValue = options->Get(String::NewSymbol("fields"));
+		if (fieldsValue->IsArray()) {
+			Local<Array> fieldsArray = Local<Array>::Cast(fieldsValue);
+			for (uint32_t i = 0; i < fieldsArray->Length(); i++)
+				fields.push_back(*String::Utf8Value(fieldsArray->Get(i)));
+		}
+
+		double capacity = GetNumberOption(options, "capacity", 1024);
+		double maxKeys = GetNumberOption(options, "maxKeys", 64);
+		if (capacity < 1 || maxKeys < 1)
+			return ThrowException(Exception::RangeError(
+						  String::New("Options 'capacity' and 'maxKeys' must be positive")));
+
+		HistoryStore *store = new HistoryStore(keyField, fields, (size_t) capacity, (size_t) maxKeys);
+		History::RecordTarget *target = new History::RecordTarget(store);
+
+		connection->histories.push_back(store);
+		connection->historyTargets.push_back(target);
+
+		/* The history fills from the dispatch thread without involving JS. */
+		connection->SubscribeStore(*String::AsciiValue(subjectV8Str), target, args[args.Length() - 1]);
+
+		return scope.Close(History::NewInstance(store, args.This()));
+	}
+
+	/*
+	 * CreateEphemeris(subject, [options], [cb]) keeps the orbit states of
+	 * every spacecraft on the subject for interpolation. Defaults match the
+	 * FreeFlyer position updates. cb(err) is called as for CreateHistory.
+	 */
+	static Handle<Value> CreateEphemeris(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, subjectV8Str);
+		OPT_OBJ_ARG(1, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		static const char *POSITION[] = { "X", "Y", "Z" };
+		static const char *VELOCITY[] = { "DX", "DY", "DZ" };
+
+		vector<string> positionFields(POSITION, POSITION + 3);
+		vector<string> velocityFields(VELOCITY, VELOCITY + 3);
+
+		Local<Value> positionValue = options->Get(String::NewSymbol("position"));
+		Local<Value> velocityValue = options->Get(String::NewSymbol("velocity"));
+		if (positionValue->IsArray()) {
+			Local<Array> array = Local<Array>::Cast(positionValue);
+			if (array->Length() != 3)
+				return ThrowException(Exception::TypeError(
+							  String::New("Option 'position' must name three fields")));
+			for (uint32_t i = 0; i < 3; i++)
+				positionFields[i] = *String::Utf8Value(array->Get(i));
+		}
+		if (velocityValue->IsArray()) {
+			Local<Array> array = Local<Array>::Cast(velocityValue);
+			if (array->Length() != 3 && array->Length() != 0)
+				return ThrowException(Exception::TypeError(
+							  String::New("Option 'velocity' must name three fields, or none")));
+			velocityFields.resize(array->Length());
+			for (uint32_t i = 0; i < array->Length(); i++)
+				velocityFields[i] = *String::Utf8Value(array->Get(i));
+		}
+
+		double capacity = GetNumberOption(options, "capacity", 4096);
+		double maxKeys = GetNumberOption(options, "maxKeys", 64);
+		if (capacity < 2 || maxKeys < 1)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'capacity' must be at least 2 and 'maxKeys' positive")));
+
+		EphemerisStore *store = new EphemerisStore(GetStringOption(options, "key", "SCName"),
+		                                           GetStringOption(options, "epoch", "EpochText"),
+		                                           positionFields, velocityFields,
+		                                           (size_t) capacity, (size_t) maxKeys);
+		Ephemeris::RecordTarget *target = new Ephemeris::RecordTarget(store);
+
+		connection->ephemerides.push_back(store);
+		connection->ephemerisTargets.push_back(target);
+
+		connection->SubscribeStore(*String::AsciiValue(subjectV8Str), target, args[args.Length() - 1]);
+
+		return scope.Close(Ephemeris::NewInstance(store, args.This()));
+	}
+
+	/*
+	 * CreateRecorder(subject, directory, [options], [cb]) records the
+	 * subject into compressed segments under directory from a native
+	 * thread. cb(err) is called as for CreateHistory.
+	 */
+	static Handle<Value> CreateRecorder(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, subjectV8Str);
+		REQ_STR_ARG(1, directoryV8Str);
+		OPT_OBJ_ARG(2, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		SegmentRecorder::Options recorderOptions;
+		recorderOptions.directory = *String::Utf8Value(directoryV8Str);
+
+		double blockBytes = GetNumberOption(options, "blockBytes", (double) recorderOptions.blockBytes);
+		double flushMs = GetNumberOption(options, "flushMs", (double) recorderOptions.flushMs);
+		double segmentBytes = GetNumberOption(options, "segmentBytes", (double) recorderOptions.segmentBytes);
+		double level = GetNumberOption(options, "level", recorderOptions.level);
+		double maxQueuedBlocks = GetNumberOption(options, "maxQueuedBlocks", (double) recorderOptions.maxQueuedBlocks);
+		if (blockBytes < 1024 || flushMs < 1 || segmentBytes < blockBytes || maxQueuedBlocks < 1)
+			return ThrowException(Exception::RangeError(
+						  String::New("Options 'blockBytes' (at least 1024), 'flushMs', 'segmentBytes' and 'maxQueuedBlocks' are out of range")));
+		if (level < 1 || level > 9)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'level' must be between 1 and 9")));
+
+		recorderOptions.blockBytes = (size_t) blockBytes;
+		recorderOptions.flushMs = (long) flushMs;
+		recorderOptions.segmentBytes = (unsigned long long) segmentBytes;
+		recorderOptions.level = (int) level;
+		recorderOptions.dictionary = GetBoolOption(options, "dictionary", true);
+		recorderOptions.maxQueuedBlocks = (size_t) maxQueuedBlocks;
+		recorderOptions.fieldRanges = GetBoolOption(options, "fieldRanges", true);
+
+		SegmentRecorder *recorder = new SegmentRecorder(recorderOptions);
+		string error;
+		if (!recorder->Start(error)) {
+			delete recorder;
+			return ThrowException(Exception::Error(String::New(error.c_str())));
+		}
+
+		SegmentRecorder::RecordTarget *target = new SegmentRecorder::RecordTarget(recorder);
+
+		connection->recorders.push_back(recorder);
+		connection->recorderTargets.push_back(target);
+
+		connection->SubscribeStore(*String::AsciiValue(subjectV8Str), target, args[args.Length() - 1]);
+
+		return scope.Close(Recorder::NewInstance(recorder, args.This()));
+	}
+
+	static Handle<Value> ConfigureReplay(const Arguments& args){
+		HandleScope scope;
+
+		OPT_OBJ_ARG(0, options);
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		double messages = GetNumberOption(options, "messages", 256);
+		double bytes = GetNumberOption(options, "bytes", 1024 * 1024);
+		double subjects = GetNumberOption(options, "subjects", (double) ReplayWindow::DEFAULT_MAX_SUBJECTS);
+		if (messages < 0 || bytes < 0)
+			return ThrowException(Exception::RangeError(
+						  String::New("Options 'messages' and 'bytes' must not be negative")));
+		if (subjects < 1)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'subjects' must be positive")));
+
+		connection->replayWindow.Configure((size_t) messages, (size_t) bytes, (size_t) subjects);
+
+		return Undefined();
+	}
+
+	/*
+	 * Replay({subject: lastSeenSeq, ...}) returns every retained message newer
+	 * than the given sequence numbers in one batch, along with the subjects
+	 * whose window no longer reaches back that far.
+	 */
+	static Handle<Value> Replay(const Arguments& args){
+		HandleScope scope;
+
+		if (args.Length() < 1 || !args[0]->IsObject())
+			return ThrowException(Exception::TypeError(
+						  String::New("Argument 0 must be an object of subject sequence numbers")));
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		Local<Object> since = args[0]->ToObject();
+		Local<Array> subjects = since->GetPropertyNames();
+
+		/* Checked up front so a bad entry replays nothing. x - x is 0 for
+		 * every double but NaN and the infinities, and works without C99's
+		 * isfinite. Negative numbers ask for everything retained. */
+		vector<double> seqs(subjects->Length());
+		for (uint32_t i = 0; i < subjects->Length(); i++) {
+			Local<Value> value = since->Get(subjects->Get(i));
+			seqs[i] = value->IsNumber() ? value->NumberValue() : 0;
+			if (!value->IsNumber() || seqs[i] - seqs[i] != 0)
+				return ThrowException(Exception::TypeError(String::New(
+							  ("Sequence number for '" + string(*String::Utf8Value(subjects->Get(i))) + "' must be a finite number").c_str())));
+			if (seqs[i] < 0)
+				seqs[i] = 0;
+		}
+
+		vector<ReplayWindow::Entry> entries;
+		Local<Array> truncated = Array::New();
+
+		for (uint32_t i = 0; i < subjects->Length(); i++) {
+			Local<Value> subject = subjects->Get(i);
+			if (!connection->replayWindow.Since(*String::Utf8Value(subject), seqs[i], entries))
+				truncated->Set(truncated->Length(), subject);
+		}
+
+		Local<Array> messages = Array::New(entries.size());
+		for (size_t i = 0; i < entries.size(); i++) {
+			Local<Object> entry = Object::New();
+			entry->Set(String::NewSymbol("subject"), String::New(entries[i].subject.c_str()));
+			entry->Set(String::NewSymbol("seq"), Number::New(entries[i].seq));
+			entry->Set(String::NewSymbol("message"), String::New(entries[i].xml.c_str(), entries[i].xml.size()));
+			messages->Set(i, entry);
+		}
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("messages"), messages);
+		result->Set(String::NewSymbol("truncated"), truncated);
+
+		return scope.Close(result);
+	}
+
+	/*
+	 * Backtest(recordingOrArray, [{speed, maxInFlight, from, to, subject, where,
+	 * orderBy}], cb) replays recordings through the subscriptions of a local
+	 * connection, merged into one time ordered stream. Speed 0 delivers as
+	 * fast as the callbacks keep up, anything else scales the recorded
+	 * spacing. cb(err, stats) runs once every replayed message has been
+	 * handed to the callbacks.
+	 */
+	static Handle<Value> RunBacktest(const Arguments& args){
+		HandleScope scope;
+
+		if (args.Length() < 1 || !args[0]->IsObject())
+			return ThrowException(Exception::TypeError(
+						  String::New("Argument 0 must be a recording or an array of recordings")));
+
+		int cbIndex = (args.Length() > 2) ? 2 : 1;
+		REQ_FUN_ARG(cbIndex, cb);
+		Local<Object> options = (cbIndex == 2 && args[1]->IsObject()) ? args[1]->ToObject() : Object::New();
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (!connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Backtests need a local connection, see ConnectLocal()")));
+		if (connection->backtest != NULL)
+			return ThrowException(Exception::Error(
+						  String::New("A backtest is already running on this connection")));
+
+		Backtest::Options backtestOptions;
+		backtestOptions.speed = GetNumberOption(options, "speed", backtestOptions.speed);
+		double maxInFlight = GetNumberOption(options, "maxInFlight", (double) backtestOptions.maxInFlight);
+		if (backtestOptions.speed < 0 || maxInFlight < 1)
+			return ThrowException(Exception::RangeError(
+						  String::New("Option 'speed' must not be negative and 'maxInFlight' must be at least 1")));
+		backtestOptions.maxInFlight = (unsigned long long) maxInFlight;
+
+		vector<Recording*> recordings;
+		vector<const SegmentSet*> sets;
+		RecordingQuery query;
+		string orderField;
+		const char *invalid = Recording::ParseMerge(args[0], options, recordings, sets, query, orderField);
+		if (invalid != NULL)
+			return ThrowException(Exception::TypeError(String::New(invalid)));
+
+		backtest_state_t *state = new backtest_state_t(connection);
+		state->backtest = new Backtest(new RecordingMerge(sets, query, orderField), &state->feed, backtestOptions);
+		state->inputs = Persistent<Value>::New(args[0]);
+		state->cb = Persistent<Function>::New(cb);
+
+		/* Deliveries refer back to the connection until the callback. */
+		connection->Ref();
+		connection->backtest = state;
+		connection->RunRouterBatch();
+
+		return Undefined();
+	}
+
+	/*
+	 * Generate(profiles, [{durationMs, messages, threads, seed}], cb) publishes
+	 * synthetic traffic through this connection from native threads, or to
+	 * its own subscribers when it is local. Returns a Generator; cb(err,
+	 * stats) runs once it stops.
+	 */
+	static Handle<Value> Generate(const Arguments& args){
+		HandleScope scope;
+
+		int cbIndex = (args.Length() > 2) ? 2 : 1;
+		REQ_FUN_ARG(cbIndex, cb);
+		Local<Object> options = (cbIndex == 2 && args[1]->IsObject()) ? args[1]->ToObject() : Object::New();
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection == NULL && !connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is not connected")));
+
+		vector<LoadGenerator::Profile> profiles;
+		const char *invalid = Generator::ParseProfiles(args[0], profiles);
+		if (invalid != NULL)
+			return ThrowException(Exception::TypeError(String::New(invalid)));
+
+		LoadGenerator::Options generatorOptions;
+		invalid = Generator::ParseOptions(options, generatorOptions);
+		if (invalid != NULL)
+			return ThrowException(Exception::RangeError(String::New(invalid)));
+
+		return scope.Close(Generator::Start(profiles, generatorOptions, new GeneratorPublisher(connection), args.This(), cb));
+	}
+
+	void StartBacktest(){
+		if (backtest == NULL || backtest->started != 0)
+			return;
+
+		backtest->started = uv_hrtime();
+
+		string error;
+		if (!backtest->backtest->Start(error))
+			FinishBacktest(error);
+	}
+
+	/* Called whenever deliveries drain, and once the replay thread stops. */
+	void CheckBacktest(){
+		if (backtest == NULL || backtest->started == 0)
+			return;
+
+		backtest->backtest->Consumed();
+		if (!backtest->backtest->IsFinished())
+			return;
+
+		{
+			AutoMutex lock(deliveryMutex);
+			if (deliveriesDone < deliveriesQueued)
+				return;
+		}
+
+		FinishBacktest(backtest->backtest->Error());
+	}
+
+	void FinishBacktest(const string &error){
+		HandleScope scope;
+
+		backtest_state_t *state = backtest;
+		backtest = NULL;
+		state->backtest->Stop();
+
+		const Backtest::Stats &stats = state->backtest->GetStats();
+		double elapsedMs = (uv_hrtime() - state->started) / 1e6;
+
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("messages"), Number::New((double) stats.messages));
+		result->Set(String::NewSymbol("elapsedMs"), Number::New(elapsedMs));
+		result->Set(String::NewSymbol("messagesPerSecond"),
+		            Number::New(elapsedMs > 0 ? stats.messages / elapsedMs * 1000 : 0));
+		result->Set(String::NewSymbol("from"), Number::New(stats.firstKey));
+		result->Set(String::NewSymbol("to"), Number::New(stats.lastKey));
+		result->Set(String::NewSymbol("blocksRead"), Number::New((double) stats.scan.blocksRead));
+		result->Set(String::NewSymbol("blocksSkipped"), Number::New((double) stats.scan.blocksSkipped));
+		result->Set(String::NewSymbol("messagesScanned"), Number::New((double) stats.scan.messagesScanned));
+
+		Local<Value> argv[2];
+		argv[0] = error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(error.c_str()));
+		argv[1] = result;
+
+		/* The callback may start the next backtest. */
+		Local<Function> cb = Local<Function>::New(state->cb);
+		delete state;
+		Unref();
+
+		TryCatch try_catch;
+		cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+		if (try_catch.HasCaught())
+			FatalException(try_catch);
+	}
+
+	/*
+	 * Connect(server, [options], cb) calls cb(err) once the middleware is
+	 * connected and dispatching. With {prewarm: true} the callback only
+	 * fires once a message built on the publisher thread has been routed
+	 * locally to subscribers of every encoding, so the first publish and
+	 * delivery do not pay for thread start-up, allocator arenas and the
+	 * middleware's lazily built structures. Nothing is published.
+	 */
+	static Handle<Value> Connect(const Arguments& args){
+		HandleScope scope;
+
+		REQ_STR_ARG(0, server);
+		int cbIndex = (args.Length() > 2 && args[2]->IsFunction()) ? 2 : 1;
+		REQ_FUN_ARG(cbIndex, cb);
+		Local<Object> options = cbIndex == 2 && args[1]->IsObject() ? args[1]->ToObject() : Object::New();
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->local)
+			return ThrowException(Exception::Error(
+						  String::New("Local connections cannot connect to a server")));
+		if (connection->gmsecConnection != NULL)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is already connected to a server")));
+
+		string loadError;
+		if (!Middleware::Load(loadError))
+			return ThrowException(Exception::Error(String::New(loadError.c_str())));
+
+		/* Extract out the server string from the V8::String object. */
+		char *serverStr = new char[ strlen(*String::AsciiValue(server)) + 1 ];
+		strcpy(serverStr, *String::AsciiValue(server));
+
+		connection_baton_t *baton = new connection_baton_t();
+		baton->connection = connection;
+		baton->cb = Persistent<Function>::New(cb);
+		baton->server = serverStr;
+		baton->prewarm = GetBoolOption(options, "prewarm", false);
+		baton->gmsecConnection = NULL;
+		connection->Ref();
+
+		uv_work_t *req = new uv_work_t;
+		req->data = baton;
+
+		uv_queue_work(uv_default_loop(), req, EIO_Connect, (uv_after_work_cb)EIO_AfterConnect);
+
+		return Undefined();
+	}
+
+	/*
+	 * ConnectLocal() puts the connection in bus-free mode. Subscriptions then
+	 * complete without a middleware and only backtests feed them.
+	 */
+	static Handle<Value> ConnectLocal(const Arguments& args){
+		HandleScope scope;
+
+		Connection *connection = ObjectWrap::Unwrap<Connection>(args.This());
+
+		if (connection->gmsecConnection != NULL)
+			return ThrowException(Exception::Error(
+						  String::New("Connection is already connected to a server")));
+
+		connection->local = true;
+
+		return Undefined();
+	}
+
+	static void EIO_Connect(uv_work_t *req){
+		connection_baton_t *baton = static_cast<connection_baton_t*>(req->data);
+
+		baton->gmsecConnection = MiddlewareApi::Get()->Connect(baton->server, baton->error);
+	}
+
+	static void EIO_AfterConnect(uv_work_t* req){
+		
+		HandleScope scope;
+
+		connection_baton_t *baton = static_cast<connection_baton_t *>(req->data);
+		baton->connection->gmsecConnection = baton->gmsecConnection;
+
+		/* Otherwise the first Publish() starts the publisher thread. */
+		if (baton->connection->gmsecConnection != NULL)
+			baton->connection->publisher->Start();
+
+		if (baton->prewarm && baton->connection->gmsecConnection != NULL) {
+			baton->connection->StartPrewarm(baton->cb);
+
+			/* The prewarm state owns the callback and the reference now. */
+			delete[] baton->server;
+			delete baton;
+			delete req;
+			return;
+		}
+
+		Local<Value> argv[1];
+		argv[0] = baton->error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(baton->error.c_str()));
+
+		TryCatch try_catch;
+
+		baton->cb->Call(Context::GetCurrent()->Global(), 1, argv);
 
 		if (try_catch.HasCaught()) {
 		      FatalException(try_catch);
 		}
 
+		baton->cb.Dispose();
+		baton->connection->Unref();
+		delete[] baton->server;
 		delete baton;
 		delete req;
 	}
+
+	void StartPrewarm(Persistent<Function> cb){
+		HandleScope scope;
+
+		prewarm_state_t *state = new prewarm_state_t();
+		state->connection = this;
+		state->cb = cb;
+		state->finished = false;
+
+		char subject[64];
+		sprintf(subject, "GMSEC.JS.PREWARM.%llu", (unsigned long long) uv_hrtime());
+		state->subject = subject;
+		state->xml = string("<MESSAGE SUBJECT=\"") + subject + "\" KIND=\"PUBLISH\">" + PREWARM_FIELDS + "</MESSAGE>";
+
+		uv_timer_init(uv_default_loop(), &state->timer);
+		state->timer.data = state;
+
+		/* One consumer per encoding, the last one compressed. */
+		static const Encoding encodings[] = { ENCODING_XML, ENCODING_JSON, ENCODING_DELTA, ENCODING_DELTA };
+		static const size_t consumers = sizeof(encodings) / sizeof(encodings[0]);
+
+		subscribe_batch_baton_t *batch = new subscribe_batch_baton_t();
+		batch->connection = this;
+		batch->cb = Persistent<Function>::New(FunctionTemplate::New(OnPrewarmSubscribed, External::New(state))->GetFunction());
+
+		Local<Function> onMessage = FunctionTemplate::New(OnPrewarmMessage, External::New(state))->GetFunction();
+		for (size_t i = 0; i < consumers; i++) {
+			Consumer *consumer = new Consumer(encodings[i], i + 1 == consumers ? COMPRESSION_DEFLATE_DICTIONARY : COMPRESSION_NONE, 1);
+			consumer->cb = Persistent<Function>::New(onMessage);
+			AddConsumer(state->subject, consumer, batch->ops);
+		}
+
+		state->pending = consumers;
+
+		char *message_contents = new char[state->xml.size() + 1];
+		strcpy(message_contents, state->xml.c_str());
+
+		publish_baton_t *publish = new publish_baton_t();
+		publish->connection = this;
+		publish->message_contents = message_contents;
+		publish->gather = 0;
+		publish->prewarm = true;
+		batch->publishes.push_back(publish);
+
+		QueueRouterBatch(batch);
+	}
+
+	/* The batch has handed the message to the publisher by now. */
+	static Handle<Value> OnPrewarmSubscribed(const Arguments& args){
+		HandleScope scope;
+
+		prewarm_state_t *state = static_cast<prewarm_state_t*>(External::Unwrap(args.Data()));
+		uv_timer_start(&state->timer, OnPrewarmTimeout, PREWARM_TIMEOUT_MS, 0);
+
+		return Undefined();
+	}
+
+	static Handle<Value> OnPrewarmMessage(const Arguments& args){
+		HandleScope scope;
+
+		prewarm_state_t *state = static_cast<prewarm_state_t*>(External::Unwrap(args.Data()));
+		if (--state->pending == 0)
+			FinishPrewarm(state);
+
+		return Undefined();
+	}
+
+	static void OnPrewarmTimeout(uv_timer_t *handle, int status /*UNUSED*/){
+		HandleScope scope;
+
+		FinishPrewarm(static_cast<prewarm_state_t*>(handle->data));
+	}
+
+	static void FinishPrewarm(prewarm_state_t *state){
+		if (state->finished)
+			return;
+		state->finished = true;
+
+		Connection *connection = state->connection;
+		connection->RemoveConsumers(state->subject, Local<Function>());
+		connection->replayWindow.Forget(state->subject);
+
+		Local<Function> cb = Local<Function>::New(state->cb);
+		state->cb.Dispose();
+		uv_close((uv_handle_t*) &state->timer, OnPrewarmClosed);
+		connection->Unref();
+
+		Local<Value> argv[1] = { Local<Value>::New(Null()) };
+
+		TryCatch try_catch;
+		cb->Call(Context::GetCurrent()->Global(), 1, argv);
+
+		if (try_catch.HasCaught())
+			FatalException(try_catch);
+	}
+
+	static void OnPrewarmClosed(uv_handle_t *handle){
+		delete static_cast<prewarm_state_t*>(handle->data);
+	}
 };
 
 Persistent<FunctionTemplate> Connection::s_ct;
@@ -348,6 +2749,15 @@ Persistent<FunctionTemplate> Connection::s_ct;
 static void init (Handle<Object> target)
 {
 	Connection::Init(target);
+	History::Init(target);
+	Ephemeris::Init(target);
+	Recorder::Init(target);
+	Recording::Init(target);
+	Generator::Init(target);
+	Frames::Init(target);
+	MemoryStats::Init(target);
+	Middleware::Init(target);
+	Trace::Init(target);
 }
 
 NODE_MODULE(gmsec, init);
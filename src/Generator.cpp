@@ -0,0 +1,298 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "Generator.h"
+#include "MessageRecord.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+Persistent<FunctionTemplate> Generator::s_ct;
+
+void Generator::Init(Handle<Object> target){
+	HandleScope scope;
+
+	Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+	s_ct = Persistent<FunctionTemplate>::New(t);
+	s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+	s_ct->SetClassName(String::NewSymbol("Generator"));
+
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Stop", Stop);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Stats", Stats);
+
+	target->Set(String::NewSymbol("Generator"), s_ct->GetFunction());
+}
+
+/* Reads [a, b] from options[key]; a lone number is taken as [a, fallback]. */
+static bool GetPairOption(Local<Object> options, const char *key, double fallback, double &a, double &b){
+	Local<Value> value = options->Get(String::NewSymbol(key));
+	if (value->IsNumber()) {
+		a = value->NumberValue();
+		b = fallback;
+		return true;
+	}
+	if (!value->IsArray())
+		return false;
+
+	Local<Array> pair = Local<Array>::Cast(value);
+	a = pair->Get(0)->NumberValue();
+	b = pair->Length() > 1 ? pair->Get(1)->NumberValue() : fallback;
+	return true;
+}
+
+static const char *ParseField(Local<Object> spec, LoadGenerator::Field &field){
+	field.name = GetStringOption(spec, "name", "");
+	field.type = MessageRecord::TypeFromName(GetStringOption(spec, "type", "STRING"));
+	if (field.name.empty())
+		return "Every field needs a name";
+	if (field.type == GMSEC_TYPE_UNSET || field.type == GMSEC_TYPE_CHAR || field.type == GMSEC_TYPE_BIN)
+		return "Field types must be BOOL, STRING, F32, F64 or one of the integer types";
+
+	LoadGenerator::Value &value = field.value;
+	if (GetPairOption(spec, "uniform", 0, value.a, value.b))
+		value.kind = LoadGenerator::Value::UNIFORM;
+	else if (GetPairOption(spec, "normal", 0, value.a, value.b))
+		value.kind = LoadGenerator::Value::NORMAL;
+	else if (GetPairOption(spec, "sequence", 1, value.a, value.b))
+		value.kind = LoadGenerator::Value::SEQUENCE;
+	else if (GetPairOption(spec, "walk", 1, value.a, value.b))
+		value.kind = LoadGenerator::Value::WALK;
+	else if (spec->Get(String::NewSymbol("text"))->IsNumber()) {
+		value.kind = LoadGenerator::Value::TEXT;
+		value.a = GetNumberOption(spec, "text", 0);
+	}
+	else if (GetBoolOption(spec, "time", false))
+		value.kind = LoadGenerator::Value::TIME;
+	else {
+		value.kind = LoadGenerator::Value::CONSTANT;
+		Local<Value> constant = spec->Get(String::NewSymbol("value"));
+		if (!constant->IsUndefined())
+			value.text = *String::Utf8Value(constant);
+	}
+
+	return NULL;
+}
+
+const char *Generator::ParseProfiles(Local<Value> list, vector<LoadGenerator::Profile> &profiles){
+	if (!list->IsArray())
+		return "Argument 0 must be an array of profiles";
+
+	Local<Array> array = Local<Array>::Cast(list);
+	for (uint32_t i = 0; i < array->Length(); i++) {
+		if (!array->Get(i)->IsObject())
+			return "Argument 0 must be an array of profiles";
+		Local<Object> spec = array->Get(i)->ToObject();
+
+		profiles.push_back(LoadGenerator::Profile());
+		LoadGenerator::Profile &profile = profiles.back();
+
+		profile.subject = GetStringOption(spec, "subject", "");
+		double subjects = GetNumberOption(spec, "subjects", 1);
+		profile.rate = GetNumberOption(spec, "rate", 0);
+		if (profile.subject.empty())
+			return "Every profile needs a subject";
+		if (subjects < 1 || (subjects > 1 && profile.subject.find("{n}") == string::npos))
+			return "Option 'subjects' needs a {n} in the subject to fill in";
+		profile.subjects = (size_t) subjects;
+
+		Local<Value> burst = spec->Get(String::NewSymbol("burst"));
+		if (burst->IsObject()) {
+			double size = GetNumberOption(burst->ToObject(), "size", 0);
+			double everyMs = GetNumberOption(burst->ToObject(), "everyMs", 0);
+			if (size < 1 || everyMs < 1)
+				return "Bursts need a size and an everyMs of at least 1";
+			profile.burstSize = (size_t) size;
+			profile.burstEveryMs = everyMs;
+		}
+
+		if (profile.rate < 0 || (profile.rate == 0 && profile.burstSize == 0))
+			return "Every profile needs a positive rate, a burst or both";
+
+		Local<Value> fields = spec->Get(String::NewSymbol("fields"));
+		if (fields->IsArray()) {
+			Local<Array> fieldArray = Local<Array>::Cast(fields);
+			for (uint32_t f = 0; f < fieldArray->Length(); f++) {
+				if (!fieldArray->Get(f)->IsObject())
+					return "Fields must be objects";
+				profile.fields.push_back(LoadGenerator::Field());
+				const char *invalid = ParseField(fieldArray->Get(f)->ToObject(), profile.fields.back());
+				if (invalid != NULL)
+					return invalid;
+			}
+		}
+
+		/* Filler to bring messages up to a realistic field count. */
+		size_t extraFields = (size_t) GetNumberOption(spec, "extraFields", 0);
+		for (size_t f = 0; f < extraFields; f++) {
+			char name[32];
+			sprintf(name, "FIELD-%lu", (unsigned long) f);
+			profile.fields.push_back(LoadGenerator::Field());
+			LoadGenerator::Field &field = profile.fields.back();
+			field.name = name;
+			field.type = GMSEC_TYPE_F64;
+			field.value.kind = LoadGenerator::Value::UNIFORM;
+			field.value.b = 1000;
+		}
+	}
+
+	if (profiles.empty())
+		return "At least one profile is required";
+	return NULL;
+}
+
+const char *Generator::ParseOptions(Local<Object> options, LoadGenerator::Options &generatorOptions){
+	double durationMs = GetNumberOption(options, "durationMs", 0);
+	double maxMessages = GetNumberOption(options, "messages", 0);
+	double threads = GetNumberOption(options, "threads", 1);
+	if (durationMs < 0 || maxMessages < 0 || threads < 1)
+		return "Options 'durationMs' and 'messages' must not be negative and 'threads' must be at least 1";
+
+	generatorOptions.durationMs = durationMs;
+	generatorOptions.maxMessages = (unsigned long long) maxMessages;
+	generatorOptions.threads = (size_t) threads;
+	generatorOptions.seed = (unsigned long) GetNumberOption(options, "seed", 1);
+	return NULL;
+}
+
+Handle<Value> Generator::Start(const vector<LoadGenerator::Profile> &profiles, const LoadGenerator::Options &options,
+                               LoadGenerator::Target *publisher, Local<Object> owner, Local<Function> cb){
+	HandleScope scope;
+
+	Generator *generator = new Generator(publisher);
+	Local<Value> argv[1] = { External::New(generator) };
+	Local<Object> handle = s_ct->GetFunction()->NewInstance(1, argv);
+
+	generator->generator = new LoadGenerator(profiles, options, generator);
+	uv_async_init(uv_default_loop(), &generator->async, OnFinishedAsync);
+	generator->async.data = generator;
+
+	generator->started = uv_hrtime();
+	string error;
+	if (!generator->generator->Start(error)) {
+		generator->Ref();
+		uv_close((uv_handle_t*) &generator->async, OnClosed);
+		return ThrowException(Exception::Error(String::New(error.c_str())));
+	}
+
+	/* Both stay alive until the callback has run. */
+	generator->owner = Persistent<Object>::New(owner);
+	generator->cb = Persistent<Function>::New(cb);
+	generator->Ref();
+
+	return scope.Close(handle);
+}
+
+Handle<Value> Generator::New(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsExternal())
+		return ThrowException(Exception::TypeError(
+					  String::New("Use Connection.Generate() to create a generator")));
+
+	Generator *generator = static_cast<Generator*>(External::Unwrap(args[0]));
+	generator->Wrap(args.This());
+	return args.This();
+}
+
+Generator::~Generator(){
+	delete generator;
+	delete publisher;
+}
+
+bool Generator::Publish(const string &subject, const string &xml, string &error){
+	return publisher->Publish(subject, xml, error);
+}
+
+void Generator::Finished(){
+	uv_async_send(&async);
+}
+
+Handle<Value> Generator::Stop(const Arguments& args){
+	HandleScope scope;
+
+	Generator *generator = ObjectWrap::Unwrap<Generator>(args.This());
+	generator->generator->Stop();
+
+	return Undefined();
+}
+
+Handle<Value> Generator::Stats(const Arguments& args){
+	HandleScope scope;
+
+	Generator *generator = ObjectWrap::Unwrap<Generator>(args.This());
+	return scope.Close(generator->StatsToObject((uv_hrtime() - generator->started) / 1e6));
+}
+
+Local<Object> Generator::StatsToObject(double elapsedMs){
+	HandleScope scope;
+
+	LoadGenerator::Stats stats = generator->GetStats();
+	string error = generator->LastError();
+
+	Local<Object> lag = Object::New();
+	lag->Set(String::NewSymbol("p50"), Number::New(stats.lag.Quantile(0.5) / 1e6));
+	lag->Set(String::NewSymbol("p90"), Number::New(stats.lag.Quantile(0.9) / 1e6));
+	lag->Set(String::NewSymbol("p99"), Number::New(stats.lag.Quantile(0.99) / 1e6));
+	lag->Set(String::NewSymbol("p999"), Number::New(stats.lag.Quantile(0.999) / 1e6));
+	lag->Set(String::NewSymbol("max"), Number::New(stats.lag.Max() / 1e6));
+	lag->Set(String::NewSymbol("mean"), Number::New(stats.lag.Mean() / 1e6));
+
+	Local<Object> obj = Object::New();
+	obj->Set(String::NewSymbol("sent"), Number::New((double) stats.sent));
+	obj->Set(String::NewSymbol("failed"), Number::New((double) stats.failed));
+	obj->Set(String::NewSymbol("late"), Number::New((double) stats.late));
+	obj->Set(String::NewSymbol("elapsedMs"), Number::New(elapsedMs));
+	obj->Set(String::NewSymbol("messagesPerSecond"), Number::New(elapsedMs > 0 ? stats.sent / elapsedMs * 1000 : 0));
+	obj->Set(String::NewSymbol("lagMs"), lag);
+	obj->Set(String::NewSymbol("error"), error.empty() ? Local<Value>::New(Null()) : Local<Value>::New(String::New(error.c_str())));
+
+	return scope.Close(obj);
+}
+
+void Generator::OnFinishedAsync(uv_async_t *handle, int status /*UNUSED*/){
+	HandleScope scope;
+
+	Generator *generator = static_cast<Generator*>(handle->data);
+	generator->generator->Stop();
+
+	Local<Value> argv[2];
+	argv[0] = Local<Value>::New(Null());
+	argv[1] = generator->StatsToObject((uv_hrtime() - generator->started) / 1e6);
+
+	Local<Function> cb = Local<Function>::New(generator->cb);
+	generator->cb.Dispose();
+	generator->cb.Clear();
+	uv_close((uv_handle_t*) &generator->async, OnClosed);
+
+	TryCatch try_catch;
+	cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+}
+
+void Generator::OnClosed(uv_handle_t *handle){
+	Generator *generator = static_cast<Generator*>(handle->data);
+	if (!generator->owner.IsEmpty()) {
+		generator->owner.Dispose();
+		generator->owner.Clear();
+	}
+	generator->Unref();
+}
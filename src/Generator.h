@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_GENERATOR_H
+#define GMSECJS_GENERATOR_H
+
+#include <vector>
+
+#include "v8.h"
+#include "node.h"
+#include "uv.h"
+
+#include "LoadGenerator.h"
+
+/*
+ * JS handle onto a LoadGenerator started by Connection.Generate(). The
+ * generator runs until its duration or message count is reached or Stop()
+ * is called, then reports cb(err, stats) once.
+ *
+ *     generator.Stop()
+ *     generator.Stats()   -> {sent, failed, late, lagMs: {p50, p90, p99, p999, max, mean}, error}
+ */
+class Generator : public node::ObjectWrap, public LoadGenerator::Target {
+public:
+	static v8::Persistent<v8::FunctionTemplate> s_ct;
+
+	static void Init(v8::Handle<v8::Object> target);
+
+	/* Each returns an error message, or NULL. */
+	static const char *ParseProfiles(v8::Local<v8::Value> list, std::vector<LoadGenerator::Profile> &profiles);
+	static const char *ParseOptions(v8::Local<v8::Object> options, LoadGenerator::Options &generatorOptions);
+
+	/*
+	 * Starts publishing through publisher, which the generator takes over.
+	 * owner is kept alive until the callback. Returns the generator handle
+	 * or throws.
+	 */
+	static v8::Handle<v8::Value> Start(const std::vector<LoadGenerator::Profile> &profiles,
+	                                   const LoadGenerator::Options &options,
+	                                   LoadGenerator::Target *publisher,
+	                                   v8::Local<v8::Object> owner, v8::Local<v8::Function> cb);
+
+	bool Publish(const std::string &subject, const std::string &xml, std::string &error);
+	void Finished();
+
+private:
+	Generator(LoadGenerator::Target *publisher) : publisher(publisher), generator(NULL), started(0) {}
+	~Generator();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Stop(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Stats(const v8::Arguments& args);
+
+	static void OnFinishedAsync(uv_async_t *handle, int status);
+	static void OnClosed(uv_handle_t *handle);
+
+	v8::Local<v8::Object> StatsToObject(double elapsedMs);
+
+	LoadGenerator::Target *publisher;
+	LoadGenerator *generator;
+	uint64_t started;
+	uv_async_t async;
+	v8::Persistent<v8::Object> owner;
+	v8::Persistent<v8::Function> cb;
+};
+
+#endif
@@ -0,0 +1,180 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Heartbeat.h"
+
+using namespace std;
+
+/* GMSEC heartbeat messages carry their counter as an I16 unless the
+ * template says otherwise. */
+static const GMSEC_TYPE DEFAULT_COUNTER_TYPE = GMSEC_TYPE_I16;
+static const char *TIME_FIELD = "PUBLISH-TIME";
+
+/* Reads the type of the one field visited. */
+class TypeReader : public MiddlewareApi::FieldVisitor {
+public:
+	TypeReader(GMSEC_TYPE &type) : type(type) {}
+	void Visit(const MiddlewareApi::Field &field){ type = field.type; }
+
+private:
+	GMSEC_TYPE &type;
+};
+
+Heartbeat::Heartbeat(MiddlewareApi::Connection *connection, Mutex &publishMutex)
+	: api(MiddlewareApi::Get()),
+	  connection(connection),
+	  publishMutex(publishMutex),
+	  message(NULL),
+	  counterType(DEFAULT_COUNTER_TYPE),
+	  counter(0),
+	  periodMs(0),
+	  condition(mutex),
+	  running(false),
+	  stopping(false){
+}
+
+Heartbeat::~Heartbeat(){
+	Stop();
+}
+
+bool Heartbeat::Start(const char *templateXml, long periodMs, const char *counterField, string &error){
+	Stop();
+
+	message = api->CreateMessage(connection, templateXml, error);
+	if(message == NULL)
+		return false;
+
+	/* Keep whatever type the template already uses for the counter so the
+	 * published messages stay consistent with it. */
+	this->counterField = counterField;
+	this->counterType = DEFAULT_COUNTER_TYPE;
+	TypeReader reader(this->counterType);
+	api->VisitField(message, counterField, reader);
+
+	this->periodMs = periodMs;
+	this->counter = 0;
+	this->stats = Stats();
+	this->stopping = false;
+
+	if(uv_thread_create(&thread, Run, this) != 0){
+		error = "Unable to create heartbeat thread";
+		api->DestroyMessage(connection, message);
+		message = NULL;
+		return false;
+	}
+
+	running = true;
+	return true;
+}
+
+void Heartbeat::Stop(){
+	if(!running)
+		return;
+
+	mutex.Enter();
+	stopping = true;
+	condition.Signal(Condition::USER);
+	mutex.Leave();
+
+	uv_thread_join(&thread);
+	running = false;
+
+	api->DestroyMessage(connection, message);
+	message = NULL;
+}
+
+void Heartbeat::Run(void *arg){
+	Heartbeat *heartbeat = static_cast<Heartbeat*>(arg);
+
+	/* Deadlines are computed from the start time rather than from the end of
+	 * the previous beat so that publish latency does not accumulate as drift. */
+	const uint64_t period = (uint64_t) heartbeat->periodMs * 1000000;
+	uint64_t deadline = uv_hrtime();
+
+	AutoMutex lock(heartbeat->mutex);
+	while(!heartbeat->stopping){
+		uint64_t now = uv_hrtime();
+		if(now < deadline){
+			long remainingMs = (long) ((deadline - now + 999999) / 1000000);
+			heartbeat->condition.Wait(remainingMs);
+			continue;
+		}
+
+		lock.leave();
+		heartbeat->Beat();
+		lock.enter();
+
+		/* If a publish stalled for longer than a period, skip the missed
+		 * beats instead of bursting to catch up. */
+		deadline += period;
+		now = uv_hrtime();
+		if(deadline + period <= now)
+			deadline = now + period - (now - deadline) % period;
+	}
+}
+
+void Heartbeat::Beat(){
+	SetCounter();
+
+	char timeBuffer[50];
+	api->FormatTime(api->Time(), timeBuffer);
+	api->SetField(message, TIME_FIELD, GMSEC_TYPE_STRING, 0, timeBuffer);
+
+	string error;
+	bool published;
+	{
+		AutoMutex lock(publishMutex);
+		published = api->Publish(connection, message, error);
+	}
+
+	{
+		AutoMutex lock(mutex);
+		if(published){
+			stats.beats++;
+			stats.error.clear();
+		}
+		else {
+			stats.failures++;
+			stats.error = error;
+		}
+	}
+
+	counter++;
+}
+
+Heartbeat::Stats Heartbeat::GetStats(){
+	AutoMutex lock(mutex);
+	return stats;
+}
+
+void Heartbeat::SetCounter(){
+	GMSEC_TYPE type = counterType;
+	double value;
+
+	switch(type){
+	case GMSEC_TYPE_I16:    value = counter % 32768; break;
+	case GMSEC_TYPE_U16:    value = (GMSEC_U16) counter; break;
+	case GMSEC_TYPE_I32:    value = counter & 0x7fffffff; break;
+	case GMSEC_TYPE_U32:
+	case GMSEC_TYPE_F32:
+	case GMSEC_TYPE_F64:    value = counter; break;
+	default:
+		type = DEFAULT_COUNTER_TYPE;
+		value = counter % 32768;
+		break;
+	}
+
+	api->SetField(message, counterField.c_str(), type, value, NULL);
+}
@@ -0,0 +1,77 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_HEARTBEAT_H
+#define GMSECJS_HEARTBEAT_H
+
+#include <string>
+
+#include "uv.h"
+#include "MiddlewareApi.h"
+#include "Sync.h"
+
+/*
+ * Publishes a prebuilt heartbeat message from a dedicated native thread so
+ * that the cadence does not depend on how busy the node event loop is.
+ * Only the counter field and PUBLISH-TIME are rewritten between beats.
+ */
+class Heartbeat {
+public:
+	/* Since the last Start(). A failed beat is counted and its error kept
+	 * until the next one succeeds. */
+	struct Stats {
+		Stats() : beats(0), failures(0) {}
+		unsigned long long beats;
+		unsigned long long failures;
+		std::string error;
+	};
+
+	Heartbeat(MiddlewareApi::Connection *connection, Mutex &publishMutex);
+	~Heartbeat();
+
+	/*
+	 * Parses the template, then starts the publisher thread. Returns false
+	 * and fills in error if the template could not be loaded.
+	 */
+	bool Start(const char *templateXml, long periodMs, const char *counterField, std::string &error);
+	void Stop();
+
+	bool IsRunning() const { return running; }
+	Stats GetStats();
+
+private:
+	static void Run(void *arg);
+	void Beat();
+	void SetCounter();
+
+	MiddlewareApi *api;
+	MiddlewareApi::Connection *connection;
+	Mutex &publishMutex;
+
+	MiddlewareApi::Message *message;
+	std::string counterField;
+	GMSEC_TYPE counterType;
+	GMSEC_U32 counter;
+	long periodMs;
+	Stats stats;
+
+	Mutex mutex;
+	Condition condition;
+	uv_thread_t thread;
+	bool running;
+	bool stopping;
+};
+
+#endif
@@ -0,0 +1,132 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "History.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+Persistent<FunctionTemplate> History::s_ct;
+
+void History::RecordTarget::Deliver(Router::Delivery &delivery){
+	store->Record(delivery, MiddlewareApi::Get()->Time() * 1000.0);
+}
+
+void History::Init(Handle<Object> target){
+	HandleScope scope;
+
+	Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+	s_ct = Persistent<FunctionTemplate>::New(t);
+	s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+	s_ct->SetClassName(String::NewSymbol("History"));
+
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Last", Last);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Range", Range);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Keys", Keys);
+
+	target->Set(String::NewSymbol("History"), s_ct->GetFunction());
+}
+
+Local<Object> History::NewInstance(HistoryStore *store, Local<Object> owner){
+	HandleScope scope;
+
+	Local<Value> argv[1] = { External::New(store) };
+	Local<Object> handle = s_ct->GetFunction()->NewInstance(1, argv);
+	ObjectWrap::Unwrap<History>(handle)->owner = Persistent<Object>::New(owner);
+	return scope.Close(handle);
+}
+
+Handle<Value> History::New(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsExternal())
+		return ThrowException(Exception::TypeError(
+					  String::New("Use Connection.CreateHistory() to create a history")));
+
+	History *history = new History(static_cast<HistoryStore*>(External::Unwrap(args[0])));
+	history->Wrap(args.This());
+	return args.This();
+}
+
+History::~History(){
+	owner.Dispose();
+}
+
+Local<Object> History::ToObject(HistoryStore *store, const HistoryStore::Result &result){
+	HandleScope scope;
+
+	Local<Object> obj = Object::New();
+	obj->Set(String::NewSymbol("time"), NewFloat64Array(result.times.empty() ? NULL : &result.times[0], result.times.size()));
+
+	const vector<string> &fields = store->Fields();
+	for (size_t i = 0; i < fields.size(); i++) {
+		const vector<double> &column = result.columns[i];
+		obj->Set(String::New(fields[i].c_str()), NewFloat64Array(column.empty() ? NULL : &column[0], column.size()));
+	}
+
+	if (store->StoresMessages()) {
+		Local<Array> messages = Array::New(result.messages.size());
+		for (size_t i = 0; i < result.messages.size(); i++)
+			messages->Set(i, String::New(result.messages[i].c_str()));
+		obj->Set(String::NewSymbol("messages"), messages);
+	}
+
+	return scope.Close(obj);
+}
+
+Handle<Value> History::Last(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, keyV8Str);
+	REQ_NUM_ARG(1, count);
+
+	History *history = ObjectWrap::Unwrap<History>(args.This());
+
+	HistoryStore::Result result;
+	history->store->Last(*String::Utf8Value(keyV8Str), count > 0 ? (size_t) count : 0, result);
+
+	return scope.Close(ToObject(history->store, result));
+}
+
+Handle<Value> History::Range(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, keyV8Str);
+	REQ_NUM_ARG(1, fromMs);
+	REQ_NUM_ARG(2, toMs);
+
+	History *history = ObjectWrap::Unwrap<History>(args.This());
+
+	HistoryStore::Result result;
+	history->store->Range(*String::Utf8Value(keyV8Str), fromMs, toMs, result);
+
+	return scope.Close(ToObject(history->store, result));
+}
+
+Handle<Value> History::Keys(const Arguments& args){
+	HandleScope scope;
+
+	History *history = ObjectWrap::Unwrap<History>(args.This());
+
+	vector<string> keys = history->store->Keys();
+	Local<Array> array = Array::New(keys.size());
+	for (size_t i = 0; i < keys.size(); i++)
+		array->Set(i, String::New(keys[i].c_str()));
+
+	return scope.Close(array);
+}
@@ -0,0 +1,65 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_HISTORY_H
+#define GMSECJS_HISTORY_H
+
+#include "v8.h"
+#include "node.h"
+
+#include "Router.h"
+#include "HistoryStore.h"
+
+/*
+ * JS handle onto a HistoryStore. Instances are created by
+ * Connection.CreateHistory(); the store itself is owned by the connection
+ * because its router keeps feeding it for the life of the subscription,
+ * so the handle keeps the connection alive.
+ */
+class History : public node::ObjectWrap {
+public:
+	/*
+	 * Route target that records every message of the subscription into
+	 * the store on the thread delivering it.
+	 */
+	class RecordTarget : public Router::Target {
+	public:
+		RecordTarget(HistoryStore *store) : store(store) {}
+		void Deliver(Router::Delivery &delivery);
+	private:
+		HistoryStore *store;
+	};
+
+	static v8::Persistent<v8::FunctionTemplate> s_ct;
+
+	static void Init(v8::Handle<v8::Object> target);
+	static v8::Local<v8::Object> NewInstance(HistoryStore *store, v8::Local<v8::Object> owner);
+
+private:
+	History(HistoryStore *store) : store(store) {}
+	~History();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Last(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Range(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Keys(const v8::Arguments& args);
+
+	static v8::Local<v8::Object> ToObject(HistoryStore *store, const HistoryStore::Result &result);
+
+	HistoryStore *store;
+	v8::Persistent<v8::Object> owner;
+};
+
+#endif
@@ -0,0 +1,171 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <limits>
+
+#include "HistoryStore.h"
+#include "FieldUtil.h"
+
+using namespace std;
+
+HistoryStore::HistoryStore(const string &keyField, const vector<string> &fields,
+                           size_t capacity, size_t maxKeys)
+	: keyField(keyField),
+	  fields(fields),
+	  capacity(capacity),
+	  maxKeys(maxKeys),
+	  droppedKeys(0){
+}
+
+HistoryStore::~HistoryStore(){
+	for (map<string, Ring*>::iterator it = rings.begin(); it != rings.end(); ++it)
+		delete it->second;
+}
+
+HistoryStore::Ring *HistoryStore::GetRing(const string &key){
+	map<string, Ring*>::iterator it = rings.find(key);
+	if (it != rings.end())
+		return it->second;
+
+	/* New keys beyond the limit are dropped rather than evicting old ones, so
+	 * a misconfigured key field cannot grow the store without bound. */
+	if (rings.size() >= maxKeys) {
+		droppedKeys++;
+		return NULL;
+	}
+
+	/* All storage for a key is allocated up front; recording never allocates
+	 * except for the XML copies in message mode. */
+	Ring *ring = new Ring();
+	ring->times.resize(capacity);
+	if (fields.empty())
+		ring->messages.resize(capacity);
+	else
+		ring->values.resize(capacity * fields.size());
+	ring->head = 0;
+	ring->count = 0;
+
+	rings.insert(make_pair(key, ring));
+	return ring;
+}
+
+void HistoryStore::Record(Router::Delivery &delivery, double timeMs){
+	string key;
+	if (!GetFieldAsString(delivery, keyField.c_str(), key))
+		return;
+
+	/* Extract outside the lock; the dispatch thread should hold it only long
+	 * enough to copy into the ring. */
+	vector<double> row(fields.size(), numeric_limits<double>::quiet_NaN());
+	for (size_t i = 0; i < fields.size(); i++)
+		GetFieldAsDouble(delivery, fields[i].c_str(), row[i]);
+
+	string xml;
+	if (fields.empty())
+		xml = delivery.Xml();
+
+	AutoMutex lock(mutex);
+
+	Ring *ring = GetRing(key);
+	if (ring == NULL)
+		return;
+
+	size_t slot = ring->head;
+	ring->times[slot] = timeMs;
+	if (fields.empty())
+		ring->messages[slot].swap(xml);
+	for (size_t i = 0; i < row.size(); i++)
+		ring->values[slot * fields.size() + i] = row[i];
+
+	ring->head = (ring->head + 1) % capacity;
+	if (ring->count < capacity)
+		ring->count++;
+}
+
+/* Maps a logical index (0 = oldest retained entry) to a ring slot. */
+size_t HistoryStore::Slot(const Ring *ring, size_t index) const{
+	return (ring->head + capacity - ring->count + index) % capacity;
+}
+
+void HistoryStore::Copy(const Ring *ring, size_t begin, size_t end, Result &result) const{
+	size_t n = end - begin;
+
+	result.times.resize(n);
+	result.columns.assign(fields.size(), vector<double>(n));
+	result.messages.clear();
+	if (fields.empty())
+		result.messages.resize(n);
+
+	for (size_t i = 0; i < n; i++) {
+		size_t slot = Slot(ring, begin + i);
+		result.times[i] = ring->times[slot];
+		for (size_t f = 0; f < fields.size(); f++)
+			result.columns[f][i] = ring->values[slot * fields.size() + f];
+		if (fields.empty())
+			result.messages[i] = ring->messages[slot];
+	}
+}
+
+bool HistoryStore::Last(const string &key, size_t count, Result &result){
+	AutoMutex lock(mutex);
+
+	map<string, Ring*>::iterator it = rings.find(key);
+	if (it == rings.end())
+		return false;
+
+	Ring *ring = it->second;
+	if (count > ring->count)
+		count = ring->count;
+
+	Copy(ring, ring->count - count, ring->count, result);
+	return true;
+}
+
+bool HistoryStore::Range(const string &key, double fromMs, double toMs, Result &result){
+	AutoMutex lock(mutex);
+
+	map<string, Ring*>::iterator it = rings.find(key);
+	if (it == rings.end())
+		return false;
+
+	Ring *ring = it->second;
+
+	/* Receive times are appended in order, so both ends of the range can be
+	 * found with a binary search over the logical indexes. */
+	size_t lo = 0, hi = ring->count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (ring->times[Slot(ring, mid)] < fromMs) lo = mid + 1; else hi = mid;
+	}
+	size_t begin = lo;
+
+	hi = ring->count;
+	while (lo < hi) {
+		size_t mid = (lo + hi) / 2;
+		if (ring->times[Slot(ring, mid)] <= toMs) lo = mid + 1; else hi = mid;
+	}
+
+	Copy(ring, begin, lo, result);
+	return true;
+}
+
+vector<string> HistoryStore::Keys(){
+	AutoMutex lock(mutex);
+
+	vector<string> keys;
+	for (map<string, Ring*>::iterator it = rings.begin(); it != rings.end(); ++it)
+		keys.push_back(it->first);
+	return keys;
+}
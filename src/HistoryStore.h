@@ -0,0 +1,80 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_HISTORYSTORE_H
+#define GMSECJS_HISTORYSTORE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Router.h"
+#include "Sync.h"
+
+/*
+ * Fixed-capacity ring of recent messages per key (e.g. SCName). Each entry
+ * holds the receive time in milliseconds since the epoch plus either the
+ * selected numeric fields or, when no fields are configured, the message XML.
+ *
+ * Record() is called from the dispatch thread, or whichever thread replays
+ * into the router, queries from the node thread, so every public method
+ * takes the store's mutex.
+ */
+class HistoryStore {
+public:
+	struct Result {
+		std::vector<double> times;
+		std::vector< std::vector<double> > columns;   /* one per configured field */
+		std::vector<std::string> messages;            /* only when storing XML */
+	};
+
+	HistoryStore(const std::string &keyField, const std::vector<std::string> &fields,
+	             size_t capacity, size_t maxKeys);
+	~HistoryStore();
+
+	void Record(Router::Delivery &delivery, double timeMs);
+
+	bool Last(const std::string &key, size_t count, Result &result);
+	bool Range(const std::string &key, double fromMs, double toMs, Result &result);
+	std::vector<std::string> Keys();
+
+	const std::vector<std::string> &Fields() const { return fields; }
+	bool StoresMessages() const { return fields.empty(); }
+	size_t DroppedKeys() const { return droppedKeys; }
+
+private:
+	struct Ring {
+		std::vector<double> times;
+		std::vector<double> values;          /* capacity x fields, row major */
+		std::vector<std::string> messages;
+		size_t head;                         /* next slot to write */
+		size_t count;
+	};
+
+	Ring *GetRing(const std::string &key);
+	size_t Slot(const Ring *ring, size_t index) const;
+	void Copy(const Ring *ring, size_t begin, size_t end, Result &result) const;
+
+	std::string keyField;
+	std::vector<std::string> fields;
+	size_t capacity;
+	size_t maxKeys;
+	size_t droppedKeys;
+
+	std::map<std::string, Ring*> rings;
+	Mutex mutex;
+};
+
+#endif
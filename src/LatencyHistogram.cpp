@@ -0,0 +1,91 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LatencyHistogram.h"
+
+using namespace std;
+
+static const unsigned SUB_BITS = 5;
+static const uint64_t SUB_COUNT = 1 << SUB_BITS;
+static const size_t BUCKETS = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+LatencyHistogram::LatencyHistogram()
+	: counts(BUCKETS, 0),
+	  count(0),
+	  max(0),
+	  sum(0){
+}
+
+size_t LatencyHistogram::Index(uint64_t ns){
+	if (ns < SUB_COUNT)
+		return (size_t) ns;
+
+	unsigned exponent = SUB_BITS;
+	while (exponent < 63 && (ns >> (exponent + 1)) != 0)
+		exponent++;
+
+	unsigned shift = exponent - SUB_BITS;
+	return (size_t) ((shift + 1) * SUB_COUNT + ((ns >> shift) & (SUB_COUNT - 1)));
+}
+
+uint64_t LatencyHistogram::UpperBound(size_t index){
+	if (index < SUB_COUNT)
+		return index;
+
+	unsigned shift = (unsigned) (index / SUB_COUNT) - 1;
+	uint64_t lower = (SUB_COUNT + index % SUB_COUNT) << shift;
+	return lower + ((uint64_t) 1 << shift) - 1;
+}
+
+void LatencyHistogram::Record(uint64_t ns){
+	counts[Index(ns)]++;
+	count++;
+	sum += (double) ns;
+	if (ns > max)
+		max = ns;
+}
+
+void LatencyHistogram::Merge(const LatencyHistogram &other){
+	for (size_t i = 0; i < BUCKETS; i++)
+		counts[i] += other.counts[i];
+	count += other.count;
+	sum += other.sum;
+	if (other.max > max)
+		max = other.max;
+}
+
+void LatencyHistogram::Clear(){
+	counts.assign(BUCKETS, 0);
+	count = 0;
+	max = 0;
+	sum = 0;
+}
+
+uint64_t LatencyHistogram::Quantile(double q) const{
+	if (count == 0)
+		return 0;
+
+	unsigned long long rank = (unsigned long long) (q * count + 0.5);
+	if (rank < 1)
+		rank = 1;
+
+	unsigned long long seen = 0;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += counts[i];
+		if (seen >= rank)
+			return UpperBound(i) < max ? UpperBound(i) : max;
+	}
+	return max;
+}
@@ -0,0 +1,54 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_LATENCYHISTOGRAM_H
+#define GMSECJS_LATENCYHISTOGRAM_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*
+ * Log-linear histogram of durations in nanoseconds. Values below 32 are
+ * kept exactly; above that every power of two is split into 32 buckets,
+ * so quantiles are within about 3% at any scale. Recording is a shift and
+ * an increment, and histograms from several threads can be merged.
+ */
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+
+	void Record(uint64_t ns);
+	void Merge(const LatencyHistogram &other);
+	void Clear();
+
+	unsigned long long Count() const { return count; }
+	uint64_t Max() const { return max; }
+	double Mean() const { return count > 0 ? sum / count : 0; }
+
+	/* Upper bound of the bucket holding quantile q, 0 to 1. */
+	uint64_t Quantile(double q) const;
+
+private:
+	static size_t Index(uint64_t ns);
+	static uint64_t UpperBound(size_t index);
+
+	std::vector<unsigned long long> counts;
+	unsigned long long count;
+	uint64_t max;
+	double sum;
+};
+
+#endif
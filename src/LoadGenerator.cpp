@@ -0,0 +1,407 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+#ifdef _WIN32
+#include <sys/timeb.h>
+#else
+#include <sys/time.h>
+#endif
+
+#include "LoadGenerator.h"
+#include "MessageRecord.h"
+
+using namespace std;
+
+/* Messages published later than this count as late. */
+static const uint64_t LATE_NS = 1000000;
+
+/* Sleeping is only accurate to a millisecond or so; the last stretch
+ * before a scheduled time is spun instead. */
+static const uint64_t SPIN_NS = 2000000;
+
+static void AppendEscaped(string &out, const string &text){
+	for (size_t i = 0; i < text.size(); i++) {
+		switch (text[i]) {
+		case '<':  out += "&lt;"; break;
+		case '>':  out += "&gt;"; break;
+		case '&':  out += "&amp;"; break;
+		case '"':  out += "&quot;"; break;
+		default:   out += text[i];
+		}
+	}
+}
+
+/* xorshift64*, returning a double in [0, 1). */
+static double NextRandom(unsigned long long &state){
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return (double) ((state * 2685821657736338717ULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+static double NextNormal(unsigned long long &state){
+	double u = 1.0 - NextRandom(state);
+	double v = NextRandom(state);
+	return sqrt(-2.0 * log(u)) * cos(6.283185307179586 * v);
+}
+
+/* The current UTC time in the GMSEC format, YYYY-DDD-HH:MM:SS.sss. Done
+ * here rather than with gmsec::util so local load needs no GMSEC library. */
+static void FormatNow(char *buffer){
+	time_t seconds;
+	int millis;
+#ifdef _WIN32
+	struct _timeb now;
+	_ftime_s(&now);
+	seconds = now.time;
+	millis = now.millitm;
+#else
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	seconds = now.tv_sec;
+	millis = (int) (now.tv_usec / 1000);
+#endif
+
+	struct tm utc;
+#ifdef _WIN32
+	gmtime_s(&utc, &seconds);
+#else
+	gmtime_r(&seconds, &utc);
+#endif
+	sprintf(buffer, "%04d-%03d-%02d:%02d:%02d.%03d", utc.tm_year + 1900, utc.tm_yday + 1,
+	        utc.tm_hour, utc.tm_min, utc.tm_sec, millis);
+}
+
+static void AppendNumber(string &out, GMSEC_TYPE type, double value){
+	double low = 0, high = 0;
+	switch (type) {
+	case GMSEC_TYPE_I8:  low = -128;         high = 127;         break;
+	case GMSEC_TYPE_U8:  low = 0;            high = 255;         break;
+	case GMSEC_TYPE_I16: low = -32768;       high = 32767;       break;
+	case GMSEC_TYPE_U16: low = 0;            high = 65535;       break;
+	case GMSEC_TYPE_I32: low = -2147483648.0; high = 2147483647.0; break;
+	case GMSEC_TYPE_U32: low = 0;            high = 4294967295.0; break;
+	case GMSEC_TYPE_I64: low = -9.2e18;      high = 9.2e18;      break;
+	case GMSEC_TYPE_U64: low = 0;            high = 1.8e19;      break;
+	default: break;
+	}
+
+	char buffer[64];
+	switch (type) {
+	case GMSEC_TYPE_BOOL:
+		out += floor(value + 0.5) != 0 ? "TRUE" : "FALSE";
+		return;
+	case GMSEC_TYPE_F32:
+		sprintf(buffer, "%.7g", value);
+		break;
+	case GMSEC_TYPE_F64:
+	case GMSEC_TYPE_STRING:
+		sprintf(buffer, "%.10g", value);
+		break;
+	default:
+		value = floor(value + 0.5);
+		sprintf(buffer, "%.0f", value < low ? low : value > high ? high : value);
+		break;
+	}
+	out += buffer;
+}
+
+LoadGenerator::LoadGenerator(const vector<Profile> &profiles, const Options &options, Target *target)
+	: profiles(profiles),
+	  options(options),
+	  target(target),
+	  started(0),
+	  condition(mutex),
+	  running(false),
+	  stopping(false),
+	  active(0),
+	  claimed(0){
+	if (this->options.threads < 1)
+		this->options.threads = 1;
+	if (this->options.threads > this->profiles.size())
+		this->options.threads = this->profiles.size() > 0 ? this->profiles.size() : 1;
+
+	for (size_t i = 0; i < this->options.threads; i++) {
+		Worker *worker = new Worker();
+		worker->generator = this;
+		worker->random = (options.seed + 1) * 0x9E3779B97F4A7C15ULL + i;
+		if (worker->random == 0)
+			worker->random = 1;
+		workers.push_back(worker);
+	}
+
+	/* Everything that does not change between messages is formatted once. */
+	for (size_t i = 0; i < this->profiles.size(); i++) {
+		const Profile &profile = this->profiles[i];
+		Worker *worker = workers[i % workers.size()];
+		worker->streams.push_back(Stream());
+		Stream &stream = worker->streams.back();
+
+		stream.profile = &profile;
+		stream.nextSubject = 0;
+		stream.rateCount = 0;
+		stream.burstCount = 0;
+
+		size_t placeholder = profile.subject.find("{n}");
+		for (size_t n = 0; n < profile.subjects; n++) {
+			string subject = profile.subject;
+			if (placeholder != string::npos) {
+				char index[32];
+				sprintf(index, "%lu", (unsigned long) n);
+				subject.replace(placeholder, 3, index);
+			}
+			stream.subjects.push_back(subject);
+
+			string header = "<MESSAGE SUBJECT=\"";
+			AppendEscaped(header, subject);
+			header += "\" KIND=\"PUBLISH\">\n";
+			stream.headers.push_back(header);
+		}
+
+		for (size_t f = 0; f < profile.fields.size(); f++) {
+			const Field &field = profile.fields[f];
+			string tag = "\t<FIELD TYPE=\"";
+			tag += MessageRecord::TypeName(field.type);
+			tag += "\" NAME=\"";
+			AppendEscaped(tag, field.name);
+			tag += "\">";
+			stream.tags.push_back(tag);
+			stream.state.push_back(field.value.a);
+		}
+	}
+}
+
+LoadGenerator::~LoadGenerator(){
+	Stop();
+	for (size_t i = 0; i < workers.size(); i++)
+		delete workers[i];
+}
+
+bool LoadGenerator::Start(string &error){
+	started = uv_hrtime();
+	active = workers.size();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		if (uv_thread_create(&workers[i]->thread, Run, workers[i]) != 0) {
+			error = "Unable to create generator thread";
+
+			/* Let the threads that did start wind down. */
+			mutex.Enter();
+			stopping = true;
+			active -= workers.size() - i;
+			condition.Broadcast(Condition::USER);
+			mutex.Leave();
+			for (size_t j = 0; j < i; j++)
+				uv_thread_join(&workers[j]->thread);
+			return false;
+		}
+	}
+
+	running = true;
+	return true;
+}
+
+void LoadGenerator::Stop(){
+	if (!running)
+		return;
+
+	mutex.Enter();
+	stopping = true;
+	condition.Broadcast(Condition::USER);
+	mutex.Leave();
+
+	for (size_t i = 0; i < workers.size(); i++)
+		uv_thread_join(&workers[i]->thread);
+	running = false;
+}
+
+bool LoadGenerator::IsFinished(){
+	AutoMutex lock(mutex);
+	return active == 0;
+}
+
+LoadGenerator::Stats LoadGenerator::GetStats(){
+	AutoMutex lock(mutex);
+	return stats;
+}
+
+string LoadGenerator::LastError(){
+	AutoMutex lock(mutex);
+	return lastError;
+}
+
+void LoadGenerator::Run(void *arg){
+	Worker *worker = static_cast<Worker*>(arg);
+	LoadGenerator *generator = worker->generator;
+
+	generator->Generate(worker);
+
+	bool last;
+	{
+		AutoMutex lock(generator->mutex);
+		last = --generator->active == 0;
+	}
+	if (last)
+		generator->target->Finished();
+}
+
+void LoadGenerator::Generate(Worker *worker){
+	const uint64_t end = options.durationMs > 0 ? started + (uint64_t) (options.durationMs * 1e6) : 0;
+	string subject, xml, error;
+
+	for (;;) {
+		/* The stream with the earliest scheduled message goes next. */
+		Stream *next = NULL;
+		uint64_t due = 0;
+		bool burst = false;
+		for (size_t i = 0; i < worker->streams.size(); i++) {
+			Stream &stream = worker->streams[i];
+			const Profile &profile = *stream.profile;
+			if (profile.rate > 0) {
+				uint64_t at = started + (uint64_t) (stream.rateCount * 1e9 / profile.rate);
+				if (next == NULL || at < due) {
+					next = &stream;
+					due = at;
+					burst = false;
+				}
+			}
+			if (profile.burstSize > 0) {
+				uint64_t at = started + (uint64_t) (stream.burstCount * profile.burstEveryMs * 1e6);
+				if (next == NULL || at < due) {
+					next = &stream;
+					due = at;
+					burst = true;
+				}
+			}
+		}
+
+		if (next == NULL || (end != 0 && due >= end) || !WaitUntil(due))
+			return;
+
+		size_t count = burst ? next->profile->burstSize : 1;
+		for (size_t i = 0; i < count; i++) {
+			if (!Claim())
+				return;
+
+			Render(*next, worker->random, subject, xml);
+			error.clear();
+			bool ok = target->Publish(subject, xml, error);
+			Record(ok, uv_hrtime() - due, error);
+		}
+
+		if (burst)
+			next->burstCount++;
+		else
+			next->rateCount++;
+	}
+}
+
+bool LoadGenerator::WaitUntil(uint64_t due){
+	for (;;) {
+		uint64_t now = uv_hrtime();
+		if (now + SPIN_NS < due) {
+			AutoMutex lock(mutex);
+			if (stopping)
+				return false;
+			condition.Wait((long) ((due - now - SPIN_NS) / 1000000) + 1);
+			continue;
+		}
+
+		while (uv_hrtime() < due)
+			;
+
+		AutoMutex lock(mutex);
+		return !stopping;
+	}
+}
+
+bool LoadGenerator::Claim(){
+	AutoMutex lock(mutex);
+	if (stopping || (options.maxMessages > 0 && claimed >= options.maxMessages))
+		return false;
+	claimed++;
+	return true;
+}
+
+void LoadGenerator::Record(bool ok, uint64_t lag, const string &error){
+	AutoMutex lock(mutex);
+	if (!ok) {
+		stats.failed++;
+		lastError = error;
+		return;
+	}
+
+	stats.sent++;
+	stats.lag.Record(lag);
+	if (lag > LATE_NS)
+		stats.late++;
+}
+
+void LoadGenerator::Render(Stream &stream, unsigned long long &random, string &subject, string &xml){
+	size_t index = stream.nextSubject;
+	stream.nextSubject = (index + 1) % stream.subjects.size();
+
+	const vector<Field> &fields = stream.profile->fields;
+	subject = stream.subjects[index];
+	xml = stream.headers[index];
+	for (size_t i = 0; i < fields.size(); i++) {
+		xml += stream.tags[i];
+		AppendValue(fields[i], stream.state[i], random, xml);
+		xml += "</FIELD>\n";
+	}
+	xml += "</MESSAGE>";
+}
+
+void LoadGenerator::AppendValue(const Field &field, double &state, unsigned long long &random, string &out){
+	const Value &value = field.value;
+	double number;
+
+	switch (value.kind) {
+	case Value::CONSTANT:
+		AppendEscaped(out, value.text);
+		return;
+	case Value::TEXT:
+		for (int i = 0; i < (int) value.a; i++)
+			out += "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789"[(int) (NextRandom(random) * 36)];
+		return;
+	case Value::TIME: {
+		char buffer[50];
+		FormatNow(buffer);
+		out += buffer;
+		return;
+	}
+	case Value::UNIFORM:
+		number = value.a + (value.b - value.a) * NextRandom(random);
+		break;
+	case Value::NORMAL:
+		number = value.a + value.b * NextNormal(random);
+		break;
+	case Value::SEQUENCE:
+		number = state;
+		state += value.b;
+		break;
+	case Value::WALK:
+		number = state;
+		state += value.b * (2 * NextRandom(random) - 1);
+		break;
+	default:
+		return;
+	}
+
+	AppendNumber(out, field.type, number);
+}
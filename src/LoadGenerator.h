@@ -0,0 +1,156 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_LOADGENERATOR_H
+#define GMSECJS_LOADGENERATOR_H
+
+#include <string>
+#include <vector>
+
+#include "uv.h"
+#include "gmsec_defs.h"
+#include "Sync.h"
+
+#include "LatencyHistogram.h"
+
+/*
+ * Synthesizes messages from subject and field profiles and publishes them
+ * on its own threads at an open-loop rate.
+ *
+ * Every message has a scheduled time fixed up front: evenly spaced at the
+ * profile's rate, plus bursts of burstSize messages every burstEveryMs. A
+ * publish that stalls does not push the schedule back; the messages that
+ * fell due meanwhile go out as soon as it returns and their lag, publish
+ * time minus scheduled time, is recorded. Measuring against the schedule
+ * rather than the previous send avoids coordinated omission, where a slow
+ * system quietly lowers the offered load and hides its own stalls.
+ *
+ * Each profile is driven by one thread; profiles are spread round robin
+ * over the threads.
+ */
+class LoadGenerator {
+public:
+	class Target {
+	public:
+		virtual ~Target() {}
+
+		/* Called on the generator threads, concurrently when there are
+		 * several. */
+		virtual bool Publish(const std::string &subject, const std::string &xml, std::string &error) = 0;
+
+		/* Called on the last generator thread to stop. */
+		virtual void Finished() {}
+	};
+
+	/* How a field's value develops from one message to the next. */
+	struct Value {
+		enum Kind { CONSTANT, UNIFORM, NORMAL, SEQUENCE, WALK, TEXT, TIME };
+
+		Value() : kind(CONSTANT), a(0), b(0) {}
+		Kind kind;
+		double a;            /* min, mean, start or text length */
+		double b;            /* max, standard deviation or step */
+		std::string text;    /* constants, already formatted */
+	};
+
+	struct Field {
+		std::string name;
+		GMSEC_TYPE type;
+		Value value;
+	};
+
+	struct Profile {
+		Profile() : subjects(1), rate(0), burstSize(0), burstEveryMs(0) {}
+		std::string subject;      /* {n} is replaced by 0 to subjects - 1 in turn */
+		size_t subjects;
+		double rate;              /* messages per second */
+		size_t burstSize;
+		double burstEveryMs;
+		std::vector<Field> fields;
+	};
+
+	struct Options {
+		Options() : durationMs(0), maxMessages(0), threads(1), seed(1) {}
+		double durationMs;                /* 0 runs until stopped */
+		unsigned long long maxMessages;   /* 0 for no limit */
+		size_t threads;
+		unsigned long seed;
+	};
+
+	struct Stats {
+		Stats() : sent(0), failed(0), late(0) {}
+		unsigned long long sent;
+		unsigned long long failed;
+		unsigned long long late;     /* published over a millisecond after schedule */
+		LatencyHistogram lag;
+	};
+
+	LoadGenerator(const std::vector<Profile> &profiles, const Options &options, Target *target);
+	~LoadGenerator();
+
+	bool Start(std::string &error);
+
+	/* Stops early and waits for the threads. Safe to call more than once. */
+	void Stop();
+
+	bool IsFinished();
+	Stats GetStats();
+	std::string LastError();
+
+private:
+	struct Stream {
+		const Profile *profile;
+		std::vector<std::string> subjects;
+		std::vector<std::string> headers;    /* MESSAGE start tag per subject */
+		std::vector<std::string> tags;       /* FIELD start tag per field */
+		std::vector<double> state;           /* sequences and walks */
+		size_t nextSubject;
+		unsigned long long rateCount;
+		unsigned long long burstCount;
+	};
+
+	struct Worker {
+		LoadGenerator *generator;
+		uv_thread_t thread;
+		std::vector<Stream> streams;
+		unsigned long long random;
+	};
+
+	static void Run(void *arg);
+	void Generate(Worker *worker);
+	bool WaitUntil(uint64_t due);
+	bool Claim();
+	void Record(bool ok, uint64_t lag, const std::string &error);
+
+	void Render(Stream &stream, unsigned long long &random, std::string &subject, std::string &xml);
+	void AppendValue(const Field &field, double &state, unsigned long long &random, std::string &out);
+
+	std::vector<Profile> profiles;
+	Options options;
+	Target *target;
+	std::vector<Worker*> workers;
+	uint64_t started;
+
+	Mutex mutex;
+	Condition condition;
+	bool running;
+	bool stopping;
+	size_t active;
+	unsigned long long claimed;
+	Stats stats;
+	std::string lastError;
+};
+
+#endif
@@ -0,0 +1,91 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#if defined(_WIN32) || defined(__linux__)
+#include <malloc.h>
+#endif
+
+#include "MemoryStats.h"
+
+using namespace node;
+using namespace v8;
+
+void MemoryStats::Init(Handle<Object> target){
+	HandleScope scope;
+
+	NODE_SET_METHOD(target, "MemoryStats", Get);
+}
+
+/* Sums the CRT heap; returns false if the walk could not finish. */
+static bool AllocatorStats(double &heapBytes, double &inUseBytes, double &freeBytes){
+#ifdef _WIN32
+	_HEAPINFO info;
+	info._pentry = NULL;
+	heapBytes = inUseBytes = freeBytes = 0;
+
+	int status;
+	while ((status = _heapwalk(&info)) == _HEAPOK) {
+		heapBytes += (double) info._size;
+		if (info._useflag == _USEDENTRY)
+			inUseBytes += (double) info._size;
+		else
+			freeBytes += (double) info._size;
+	}
+	return status == _HEAPEND || status == _HEAPEMPTY;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+	struct mallinfo2 info = mallinfo2();
+	heapBytes = (double) (info.arena + info.hblkhd);
+	inUseBytes = (double) (info.uordblks + info.hblkhd);
+	freeBytes = (double) info.fordblks;
+	return true;
+#elif defined(__GLIBC__)
+	/* Older glibc counts in int, which wraps past 4 GB; good enough to watch
+	 * a trend over a soak run. */
+	struct mallinfo info = mallinfo();
+	heapBytes = (double) (unsigned) info.arena + (double) (unsigned) info.hblkhd;
+	inUseBytes = (double) (unsigned) info.uordblks + (double) (unsigned) info.hblkhd;
+	freeBytes = (double) (unsigned) info.fordblks;
+	return true;
+#else
+	return false;
+#endif
+}
+
+Handle<Value> MemoryStats::Get(const Arguments& args){
+	HandleScope scope;
+
+	Local<Object> result = Object::New();
+
+	double heapBytes, inUseBytes, freeBytes;
+	if (AllocatorStats(heapBytes, inUseBytes, freeBytes)) {
+		Local<Object> allocator = Object::New();
+		allocator->Set(String::NewSymbol("heapBytes"), Number::New(heapBytes));
+		allocator->Set(String::NewSymbol("inUseBytes"), Number::New(inUseBytes));
+		allocator->Set(String::NewSymbol("freeBytes"), Number::New(freeBytes));
+		result->Set(String::NewSymbol("allocator"), allocator);
+	}
+
+	HeapStatistics heap;
+	V8::GetHeapStatistics(&heap);
+
+	Local<Object> v8Heap = Object::New();
+	v8Heap->Set(String::NewSymbol("heapTotal"), Number::New((double) heap.total_heap_size()));
+	v8Heap->Set(String::NewSymbol("heapUsed"), Number::New((double) heap.used_heap_size()));
+	v8Heap->Set(String::NewSymbol("heapLimit"), Number::New((double) heap.heap_size_limit()));
+	v8Heap->Set(String::NewSymbol("executable"), Number::New((double) heap.total_heap_size_executable()));
+	result->Set(String::NewSymbol("v8"), v8Heap);
+
+	return scope.Close(result);
+}
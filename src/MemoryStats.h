@@ -0,0 +1,41 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_MEMORYSTATS_H
+#define GMSECJS_MEMORYSTATS_H
+
+#include "v8.h"
+#include "node.h"
+
+/*
+ * Module level view of native memory for soak tests:
+ *
+ *     GMSEC.MemoryStats() -> {allocator: {heapBytes, inUseBytes, freeBytes},
+ *                             v8: {heapTotal, heapUsed, heapLimit, executable}}
+ *
+ * The allocator figures come from the C runtime heap (mallinfo with glibc,
+ * a heap walk on Windows). Free bytes held in a heap that keeps growing
+ * point at fragmentation rather than a leak. Fields the platform cannot
+ * report are left out.
+ */
+class MemoryStats {
+public:
+	static void Init(v8::Handle<v8::Object> target);
+
+private:
+	static v8::Handle<v8::Value> Get(const v8::Arguments& args);
+};
+
+#endif
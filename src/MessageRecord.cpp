@@ -0,0 +1,295 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "MessageRecord.h"
+#include "FieldUtil.h"
+
+using namespace std;
+
+/* Appends each field visited to a record. */
+class RecordReader : public MiddlewareApi::FieldVisitor {
+public:
+	RecordReader(vector<MessageRecord::Field> &fields) : fields(fields) {}
+
+	void Visit(const MiddlewareApi::Field &field){
+		fields.push_back(MessageRecord::Field());
+		MessageRecord::Field &f = fields.back();
+		f.name = field.name;
+		f.type = field.type;
+		FieldToString(field, f.value);
+	}
+
+private:
+	vector<MessageRecord::Field> &fields;
+};
+
+void MessageRecord::FromMessage(MiddlewareApi::Message *msg){
+	MiddlewareApi *api = MiddlewareApi::Get();
+	subject = api->Subject(msg);
+	kind = api->Kind(msg);
+
+	fields.clear();
+	fields.reserve(api->FieldCount(msg));
+
+	RecordReader reader(fields);
+	api->VisitFields(msg, reader);
+}
+
+/* Reads NAME="value" or NAME='value' from the tag between start and end. */
+static bool GetAttribute(const string &xml, size_t start, size_t end, const char *name, string &value){
+	string key = string(" ") + name + "=";
+	size_t pos = xml.find(key, start);
+	if (pos == string::npos || pos + key.size() >= end)
+		return false;
+	pos += key.size();
+	char quote = xml[pos++];
+	if (quote != '"' && quote != '\'')
+		return false;
+	size_t close = xml.find(quote, pos);
+	if (close == string::npos || close > end)
+		return false;
+	value.assign(xml, pos, close - pos);
+	return true;
+}
+
+static void Unescape(const string &xml, size_t start, size_t end, string &out){
+	out.clear();
+	while (start < end) {
+		size_t amp = xml.find('&', start);
+		if (amp == string::npos || amp >= end) {
+			out.append(xml, start, end - start);
+			return;
+		}
+		out.append(xml, start, amp - start);
+
+		size_t semi = xml.find(';', amp);
+		string entity = semi != string::npos && semi < end ? xml.substr(amp + 1, semi - amp - 1) : "";
+		if (entity == "lt")        out += '<';
+		else if (entity == "gt")   out += '>';
+		else if (entity == "amp")  out += '&';
+		else if (entity == "quot") out += '"';
+		else if (entity == "apos") out += '\'';
+		else if (!entity.empty() && entity[0] == '#') {
+			bool hex = entity.size() > 1 && entity[1] == 'x';
+			out += (char) strtol(entity.c_str() + (hex ? 2 : 1), NULL, hex ? 16 : 10);
+		}
+		else {
+			out += '&';
+			start = amp + 1;
+			continue;
+		}
+		start = semi + 1;
+	}
+}
+
+bool MessageRecord::FromXML(const string &xml){
+	size_t start = xml.find("<MESSAGE");
+	size_t end = start == string::npos ? string::npos : xml.find('>', start);
+	if (end == string::npos)
+		return false;
+
+	string kindName;
+	if (!GetAttribute(xml, start, end, "SUBJECT", subject))
+		return false;
+	GetAttribute(xml, start, end, "KIND", kindName);
+	kind = KindFromName(kindName);
+
+	fields.clear();
+	string typeName, raw;
+	for (size_t pos = xml.find("<FIELD", end); pos != string::npos; pos = xml.find("<FIELD", end)) {
+		size_t tagEnd = xml.find('>', pos);
+		if (tagEnd == string::npos)
+			return false;
+
+		fields.push_back(Field());
+		Field &f = fields.back();
+		GetAttribute(xml, pos, tagEnd, "NAME", raw);
+		Unescape(raw, 0, raw.size(), f.name);
+		GetAttribute(xml, pos, tagEnd, "TYPE", typeName);
+		f.type = TypeFromName(typeName);
+
+		if (xml[tagEnd - 1] == '/') {
+			end = tagEnd;
+			continue;
+		}
+		end = xml.find("</FIELD>", tagEnd);
+		if (end == string::npos)
+			return false;
+		Unescape(xml, tagEnd + 1, end, f.value);
+	}
+
+	return true;
+}
+
+bool MessageRecord::FieldFromXML(const string &xml, const string &name, string &value){
+	string key = " NAME=\"" + name + "\"";
+	size_t pos = xml.find(key);
+	size_t tagEnd = pos == string::npos ? string::npos : xml.find('>', pos);
+	if (tagEnd == string::npos)
+		return false;
+
+	if (xml[tagEnd - 1] == '/') {
+		value.clear();
+		return true;
+	}
+
+	size_t end = xml.find("</FIELD>", tagEnd);
+	if (end == string::npos)
+		return false;
+	Unescape(xml, tagEnd + 1, end, value);
+	return true;
+}
+
+bool MessageRecord::SubjectFromXML(const string &xml, string &subject){
+	size_t start = xml.find("<MESSAGE");
+	size_t end = start == string::npos ? string::npos : xml.find('>', start);
+	return end != string::npos && GetAttribute(xml, start, end, "SUBJECT", subject);
+}
+
+bool MessageRecord::KindFromXML(const string &xml, GMSEC_MSG_KIND &kind){
+	size_t start = xml.find("<MESSAGE");
+	size_t end = start == string::npos ? string::npos : xml.find('>', start);
+	string kindName;
+	if (end == string::npos || !GetAttribute(xml, start, end, "KIND", kindName))
+		return false;
+	kind = KindFromName(kindName);
+	return true;
+}
+
+GMSEC_TYPE MessageRecord::TypeFromName(const string &name){
+	static const GMSEC_TYPE types[] = {
+		GMSEC_TYPE_CHAR, GMSEC_TYPE_BOOL, GMSEC_TYPE_I16, GMSEC_TYPE_U16, GMSEC_TYPE_I32,
+		GMSEC_TYPE_U32, GMSEC_TYPE_F32, GMSEC_TYPE_F64, GMSEC_TYPE_STRING, GMSEC_TYPE_BIN,
+		GMSEC_TYPE_I8, GMSEC_TYPE_U8, GMSEC_TYPE_I64, GMSEC_TYPE_U64
+	};
+	for (size_t i = 0; i < sizeof(types) / sizeof(types[0]); i++)
+		if (name == TypeName(types[i]))
+			return types[i];
+	return GMSEC_TYPE_UNSET;
+}
+
+GMSEC_MSG_KIND MessageRecord::KindFromName(const string &name){
+	if (name == "PUBLISH") return GMSEC_MSG_PUBLISH;
+	if (name == "REQUEST") return GMSEC_MSG_REQUEST;
+	if (name == "REPLY")   return GMSEC_MSG_REPLY;
+	return GMSEC_MSG_UNSET;
+}
+
+const char *MessageRecord::TypeName(GMSEC_TYPE type){
+	switch (type) {
+	case GMSEC_TYPE_CHAR:   return "CHAR";
+	case GMSEC_TYPE_BOOL:   return "BOOL";
+	case GMSEC_TYPE_I16:    return "I16";
+	case GMSEC_TYPE_U16:    return "U16";
+	case GMSEC_TYPE_I32:    return "I32";
+	case GMSEC_TYPE_U32:    return "U32";
+	case GMSEC_TYPE_F32:    return "F32";
+	case GMSEC_TYPE_F64:    return "F64";
+	case GMSEC_TYPE_STRING: return "STRING";
+	case GMSEC_TYPE_BIN:    return "BIN";
+	case GMSEC_TYPE_I8:     return "I8";
+	case GMSEC_TYPE_U8:     return "U8";
+	case GMSEC_TYPE_I64:    return "I64";
+	case GMSEC_TYPE_U64:    return "U64";
+	default:                return "UNSET";
+	}
+}
+
+const char *MessageRecord::KindName(GMSEC_MSG_KIND kind){
+	switch (kind) {
+	case GMSEC_MSG_PUBLISH: return "PUBLISH";
+	case GMSEC_MSG_REQUEST: return "REQUEST";
+	case GMSEC_MSG_REPLY:   return "REPLY";
+	default:                return "UNSET";
+	}
+}
+
+bool MessageRecord::IsNumericType(GMSEC_TYPE type){
+	return type != GMSEC_TYPE_STRING && type != GMSEC_TYPE_BIN && type != GMSEC_TYPE_UNSET;
+}
+
+void MessageRecord::ToJSON(double seq, string &out) const{
+	char seqBuffer[32];
+	sprintf(seqBuffer, "%.0f", seq);
+
+	out.clear();
+	out.reserve(64 + fields.size() * 48);
+
+	out += "{\"Subject\":";
+	AppendJSONString(out, subject);
+	out += ",\"Kind\":\"";
+	out += KindName(kind);
+	out += "\",\"Seq\":";
+	out += seqBuffer;
+	out += ",\"Fields\":{";
+
+	for (size_t i = 0; i < fields.size(); i++) {
+		if (i > 0)
+			out += ',';
+		AppendJSONField(out, fields[i]);
+	}
+
+	out += "}}";
+}
+
+void AppendJSONString(string &out, const string &value){
+	out += '"';
+	for (size_t i = 0; i < value.size(); i++) {
+		unsigned char c = value[i];
+		switch (c) {
+		case '"':  out += "\\\""; break;
+		case '\\': out += "\\\\"; break;
+		case '\n': out += "\\n"; break;
+		case '\r': out += "\\r"; break;
+		case '\t': out += "\\t"; break;
+		default:
+			if (c < 0x20) {
+				char escaped[8];
+				sprintf(escaped, "\\u%04x", c);
+				out += escaped;
+			}
+			else {
+				out += (char) c;
+			}
+		}
+	}
+	out += '"';
+}
+
+void AppendJSONField(string &out, const MessageRecord::Field &field){
+	AppendJSONString(out, field.name);
+	out += ":{\"Type\":\"";
+	out += MessageRecord::TypeName(field.type);
+	out += "\",\"Value\":";
+
+	/* Numbers go out bare so clients do not have to parse them again; the
+	 * check guards against values like nan that are not valid JSON. */
+	bool bare = false;
+	if (MessageRecord::IsNumericType(field.type) && !field.value.empty()) {
+		char *end;
+		strtod(field.value.c_str(), &end);
+		bare = *end == '\0' && field.value.find_first_of("nNiI") == string::npos;
+	}
+
+	if (bare)
+		out += field.value;
+	else
+		AppendJSONString(out, field.value);
+
+	out += '}';
+}
@@ -0,0 +1,72 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_MESSAGERECORD_H
+#define GMSECJS_MESSAGERECORD_H
+
+#include <string>
+#include <vector>
+
+#include "MiddlewareApi.h"
+
+/*
+ * Plain structured copy of a GMSEC message: subject, kind and the fields in
+ * order with their values rendered as text. Decoding happens once on the
+ * dispatch thread; encoders work from the record without touching the
+ * middleware again.
+ */
+struct MessageRecord {
+	struct Field {
+		std::string name;
+		GMSEC_TYPE type;
+		std::string value;
+	};
+
+	std::string subject;
+	GMSEC_MSG_KIND kind;
+	std::vector<Field> fields;
+
+	void FromMessage(MiddlewareApi::Message *msg);
+
+	/*
+	 * Rebuilds a record from the XML form the middleware produces with
+	 * ToXML, as stored in recordings. Returns false if the text is not a
+	 * MESSAGE element.
+	 */
+	bool FromXML(const std::string &xml);
+
+	/* Finds a single field's value in the XML without decoding the rest. */
+	static bool FieldFromXML(const std::string &xml, const std::string &name, std::string &value);
+	static bool SubjectFromXML(const std::string &xml, std::string &subject);
+	static bool KindFromXML(const std::string &xml, GMSEC_MSG_KIND &kind);
+
+	/*
+	 * Same shape the dataproxy builds from XML:
+	 * {"Subject":..,"Kind":..,"Seq":..,"Fields":{"NAME":{"Type":..,"Value":..}}}
+	 */
+	void ToJSON(double seq, std::string &out) const;
+
+	static const char *TypeName(GMSEC_TYPE type);
+	static const char *KindName(GMSEC_MSG_KIND kind);
+	static GMSEC_TYPE TypeFromName(const std::string &name);
+	static GMSEC_MSG_KIND KindFromName(const std::string &name);
+	static bool IsNumericType(GMSEC_TYPE type);
+};
+
+/* JSON fragments shared by the encoders. */
+void AppendJSONString(std::string &out, const std::string &value);
+void AppendJSONField(std::string &out, const MessageRecord::Field &field);
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <delayimp.h>
+#else
+#include <dlfcn.h>
+#endif
+
+#include "Middleware.h"
+#include "MiddlewareApi.h"
+#ifdef _WIN32
+#include "shim/MiddlewareShim.h"
+#endif
+
+using namespace std;
+using namespace v8;
+
+#ifdef _WIN32
+
+#pragma comment(lib, "delayimp.lib")
+
+static const char LIBRARY[] = "gmsecapi.dll";
+
+/* Kept apart from Load: __try cannot share a frame with C++ objects. */
+static bool LoadImports(){
+	__try {
+		return SUCCEEDED(__HrLoadAllImportsForDll(LIBRARY));
+	}
+	__except (EXCEPTION_EXECUTE_HANDLER) {
+		return false;
+	}
+}
+
+#else
+
+#ifndef GMSECJS_SHIM_LIBRARY
+#define GMSECJS_SHIM_LIBRARY "gmsec-shim.so"
+#endif
+
+/* The shim's path in the addon's own folder; a bare name would only be
+ * looked for on the process's search path. */
+static string ShimPath(){
+	string path = GMSECJS_SHIM_LIBRARY;
+
+	Dl_info info;
+	if (dladdr((void*) &ShimPath, &info) != 0 && info.dli_fname != NULL) {
+		string addon = info.dli_fname;
+		size_t slash = addon.rfind('/');
+		if (slash != string::npos)
+			path = addon.substr(0, slash + 1) + path;
+	}
+	return path;
+}
+
+#endif
+
+static bool attempted = false;
+static bool loaded = false;
+static string loadError;
+
+void Middleware::Init(Handle<Object> target){
+	HandleScope scope;
+
+	NODE_SET_METHOD(target, "MiddlewareLoaded", IsLoaded);
+}
+
+bool Middleware::Load(string &error){
+	if (!attempted) {
+		attempted = true;
+
+		MiddlewareApi *api = NULL;
+#ifdef _WIN32
+		if (LoadImports())
+			api = gmsecjs_middleware_api(GMSECJS_MIDDLEWARE_API_VERSION);
+		else
+			loadError = string("Unable to load ") + LIBRARY;
+#else
+		/* Global scope, since the middleware wrappers the API opens in turn
+		 * may expect its symbols there. The handle is never closed. */
+		string path = ShimPath();
+		void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_GLOBAL);
+		if (handle == NULL) {
+			loadError = string("Unable to load ") + path + ": " + dlerror();
+		}
+		else {
+			MiddlewareApiEntry entry = (MiddlewareApiEntry) dlsym(handle, GMSECJS_MIDDLEWARE_API_ENTRY);
+			api = entry != NULL ? entry(GMSECJS_MIDDLEWARE_API_VERSION) : NULL;
+			if (api == NULL)
+				loadError = path + " is not from this build of the addon";
+		}
+#endif
+
+		if (api != NULL) {
+			MiddlewareApi::Set(api);
+			loaded = true;
+		}
+	}
+
+	if (!loaded)
+		error = loadError;
+	return loaded;
+}
+
+bool Middleware::Loaded(){
+	return loaded;
+}
+
+Handle<Value> Middleware::IsLoaded(const Arguments& args){
+	HandleScope scope;
+
+	return scope.Close(Boolean::New(loaded));
+}
@@ -0,0 +1,52 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_MIDDLEWARE_H
+#define GMSECJS_MIDDLEWARE_H
+
+#include <string>
+
+#include "v8.h"
+#include "node.h"
+
+/*
+ * Loads the GMSEC API, and through it the middleware wrappers, on the first
+ * Connect instead of with the module, so tools that only replay recordings,
+ * generate local load or read stores never map it. The addon reaches the
+ * API only through MiddlewareApi.
+ *
+ * On Linux the shim implementing it is a library of its own, gmsec-shim.so
+ * next to the addon, linked against libGMSECAPI.so. Load opens it with
+ * immediate binding, so a missing or incomplete GMSEC library fails the
+ * Connect, and looks up its one entry point. On Windows the shim is built
+ * into the addon and gmsecapi.dll is delay loaded; Load binds the whole
+ * import table up front for the same reason.
+ *
+ *     GMSEC.MiddlewareLoaded() -> true once a Connect has loaded the API
+ */
+class Middleware {
+public:
+	static void Init(v8::Handle<v8::Object> target);
+
+	/* Loads the API once; later calls return the first result. JS thread only. */
+	static bool Load(std::string &error);
+
+	static bool Loaded();
+
+private:
+	static v8::Handle<v8::Value> IsLoaded(const v8::Arguments& args);
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_MIDDLEWAREAPI_H
+#define GMSECJS_MIDDLEWAREAPI_H
+
+#include <stddef.h>
+#include <string>
+
+#include "gmsec_defs.h"
+
+/*
+ * Every GMSEC call the addon makes. The shim in src/shim implements it
+ * against the C++ API; the addon only sees this interface and the types
+ * and constants of gmsec_defs.h, so it holds no reference to a GMSEC
+ * symbol of any kind and the build checks that it stays that way.
+ *
+ * Connections, messages and subscriptions are opaque. Calls that can fail
+ * return false or NULL and set error to the middleware's status text.
+ */
+class MiddlewareApi {
+public:
+	struct Connection;
+	struct Message;
+	struct Subscription;
+
+	/* A field as read from a message, valid during the visit only. CHAR,
+	 * BOOL and the 16, 32 bit and floating point types are numeric. */
+	struct Field {
+		const char *name;
+		GMSEC_TYPE type;
+		bool numeric;
+		double number;
+		const char *text;    /* STRING fields */
+	};
+
+	class FieldVisitor {
+	public:
+		virtual ~FieldVisitor() {}
+		virtual void Visit(const Field &field) = 0;
+	};
+
+	/* Called on the middleware's dispatch thread. */
+	class Callback {
+	public:
+		virtual ~Callback() {}
+		virtual void OnMessage(Message *msg) = 0;
+	};
+
+	virtual ~MiddlewareApi() {}
+
+	/* Creates a gmsec_mb connection to server, connects and starts
+	 * dispatching. */
+	virtual Connection *Connect(const char *server, std::string &error) = 0;
+	virtual void StopDispatch(Connection *connection) = 0;
+	/* Disconnects and destroys the connection. */
+	virtual void Disconnect(Connection *connection) = 0;
+
+	virtual Subscription *Subscribe(Connection *connection, const char *pattern, Callback *cb, std::string &error) = 0;
+	/* Frees the subscription once the middleware has dropped it. If that
+	 * fails it stays subscribed and valid. */
+	virtual bool Unsubscribe(Connection *connection, Subscription *subscription, std::string &error) = 0;
+
+	virtual Message *CreateMessage(Connection *connection, const char *xml, std::string &error) = 0;
+	virtual void DestroyMessage(Connection *connection, Message *msg) = 0;
+	virtual bool Publish(Connection *connection, Message *msg, std::string &error) = 0;
+
+	virtual const char *Subject(Message *msg) = 0;
+	virtual GMSEC_MSG_KIND Kind(Message *msg) = 0;
+	virtual void ToXML(Message *msg, std::string &xml) = 0;
+	virtual size_t FieldCount(Message *msg) = 0;
+	/* Returns false if the message has no such field. */
+	virtual bool VisitField(Message *msg, const char *name, FieldVisitor &visitor) = 0;
+	virtual void VisitFields(Message *msg, FieldVisitor &visitor) = 0;
+	/* Adds or replaces a field. STRING takes text, the numeric types take
+	 * number. */
+	virtual bool SetField(Message *msg, const char *name, GMSEC_TYPE type, double number, const char *text) = 0;
+
+	/* gmsec::util's clock: seconds since the epoch, and that time in the
+	 * GMSEC format. buffer takes at least 50 characters. */
+	virtual double Time() = 0;
+	virtual void FormatTime(double seconds, char *buffer) = 0;
+
+	/* The loaded implementation; NULL until Middleware::Load succeeds. */
+	static MiddlewareApi *Get() { return current; }
+	static void Set(MiddlewareApi *api) { current = api; }
+
+private:
+	static MiddlewareApi *current;
+};
+
+/*
+ * The shim's one exported symbol, looked up with dlsym. It returns NULL if
+ * the shim was built against a different version of this interface.
+ */
+#define GMSECJS_MIDDLEWARE_API_VERSION 1
+#define GMSECJS_MIDDLEWARE_API_ENTRY "gmsecjs_middleware_api"
+
+extern "C" typedef MiddlewareApi *(*MiddlewareApiEntry)(int version);
+
+#endif
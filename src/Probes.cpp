@@ -0,0 +1,36 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Probes.h"
+
+#ifdef GMSECJS_USDT
+
+/* Tracers find the semaphores through the probe notes and bump them in the
+ * running process; they must live in the .probes section. */
+#define GMSECJS_DEFINE_SEMAPHORE(name) \
+	volatile unsigned short GMSECJS_PROBE_SEMAPHORE(name) __attribute__((unused, section(".probes"))) = 0
+
+extern "C" {
+GMSECJS_DEFINE_SEMAPHORE(message__receive);
+GMSECJS_DEFINE_SEMAPHORE(message__enqueue);
+GMSECJS_DEFINE_SEMAPHORE(message__dequeue);
+GMSECJS_DEFINE_SEMAPHORE(callback__start);
+GMSECJS_DEFINE_SEMAPHORE(callback__end);
+GMSECJS_DEFINE_SEMAPHORE(message__drop);
+GMSECJS_DEFINE_SEMAPHORE(publish__enqueue);
+GMSECJS_DEFINE_SEMAPHORE(publish__done);
+}
+
+#endif
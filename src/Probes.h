@@ -0,0 +1,88 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_PROBES_H
+#define GMSECJS_PROBES_H
+
+/*
+ * USDT probes on the message path, provider "gmsecjs":
+ *
+ *     message__receive(subject, consumers)       dispatch thread, before encoding
+ *     message__enqueue(subject, seq, depth)      queued for the node thread
+ *     message__dequeue(subject, seq, depth, ns)  taken off the queue, after ns waiting
+ *     callback__start(subject, seq)
+ *     callback__end(subject, seq, ns)
+ *     message__drop(subject, reason)             see ProbeDropReason
+ *     publish__enqueue(subject, depth)           queued for the publisher thread
+ *     publish__done(subject, ns, failed)         ns since publish__enqueue
+ *
+ * Subjects are C strings, times are nanoseconds and depths count messages
+ * waiting. A disabled probe is a single nop; arguments that cost anything to
+ * compute are guarded by GMSECJS_PROBE_ENABLED, which reads the semaphore a
+ * tracer increments when it attaches:
+ *
+ *     bpftrace -e 'usdt:./gmsec.node:gmsecjs:callback__end { @ns = hist(arg2); }'
+ *
+ * Probes are compiled in on Linux whenever <sys/sdt.h> is available
+ * (systemtap-sdt-dev) unless GMSECJS_NO_USDT is defined. Elsewhere the
+ * macros expand to nothing.
+ */
+
+enum ProbeDropReason {
+	PROBE_DROP_UNMATCHED = 1,   /* a covering subscription delivered a subject nobody wants */
+	PROBE_DROP_UNSUBSCRIBED,    /* the consumer went away while the message was queued */
+	PROBE_DROP_PUBLISH          /* the middleware, or the local loopback, rejected a publish */
+};
+
+#if defined(__linux__) && !defined(GMSECJS_NO_USDT) && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#define GMSECJS_USDT 1
+#endif
+#endif
+
+#ifdef GMSECJS_USDT
+
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define GMSECJS_PROBE_SEMAPHORE(name) gmsecjs_##name##_semaphore
+
+extern "C" {
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(message__receive);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(message__enqueue);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(message__dequeue);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(callback__start);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(callback__end);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(message__drop);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(publish__enqueue);
+extern volatile unsigned short GMSECJS_PROBE_SEMAPHORE(publish__done);
+}
+
+#define GMSECJS_PROBE_ENABLED(name) __builtin_expect(GMSECJS_PROBE_SEMAPHORE(name) != 0, 0)
+#define GMSECJS_PROBE2(name, a, b) STAP_PROBE2(gmsecjs, name, a, b)
+#define GMSECJS_PROBE3(name, a, b, c) STAP_PROBE3(gmsecjs, name, a, b, c)
+#define GMSECJS_PROBE4(name, a, b, c, d) STAP_PROBE4(gmsecjs, name, a, b, c, d)
+
+#else
+
+/* Arguments still compile so probes without a tracer cannot rot. */
+#define GMSECJS_PROBE_ENABLED(name) false
+#define GMSECJS_PROBE2(name, a, b) do { if (false) { (void) (a); (void) (b); } } while (0)
+#define GMSECJS_PROBE3(name, a, b, c) do { if (false) { (void) (a); (void) (b); (void) (c); } } while (0)
+#define GMSECJS_PROBE4(name, a, b, c, d) do { if (false) { (void) (a); (void) (b); (void) (c); (void) (d); } } while (0)
+
+#endif
+
+#endif
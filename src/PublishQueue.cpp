@@ -0,0 +1,186 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <string.h>
+
+#include "PublishQueue.h"
+
+using namespace std;
+
+PublishQueue::Stats::Stats() : batches(0), jobs(0){
+	memset(flushes, 0, sizeof(flushes));
+	memset(sizes, 0, sizeof(sizes));
+}
+
+PublishQueue::PublishQueue(Target *target)
+	: target(target),
+	  condition(mutex),
+	  running(false),
+	  stopping(false),
+	  busy(false){
+}
+
+PublishQueue::~PublishQueue(){
+	vector<Job*> pending;
+	Stop(pending);
+}
+
+bool PublishQueue::Start(){
+	if (running)
+		return true;
+
+	stopping = false;
+	if (uv_thread_create(&thread, Run, this) != 0)
+		return false;
+
+	running = true;
+	return true;
+}
+
+void PublishQueue::Stop(vector<Job*> &pending){
+	if (running) {
+		mutex.Enter();
+		stopping = true;
+		condition.Signal(Condition::USER);
+		mutex.Leave();
+
+		uv_thread_join(&thread);
+		running = false;
+	}
+
+	AutoMutex lock(mutex);
+	pending.insert(pending.end(), done.begin(), done.end());
+	pending.insert(pending.end(), queue.begin(), queue.end());
+	done.clear();
+	queue.clear();
+}
+
+void PublishQueue::Configure(const Options &options){
+	AutoMutex lock(mutex);
+	this->options = options;
+
+	/* A thread holding a batch back re-evaluates it under the new limits. */
+	condition.Signal(Condition::USER);
+}
+
+PublishQueue::Options PublishQueue::GetOptions(){
+	AutoMutex lock(mutex);
+	return options;
+}
+
+void PublishQueue::Push(Job *job){
+	job->queued = uv_hrtime();
+
+	if (!Start()) {
+		vector<Job*> single(1, job);
+		target->Publish(single);
+		{
+			AutoMutex lock(mutex);
+			done.push_back(job);
+		}
+		target->Published();
+		return;
+	}
+
+	AutoMutex lock(mutex);
+	queue.push_back(job);
+
+	/* Wake the thread when the queue was idle or a held batch has filled
+	 * up; while it publishes it looks at the queue again by itself. */
+	if (!busy && (queue.size() == 1 || queue.size() >= options.maxBatch))
+		condition.Signal(Condition::USER);
+}
+
+void PublishQueue::TakeDone(vector<Job*> &jobs){
+	AutoMutex lock(mutex);
+	jobs.swap(done);
+	done.clear();
+}
+
+PublishQueue::Stats PublishQueue::GetStats(bool reset){
+	AutoMutex lock(mutex);
+	Stats result = stats;
+	if (reset)
+		stats = Stats();
+	return result;
+}
+
+void PublishQueue::Run(void *arg){
+	PublishQueue *publisher = static_cast<PublishQueue*>(arg);
+
+	AutoMutex lock(publisher->mutex);
+
+	/* Whether the queue had drained when the last batch finished. */
+	bool idle = true;
+	while (!publisher->stopping) {
+		deque<Job*> &queue = publisher->queue;
+		if (queue.empty()) {
+			idle = true;
+			publisher->condition.Wait();
+			continue;
+		}
+
+		if (queue.size() >= publisher->options.maxBatch) {
+			publisher->Flush(FLUSH_FULL);
+		}
+		else if (idle) {
+			publisher->Flush(FLUSH_IDLE);
+		}
+		else {
+			/* Messages that queued up behind the last batch wait for more to
+			 * join them, but never longer than the ceiling. */
+			uint64_t deadline = queue.front()->queued + (uint64_t) publisher->options.maxDelayUs * 1000;
+			uint64_t now = uv_hrtime();
+			if (now < deadline) {
+				publisher->condition.WaitMicros((long) ((deadline - now + 999) / 1000));
+				continue;
+			}
+			publisher->Flush(FLUSH_DEADLINE);
+		}
+		idle = false;
+	}
+}
+
+/* Called with the mutex held, which is released while the target publishes. */
+void PublishQueue::Flush(FlushReason reason){
+	size_t count = queue.size() < options.maxBatch ? queue.size() : options.maxBatch;
+	batch.assign(queue.begin(), queue.begin() + count);
+	queue.erase(queue.begin(), queue.begin() + count);
+	busy = true;
+
+	uint64_t now = uv_hrtime();
+	for (size_t i = 0; i < count; i++)
+		stats.wait.Record(now > batch[i]->queued ? now - batch[i]->queued : 0);
+
+	size_t bucket = 0;
+	while (bucket + 1 < SIZE_BUCKETS && (count >> (bucket + 1)) != 0)
+		bucket++;
+	stats.sizes[bucket]++;
+	stats.flushes[reason]++;
+	stats.batches++;
+	stats.jobs += count;
+
+	mutex.Leave();
+	target->Publish(batch);
+	mutex.Enter();
+
+	busy = false;
+	done.insert(done.end(), batch.begin(), batch.end());
+	batch.clear();
+
+	mutex.Leave();
+	target->Published();
+	mutex.Enter();
+}
@@ -0,0 +1,122 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_PUBLISHQUEUE_H
+#define GMSECJS_PUBLISHQUEUE_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "uv.h"
+#include "Sync.h"
+#include "LatencyHistogram.h"
+
+/*
+ * Publishes a connection's queued messages from one native thread, in
+ * batches that follow the load. A message pushed while the publisher is
+ * idle goes out at once, so a quiet connection adds no delay. Messages
+ * that pile up while a batch is being published are held until there are
+ * maxBatch of them or the oldest has waited maxDelayUs, then go out
+ * together.
+ *
+ * Jobs are published by the target on the publisher thread and come back
+ * through TakeDone() once their batch is finished.
+ */
+class PublishQueue {
+public:
+	struct Job {
+		/* uv_hrtime() when pushed. */
+		uint64_t queued;
+	};
+
+	class Target {
+	public:
+		virtual ~Target() {}
+
+		/* Publishes one batch, oldest job first. */
+		virtual void Publish(const std::vector<Job*> &batch) = 0;
+
+		/* Called once a batch has been published and its jobs wait in
+		 * TakeDone(). */
+		virtual void Published() = 0;
+	};
+
+	enum FlushReason { FLUSH_IDLE, FLUSH_FULL, FLUSH_DEADLINE, FLUSH_REASONS };
+
+	struct Options {
+		Options() : maxBatch(64), maxDelayUs(200) {}
+		size_t maxBatch;
+		long maxDelayUs;
+	};
+
+	/* Batch sizes are counted in power of two buckets: 1, 2-3, 4-7 and so
+	 * on; the last one takes every larger batch. */
+	static const size_t SIZE_BUCKETS = 16;
+
+	struct Stats {
+		Stats();
+		unsigned long long batches;
+		unsigned long long jobs;
+		unsigned long long flushes[FLUSH_REASONS];
+		unsigned long long sizes[SIZE_BUCKETS];
+
+		/* From Push() to the start of the job's batch. */
+		LatencyHistogram wait;
+	};
+
+	explicit PublishQueue(Target *target);
+	~PublishQueue();
+
+	/* Starts the publisher thread if it is not running yet. Push() calls
+	 * this itself. */
+	bool Start();
+
+	/* Stops after the batch in progress and hands back every job still
+	 * held, published or not. */
+	void Stop(std::vector<Job*> &pending);
+
+	void Configure(const Options &options);
+	Options GetOptions();
+
+	/* Should the thread not start, the job is published on the caller's
+	 * thread instead. */
+	void Push(Job *job);
+
+	void TakeDone(std::vector<Job*> &done);
+
+	Stats GetStats(bool reset);
+
+private:
+	static void Run(void *arg);
+	void Flush(FlushReason reason);
+
+	Target *target;
+	Options options;
+	Stats stats;
+
+	std::deque<Job*> queue;
+	std::vector<Job*> batch;
+	std::vector<Job*> done;
+
+	Mutex mutex;
+	Condition condition;
+	uv_thread_t thread;
+	bool running;
+	bool stopping;
+	bool busy;
+};
+
+#endif
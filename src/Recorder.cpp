@@ -0,0 +1,95 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Recorder.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+Persistent<FunctionTemplate> Recorder::s_ct;
+
+void Recorder::Init(Handle<Object> target){
+	HandleScope scope;
+
+	Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+	s_ct = Persistent<FunctionTemplate>::New(t);
+	s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+	s_ct->SetClassName(String::NewSymbol("Recorder"));
+
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Stop", Stop);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Stats", Stats);
+
+	target->Set(String::NewSymbol("Recorder"), s_ct->GetFunction());
+}
+
+Local<Object> Recorder::NewInstance(SegmentRecorder *recorder, Local<Object> owner){
+	HandleScope scope;
+
+	Local<Value> argv[1] = { External::New(recorder) };
+	Local<Object> handle = s_ct->GetFunction()->NewInstance(1, argv);
+	ObjectWrap::Unwrap<Recorder>(handle)->owner = Persistent<Object>::New(owner);
+	return scope.Close(handle);
+}
+
+Handle<Value> Recorder::New(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsExternal())
+		return ThrowException(Exception::TypeError(
+					  String::New("Use Connection.CreateRecorder() to create a recorder")));
+
+	Recorder *recorder = new Recorder(static_cast<SegmentRecorder*>(External::Unwrap(args[0])));
+	recorder->Wrap(args.This());
+	return args.This();
+}
+
+Recorder::~Recorder(){
+	owner.Dispose();
+}
+
+/*
+ * Stop() writes out the open block and the segment index. Messages that
+ * arrive afterwards are ignored.
+ */
+Handle<Value> Recorder::Stop(const Arguments& args){
+	HandleScope scope;
+
+	Recorder *recorder = ObjectWrap::Unwrap<Recorder>(args.This());
+	recorder->recorder->Stop();
+
+	return Undefined();
+}
+
+Handle<Value> Recorder::Stats(const Arguments& args){
+	HandleScope scope;
+
+	Recorder *recorder = ObjectWrap::Unwrap<Recorder>(args.This());
+	SegmentRecorder::Stats stats = recorder->recorder->GetStats();
+	string error = recorder->recorder->LastError();
+
+	Local<Object> obj = Object::New();
+	obj->Set(String::NewSymbol("messages"), Number::New((double) stats.messages));
+	obj->Set(String::NewSymbol("dropped"), Number::New((double) stats.dropped));
+	obj->Set(String::NewSymbol("blocks"), Number::New((double) stats.blocks));
+	obj->Set(String::NewSymbol("segments"), Number::New((double) stats.segments));
+	obj->Set(String::NewSymbol("rawBytes"), Number::New((double) stats.rawBytes));
+	obj->Set(String::NewSymbol("compressedBytes"), Number::New((double) stats.compressedBytes));
+	obj->Set(String::NewSymbol("error"), error.empty() ? Local<Value>::New(Null()) : Local<Value>::New(String::New(error.c_str())));
+
+	return scope.Close(obj);
+}
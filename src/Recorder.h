@@ -0,0 +1,48 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_RECORDER_H
+#define GMSECJS_RECORDER_H
+
+#include "v8.h"
+#include "node.h"
+
+#include "SegmentRecorder.h"
+
+/*
+ * JS handle onto a SegmentRecorder created by Connection.CreateRecorder().
+ * The recorder is owned by the connection, which keeps its subscription;
+ * the handle keeps the connection alive.
+ */
+class Recorder : public node::ObjectWrap {
+public:
+	static v8::Persistent<v8::FunctionTemplate> s_ct;
+
+	static void Init(v8::Handle<v8::Object> target);
+	static v8::Local<v8::Object> NewInstance(SegmentRecorder *recorder, v8::Local<v8::Object> owner);
+
+private:
+	Recorder(SegmentRecorder *recorder) : recorder(recorder) {}
+	~Recorder();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Stop(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Stats(const v8::Arguments& args);
+
+	SegmentRecorder *recorder;
+	v8::Persistent<v8::Object> owner;
+};
+
+#endif
@@ -0,0 +1,758 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Recording.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+/* Batches a segment may hold before its job waits for the callback. */
+static const size_t MAX_QUEUED_BATCHES = 4;
+
+Persistent<FunctionTemplate> Recording::s_ct;
+
+void Recording::Init(Handle<Object> target){
+	HandleScope scope;
+
+	Local<FunctionTemplate> t = FunctionTemplate::New(New);
+
+	s_ct = Persistent<FunctionTemplate>::New(t);
+	s_ct->InstanceTemplate()->SetInternalFieldCount(1);
+	s_ct->SetClassName(String::NewSymbol("Recording"));
+
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Info", Info);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Read", Read);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Query", Query);
+	NODE_SET_PROTOTYPE_METHOD(s_ct, "Export", Export);
+
+	target->Set(String::NewSymbol("Recording"), s_ct->GetFunction());
+	NODE_SET_METHOD(target, "OpenRecording", Open);
+	NODE_SET_METHOD(target, "MergeRecordings", Merge);
+}
+
+Recording::~Recording(){
+	delete set;
+}
+
+Handle<Value> Recording::New(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsExternal())
+		return ThrowException(Exception::TypeError(
+					  String::New("Use GMSEC.OpenRecording() to open a recording")));
+
+	Recording *recording = new Recording(static_cast<SegmentSet*>(External::Unwrap(args[0])));
+	recording->Wrap(args.This());
+	return args.This();
+}
+
+Handle<Value> Recording::Open(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, pathV8Str);
+	REQ_FUN_ARG(1, cb);
+
+	open_baton_t *baton = new open_baton_t();
+	baton->path = *String::Utf8Value(pathV8Str);
+	baton->set = new SegmentSet();
+	baton->cb = Persistent<Function>::New(cb);
+
+	uv_work_t *req = new uv_work_t;
+	req->data = baton;
+
+	uv_queue_work(uv_default_loop(), req, EIO_Open, (uv_after_work_cb)EIO_AfterOpen);
+
+	return Undefined();
+}
+
+void Recording::EIO_Open(uv_work_t *req){
+	open_baton_t *baton = static_cast<open_baton_t*>(req->data);
+
+	baton->set->Open(baton->path, baton->error);
+}
+
+void Recording::EIO_AfterOpen(uv_work_t *req){
+	HandleScope scope;
+
+	open_baton_t *baton = static_cast<open_baton_t*>(req->data);
+
+	Local<Value> argv[2];
+	if (baton->error.empty()) {
+		Local<Value> ctorArgv[1] = { External::New(baton->set) };
+		argv[0] = Local<Value>::New(Null());
+		argv[1] = s_ct->GetFunction()->NewInstance(1, ctorArgv);
+	}
+	else {
+		delete baton->set;
+		argv[0] = Exception::Error(String::New(baton->error.c_str()));
+		argv[1] = Local<Value>::New(Undefined());
+	}
+
+	TryCatch try_catch;
+	baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+
+	baton->cb.Dispose();
+	delete baton;
+	delete req;
+}
+
+Handle<Value> Recording::Info(const Arguments& args){
+	HandleScope scope;
+
+	Recording *recording = ObjectWrap::Unwrap<Recording>(args.This());
+	const vector<SegmentReader*> &segments = recording->set->Segments();
+
+	double messages = 0, rawBytes = 0, compressedBytes = 0;
+	double start = 0, end = 0;
+	bool any = false;
+
+	Local<Array> list = Array::New(segments.size());
+	for (size_t i = 0; i < segments.size(); i++) {
+		const vector<Segment::Block> &blocks = segments[i]->Blocks();
+
+		double segmentMessages = 0;
+		for (size_t b = 0; b < blocks.size(); b++) {
+			segmentMessages += blocks[b].count;
+			rawBytes += blocks[b].rawSize;
+			compressedBytes += blocks[b].compressedSize;
+			if (!any || blocks[b].first < start)
+				start = blocks[b].first;
+			if (!any || blocks[b].last > end)
+				end = blocks[b].last;
+			any = true;
+		}
+		messages += segmentMessages;
+
+		Local<Object> segment = Object::New();
+		segment->Set(String::NewSymbol("path"), String::New(segments[i]->Path().c_str()));
+		segment->Set(String::NewSymbol("blocks"), Number::New((double) blocks.size()));
+		segment->Set(String::NewSymbol("messages"), Number::New(segmentMessages));
+		segment->Set(String::NewSymbol("recovered"), Boolean::New(segments[i]->Recovered()));
+		list->Set(i, segment);
+	}
+
+	Local<Object> obj = Object::New();
+	obj->Set(String::NewSymbol("segments"), list);
+	obj->Set(String::NewSymbol("messages"), Number::New(messages));
+	obj->Set(String::NewSymbol("rawBytes"), Number::New(rawBytes));
+	obj->Set(String::NewSymbol("compressedBytes"), Number::New(compressedBytes));
+	obj->Set(String::NewSymbol("start"), any ? Local<Value>::New(Number::New(start)) : Local<Value>::New(Null()));
+	obj->Set(String::NewSymbol("end"), any ? Local<Value>::New(Number::New(end)) : Local<Value>::New(Null()));
+
+	return scope.Close(obj);
+}
+
+Handle<Value> Recording::Read(const Arguments& args){
+	HandleScope scope;
+
+	REQ_NUM_ARG(0, fromMs);
+	REQ_NUM_ARG(1, toMs);
+
+	int cbIndex = (args.Length() > 2 && args[2]->IsFunction()) ? 2 : 3;
+	Local<Object> options = (cbIndex == 3 && args[2]->IsObject()) ? args[2]->ToObject() : Object::New();
+	REQ_FUN_ARG(cbIndex, cb);
+
+	Recording *recording = ObjectWrap::Unwrap<Recording>(args.This());
+
+	read_baton_t *baton = new read_baton_t();
+	baton->recording = recording;
+	baton->query.from = fromMs;
+	baton->query.to = toMs;
+	baton->cb = Persistent<Function>::New(cb);
+
+	Local<Value> subjects = options->Get(String::NewSymbol("subjects"));
+	if (subjects->IsArray()) {
+		Local<Array> array = Local<Array>::Cast(subjects);
+		for (uint32_t i = 0; i < array->Length(); i++)
+			baton->query.subjects.push_back(*String::Utf8Value(array->Get(i)));
+	}
+
+	/* Keep the recording alive while the thread pool reads from it. */
+	recording->Ref();
+
+	uv_work_t *req = new uv_work_t;
+	req->data = baton;
+
+	uv_queue_work(uv_default_loop(), req, EIO_Read, (uv_after_work_cb)EIO_AfterRead);
+
+	return Undefined();
+}
+
+void Recording::EIO_Read(uv_work_t *req){
+	read_baton_t *baton = static_cast<read_baton_t*>(req->data);
+
+	baton->recording->set->Read(baton->query, baton->messages, baton->stats, baton->error);
+}
+
+void Recording::EIO_AfterRead(uv_work_t *req){
+	HandleScope scope;
+
+	read_baton_t *baton = static_cast<read_baton_t*>(req->data);
+
+	Local<Value> argv[3];
+	if (baton->error.empty()) {
+		Local<Array> messages = MessagesToArray(baton->messages);
+
+		Local<Object> stats = Object::New();
+		stats->Set(String::NewSymbol("blocksRead"), Number::New((double) baton->stats.blocksRead));
+		stats->Set(String::NewSymbol("blocksSkipped"), Number::New((double) baton->stats.blocksSkipped));
+
+		argv[0] = Local<Value>::New(Null());
+		argv[1] = messages;
+		argv[2] = stats;
+	}
+	else {
+		argv[0] = Exception::Error(String::New(baton->error.c_str()));
+		argv[1] = Local<Value>::New(Undefined());
+		argv[2] = Local<Value>::New(Undefined());
+	}
+
+	baton->recording->Unref();
+
+	TryCatch try_catch;
+	baton->cb->Call(Context::GetCurrent()->Global(), 3, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+
+	baton->cb.Dispose();
+	delete baton;
+	delete req;
+}
+
+Local<Array> Recording::MessagesToArray(const vector<RecordedMessage> &messages){
+	Local<Array> array = Array::New(messages.size());
+	for (size_t i = 0; i < messages.size(); i++) {
+		const RecordedMessage &message = messages[i];
+		Local<Object> entry = Object::New();
+		entry->Set(String::NewSymbol("time"), Number::New(message.time));
+		entry->Set(String::NewSymbol("subject"), String::New(message.subject.c_str()));
+		entry->Set(String::NewSymbol("message"), String::New(message.xml.c_str(), message.xml.size()));
+		array->Set(i, entry);
+	}
+	return array;
+}
+
+/* Hands a segment's matches to the main thread, waiting while it is
+ * already holding MAX_QUEUED_BATCHES of them. */
+class Recording::QuerySink : public RecordingQuery::Sink {
+public:
+	QuerySink(query_state_t *state, size_t segment) : state(state), segment(segment) {}
+
+	bool Batch(vector<RecordedMessage> &messages){
+		{
+			AutoMutex lock(state->mutex);
+			while (!state->cancelled && state->batches[segment].size() >= MAX_QUEUED_BATCHES)
+				state->condition.Wait();
+
+			if (state->cancelled)
+				return false;
+
+			vector<RecordedMessage> *batch = new vector<RecordedMessage>();
+			batch->swap(messages);
+			state->batches[segment].push_back(batch);
+		}
+
+		uv_async_send(&state->async);
+		return true;
+	}
+
+private:
+	query_state_t *state;
+	size_t segment;
+};
+
+Handle<Value> Recording::Query(const Arguments& args){
+	HandleScope scope;
+
+	OPT_OBJ_ARG(0, options);
+	REQ_FUN_ARG(1, onBatch);
+	REQ_FUN_ARG(2, cb);
+
+	Recording *recording = ObjectWrap::Unwrap<Recording>(args.This());
+
+	RecordingQuery query;
+	const char *invalid = ParseQuery(options, query);
+	if (invalid != NULL)
+		return ThrowException(Exception::TypeError(String::New(invalid)));
+
+	double parallel = GetNumberOption(options, "parallel", 4);
+	if (query.batchSize < 1 || parallel < 1)
+		return ThrowException(Exception::RangeError(
+					  String::New("batchSize and parallel must be at least 1")));
+
+	query_state_t *state = new query_state_t();
+	state->recordings.push_back(recording);
+	state->query = query;
+	state->parallel = (size_t) parallel;
+	state->batches.resize(recording->set->Segments().size());
+
+	StartQuery(state, onBatch, cb);
+
+	return Undefined();
+}
+
+/*
+ * Reads {from, to, subject, where, batchSize} into query. Returns a
+ * message for a TypeError, or NULL.
+ */
+const char *Recording::ParseQuery(Local<Object> options, RecordingQuery &query){
+	query.from = GetNumberOption(options, "from", query.from);
+	query.to = GetNumberOption(options, "to", query.to);
+	query.subject = GetStringOption(options, "subject", "");
+
+	double batchSize = GetNumberOption(options, "batchSize", (double) query.batchSize);
+	query.batchSize = batchSize < 1 ? 0 : (size_t) batchSize;
+
+	Local<Value> where = options->Get(String::NewSymbol("where"));
+	if (!where->IsUndefined() && !where->IsArray())
+		return "where must be an array of {field, op, value}";
+
+	if (where->IsArray()) {
+		Local<Array> array = Local<Array>::Cast(where);
+		for (uint32_t i = 0; i < array->Length(); i++) {
+			if (!array->Get(i)->IsObject())
+				return "where must be an array of {field, op, value}";
+			Local<Object> clause = array->Get(i)->ToObject();
+			Local<Value> value = clause->Get(String::NewSymbol("value"));
+
+			RecordingQuery::Predicate predicate;
+			predicate.field = GetStringOption(clause, "field", "");
+			if (predicate.field.empty() || !(value->IsNumber() || value->IsString()))
+				return "Each predicate needs a field name and a number or string value";
+
+			if (!RecordingQuery::ParseOp(GetStringOption(clause, "op", "=="), predicate.op))
+				return "op must be one of ==, !=, <, <=, >, >=";
+
+			predicate.numeric = value->IsNumber();
+			predicate.number = value->NumberValue();
+			if (!predicate.numeric)
+				predicate.text = *String::Utf8Value(value);
+			query.where.push_back(predicate);
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * MergeRecordings([recording, ...], options, onBatch, done) streams the
+ * recordings as one time ordered sequence. With options.output the merge
+ * is also written as a new recording, and onBatch may be null.
+ */
+Handle<Value> Recording::Merge(const Arguments& args){
+	HandleScope scope;
+
+	if (args.Length() < 1 || !args[0]->IsArray())
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 0 must be an array of recordings")));
+
+	OPT_OBJ_ARG(1, options);
+	if (args.Length() <= 2 || !(args[2]->IsFunction() || args[2]->IsNull()))
+		return ThrowException(Exception::TypeError(
+					  String::New("Argument 2 must be a function or null")));
+	REQ_FUN_ARG(3, cb);
+
+	vector<Recording*> recordings;
+	vector<const SegmentSet*> sets;
+	RecordingQuery query;
+	string orderField;
+	const char *invalid = ParseMerge(args[0], options, recordings, sets, query, orderField);
+	if (invalid != NULL)
+		return ThrowException(Exception::TypeError(String::New(invalid)));
+	if (query.batchSize < 1)
+		return ThrowException(Exception::RangeError(
+					  String::New("batchSize must be at least 1")));
+
+	RecordingWriter::Options outputOptions;
+	outputOptions.directory = GetStringOption(options, "output", "");
+	double blockBytes = GetNumberOption(options, "blockBytes", (double) outputOptions.blockBytes);
+	double segmentBytes = GetNumberOption(options, "segmentBytes", (double) outputOptions.segmentBytes);
+	double level = GetNumberOption(options, "level", outputOptions.level);
+	if (blockBytes < 1024 || segmentBytes < blockBytes || level < 1 || level > 9)
+		return ThrowException(Exception::RangeError(
+					  String::New("Options 'blockBytes' (at least 1024), 'segmentBytes' and 'level' (1 to 9) are out of range")));
+	outputOptions.blockBytes = (size_t) blockBytes;
+	outputOptions.segmentBytes = (unsigned long long) segmentBytes;
+	outputOptions.level = (int) level;
+
+	if (args[2]->IsNull() && outputOptions.directory.empty())
+		return ThrowException(Exception::TypeError(
+					  String::New("Either onBatch or the output option is required")));
+
+	query_state_t *state = new query_state_t();
+	state->recordings = recordings;
+	state->query = query;
+	state->parallel = 1;
+	state->batches.resize(1);
+	state->merge = new RecordingMerge(sets, query, orderField);
+	if (!outputOptions.directory.empty())
+		state->output = new RecordingWriter(outputOptions);
+
+	StartQuery(state, args[2]->IsFunction() ? Local<Function>::Cast(args[2]) : Local<Function>(), cb);
+
+	return Undefined();
+}
+
+const char *Recording::ParseMerge(Local<Value> inputs, Local<Object> options,
+                                  vector<Recording*> &recordings, vector<const SegmentSet*> &sets,
+                                  RecordingQuery &query, string &orderField){
+	Local<Array> list;
+	if (inputs->IsArray()) {
+		list = Local<Array>::Cast(inputs);
+	}
+	else {
+		list = Array::New(1);
+		list->Set(0, inputs);
+	}
+
+	for (uint32_t i = 0; i < list->Length(); i++) {
+		Local<Value> input = list->Get(i);
+		if (!input->IsObject() || !s_ct->HasInstance(input))
+			return "Expected a recording or an array of recordings";
+		recordings.push_back(ObjectWrap::Unwrap<Recording>(input->ToObject()));
+		sets.push_back(recordings.back()->set);
+	}
+
+	const char *invalid = ParseQuery(options, query);
+	if (invalid != NULL)
+		return invalid;
+
+	string orderBy = GetStringOption(options, "orderBy", "receive");
+	orderField = orderBy == "receive" ? string() : orderBy;
+	return NULL;
+}
+
+void Recording::StartQuery(query_state_t *state, Local<Function> onBatch, Local<Function> cb){
+	state->done.resize(state->batches.size(), false);
+	state->streaming = !onBatch.IsEmpty();
+	if (state->streaming)
+		state->onBatch = Persistent<Function>::New(onBatch);
+	state->cb = Persistent<Function>::New(cb);
+
+	uv_async_init(uv_default_loop(), &state->async, OnQueryAsync);
+	state->async.data = state;
+
+	/* Keep the recordings alive while the thread pool reads from them. */
+	for (size_t i = 0; i < state->recordings.size(); i++)
+		state->recordings[i]->Ref();
+
+	LaunchQueries(state);
+
+	/* Even an empty recording reports from the event loop, never from
+	 * inside this call. */
+	uv_async_send(&state->async);
+}
+
+void Recording::LaunchQueries(query_state_t *state){
+	size_t segments = state->batches.size();
+
+	while (!state->cancelled && state->running < state->parallel && state->launched < segments) {
+		query_job_t *job = new query_job_t();
+		job->state = state;
+		job->segment = state->launched++;
+		state->running++;
+
+		uv_work_t *req = new uv_work_t;
+		req->data = job;
+
+		uv_queue_work(uv_default_loop(), req, state->merge != NULL ? EIO_Merge : EIO_Query,
+		              (uv_after_work_cb)EIO_AfterQuery);
+	}
+}
+
+void Recording::EIO_Query(uv_work_t *req){
+	query_job_t *job = static_cast<query_job_t*>(req->data);
+	query_state_t *state = job->state;
+
+	QuerySink sink(state, job->segment);
+	state->query.Run(*state->recordings[0]->set->Segments()[job->segment], sink, job->stats, job->error);
+}
+
+/* The merge is sequential, so it runs as the query's only job and streams
+ * through batch slot 0. */
+void Recording::EIO_Merge(uv_work_t *req){
+	query_job_t *job = static_cast<query_job_t*>(req->data);
+	query_state_t *state = job->state;
+
+	QuerySink sink(state, 0);
+	bool more = true;
+
+	if (state->output != NULL && !state->output->Open(job->error))
+		return;
+
+	vector<RecordedMessage> batch;
+	RecordedMessage message;
+	while (more && state->merge->Next(message, job->error)) {
+		if (state->output != NULL && !state->output->Append(message, job->error))
+			break;
+
+		if (state->streaming) {
+			batch.push_back(RecordedMessage());
+			batch.back().time = message.time;
+			batch.back().subject.swap(message.subject);
+			batch.back().xml.swap(message.xml);
+			if (batch.size() >= state->query.batchSize) {
+				more = sink.Batch(batch);
+				batch.clear();
+			}
+		}
+	}
+
+	if (job->error.empty() && more && !batch.empty())
+		sink.Batch(batch);
+
+	if (state->output != NULL && job->error.empty())
+		state->output->Close(job->error);
+
+	job->stats = state->merge->GetStats();
+}
+
+void Recording::EIO_AfterQuery(uv_work_t *req){
+	query_job_t *job = static_cast<query_job_t*>(req->data);
+	query_state_t *state = job->state;
+
+	{
+		AutoMutex lock(state->mutex);
+		state->running--;
+		state->done[job->segment] = true;
+		state->stats.Add(job->stats);
+		if (!job->error.empty() && state->error.empty()) {
+			state->error = job->error;
+			state->cancelled = true;
+			state->condition.Broadcast(Condition::USER);
+		}
+	}
+
+	delete job;
+	delete req;
+
+	LaunchQueries(state);
+	DrainQuery(state);
+}
+
+void Recording::OnQueryAsync(uv_async_t *handle, int status /*UNUSED*/){
+	DrainQuery(static_cast<query_state_t*>(handle->data));
+}
+
+/*
+ * Runs on the main thread: delivers queued batches segment by segment,
+ * then reports the outcome once every job has returned.
+ */
+void Recording::DrainQuery(query_state_t *state){
+	HandleScope scope;
+
+	if (state->finished)
+		return;
+
+	size_t segments = state->batches.size();
+	for (;;) {
+		vector<RecordedMessage> *batch = NULL;
+		{
+			AutoMutex lock(state->mutex);
+			if (state->cancelled || state->next >= segments)
+				break;
+
+			if (!state->batches[state->next].empty()) {
+				batch = state->batches[state->next].front();
+				state->batches[state->next].pop_front();
+				state->condition.Broadcast(Condition::USER);
+			}
+			else if (state->done[state->next]) {
+				state->next++;
+				continue;
+			}
+			else {
+				break;
+			}
+		}
+
+		Local<Value> argv[1] = { MessagesToArray(*batch) };
+		delete batch;
+
+		TryCatch try_catch;
+		Local<Value> result = state->onBatch->Call(Context::GetCurrent()->Global(), 1, argv);
+
+		if (try_catch.HasCaught() || result->IsFalse()) {
+			AutoMutex lock(state->mutex);
+			state->cancelled = true;
+			state->condition.Broadcast(Condition::USER);
+		}
+
+		if (try_catch.HasCaught()) {
+			FatalException(try_catch);
+			break;
+		}
+	}
+
+	{
+		AutoMutex lock(state->mutex);
+		if (state->running > 0 || (!state->cancelled && state->launched < segments))
+			return;
+
+		/* Nothing is running any more, so whatever a cancelled query left
+		 * queued can go. */
+		for (size_t s = 0; s < segments; s++)
+			for (size_t b = 0; b < state->batches[s].size(); b++)
+				delete state->batches[s][b];
+		state->finished = true;
+	}
+
+	Local<Object> stats = Object::New();
+	stats->Set(String::NewSymbol("blocksRead"), Number::New((double) state->stats.blocksRead));
+	stats->Set(String::NewSymbol("blocksSkipped"), Number::New((double) state->stats.blocksSkipped));
+	stats->Set(String::NewSymbol("messagesScanned"), Number::New((double) state->stats.messagesScanned));
+	stats->Set(String::NewSymbol("messagesMatched"), Number::New((double) state->stats.messagesMatched));
+	if (state->output != NULL) {
+		stats->Set(String::NewSymbol("messagesWritten"), Number::New((double) state->output->Messages()));
+		stats->Set(String::NewSymbol("segmentsWritten"), Number::New((double) state->output->Segments()));
+	}
+
+	Local<Value> argv[2];
+	argv[0] = state->error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(state->error.c_str()));
+	argv[1] = stats;
+
+	for (size_t i = 0; i < state->recordings.size(); i++)
+		state->recordings[i]->Unref();
+	uv_close((uv_handle_t*) &state->async, OnQueryClosed);
+
+	TryCatch try_catch;
+	state->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+}
+
+void Recording::OnQueryClosed(uv_handle_t *handle){
+	query_state_t *state = static_cast<query_state_t*>(handle->data);
+
+	if (state->streaming)
+		state->onBatch.Dispose();
+	state->cb.Dispose();
+	delete state->merge;
+	delete state->output;
+	delete state;
+}
+
+Handle<Value> Recording::Export(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, directoryV8Str);
+
+	int cbIndex = (args.Length() > 1 && args[1]->IsFunction()) ? 1 : 2;
+	Local<Object> options = (cbIndex == 2 && args[1]->IsObject()) ? args[1]->ToObject() : Object::New();
+	REQ_FUN_ARG(cbIndex, cb);
+
+	Recording *recording = ObjectWrap::Unwrap<Recording>(args.This());
+
+	RecordingQuery query;
+	const char *invalid = ParseQuery(options, query);
+	if (invalid != NULL)
+		return ThrowException(Exception::TypeError(String::New(invalid)));
+
+	double batchRows = GetNumberOption(options, "batchRows", 65536);
+	double parallel = GetNumberOption(options, "parallel", 4);
+	if (batchRows < 1 || parallel < 1)
+		return ThrowException(Exception::RangeError(
+					  String::New("batchRows and parallel must be at least 1")));
+
+	export_state_t *state = new export_state_t();
+	state->recording = recording;
+	state->exporter = new ColumnarExport(query, *String::Utf8Value(directoryV8Str), (size_t) batchRows);
+	state->parallel = (size_t) parallel;
+	state->cb = Persistent<Function>::New(cb);
+
+	/* Keep the recording alive while the thread pool reads from it. */
+	recording->Ref();
+
+	LaunchExports(state);
+
+	return Undefined();
+}
+
+/* An empty recording still gets one job so the callback comes from the
+ * event loop. */
+void Recording::LaunchExports(export_state_t *state){
+	size_t segments = state->recording->set->Segments().size();
+	size_t jobs = segments > 0 ? segments : 1;
+
+	while (state->error.empty() && state->running < state->parallel && state->launched < jobs) {
+		export_job_t *job = new export_job_t();
+		job->state = state;
+		job->segment = state->launched++;
+		state->running++;
+
+		uv_work_t *req = new uv_work_t;
+		req->data = job;
+
+		uv_queue_work(uv_default_loop(), req, EIO_Export, (uv_after_work_cb)EIO_AfterExport);
+	}
+}
+
+void Recording::EIO_Export(uv_work_t *req){
+	export_job_t *job = static_cast<export_job_t*>(req->data);
+	const vector<SegmentReader*> &segments = job->state->recording->set->Segments();
+
+	if (job->segment < segments.size())
+		job->state->exporter->ExportSegment(*segments[job->segment], job->stats, job->error);
+}
+
+void Recording::EIO_AfterExport(uv_work_t *req){
+	HandleScope scope;
+
+	export_job_t *job = static_cast<export_job_t*>(req->data);
+	export_state_t *state = job->state;
+
+	state->running--;
+	state->stats.Add(job->stats);
+	if (!job->error.empty() && state->error.empty())
+		state->error = job->error;
+
+	delete job;
+	delete req;
+
+	/* After an error no more segments are started; the callback waits for
+	 * the ones already running. */
+	LaunchExports(state);
+	if (state->running > 0)
+		return;
+
+	Local<Object> stats = Object::New();
+	stats->Set(String::NewSymbol("blocksRead"), Number::New((double) state->stats.blocksRead));
+	stats->Set(String::NewSymbol("blocksSkipped"), Number::New((double) state->stats.blocksSkipped));
+	stats->Set(String::NewSymbol("rows"), Number::New((double) state->stats.rows));
+	stats->Set(String::NewSymbol("files"), Number::New((double) state->stats.files));
+
+	Local<Value> argv[2];
+	argv[0] = state->error.empty() ? Local<Value>::New(Null()) : Exception::Error(String::New(state->error.c_str()));
+	argv[1] = stats;
+
+	state->recording->Unref();
+
+	TryCatch try_catch;
+	state->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+
+	state->cb.Dispose();
+	delete state->exporter;
+	delete state;
+}
@@ -0,0 +1,183 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_RECORDING_H
+#define GMSECJS_RECORDING_H
+
+#include "v8.h"
+#include "node.h"
+#include "uv.h"
+
+#include <deque>
+
+#include "Sync.h"
+
+#include "Segment.h"
+#include "RecordingQuery.h"
+#include "RecordingMerge.h"
+#include "ColumnarExport.h"
+
+/*
+ * A recording opened for reading. Opening only reads the block indexes;
+ * reads inflate the blocks they need on the thread pool:
+ *
+ *     GMSEC.OpenRecording(fileOrDirectory, function(err, recording){})
+ *     recording.Info()
+ *     recording.Read(fromMs, toMs, [{subjects: [...]}], function(err, messages, stats){})
+ *     recording.Query({from, to, subject, where, batchSize, parallel},
+ *                     function(messages){}, function(err, stats){})
+ *
+ * Query runs one job per segment on the thread pool, at most parallel at
+ * a time, and streams matches back in batches in recorded order. Each
+ * segment holds only a few batches ahead of the callback; returning false
+ * from it stops the query.
+ *
+ *     GMSEC.MergeRecordings([recording, ...], {orderBy: 'receive', output, ...query},
+ *                           function(messages){}, function(err, stats){})
+ *
+ * MergeRecordings streams several recordings as one sequence ordered by
+ * receive time or by the time field named in orderBy, and can write the
+ * result as a new recording.
+ *
+ *     recording.Export(directory, [{subject, from, to, where, batchRows, parallel}],
+ *                      function(err, stats){})
+ *
+ * Export writes Arrow files per subject, converting segments in parallel.
+ */
+class Recording : public node::ObjectWrap {
+public:
+	static v8::Persistent<v8::FunctionTemplate> s_ct;
+
+	static void Init(v8::Handle<v8::Object> target);
+
+	/*
+	 * Reads a recording or an array of recordings along with the query and
+	 * orderBy options of a merge. Returns a TypeError message, or NULL.
+	 */
+	static const char *ParseMerge(v8::Local<v8::Value> inputs, v8::Local<v8::Object> options,
+	                              std::vector<Recording*> &recordings, std::vector<const SegmentSet*> &sets,
+	                              RecordingQuery &query, std::string &orderField);
+
+private:
+	struct open_baton_t {
+		std::string path;
+		SegmentSet *set;
+		std::string error;
+		v8::Persistent<v8::Function> cb;
+	};
+
+	struct read_baton_t {
+		Recording *recording;
+		SegmentSet::Query query;
+		std::vector<RecordedMessage> messages;
+		SegmentSet::Stats stats;
+		std::string error;
+		v8::Persistent<v8::Function> cb;
+	};
+
+	struct query_state_t {
+		query_state_t() : merge(NULL), output(NULL), streaming(true), condition(mutex), launched(0), running(0),
+		                  next(0), cancelled(false), finished(false) {}
+
+		std::vector<Recording*> recordings;
+		RecordingQuery query;
+		size_t parallel;
+		RecordingMerge *merge;      /* set for merges, which run as one job */
+		RecordingWriter *output;
+		bool streaming;             /* false for a merge into output only */
+
+		Mutex mutex;
+		Condition condition;
+		std::vector< std::deque< std::vector<RecordedMessage>* > > batches;
+		std::vector<bool> done;     /* per segment */
+		size_t launched;
+		size_t running;
+		size_t next;                /* segment whose batches go out next */
+		bool cancelled;
+		bool finished;
+		std::string error;
+		RecordingQuery::Stats stats;
+
+		uv_async_t async;
+		v8::Persistent<v8::Function> onBatch;
+		v8::Persistent<v8::Function> cb;
+	};
+
+	struct query_job_t {
+		query_state_t *state;
+		size_t segment;
+		RecordingQuery::Stats stats;
+		std::string error;
+	};
+
+	class QuerySink;
+
+	struct export_state_t {
+		export_state_t() : exporter(NULL), launched(0), running(0) {}
+
+		Recording *recording;
+		ColumnarExport *exporter;
+		size_t parallel;
+		size_t launched;
+		size_t running;
+		std::string error;
+		ColumnarExport::Stats stats;
+		v8::Persistent<v8::Function> cb;
+	};
+
+	struct export_job_t {
+		export_state_t *state;
+		size_t segment;
+		ColumnarExport::Stats stats;
+		std::string error;
+	};
+
+	Recording(SegmentSet *set) : set(set) {}
+	~Recording();
+
+	static v8::Handle<v8::Value> New(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Open(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Info(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Read(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Query(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Merge(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Export(const v8::Arguments& args);
+
+	static const char *ParseQuery(v8::Local<v8::Object> options, RecordingQuery &query);
+	static void StartQuery(query_state_t *state, v8::Local<v8::Function> onBatch, v8::Local<v8::Function> cb);
+
+	static v8::Local<v8::Array> MessagesToArray(const std::vector<RecordedMessage> &messages);
+
+	static void EIO_Open(uv_work_t *req);
+	static void EIO_AfterOpen(uv_work_t *req);
+	static void EIO_Read(uv_work_t *req);
+	static void EIO_AfterRead(uv_work_t *req);
+
+	static void LaunchQueries(query_state_t *state);
+	static void DrainQuery(query_state_t *state);
+	static void OnQueryAsync(uv_async_t *handle, int status);
+	static void OnQueryClosed(uv_handle_t *handle);
+	static void EIO_Query(uv_work_t *req);
+	static void EIO_Merge(uv_work_t *req);
+	static void EIO_AfterQuery(uv_work_t *req);
+
+	static void LaunchExports(export_state_t *state);
+	static void EIO_Export(uv_work_t *req);
+	static void EIO_AfterExport(uv_work_t *req);
+
+	SegmentSet *set;
+};
+
+#endif
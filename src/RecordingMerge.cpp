@@ -0,0 +1,168 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+
+#include "RecordingMerge.h"
+#include "EphemerisStore.h"
+
+using namespace std;
+
+/* Larger stdio buffers per input so block reads stream sequentially
+ * instead of seeking between the files on every block. */
+static const size_t READAHEAD_BYTES = 1024 * 1024;
+
+static const size_t NO_POSITION = (size_t) -1;
+
+bool RecordingMerge::Later::operator()(const Cursor *a, const Cursor *b) const{
+	return a->key > b->key || (a->key == b->key && a->input > b->input);
+}
+
+RecordingMerge::RecordingMerge(const vector<const SegmentSet*> &inputs, const RecordingQuery &filter,
+                               const string &orderField)
+	: filter(filter),
+	  orderField(orderField),
+	  started(false),
+	  lastKey(0){
+	for (size_t i = 0; i < inputs.size(); i++) {
+		Cursor *cursor = new Cursor();
+		cursor->set = inputs[i];
+		cursor->input = i;
+		cursor->segment = 0;
+		cursor->block = 0;
+		cursor->file = NULL;
+		cursor->position = NO_POSITION;
+		cursor->key = 0;
+		cursors.push_back(cursor);
+	}
+}
+
+RecordingMerge::~RecordingMerge(){
+	for (size_t i = 0; i < cursors.size(); i++) {
+		if (cursors[i]->file != NULL)
+			fclose(cursors[i]->file);
+		delete cursors[i];
+	}
+}
+
+bool RecordingMerge::Next(RecordedMessage &message, string &error){
+	if (!started) {
+		started = true;
+		for (size_t i = 0; i < cursors.size(); i++) {
+			if (Advance(cursors[i], error))
+				heap.push_back(cursors[i]);
+			else if (!error.empty())
+				return false;
+		}
+		make_heap(heap.begin(), heap.end(), Later());
+	}
+
+	if (heap.empty())
+		return false;
+
+	pop_heap(heap.begin(), heap.end(), Later());
+	Cursor *cursor = heap.back();
+
+	RecordedMessage &current = cursor->records[cursor->position];
+	message.time = current.time;
+	message.subject.swap(current.subject);
+	message.xml.swap(current.xml);
+	lastKey = cursor->key;
+
+	if (Advance(cursor, error))
+		push_heap(heap.begin(), heap.end(), Later());
+	else
+		heap.pop_back();
+
+	return error.empty();
+}
+
+/* Moves the cursor to its next matching message. */
+bool RecordingMerge::Advance(Cursor *cursor, string &error){
+	for (;;) {
+		while (++cursor->position < cursor->records.size()) {
+			const RecordedMessage &message = cursor->records[cursor->position];
+			stats.messagesScanned++;
+			if (filter.Matches(message, scratch)) {
+				stats.messagesMatched++;
+				cursor->key = Key(message);
+				return true;
+			}
+		}
+
+		if (!LoadNextBlock(cursor, error))
+			return false;
+	}
+}
+
+bool RecordingMerge::LoadNextBlock(Cursor *cursor, string &error){
+	const vector<SegmentReader*> &segments = cursor->set->Segments();
+
+	while (cursor->segment < segments.size()) {
+		const SegmentReader *reader = segments[cursor->segment];
+		const vector<Segment::Block> &blocks = reader->Blocks();
+
+		while (cursor->block < blocks.size()) {
+			size_t b = cursor->block++;
+			if (!filter.BlockMayMatch(blocks[b])) {
+				stats.blocksSkipped++;
+				continue;
+			}
+
+			if (cursor->file == NULL) {
+				if ((cursor->file = reader->OpenFile(error)) == NULL)
+					return false;
+				setvbuf(cursor->file, NULL, _IOFBF, READAHEAD_BYTES);
+			}
+
+			cursor->records.clear();
+			cursor->position = NO_POSITION;
+			if (!reader->ReadBlock(cursor->file, b, raw, error))
+				return false;
+			if (!Segment::ParseRecords(raw, cursor->records)) {
+				error = reader->Path() + " has a malformed block";
+				return false;
+			}
+			stats.blocksRead++;
+			return true;
+		}
+
+		if (cursor->file != NULL) {
+			fclose(cursor->file);
+			cursor->file = NULL;
+		}
+		cursor->segment++;
+		cursor->block = 0;
+	}
+
+	cursor->records.clear();
+	cursor->position = NO_POSITION;
+	return false;
+}
+
+double RecordingMerge::Key(const RecordedMessage &message){
+	if (orderField.empty() || !MessageRecord::FieldFromXML(message.xml, orderField, field))
+		return message.time;
+
+	double key;
+	if (EphemerisStore::ParseEpoch(field, key))
+		return key;
+
+	/* Numeric time fields are taken as milliseconds already. */
+	char *end;
+	key = strtod(field.c_str(), &end);
+	return (end == field.c_str() || *end != '\0') ? message.time : key;
+}
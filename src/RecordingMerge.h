@@ -0,0 +1,86 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_RECORDINGMERGE_H
+#define GMSECJS_RECORDINGMERGE_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "Segment.h"
+#include "RecordingQuery.h"
+#include "MessageRecord.h"
+
+/*
+ * Time ordered k-way merge of several recordings, pulled one message at a
+ * time. Each input keeps one inflated block in memory and the heap holds
+ * one message per input, so any number of recordings of any size merge in
+ * constant memory.
+ *
+ * Messages are ordered by receive time, or by a time field such as
+ * PUBLISH-TIME when orderField is given; messages without a usable value
+ * fall back to their receive time. Each input is taken in its own recorded
+ * order, and ties go to the earlier input. The filter is applied to every
+ * input, skipping blocks through the index as queries do.
+ */
+class RecordingMerge {
+public:
+	RecordingMerge(const std::vector<const SegmentSet*> &inputs, const RecordingQuery &filter,
+	               const std::string &orderField);
+	~RecordingMerge();
+
+	/* Returns false once every input is exhausted, or on error. */
+	bool Next(RecordedMessage &message, std::string &error);
+
+	/* Ordering key, in milliseconds, of the message Next() last returned. */
+	double LastKey() const { return lastKey; }
+
+	const RecordingQuery::Stats &GetStats() const { return stats; }
+
+private:
+	struct Cursor {
+		const SegmentSet *set;
+		size_t input;
+		size_t segment;
+		size_t block;
+		FILE *file;
+		std::vector<RecordedMessage> records;
+		size_t position;
+		double key;
+	};
+
+	struct Later {
+		bool operator()(const Cursor *a, const Cursor *b) const;
+	};
+
+	bool Advance(Cursor *cursor, std::string &error);
+	bool LoadNextBlock(Cursor *cursor, std::string &error);
+	double Key(const RecordedMessage &message);
+
+	RecordingQuery filter;
+	std::string orderField;
+	std::vector<Cursor*> cursors;
+	std::vector<Cursor*> heap;
+	bool started;
+	double lastKey;
+
+	RecordingQuery::Stats stats;
+	MessageRecord scratch;
+	std::string raw;
+	std::string field;
+};
+
+#endif
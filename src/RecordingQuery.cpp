@@ -0,0 +1,184 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+
+#include "RecordingQuery.h"
+#include "Subject.h"
+
+using namespace std;
+
+void RecordingQuery::Stats::Add(const Stats &other){
+	blocksRead += other.blocksRead;
+	blocksSkipped += other.blocksSkipped;
+	messagesScanned += other.messagesScanned;
+	messagesMatched += other.messagesMatched;
+}
+
+bool RecordingQuery::ParseOp(const string &name, Predicate::Op &op){
+	if (name == "==" || name == "=") op = Predicate::EQ;
+	else if (name == "!=")           op = Predicate::NE;
+	else if (name == "<")            op = Predicate::LT;
+	else if (name == "<=")           op = Predicate::LE;
+	else if (name == ">")            op = Predicate::GT;
+	else if (name == ">=")           op = Predicate::GE;
+	else return false;
+	return true;
+}
+
+/* Shared by numbers and text; only operator< and operator== are used. */
+template <class T>
+static bool Compare(int op, const T &value, const T &operand){
+	switch (op) {
+	case RecordingQuery::Predicate::EQ: return value == operand;
+	case RecordingQuery::Predicate::NE: return !(value == operand);
+	case RecordingQuery::Predicate::LT: return value < operand;
+	case RecordingQuery::Predicate::LE: return !(operand < value);
+	case RecordingQuery::Predicate::GT: return operand < value;
+	case RecordingQuery::Predicate::GE: return !(value < operand);
+	}
+	return false;
+}
+
+template <class T>
+static bool RangeAllows(int op, const T &min, const T &max, const T &operand){
+	switch (op) {
+	case RecordingQuery::Predicate::EQ: return !(operand < min) && !(max < operand);
+	case RecordingQuery::Predicate::NE: return !(min == operand && max == operand);
+	case RecordingQuery::Predicate::LT: return min < operand;
+	case RecordingQuery::Predicate::LE: return !(operand < min);
+	case RecordingQuery::Predicate::GT: return operand < max;
+	case RecordingQuery::Predicate::GE: return !(max < operand);
+	}
+	return true;
+}
+
+bool RecordingQuery::RangeMayMatch(const Predicate &predicate, const Segment::FieldRange &range){
+	/* A numeric predicate on a text field may still match values that
+	 * parse as numbers, so only like-for-like ranges can rule a block out. */
+	if (predicate.numeric != range.numeric)
+		return true;
+
+	if (predicate.numeric)
+		return RangeAllows(predicate.op, range.min, range.max, predicate.number);
+	return RangeAllows(predicate.op, range.minText, range.maxText, predicate.text);
+}
+
+bool RecordingQuery::BlockMayMatch(const Segment::Block &block) const{
+	if (block.last < from || block.first > to)
+		return false;
+
+	if (!subject.empty() && !Subject::IsPattern(subject) && !Segment::MayContain(block, subject))
+		return false;
+
+	for (size_t p = 0; p < where.size(); p++)
+		for (size_t r = 0; r < block.ranges.size(); r++)
+			if (block.ranges[r].name == where[p].field && !RangeMayMatch(where[p], block.ranges[r]))
+				return false;
+
+	return true;
+}
+
+bool RecordingQuery::FieldMatches(const Predicate &predicate, const MessageRecord::Field &field){
+	if (!predicate.numeric)
+		return Compare(predicate.op, field.value, predicate.text);
+
+	char *end;
+	double value = strtod(field.value.c_str(), &end);
+	if (end == field.value.c_str() || *end != '\0')
+		return false;
+	return Compare(predicate.op, value, predicate.number);
+}
+
+bool RecordingQuery::Matches(const RecordedMessage &message, MessageRecord &scratch) const{
+	return MatchesEnvelope(message) &&
+		(where.empty() || (scratch.FromXML(message.xml) && MatchesFields(scratch)));
+}
+
+bool RecordingQuery::MatchesEnvelope(const RecordedMessage &message) const{
+	if (message.time < from || message.time > to)
+		return false;
+
+	return subject.empty() || (Subject::IsPattern(subject) ? Subject::Matches(subject, message.subject)
+	                                                        : subject == message.subject);
+}
+
+bool RecordingQuery::MatchesFields(const MessageRecord &record) const{
+	/* A message without the field fails the predicate. */
+	for (size_t p = 0; p < where.size(); p++) {
+		bool matched = false;
+		for (size_t f = 0; f < record.fields.size() && !matched; f++)
+			if (record.fields[f].name == where[p].field)
+				matched = FieldMatches(where[p], record.fields[f]);
+		if (!matched)
+			return false;
+	}
+
+	return true;
+}
+
+bool RecordingQuery::Run(const SegmentReader &reader, Sink &sink, Stats &stats, string &error) const{
+	const vector<Segment::Block> &blocks = reader.Blocks();
+
+	FILE *file = NULL;
+	string raw;
+	vector<RecordedMessage> records, batch;
+	MessageRecord scratch;
+	bool ok = true, more = true;
+
+	for (size_t b = 0; b < blocks.size() && ok && more; b++) {
+		if (!BlockMayMatch(blocks[b])) {
+			stats.blocksSkipped++;
+			continue;
+		}
+
+		if (file == NULL && (file = reader.OpenFile(error)) == NULL)
+			return false;
+
+		records.clear();
+		ok = reader.ReadBlock(file, b, raw, error) && Segment::ParseRecords(raw, records);
+		if (!ok) {
+			if (error.empty())
+				error = reader.Path() + " has a malformed block";
+			break;
+		}
+		stats.blocksRead++;
+
+		for (size_t i = 0; i < records.size() && more; i++) {
+			stats.messagesScanned++;
+			if (!Matches(records[i], scratch))
+				continue;
+
+			stats.messagesMatched++;
+			batch.push_back(RecordedMessage());
+			batch.back().time = records[i].time;
+			batch.back().subject.swap(records[i].subject);
+			batch.back().xml.swap(records[i].xml);
+
+			if (batch.size() >= batchSize) {
+				more = sink.Batch(batch);
+				batch.clear();
+			}
+		}
+	}
+
+	if (file != NULL)
+		fclose(file);
+
+	if (ok && more && !batch.empty())
+		sink.Batch(batch);
+
+	return ok;
+}
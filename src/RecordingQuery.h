@@ -0,0 +1,88 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_RECORDINGQUERY_H
+#define GMSECJS_RECORDINGQUERY_H
+
+#include <string>
+#include <vector>
+
+#include "Segment.h"
+#include "MessageRecord.h"
+
+/*
+ * A filter over recorded messages: a time range, a subject or subject
+ * pattern and field predicates that must all hold. Everything the block
+ * index can answer is checked there first, so blocks outside the time
+ * range, without the subject in their bloom filter or whose field ranges
+ * exclude a predicate are never read or inflated.
+ *
+ * Run works on one segment at a time and holds nothing but its own file
+ * handle, so segments can be queried concurrently.
+ */
+class RecordingQuery {
+public:
+	struct Predicate {
+		enum Op { EQ, NE, LT, LE, GT, GE };
+
+		std::string field;
+		Op op;
+		bool numeric;
+		double number;
+		std::string text;
+	};
+
+	struct Stats {
+		Stats() : blocksRead(0), blocksSkipped(0), messagesScanned(0), messagesMatched(0) {}
+		void Add(const Stats &other);
+
+		size_t blocksRead;
+		size_t blocksSkipped;
+		size_t messagesScanned;
+		size_t messagesMatched;
+	};
+
+	/* Receives matches in recorded order; returning false stops the run. */
+	class Sink {
+	public:
+		virtual ~Sink() {}
+		virtual bool Batch(std::vector<RecordedMessage> &messages) = 0;
+	};
+
+	RecordingQuery() : from(-1e300), to(1e300), batchSize(500) {}
+
+	static bool ParseOp(const std::string &name, Predicate::Op &op);
+
+	bool BlockMayMatch(const Segment::Block &block) const;
+	bool Matches(const RecordedMessage &message, MessageRecord &scratch) const;
+
+	/* The two halves of Matches, for callers that decode messages anyway. */
+	bool MatchesEnvelope(const RecordedMessage &message) const;
+	bool MatchesFields(const MessageRecord &record) const;
+
+	bool Run(const SegmentReader &reader, Sink &sink, Stats &stats, std::string &error) const;
+
+	double from;
+	double to;
+	std::string subject;                 /* empty means all */
+	std::vector<Predicate> where;
+	size_t batchSize;
+
+private:
+	static bool RangeMayMatch(const Predicate &predicate, const Segment::FieldRange &range);
+	static bool FieldMatches(const Predicate &predicate, const MessageRecord::Field &field);
+};
+
+#endif
@@ -0,0 +1,142 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ReplayWindow.h"
+
+using namespace std;
+
+ReplayWindow::ReplayWindow() : maxMessages(0), maxBytes(0), maxSubjects(DEFAULT_MAX_SUBJECTS), firstSeq(1){
+}
+
+void ReplayWindow::Configure(size_t maxMessages, size_t maxBytes, size_t maxSubjects){
+	AutoMutex lock(mutex);
+
+	this->maxMessages = maxMessages;
+	this->maxBytes = maxBytes;
+	this->maxSubjects = maxSubjects;
+	Evict(maxSubjects);
+
+	for (map<string, SubjectWindow>::iterator it = subjects.begin(); it != subjects.end(); ++it) {
+		SubjectWindow &window = it->second;
+		while (!window.retained.empty() &&
+		       (window.retained.size() > maxMessages || window.bytes > maxBytes)) {
+			window.bytes -= window.retained.front().xml.size();
+			window.retained.pop_front();
+		}
+	}
+}
+
+double ReplayWindow::Append(const string &subject, const string &xml){
+	AutoMutex lock(mutex);
+
+	map<string, SubjectWindow>::iterator it = subjects.find(subject);
+	if (it == subjects.end()) {
+		Evict(maxSubjects - 1);
+		it = subjects.insert(make_pair(subject, SubjectWindow())).first;
+		it->second.start = it->second.nextSeq = firstSeq;
+		it->second.recent = recent.insert(recent.end(), subject);
+	}
+	else {
+		recent.splice(recent.end(), recent, it->second.recent);
+	}
+
+	SubjectWindow &window = it->second;
+	double seq = window.nextSeq++;
+
+	if (maxMessages == 0)
+		return seq;
+
+	Retained retained;
+	retained.seq = seq;
+	window.retained.push_back(retained);
+	window.retained.back().xml = xml;
+	window.bytes += xml.size();
+
+	/* Always keep the newest message even if it alone exceeds the byte limit. */
+	while (window.retained.size() > 1 &&
+	       (window.retained.size() > maxMessages || window.bytes > maxBytes)) {
+		window.bytes -= window.retained.front().xml.size();
+		window.retained.pop_front();
+	}
+
+	return seq;
+}
+
+bool ReplayWindow::Since(const string &subject, double sinceSeq, vector<Entry> &entries){
+	AutoMutex lock(mutex);
+
+	if (sinceSeq < 0)
+		sinceSeq = 0;
+
+	map<string, SubjectWindow>::iterator it = subjects.find(subject);
+	if (it == subjects.end())
+		return sinceSeq == 0;
+
+	/* Starting over asks from the window's first number; anything between
+	 * that and zero belonged to an evicted earlier window. */
+	SubjectWindow &window = it->second;
+	if (sinceSeq == 0)
+		sinceSeq = window.start - 1;
+	if (sinceSeq + 1 >= window.nextSeq)
+		return true;
+
+	/* Sequence numbers within a window are contiguous, so the first wanted
+	 * entry is found by offset rather than by searching. */
+	if (window.retained.empty() || window.retained.front().seq > sinceSeq + 1)
+		return false;
+
+	size_t first = (size_t) (sinceSeq + 1 - window.retained.front().seq);
+	for (size_t i = first; i < window.retained.size(); i++) {
+		Entry entry;
+		entry.subject = subject;
+		entry.seq = window.retained[i].seq;
+		entries.push_back(entry);
+		entries.back().xml = window.retained[i].xml;
+	}
+
+	return true;
+}
+
+void ReplayWindow::Forget(const string &subject){
+	AutoMutex lock(mutex);
+
+	map<string, SubjectWindow>::iterator it = subjects.find(subject);
+	if (it == subjects.end())
+		return;
+	recent.erase(it->second.recent);
+	subjects.erase(it);
+}
+
+/* Called with the mutex held. */
+void ReplayWindow::Evict(size_t keep){
+	while (subjects.size() > keep && !recent.empty()) {
+		map<string, SubjectWindow>::iterator it = subjects.find(recent.front());
+		if (it->second.nextSeq > firstSeq)
+			firstSeq = it->second.nextSeq;
+		subjects.erase(it);
+		recent.pop_front();
+	}
+}
+
+void ReplayWindow::Usage(size_t &subjectCount, size_t &messages, size_t &bytes){
+	AutoMutex lock(mutex);
+
+	subjectCount = subjects.size();
+	messages = bytes = 0;
+	for (map<string, SubjectWindow>::iterator it = subjects.begin(); it != subjects.end(); ++it) {
+		messages += it->second.retained.size();
+		bytes += it->second.bytes;
+	}
+}
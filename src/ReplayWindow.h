@@ -0,0 +1,102 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_REPLAYWINDOW_H
+#define GMSECJS_REPLAYWINDOW_H
+
+#include <deque>
+#include <list>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Sync.h"
+
+/*
+ * Stamps every delivered message with a per-subject monotonic sequence
+ * number and keeps the most recent messages of each subject so that a
+ * reconnecting client can ask for everything after the last sequence number
+ * it saw.
+ *
+ * At most maxSubjects subjects are tracked. Past that the one appended to
+ * least recently is evicted, and subjects added from then on number their
+ * messages after the highest sequence number evicted, so a client holding
+ * an old number is told it missed messages rather than resuming wrongly.
+ */
+class ReplayWindow {
+public:
+	struct Entry {
+		std::string subject;
+		double seq;
+		std::string xml;
+	};
+
+	static const size_t DEFAULT_MAX_SUBJECTS = 65536;
+
+	ReplayWindow();
+
+	/* Limits per subject, and on the number of subjects; a limit of zero
+	 * messages disables retention but sequence numbers are still
+	 * assigned. */
+	void Configure(size_t maxMessages, size_t maxBytes, size_t maxSubjects);
+
+	bool Retaining() const { return maxMessages > 0; }
+
+	/* Assigns the next sequence number for the subject and retains a copy. */
+	double Append(const std::string &subject, const std::string &xml);
+
+	/*
+	 * Appends everything newer than sinceSeq on the subject to entries.
+	 * Returns false if messages after sinceSeq have already been evicted, in
+	 * which case the caller should fall back to a full reload. A negative
+	 * sinceSeq asks for everything retained.
+	 */
+	bool Since(const std::string &subject, double sinceSeq, std::vector<Entry> &entries);
+
+	/* Drops the subject's sequence numbers and retained messages, as if it
+	 * had never been delivered. */
+	void Forget(const std::string &subject);
+
+	/* Totals across subjects, for watching the window's footprint. */
+	void Usage(size_t &subjectCount, size_t &messages, size_t &bytes);
+
+private:
+	struct Retained {
+		double seq;
+		std::string xml;
+	};
+
+	struct SubjectWindow {
+		SubjectWindow() : start(1), nextSeq(1), bytes(0) {}
+		double start;        /* first sequence number assigned */
+		double nextSeq;
+		size_t bytes;
+		std::deque<Retained> retained;
+		std::list<std::string>::iterator recent;
+	};
+
+	void Evict(size_t keep);
+
+	size_t maxMessages;
+	size_t maxBytes;
+	size_t maxSubjects;
+	double firstSeq;     /* of subjects added from now on */
+
+	std::map<std::string, SubjectWindow> subjects;
+	std::list<std::string> recent;   /* least recently appended first */
+	Mutex mutex;
+};
+
+#endif
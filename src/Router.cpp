@@ -0,0 +1,787 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Router.h"
+#include "Probes.h"
+#include "TraceBuffer.h"
+
+using namespace std;
+
+void Router::Subscription::OnMessage(MiddlewareApi::Message *msg)
+{
+	const char *subject = NULL;
+	if (TraceBuffer::Enabled())
+		subject = MiddlewareApi::Get()->Subject(msg);
+	TraceSpan span(TraceBuffer::DISPATCH, subject);
+
+	router->Dispatch(this, msg);
+}
+
+const string &Router::Delivery::Xml()
+{
+	if (recorded != NULL)
+		return *recorded;
+
+	if (!rendered) {
+		TraceSpan span(TraceBuffer::TO_XML, subject);
+		MiddlewareApi::Get()->ToXML(msg, xml);
+		rendered = true;
+	}
+	return xml;
+}
+
+Router::Router()
+	: consolidate(true), minSiblings(32), maxOverDelivery(1.0), minSamples(1000), unmatched(0),
+	  nextSubscriptionId(1), sequencer(NULL), current(NULL, NULL, NULL)
+{
+}
+
+Router::~Router()
+{
+	set<Subscription*>::iterator it;
+	for (it = subscriptions.begin(); it != subscriptions.end(); ++it)
+		delete *it;
+}
+
+void Router::Configure(bool consolidate, size_t minSiblings, double maxOverDelivery, unsigned long long minSamples)
+{
+	AutoMutex lock(mutex);
+
+	this->consolidate = consolidate;
+	this->minSiblings = minSiblings < 2 ? 2 : minSiblings;
+	this->maxOverDelivery = maxOverDelivery;
+	this->minSamples = minSamples;
+}
+
+void Router::SetSequencer(Sequencer *sequencer)
+{
+	AutoMutex lock(mutex);
+	this->sequencer = sequencer;
+}
+
+bool Router::IsWildcard(const string &pattern)
+{
+	return pattern.find_first_of("*>") != string::npos;
+}
+
+string Router::Parent(const string &subject)
+{
+	size_t dot = subject.rfind('.');
+	return dot == string::npos ? string() : subject.substr(0, dot);
+}
+
+void Router::Dispatch(Subscription *subscription, MiddlewareApi::Message *msg)
+{
+	AutoMutex lock(mutex);
+
+	const char *subject = MiddlewareApi::Get()->Subject(msg);
+	Delivery &delivery = Receive(subscription, msg, subject);
+
+	/* A subscription carrying other wildcard routes delivers to those that
+	 * match, its own included. */
+	if (!subscription->riders.empty()) {
+		matches.clear();
+		wildcardRoutes.Covering(subject, matches);
+		for (size_t i = 0; i < matches.size(); i++) {
+			Route &route = *static_cast<Route*>(matches[i]->value);
+			if (route.owner == subscription || route.pending == subscription) {
+				Sequence(delivery);
+				route.target->Deliver(delivery);
+			}
+		}
+		return;
+	}
+
+	map<string, Route>::iterator it = subscription->covering ? routes.find(subject) : routes.find(subscription->pattern);
+
+	bool owned = it != routes.end() &&
+		(it->second.owner == subscription || it->second.pending == subscription);
+
+	if (subscription->covering) {
+		if (owned) {
+			subscription->matched++;
+		}
+		else {
+			subscription->unmatched++;
+			unmatched++;
+			GMSECJS_PROBE2(message__drop, subject, PROBE_DROP_UNMATCHED);
+		}
+	}
+
+	if (owned) {
+		Sequence(delivery);
+		it->second.target->Deliver(delivery);
+	}
+}
+
+/*
+ * A callback for the message the previous one had, same object and
+ * subject, on a subscription that has not had it yet, shares its delivery.
+ * Anything else is the next message, even one allocated at a reused
+ * address, since that reaches a subscription that already had the last.
+ * Every callback counts, whether or not it delivers to a route.
+ *
+ * A subscription's first callback cannot be placed that way, as the
+ * middleware may have registered it since the last message, so it starts
+ * a new delivery and keeps the receivers: at worst the message is
+ * numbered twice, rather than two messages numbered once.
+ */
+Router::Delivery &Router::Receive(Subscription *subscription, MiddlewareApi::Message *msg, const char *subject)
+{
+	bool same = current.msg == msg && currentSubject == subject &&
+	            currentReceivers.count(subscription->id) == 0;
+	if (!same) {
+		currentSubject = subject;
+		currentReceivers.clear();
+	}
+	if (!same || !subscription->received)
+		current = Delivery(currentSubject.c_str(), msg, NULL);
+	subscription->received = true;
+	currentReceivers.insert(subscription->id);
+	return current;
+}
+
+void Router::Sequence(Delivery &delivery)
+{
+	if (delivery.sequenced)
+		return;
+	delivery.sequenced = true;
+	if (sequencer != NULL)
+		sequencer->Sequence(delivery);
+}
+
+static bool Delivering(const Router::Subscription *owner, const Router::Subscription *pending)
+{
+	return (owner != NULL && owner->IsActive()) || (pending != NULL && pending->IsActive());
+}
+
+void Router::Replay(const string &subject, const string &xml)
+{
+	AutoMutex lock(mutex);
+
+	Delivery delivery(subject.c_str(), NULL, &xml);
+
+	map<string, Route>::iterator it = routes.find(subject);
+	if (it != routes.end() && Delivering(it->second.owner, it->second.pending)) {
+		Sequence(delivery);
+		it->second.target->Deliver(delivery);
+	}
+
+	matches.clear();
+	wildcardRoutes.Covering(subject, matches);
+	for (size_t i = 0; i < matches.size(); i++) {
+		Route &route = *static_cast<Route*>(matches[i]->value);
+		if (Delivering(route.owner, route.pending)) {
+			Sequence(delivery);
+			route.target->Deliver(delivery);
+		}
+	}
+}
+
+Router::Subscription *Router::NewSubscription(const string &pattern, bool covering)
+{
+	Subscription *subscription = new Subscription(this, pattern, covering, nextSubscriptionId++);
+	subscriptions.insert(subscription);
+	return subscription;
+}
+
+void Router::Subscribe(Subscription *subscription, vector<Operation> &ops)
+{
+	Operation op;
+	op.kind = Operation::SUBSCRIBE;
+	op.subscription = subscription;
+	ops.push_back(op);
+}
+
+void Router::Unsubscribe(Subscription *subscription, vector<Operation> &ops)
+{
+	if (subscription->unsubscribing)
+		return;
+
+	subscription->unsubscribing = true;
+
+	Operation op;
+	op.kind = Operation::UNSUBSCRIBE;
+	op.subscription = subscription;
+	ops.push_back(op);
+}
+
+void Router::Add(const string &pattern, Target *target, vector<Operation> &ops)
+{
+	AutoMutex lock(mutex);
+
+	if (routes.find(pattern) != routes.end())
+		return;
+
+	Route &route = routes[pattern];
+	route.target = target;
+
+	if (IsWildcard(pattern)) {
+		wildcardRoutes.Insert(pattern, &route);
+
+		Subscription *cover = consolidate ? Cover(pattern, NULL) : NULL;
+		if (cover != NULL) {
+			route.owner = cover;
+			cover->riders.insert(pattern);
+			return;
+		}
+
+		route.owner = NewSubscription(pattern, false);
+		Subscribe(route.owner, ops);
+		if (consolidate)
+			Adopt(pattern, route.owner, ops);
+		return;
+	}
+
+	string parent = Parent(pattern);
+	if (parent.empty()) {
+		route.owner = NewSubscription(pattern, false);
+		Subscribe(route.owner, ops);
+		return;
+	}
+
+	Group &group = groups[parent];
+	group.members.insert(pattern);
+
+	/* A covered group only needs the new subject added to the filter. */
+	if (group.covering != NULL && group.pendingSubscribes == 0) {
+		route.owner = group.covering;
+		return;
+	}
+
+	route.owner = NewSubscription(pattern, false);
+	Subscribe(route.owner, ops);
+
+	Consider(parent, group, ops);
+}
+
+void Router::Remove(const string &pattern, vector<Operation> &ops)
+{
+	AutoMutex lock(mutex);
+
+	map<string, Route>::iterator it = routes.find(pattern);
+	if (it == routes.end())
+		return;
+
+	Route route = it->second;
+	routes.erase(it);
+
+	if (IsWildcard(pattern)) {
+		wildcardRoutes.Erase(pattern);
+
+		/* Routes riding on this pattern's own subscription move first, so
+		 * it keeps delivering to them until their new one is in place. */
+		if (route.owner != NULL && route.owner->pattern == pattern)
+			Evict(route.owner, ops);
+		if (route.pending != NULL && route.pending->pattern == pattern)
+			Evict(route.pending, ops);
+
+		if (route.owner != NULL)
+			Release(route.owner, pattern, ops);
+		if (route.pending != NULL)
+			Release(route.pending, pattern, ops);
+		return;
+	}
+
+	if (route.owner != NULL && !route.owner->covering)
+		Unsubscribe(route.owner, ops);
+	if (route.pending != NULL && !route.pending->covering)
+		Unsubscribe(route.pending, ops);
+
+	string parent = Parent(pattern);
+	map<string, Group>::iterator found = groups.find(parent);
+	if (parent.empty() || found == groups.end())
+		return;
+
+	Group &group = found->second;
+	group.members.erase(pattern);
+
+	if (group.covering == NULL) {
+		Forget(parent);
+		return;
+	}
+
+	/* A route that was still moving to its own subscription no longer
+	 * holds up the split. */
+	if (group.pendingSubscribes > 0) {
+		if (route.pending != NULL && !route.pending->covering && !route.pending->active)
+			SplitProgress(group, ops);
+		Forget(parent);
+		return;
+	}
+
+	/* Shrinking groups go back to exact subscriptions well below the
+	 * consolidation threshold so a subject or two of churn does not flap. */
+	if (group.members.size() < minSiblings / 2)
+		Split(group, ops);
+
+	Forget(parent);
+}
+
+void Router::Review(vector<Operation> &ops)
+{
+	AutoMutex lock(mutex);
+
+	if (!consolidate) {
+		set<Subscription*>::iterator it;
+		for (it = subscriptions.begin(); it != subscriptions.end(); ++it)
+			if (!(*it)->riders.empty() && !(*it)->unsubscribing)
+				Evict(*it, ops);
+	}
+
+	map<string, Group>::iterator it;
+	for (it = groups.begin(); it != groups.end(); ++it) {
+		Group &group = it->second;
+
+		if (group.covering == NULL) {
+			Consider(it->first, group, ops);
+			continue;
+		}
+
+		if (group.pendingSubscribes > 0 || group.covering->unsubscribing)
+			continue;
+
+		if (!consolidate) {
+			Split(group, ops);
+			continue;
+		}
+
+		Subscription *covering = group.covering;
+		if (covering->matched + covering->unmatched < minSamples)
+			continue;
+
+		if (covering->unmatched > maxOverDelivery * covering->matched) {
+			group.rejectedSize = group.members.size();
+			Split(group, ops);
+		}
+		else {
+			/* Decay so the decision follows the current traffic mix. */
+			covering->matched /= 2;
+			covering->unmatched /= 2;
+		}
+	}
+}
+
+void Router::Consider(const string &parent, Group &group, vector<Operation> &ops)
+{
+	if (!consolidate || group.covering != NULL)
+		return;
+
+	if (group.members.size() < minSiblings || group.members.size() < 2 * group.rejectedSize)
+		return;
+
+	Consolidate(parent, group, ops);
+}
+
+void Router::Consolidate(const string &parent, Group &group, vector<Operation> &ops)
+{
+	Subscription *covering = NewSubscription(parent + ".*", true);
+	group.covering = covering;
+
+	/* Exact subscriptions that have not been issued yet are simply dropped;
+	 * nothing can have arrived through them. */
+	for (size_t i = 0; i < ops.size(); ) {
+		Subscription *subscription = ops[i].subscription;
+		map<string, Route>::iterator it = routes.find(subscription->pattern);
+
+		if (ops[i].kind == Operation::SUBSCRIBE && !subscription->covering &&
+		    group.members.count(subscription->pattern) && it->second.owner == subscription) {
+			it->second.owner = covering;
+			subscriptions.erase(subscription);
+			delete subscription;
+			ops.erase(ops.begin() + i);
+		}
+		else {
+			i++;
+		}
+	}
+
+	/* The rest keep delivering through their exact subscription until the
+	 * covering one is in place. */
+	set<string>::iterator member;
+	for (member = group.members.begin(); member != group.members.end(); ++member) {
+		Route &route = routes[*member];
+		if (route.owner != covering)
+			route.pending = covering;
+	}
+
+	Subscribe(covering, ops);
+}
+
+void Router::Split(Group &group, vector<Operation> &ops)
+{
+	set<string>::iterator member;
+	for (member = group.members.begin(); member != group.members.end(); ++member) {
+		Route &route = routes[*member];
+
+		/* Still consolidating: those routes never stopped using their own
+		 * subscription. */
+		if (route.pending == group.covering)
+			route.pending = NULL;
+
+		if (route.owner != group.covering)
+			continue;
+
+		route.pending = NewSubscription(*member, false);
+		Subscribe(route.pending, ops);
+		group.pendingSubscribes++;
+	}
+
+	if (group.pendingSubscribes == 0) {
+		Unsubscribe(group.covering, ops);
+		group.covering = NULL;
+	}
+}
+
+/*
+ * Called as each exact subscription of a split completes. Once all are in
+ * place the routes move over and the covering subscription is dropped,
+ * unless a failed subscription left a route with nothing else to use.
+ */
+void Router::SplitProgress(Group &group, vector<Operation> &ops)
+{
+	if (--group.pendingSubscribes > 0)
+		return;
+
+	bool stillCovered = false;
+	set<string>::iterator member;
+	for (member = group.members.begin(); member != group.members.end(); ++member) {
+		Route &route = routes[*member];
+		if (route.pending != NULL) {
+			route.owner = route.pending;
+			route.pending = NULL;
+		}
+		else if (route.owner == group.covering) {
+			stillCovered = true;
+		}
+	}
+
+	if (!stillCovered) {
+		Unsubscribe(group.covering, ops);
+		group.covering = NULL;
+	}
+}
+
+void Router::Forget(const string &parent)
+{
+	map<string, Group>::iterator it = groups.find(parent);
+	if (it != groups.end() && it->second.members.empty() && it->second.covering == NULL)
+		groups.erase(it);
+}
+
+void Router::Completed(const Operation &op, bool ok, vector<Operation> &ops)
+{
+	AutoMutex lock(mutex);
+
+	Subscription *subscription = op.subscription;
+
+	if (op.kind == Operation::UNSUBSCRIBE) {
+		subscriptions.erase(subscription);
+		delete subscription;
+		return;
+	}
+
+	if (subscription->unsubscribing)
+		return;
+
+	subscription->active = ok;
+
+	if (subscription->covering) {
+		string parent = Parent(subscription->pattern);
+		map<string, Group>::iterator found = groups.find(parent);
+		if (found == groups.end() || found->second.covering != subscription) {
+			if (ok)
+				Unsubscribe(subscription, ops);
+			else {
+				subscriptions.erase(subscription);
+				delete subscription;
+			}
+			return;
+		}
+
+		Group &group = found->second;
+		set<string>::iterator member;
+		for (member = group.members.begin(); member != group.members.end(); ++member) {
+			Route &route = routes[*member];
+
+			if (ok && route.pending == subscription) {
+				Subscription *previous = route.owner;
+				route.owner = subscription;
+				route.pending = NULL;
+				if (previous != NULL)
+					Unsubscribe(previous, ops);
+			}
+			else if (!ok) {
+				/* Routes that only ever had the covering subscription need
+				 * their own after all. */
+				if (route.pending == subscription)
+					route.pending = NULL;
+				if (route.owner == subscription) {
+					route.owner = NewSubscription(*member, false);
+					Subscribe(route.owner, ops);
+				}
+			}
+		}
+
+		if (!ok) {
+			group.covering = NULL;
+			group.rejectedSize = group.members.size();
+			subscriptions.erase(subscription);
+			delete subscription;
+		}
+		return;
+	}
+
+	map<string, Route>::iterator it = routes.find(subscription->pattern);
+	bool wanted = it != routes.end() &&
+		(it->second.owner == subscription || it->second.pending == subscription);
+
+	if (!ok) {
+		bool splitting = wanted && it->second.pending == subscription;
+		if (wanted) {
+			if (it->second.owner == subscription)
+				it->second.owner = NULL;
+			if (it->second.pending == subscription)
+				it->second.pending = NULL;
+		}
+
+		/* Routes that were to ride on it move on to the subscription they
+		 * were already moving to, or look for another. */
+		set<string> riders;
+		riders.swap(subscription->riders);
+		for (set<string>::iterator rider = riders.begin(); rider != riders.end(); ++rider) {
+			Route &route = routes[*rider];
+			if (route.pending == subscription)
+				route.pending = NULL;
+			if (route.owner == subscription) {
+				route.owner = route.pending;
+				route.pending = NULL;
+				if (route.owner == NULL)
+					Rehome(*rider, route, ops);
+			}
+		}
+
+		subscriptions.erase(subscription);
+		delete subscription;
+
+		if (splitting && !IsWildcard(it->first))
+			SplitProgress(groups[Parent(it->first)], ops);
+		return;
+	}
+
+	set<string> riders = subscription->riders;
+	for (set<string>::iterator rider = riders.begin(); rider != riders.end(); ++rider) {
+		Route &route = routes[*rider];
+		if (route.pending == subscription)
+			Handover(*rider, route, ops);
+	}
+
+	if (!wanted) {
+		if (!Carries(subscription))
+			Unsubscribe(subscription, ops);
+		return;
+	}
+
+	if (it->second.pending == subscription) {
+		if (IsWildcard(it->first))
+			Handover(it->first, it->second, ops);
+		else
+			SplitProgress(groups[Parent(it->first)], ops);
+	}
+}
+
+/*
+ * A wildcard subscription, serving its own route, whose pattern matches
+ * everything the given one does. Active ones are preferred.
+ */
+Router::Subscription *Router::Cover(const string &pattern, const Subscription *exclude)
+{
+	vector<const SubjectTrie::Entry*> covering;
+	wildcardRoutes.Covering(pattern, covering);
+
+	Subscription *found = NULL;
+	for (size_t i = 0; i < covering.size(); i++) {
+		const string &candidate = covering[i]->pattern;
+		if (candidate == pattern)
+			continue;
+
+		const Route &route = *static_cast<Route*>(covering[i]->value);
+		Subscription *owner = route.owner;
+		if (owner == NULL || owner == exclude || owner->pattern != candidate ||
+		    owner->unsubscribing || route.pending != NULL)
+			continue;
+
+		if (owner->active)
+			return owner;
+		if (found == NULL)
+			found = owner;
+	}
+	return found;
+}
+
+/*
+ * Moves the wildcard routes a new pattern covers onto its subscription,
+ * unless they ride on a pattern it does not cover. Their current
+ * subscriptions keep delivering until it completes.
+ */
+void Router::Adopt(const string &pattern, Subscription *subscription, vector<Operation> &ops)
+{
+	vector<const SubjectTrie::Entry*> found;
+	wildcardRoutes.Covered(pattern, found);
+
+	set<string> covered;
+	for (size_t i = 0; i < found.size(); i++)
+		if (found[i]->pattern != pattern)
+			covered.insert(found[i]->pattern);
+
+	for (set<string>::iterator member = covered.begin(); member != covered.end(); ++member) {
+		Route &route = routes[*member];
+		if (route.owner != NULL && !covered.count(route.owner->pattern))
+			continue;
+
+		if (route.owner == NULL) {
+			route.owner = subscription;
+			subscription->riders.insert(*member);
+			continue;
+		}
+
+		Subscription *previous = route.pending;
+		route.pending = subscription;
+		subscription->riders.insert(*member);
+		if (previous != NULL)
+			Release(previous, *member, ops);
+	}
+}
+
+/*
+ * Sends the routes riding on a subscription elsewhere, as when its own
+ * route goes away.
+ */
+void Router::Evict(Subscription *subscription, vector<Operation> &ops)
+{
+	set<string> riders = subscription->riders;
+	for (set<string>::iterator rider = riders.begin(); rider != riders.end(); ++rider) {
+		Route &route = routes[*rider];
+		if (route.pending == subscription) {
+			route.pending = NULL;
+			subscription->riders.erase(*rider);
+		}
+		else if (route.owner == subscription && route.pending == NULL) {
+			Rehome(*rider, route, ops);
+		}
+	}
+}
+
+/*
+ * Gives a wildcard route another cover, or its own subscription. While
+ * its current owner is delivering and the new one is not yet, the route
+ * keeps both.
+ */
+void Router::Rehome(const string &pattern, Route &route, vector<Operation> &ops)
+{
+	Subscription *next = consolidate ? Cover(pattern, route.owner) : NULL;
+	if (next != NULL) {
+		next->riders.insert(pattern);
+	}
+	else {
+		next = NewSubscription(pattern, false);
+		Subscribe(next, ops);
+	}
+
+	if (route.owner != NULL && route.owner->active && !next->active) {
+		route.pending = next;
+		return;
+	}
+
+	Subscription *previous = route.owner;
+	route.owner = next;
+	if (previous != NULL)
+		Release(previous, pattern, ops);
+}
+
+void Router::Handover(const string &pattern, Route &route, vector<Operation> &ops)
+{
+	Subscription *previous = route.owner;
+	route.owner = route.pending;
+	route.pending = NULL;
+	if (previous != NULL)
+		Release(previous, pattern, ops);
+}
+
+/* Drops a wildcard route from a subscription, and the subscription once it
+ * delivers to nothing. */
+void Router::Release(Subscription *subscription, const string &pattern, vector<Operation> &ops)
+{
+	if (subscription->covering)
+		return;
+
+	subscription->riders.erase(pattern);
+	if (!Carries(subscription))
+		Unsubscribe(subscription, ops);
+}
+
+bool Router::Carries(const Subscription *subscription)
+{
+	if (!subscription->riders.empty())
+		return true;
+
+	map<string, Route>::iterator it = routes.find(subscription->pattern);
+	return it != routes.end() && (it->second.owner == subscription || it->second.pending == subscription);
+}
+
+string Router::OwnerPattern(const string &pattern)
+{
+	AutoMutex lock(mutex);
+
+	map<string, Route>::iterator it = routes.find(pattern);
+	if (it == routes.end() || it->second.owner == NULL)
+		return string();
+
+	return it->second.owner->pattern;
+}
+
+Router::Stats Router::GetStats()
+{
+	AutoMutex lock(mutex);
+
+	Stats stats;
+	stats.routes = routes.size();
+	stats.subscriptions = subscriptions.size();
+	stats.coveringSubscriptions = 0;
+	stats.coveredWildcards = 0;
+	stats.unmatched = unmatched;
+
+	map<string, Route>::iterator route;
+	for (route = routes.begin(); route != routes.end(); ++route)
+		if (route->second.owner != NULL && !route->second.owner->covering && route->second.owner->pattern != route->first)
+			stats.coveredWildcards++;
+
+	map<string, Group>::iterator it;
+	for (it = groups.begin(); it != groups.end(); ++it)
+		if (it->second.covering != NULL)
+			stats.coveringSubscriptions++;
+
+	return stats;
+}
+
+void Router::Active(vector<Subscription*> &active)
+{
+	AutoMutex lock(mutex);
+
+	set<Subscription*>::iterator it;
+	for (it = subscriptions.begin(); it != subscriptions.end(); ++it)
+		if ((*it)->active)
+			active.push_back(*it);
+}
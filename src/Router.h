@@ -0,0 +1,262 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_ROUTER_H
+#define GMSECJS_ROUTER_H
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "MiddlewareApi.h"
+#include "Sync.h"
+
+#include "SubjectTrie.h"
+
+/*
+ * Maps local subscription patterns (routes) onto middleware subscriptions.
+ *
+ * Every wildcard pattern gets its own middleware subscription. Exact
+ * subjects normally do too, but when at least minSiblings exact subjects
+ * share a parent (GMSEC.FDS_DEMO.A, GMSEC.FDS_DEMO.B, ...) they are replaced
+ * by one covering "parent.*" subscription and messages are filtered locally
+ * by exact subject. If the covering subscription turns out to deliver more
+ * unwanted messages than maxOverDelivery per wanted one, the group is split
+ * back into exact subscriptions and is only reconsidered once it has grown
+ * to twice the size it had then.
+ *
+ * A wildcard pattern matching nothing that another subscribed wildcard
+ * does not (GMSEC.A.*.X under GMSEC.A.>) rides on that pattern's
+ * subscription instead of getting its own, and narrower patterns move onto
+ * a broader one when it is added. Wildcard routes are indexed by element,
+ * so matching a message against them costs about the depth of its subject
+ * whatever the number of routes.
+ *
+ * Each route is owned by exactly one middleware subscription and is only
+ * delivered messages arriving through its owner, so overlapping middleware
+ * subscriptions never cause duplicates. While ownership moves between
+ * subscriptions both deliver, which can duplicate a message in flight but
+ * never drops one.
+ *
+ * The router never talks to the middleware itself. Add(), Remove() and
+ * Review() return the subscribe/unsubscribe operations to run on a worker
+ * thread, in order, and the owner reports each one back through Completed(),
+ * which may return follow-up operations. All of those are called on the
+ * node thread; Dispatch() runs on the middleware dispatch thread.
+ *
+ * Replay() feeds recorded messages to the routes without the middleware,
+ * matching patterns locally. A route receives them once one of its
+ * subscriptions has completed, just as it would receive live traffic.
+ *
+ * Every message is handed to the sequencer once, before the first route
+ * sees it, and all routes it reaches share that delivery. The middleware
+ * calls each matching subscription's callback in turn for one message, so
+ * consecutive callbacks for the same message share a delivery too.
+ */
+class Router {
+public:
+	/*
+	 * One message on its way to the routes: a live message or a recorded
+	 * one's XML. The XML of a live message is rendered on first use and
+	 * shared by every route after that.
+	 */
+	class Delivery {
+	public:
+		Delivery(const char *subject, MiddlewareApi::Message *msg, const std::string *recorded)
+			: subject(subject), msg(msg), recorded(recorded), seq(0), sequenced(false), rendered(false) {}
+
+		const char *subject;
+		MiddlewareApi::Message *msg;
+		const std::string *recorded;
+		double seq;
+
+		const std::string &Xml();
+
+	private:
+		friend class Router;
+
+		bool sequenced;
+		bool rendered;
+		std::string xml;
+	};
+
+	class Target {
+	public:
+		virtual ~Target() {}
+		virtual void Deliver(Delivery &delivery) = 0;
+	};
+
+	/* Numbers (and retains) a message once, whatever number of routes it
+	 * reaches. Called under the router's mutex. */
+	class Sequencer {
+	public:
+		virtual ~Sequencer() {}
+		virtual void Sequence(Delivery &delivery) = 0;
+	};
+
+	class Subscription;
+
+	struct Operation {
+		enum Kind { SUBSCRIBE, UNSUBSCRIBE };
+		Kind kind;
+		Subscription *subscription;
+	};
+
+	/*
+	 * A middleware subscription. Covering subscriptions filter by exact
+	 * subject; all others deliver to their own route and to any wildcard
+	 * routes riding on them.
+	 */
+	class Subscription : public MiddlewareApi::Callback {
+	public:
+		void OnMessage(MiddlewareApi::Message *msg);
+
+		const std::string &Pattern() const { return pattern; }
+		bool IsActive() const { return active; }
+
+		/* The middleware's handle while subscribed, kept by whoever runs
+		 * the operations. */
+		MiddlewareApi::Subscription *registration;
+
+	private:
+		friend class Router;
+
+		Subscription(Router *router, const std::string &pattern, bool covering, unsigned long long id)
+			: registration(NULL), router(router), pattern(pattern), covering(covering), active(false), unsubscribing(false),
+			  matched(0), unmatched(0), id(id), received(false) {}
+
+		Router *router;
+		std::string pattern;
+		bool covering;
+		bool active;
+		bool unsubscribing;
+		unsigned long long matched;
+		unsigned long long unmatched;
+		unsigned long long id;        /* never reused, unlike the address */
+		bool received;                /* has had a callback */
+		std::set<std::string> riders;   /* other wildcard routes it delivers to, or will */
+	};
+
+	struct Stats {
+		size_t routes;
+		size_t subscriptions;
+		size_t coveringSubscriptions;
+		size_t coveredWildcards;
+		unsigned long long unmatched;
+	};
+
+	Router();
+	~Router();
+
+	void Configure(bool consolidate, size_t minSiblings, double maxOverDelivery, unsigned long long minSamples);
+
+	/* Without a sequencer every delivery has sequence number 0. */
+	void SetSequencer(Sequencer *sequencer);
+
+	void Add(const std::string &pattern, Target *target, std::vector<Operation> &ops);
+	void Remove(const std::string &pattern, std::vector<Operation> &ops);
+
+	/* Re-evaluates covering subscriptions against their measured
+	 * over-delivery. Meant to be called periodically. */
+	void Review(std::vector<Operation> &ops);
+
+	/* Reports a finished operation. Unsubscribed subscriptions are deleted
+	 * here, so the operation must not be used afterwards. */
+	void Completed(const Operation &op, bool ok, std::vector<Operation> &ops);
+
+	/* Pattern of the middleware subscription currently delivering to the
+	 * route, or an empty string. */
+	std::string OwnerPattern(const std::string &pattern);
+
+	Stats GetStats();
+
+	/* Subscriptions the middleware currently has, for tearing it down. */
+	void Active(std::vector<Subscription*> &active);
+
+	/* Delivers a recorded message to every route whose pattern matches its
+	 * subject. May be called from any thread. */
+	void Replay(const std::string &subject, const std::string &xml);
+
+	static bool IsWildcard(const std::string &pattern);
+
+private:
+	struct Route {
+		Route() : target(NULL), owner(NULL), pending(NULL) {}
+		Target *target;
+		Subscription *owner;     /* delivers to this route */
+		Subscription *pending;   /* also delivers while ownership moves */
+	};
+
+	struct Group {
+		Group() : covering(NULL), pendingSubscribes(0), rejectedSize(0) {}
+		std::set<std::string> members;
+		Subscription *covering;
+		size_t pendingSubscribes;   /* exact subscriptions still outstanding while splitting */
+		size_t rejectedSize;
+	};
+
+	void Dispatch(Subscription *subscription, MiddlewareApi::Message *msg);
+	Delivery &Receive(Subscription *subscription, MiddlewareApi::Message *msg, const char *subject);
+	void Sequence(Delivery &delivery);
+
+	static std::string Parent(const std::string &subject);
+
+	Subscription *NewSubscription(const std::string &pattern, bool covering);
+	void Subscribe(Subscription *subscription, std::vector<Operation> &ops);
+	void Unsubscribe(Subscription *subscription, std::vector<Operation> &ops);
+
+	void Consider(const std::string &parent, Group &group, std::vector<Operation> &ops);
+	void Consolidate(const std::string &parent, Group &group, std::vector<Operation> &ops);
+	void Split(Group &group, std::vector<Operation> &ops);
+	void SplitProgress(Group &group, std::vector<Operation> &ops);
+	void Forget(const std::string &parent);
+
+	Subscription *Cover(const std::string &pattern, const Subscription *exclude);
+	void Adopt(const std::string &pattern, Subscription *subscription, std::vector<Operation> &ops);
+	void Evict(Subscription *subscription, std::vector<Operation> &ops);
+	void Rehome(const std::string &pattern, Route &route, std::vector<Operation> &ops);
+	void Handover(const std::string &pattern, Route &route, std::vector<Operation> &ops);
+	void Release(Subscription *subscription, const std::string &pattern, std::vector<Operation> &ops);
+	bool Carries(const Subscription *subscription);
+
+	bool consolidate;
+	size_t minSiblings;
+	double maxOverDelivery;
+	unsigned long long minSamples;
+
+	std::map<std::string, Route> routes;
+	SubjectTrie wildcardRoutes;   /* values are the Route entries */
+	std::map<std::string, Group> groups;
+	std::set<Subscription*> subscriptions;
+	unsigned long long unmatched;
+	unsigned long long nextSubscriptionId;
+	Sequencer *sequencer;
+
+	/* The live message last dispatched, with the subscriptions that have
+	 * received it so far. Only Dispatch() touches these. */
+	Delivery current;
+	std::string currentSubject;
+	std::set<unsigned long long> currentReceivers;
+
+	/* Scratch for Dispatch() and Replay(), which run under the mutex. */
+	std::vector<const SubjectTrie::Entry*> matches;
+
+	/* Held by Dispatch() for the whole delivery so routes and targets can
+	 * be changed safely from the node thread. */
+	Mutex mutex;
+};
+
+#endif
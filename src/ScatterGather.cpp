@@ -0,0 +1,129 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "ScatterGather.h"
+
+using namespace std;
+
+ScatterGather::ScatterGather() : nextId(1){
+}
+
+ScatterGather::~ScatterGather(){
+	for (map<unsigned long long, Gather*>::iterator it = byId.begin(); it != byId.end(); ++it)
+		delete it->second;
+}
+
+unsigned long long ScatterGather::Begin(const string &correlationId, const string &replySubject,
+                                        size_t expected, uint64_t deadline){
+	AutoMutex lock(mutex);
+
+	if (byCorrelation.count(correlationId))
+		return 0;
+
+	Gather *gather = new Gather();
+	gather->result.id = nextId++;
+	gather->result.correlationId = correlationId;
+	gather->result.replySubject = replySubject;
+	gather->result.timedOut = false;
+	gather->expected = expected;
+	gather->deadline = deadlines.insert(make_pair(deadline, gather));
+
+	byCorrelation[correlationId] = gather;
+	byId[gather->result.id] = gather;
+	return gather->result.id;
+}
+
+bool ScatterGather::Expects(const string &correlationId){
+	AutoMutex lock(mutex);
+	return byCorrelation.count(correlationId) > 0;
+}
+
+bool ScatterGather::Offer(const string &correlationId, const string &xml){
+	AutoMutex lock(mutex);
+
+	map<string, Gather*>::iterator it = byCorrelation.find(correlationId);
+	if (it == byCorrelation.end())
+		return false;
+
+	Gather *gather = it->second;
+	gather->result.replies.push_back(xml);
+	if (gather->result.replies.size() < gather->expected)
+		return false;
+
+	Finish(gather);
+	return true;
+}
+
+void ScatterGather::Fail(unsigned long long id, const string &error){
+	AutoMutex lock(mutex);
+
+	map<unsigned long long, Gather*>::iterator it = byId.find(id);
+	if (it == byId.end())
+		return;
+
+	it->second->result.error = error;
+	Finish(it->second);
+}
+
+void ScatterGather::Collect(uint64_t now, vector<Result> &results){
+	AutoMutex lock(mutex);
+
+	while (!deadlines.empty() && deadlines.begin()->first <= now) {
+		Gather *gather = deadlines.begin()->second;
+		gather->result.timedOut = true;
+		Finish(gather);
+	}
+
+	/* Swapped out element by element so the replies are not copied. */
+	size_t start = results.size();
+	results.resize(start + finished.size());
+	for (size_t i = 0; i < finished.size(); i++) {
+		Result &result = results[start + i];
+		result.id = finished[i].id;
+		result.correlationId.swap(finished[i].correlationId);
+		result.replySubject.swap(finished[i].replySubject);
+		result.replies.swap(finished[i].replies);
+		result.timedOut = finished[i].timedOut;
+		result.error.swap(finished[i].error);
+	}
+	finished.clear();
+}
+
+uint64_t ScatterGather::NextDeadline(){
+	AutoMutex lock(mutex);
+	return deadlines.empty() ? 0 : deadlines.begin()->first;
+}
+
+size_t ScatterGather::Open(){
+	AutoMutex lock(mutex);
+	return byId.size();
+}
+
+/* Called with the mutex held. */
+void ScatterGather::Finish(Gather *gather){
+	deadlines.erase(gather->deadline);
+	byCorrelation.erase(gather->result.correlationId);
+	byId.erase(gather->result.id);
+
+	finished.push_back(Result());
+	Result &result = finished.back();
+	result.id = gather->result.id;
+	result.correlationId.swap(gather->result.correlationId);
+	result.replySubject.swap(gather->result.replySubject);
+	result.replies.swap(gather->result.replies);
+	result.timedOut = gather->result.timedOut;
+	result.error.swap(gather->result.error);
+	delete gather;
+}
@@ -0,0 +1,87 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SCATTERGATHER_H
+#define GMSECJS_SCATTERGATHER_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Sync.h"
+
+/*
+ * Bookkeeping for requests that collect replies from several responders.
+ * Each gather waits for a number of replies carrying its correlation id,
+ * or for its deadline, whichever comes first. Replies are offered from the
+ * dispatch thread; everything else happens on the node thread, which polls
+ * Collect() when a gather completes and when the earliest deadline passes,
+ * so any number of gathers share one timer.
+ */
+class ScatterGather {
+public:
+	struct Result {
+		unsigned long long id;
+		std::string correlationId;
+		std::string replySubject;
+		std::vector<std::string> replies;
+		bool timedOut;
+		std::string error;
+	};
+
+	ScatterGather();
+	~ScatterGather();
+
+	/* Returns 0 if a gather with the same correlation id is still open.
+	 * Deadlines are uv_hrtime() values. */
+	unsigned long long Begin(const std::string &correlationId, const std::string &replySubject,
+	                         size_t expected, uint64_t deadline);
+
+	/* Cheap check before the caller renders the reply's XML for Offer(). */
+	bool Expects(const std::string &correlationId);
+
+	/* Adds a reply. Returns true if it was the last one the gather expected. */
+	bool Offer(const std::string &correlationId, const std::string &xml);
+
+	/* Ends a gather early, e.g. because its request could not be published. */
+	void Fail(unsigned long long id, const std::string &error);
+
+	/* Moves completed and failed gathers, and those whose deadline is at or
+	 * before now, to results. */
+	void Collect(uint64_t now, std::vector<Result> &results);
+
+	/* Earliest deadline of an open gather, or 0 if there are none. */
+	uint64_t NextDeadline();
+
+	size_t Open();
+
+private:
+	struct Gather {
+		Result result;
+		size_t expected;
+		std::multimap<uint64_t, Gather*>::iterator deadline;
+	};
+
+	void Finish(Gather *gather);
+
+	unsigned long long nextId;
+	std::map<std::string, Gather*> byCorrelation;
+	std::map<unsigned long long, Gather*> byId;
+	std::multimap<uint64_t, Gather*> deadlines;
+	std::vector<Result> finished;
+	Mutex mutex;
+};
+
+#endif
@@ -0,0 +1,743 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdlib.h>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#endif
+
+#include "Segment.h"
+#include "Bytes.h"
+
+using namespace std;
+
+const char *Segment::EXTENSION = ".gjsr";
+
+static const char HEADER_MAGIC[4] = { 'G', 'J', 'S', 'R' };
+static const char BLOCK_MAGIC[4] = { 'G', 'J', 'S', 'B' };
+static const char INDEX_MAGIC[4] = { 'G', 'J', 'S', 'I' };
+static const char TRAILER_MAGIC[4] = { 'G', 'J', 'S', 'E' };
+static const unsigned VERSION = 3;
+static const unsigned FLAG_DICTIONARY = 1;
+
+static const size_t HEADER_SIZE = 16;
+static const size_t BLOCK_HEADER_SIZE = 44;
+static const size_t TRAILER_SIZE = 12;
+
+/* Deflate cannot expand data by more than about 1032 to 1, so a block
+ * claiming more raw bytes than that has a damaged header or index entry. */
+static const unsigned long long MAX_INFLATE_RATIO = 1032;
+static const unsigned long long INFLATE_SLACK = 1024;
+static const size_t MAX_RESERVE = 16 * 1024 * 1024;
+
+/* Bounds on what a block tracks so the index stays small. */
+static const size_t MAX_RANGE_FIELDS = 64;
+static const size_t MAX_RANGE_TEXT = 64;
+
+/* Segments grow past 2GB, so plain fseek/ftell are not enough. */
+static bool Seek(FILE *file, unsigned long long offset){
+#ifdef _WIN32
+	return _fseeki64(file, (__int64) offset, SEEK_SET) == 0;
+#else
+	return fseeko(file, (off_t) offset, SEEK_SET) == 0;
+#endif
+}
+
+static bool FileSize(FILE *file, unsigned long long &size){
+#ifdef _WIN32
+	if (_fseeki64(file, 0, SEEK_END) != 0)
+		return false;
+	__int64 end = _ftelli64(file);
+#else
+	if (fseeko(file, 0, SEEK_END) != 0)
+		return false;
+	off_t end = ftello(file);
+#endif
+	if (end < 0)
+		return false;
+	size = (unsigned long long) end;
+	return true;
+}
+
+static bool ReadExactly(FILE *file, size_t length, string &out){
+	out.resize(length);
+	return length == 0 || fread(&out[0], 1, length, file) == length;
+}
+
+static bool HasMagic(const string &in, size_t pos, const char magic[4]){
+	return in.size() >= pos + 4 && in.compare(pos, 4, magic, 4) == 0;
+}
+
+static void PutBlockFields(string &out, const Segment::Block &block){
+	PutU32(out, block.compressedSize);
+	PutU32(out, block.rawSize);
+	PutU32(out, block.count);
+	PutF64(out, block.first);
+	PutF64(out, block.last);
+	PutU64(out, block.bloom);
+}
+
+static bool GetBlockFields(const string &in, size_t &pos, Segment::Block &block){
+	return GetU32(in, pos, block.compressedSize) && GetU32(in, pos, block.rawSize) &&
+	       GetU32(in, pos, block.count) && GetF64(in, pos, block.first) &&
+	       GetF64(in, pos, block.last) && GetU64(in, pos, block.bloom);
+}
+
+/* Whether a block's header fields fit a file whose blocks end at end. */
+static bool BlockFits(const Segment::Block &block, unsigned long long end){
+	return block.offset >= HEADER_SIZE &&
+	       block.offset + BLOCK_HEADER_SIZE + block.compressedSize <= end &&
+	       block.rawSize <= block.compressedSize * MAX_INFLATE_RATIO + INFLATE_SLACK;
+}
+
+static void PutString16(string &out, const string &value){
+	PutU16(out, (unsigned) value.size());
+	out += value;
+}
+
+static bool GetString16(const string &in, size_t &pos, string &value){
+	unsigned length;
+	if (!GetU16(in, pos, length) || pos + length > in.size())
+		return false;
+	value.assign(in, pos, length);
+	pos += length;
+	return true;
+}
+
+static void PutRanges(string &out, const vector<Segment::FieldRange> &ranges){
+	PutU16(out, (unsigned) ranges.size());
+	for (size_t i = 0; i < ranges.size(); i++) {
+		const Segment::FieldRange &range = ranges[i];
+		PutString16(out, range.name);
+		out += (char) (range.numeric ? 1 : 0);
+		if (range.numeric) {
+			PutF64(out, range.min);
+			PutF64(out, range.max);
+		}
+		else {
+			PutString16(out, range.minText);
+			PutString16(out, range.maxText);
+		}
+	}
+}
+
+static bool GetRanges(const string &in, size_t &pos, vector<Segment::FieldRange> &ranges){
+	unsigned count;
+	if (!GetU16(in, pos, count))
+		return false;
+
+	ranges.resize(count);
+	for (unsigned i = 0; i < count; i++) {
+		Segment::FieldRange &range = ranges[i];
+		if (!GetString16(in, pos, range.name) || pos >= in.size())
+			return false;
+		range.numeric = in[pos++] != 0;
+		range.min = range.max = 0;
+		if (range.numeric) {
+			if (!GetF64(in, pos, range.min) || !GetF64(in, pos, range.max))
+				return false;
+		}
+		else if (!GetString16(in, pos, range.minText) || !GetString16(in, pos, range.maxText)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+unsigned long long Segment::SubjectBloom(const string &subject){
+	/* FNV-1a, with the two bits taken from different parts of the hash. */
+	unsigned long long hash = 14695981039346656037ULL;
+	for (size_t i = 0; i < subject.size(); i++) {
+		hash ^= (unsigned char) subject[i];
+		hash *= 1099511628211ULL;
+	}
+	return (1ULL << (hash & 63)) | (1ULL << ((hash >> 32) & 63));
+}
+
+bool Segment::MayContain(const Block &block, const string &subject){
+	unsigned long long bits = SubjectBloom(subject);
+	return (block.bloom & bits) == bits;
+}
+
+void Segment::AppendRecord(string &raw, double time, const string &subject, const char *xml, size_t length){
+	PutF64(raw, time);
+	PutU16(raw, (unsigned) subject.size());
+	raw += subject;
+	PutU32(raw, (unsigned) length);
+	raw.append(xml, length);
+}
+
+bool Segment::ParseRecords(const string &raw, vector<RecordedMessage> &out){
+	size_t pos = 0;
+	while (pos < raw.size()) {
+		RecordedMessage message;
+		unsigned subjectLength, xmlLength;
+
+		if (!GetF64(raw, pos, message.time) || !GetU16(raw, pos, subjectLength) ||
+		    pos + subjectLength > raw.size())
+			return false;
+		message.subject.assign(raw, pos, subjectLength);
+		pos += subjectLength;
+
+		if (!GetU32(raw, pos, xmlLength) || pos + xmlLength > raw.size())
+			return false;
+		message.xml.assign(raw, pos, xmlLength);
+		pos += xmlLength;
+
+		out.push_back(message);
+	}
+	return true;
+}
+
+bool Segment::List(const string &path, vector<string> &segments, string &error){
+	segments.clear();
+
+#ifdef _WIN32
+	DWORD attributes = GetFileAttributesA(path.c_str());
+	if (attributes == INVALID_FILE_ATTRIBUTES) {
+		error = "Unable to open " + path;
+		return false;
+	}
+	if (!(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+		segments.push_back(path);
+		return true;
+	}
+
+	WIN32_FIND_DATAA found;
+	HANDLE find = FindFirstFileA((path + "\\*" + EXTENSION).c_str(), &found);
+	if (find != INVALID_HANDLE_VALUE) {
+		do {
+			segments.push_back(path + "/" + found.cFileName);
+		} while (FindNextFileA(find, &found));
+		FindClose(find);
+	}
+#else
+	struct stat info;
+	if (stat(path.c_str(), &info) != 0) {
+		error = "Unable to open " + path;
+		return false;
+	}
+	if (!S_ISDIR(info.st_mode)) {
+		segments.push_back(path);
+		return true;
+	}
+
+	DIR *dir = opendir(path.c_str());
+	if (dir == NULL) {
+		error = "Unable to list " + path;
+		return false;
+	}
+	size_t extension = strlen(EXTENSION);
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL) {
+		string name = entry->d_name;
+		if (name.size() > extension && name.compare(name.size() - extension, extension, EXTENSION) == 0)
+			segments.push_back(path + "/" + name);
+	}
+	closedir(dir);
+#endif
+
+	sort(segments.begin(), segments.end());
+	return true;
+}
+
+bool Segment::MakeDirectory(const string &path, string &error){
+#ifdef _WIN32
+	DWORD attributes;
+	if (_mkdir(path.c_str()) == 0 ||
+	    ((attributes = GetFileAttributesA(path.c_str())) != INVALID_FILE_ATTRIBUTES &&
+	     (attributes & FILE_ATTRIBUTE_DIRECTORY)))
+		return true;
+#else
+	if (mkdir(path.c_str(), 0777) == 0 || errno == EEXIST)
+		return true;
+#endif
+	error = "Unable to create " + path;
+	return false;
+}
+
+string Segment::SegmentPath(const string &directory, double first, unsigned long long sequence){
+	char name[64];
+	sprintf(name, "/segment-%013.0f-%llu", first, sequence);
+	return directory + name + EXTENSION;
+}
+
+void FieldRangeBuilder::Add(const MessageRecord::Field &field){
+	if (field.type == GMSEC_TYPE_BIN || untracked.count(field.name))
+		return;
+
+	bool numeric = MessageRecord::IsNumericType(field.type);
+	double number = 0;
+	if (numeric) {
+		char *end;
+		number = strtod(field.value.c_str(), &end);
+		if (end == field.value.c_str() || number != number)
+			return;
+	}
+
+	map<string, Segment::FieldRange>::iterator it = ranges.find(field.name);
+	if (it == ranges.end()) {
+		if (ranges.size() >= MAX_RANGE_FIELDS || (!numeric && field.value.size() > MAX_RANGE_TEXT))
+			return;
+
+		Segment::FieldRange range;
+		range.name = field.name;
+		range.numeric = numeric;
+		range.min = range.max = number;
+		if (!numeric)
+			range.minText = range.maxText = field.value;
+		ranges.insert(make_pair(field.name, range));
+		return;
+	}
+
+	/* A field whose type or length makes the range meaningless is dropped
+	 * for the rest of the block. */
+	Segment::FieldRange &range = it->second;
+	if (range.numeric != numeric || (!numeric && field.value.size() > MAX_RANGE_TEXT)) {
+		ranges.erase(it);
+		untracked.insert(field.name);
+		return;
+	}
+
+	if (numeric) {
+		if (number < range.min)
+			range.min = number;
+		if (number > range.max)
+			range.max = number;
+	}
+	else {
+		if (field.value < range.minText)
+			range.minText = field.value;
+		if (field.value > range.maxText)
+			range.maxText = field.value;
+	}
+}
+
+void FieldRangeBuilder::Get(vector<Segment::FieldRange> &out) const{
+	out.clear();
+	for (map<string, Segment::FieldRange>::const_iterator it = ranges.begin(); it != ranges.end(); ++it)
+		out.push_back(it->second);
+}
+
+void FieldRangeBuilder::Clear(){
+	ranges.clear();
+	untracked.clear();
+}
+
+SegmentWriter::SegmentWriter(bool useDictionary, int level)
+	: file(NULL),
+	  useDictionary(useDictionary),
+	  compressor(useDictionary, level),
+	  offset(0),
+	  compressedBytes(0){
+}
+
+SegmentWriter::~SegmentWriter(){
+	string error;
+	Close(error);
+}
+
+bool SegmentWriter::Open(const string &path, string &error){
+	file = fopen(path.c_str(), "wb");
+	if (file == NULL) {
+		error = "Unable to open " + path;
+		return false;
+	}
+
+	this->path = path;
+	blocks.clear();
+	compressedBytes = 0;
+
+	string header(HEADER_MAGIC, sizeof(HEADER_MAGIC));
+	PutU32(header, VERSION);
+	PutU32(header, useDictionary ? FLAG_DICTIONARY : 0);
+	PutU32(header, 0);
+
+	if (fwrite(header.data(), 1, header.size(), file) != header.size()) {
+		error = "Unable to write " + path;
+		return false;
+	}
+	offset = header.size();
+	return true;
+}
+
+bool SegmentWriter::WriteBlock(const string &raw, unsigned count, double first, double last,
+                               unsigned long long bloom, const vector<Segment::FieldRange> &ranges,
+                               string &error){
+	if (!compressor.Compress(raw.data(), raw.size(), scratch)) {
+		error = "Unable to compress a block of " + path;
+		return false;
+	}
+
+	Segment::Block block;
+	block.offset = offset;
+	block.compressedSize = (unsigned) scratch.size();
+	block.rawSize = (unsigned) raw.size();
+	block.count = count;
+	block.first = first;
+	block.last = last;
+	block.bloom = bloom;
+	block.ranges = ranges;
+
+	string header(BLOCK_MAGIC, sizeof(BLOCK_MAGIC));
+	PutBlockFields(header, block);
+	PutU32(header, (unsigned) crc32(0L, (const Bytef*) scratch.data(), (uInt) scratch.size()));
+
+	if (fwrite(header.data(), 1, header.size(), file) != header.size() ||
+	    fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size()) {
+		error = "Unable to write " + path;
+		return false;
+	}
+
+	/* Flushed per block so a crash loses at most the block being written. */
+	fflush(file);
+
+	blocks.push_back(block);
+	offset += header.size() + scratch.size();
+	compressedBytes += scratch.size();
+	return true;
+}
+
+bool SegmentWriter::Close(string &error){
+	if (file == NULL)
+		return true;
+
+	string index(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+	PutU32(index, (unsigned) blocks.size());
+	for (size_t i = 0; i < blocks.size(); i++) {
+		PutU64(index, blocks[i].offset);
+		PutBlockFields(index, blocks[i]);
+		PutRanges(index, blocks[i].ranges);
+	}
+	PutU64(index, offset);
+	index.append(TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+
+	bool written = fwrite(index.data(), 1, index.size(), file) == index.size();
+	written = fclose(file) == 0 && written;
+	file = NULL;
+
+	if (!written) {
+		error = "Unable to write the index of " + path;
+		return false;
+	}
+	return true;
+}
+
+bool SegmentReader::Open(const string &path, string &error){
+	this->path = path;
+	blocks.clear();
+
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		error = "Unable to open " + path;
+		return false;
+	}
+
+	string header;
+	size_t pos = sizeof(HEADER_MAGIC);
+	unsigned version, flags;
+	if (!ReadExactly(file, HEADER_SIZE, header) || !HasMagic(header, 0, HEADER_MAGIC) ||
+	    !GetU32(header, pos, version) || !GetU32(header, pos, flags)) {
+		fclose(file);
+		error = path + " is not a recording segment";
+		return false;
+	}
+
+	if (version < 1 || version > VERSION) {
+		fclose(file);
+		error = path + " has an unsupported segment version";
+		return false;
+	}
+
+	if ((flags & FLAG_DICTIONARY) == 0)
+		dictionary = NULL;
+	else if (version >= 3)
+		dictionary = &FrameCompressor::Dictionary();
+	else
+		dictionary = &FrameCompressor::HandWrittenDictionary();
+
+	/* A missing or damaged index is not an error; the blocks are scanned
+	 * instead. */
+	recovered = !ReadIndex(file, version);
+	if (recovered)
+		ScanBlocks(file);
+
+	fclose(file);
+	return true;
+}
+
+bool SegmentReader::ReadIndex(FILE *file, unsigned version){
+	unsigned long long size, indexOffset;
+	string trailer, index;
+	size_t pos = 0;
+
+	if (!FileSize(file, size) || size < HEADER_SIZE + TRAILER_SIZE ||
+	    !Seek(file, size - TRAILER_SIZE) || !ReadExactly(file, TRAILER_SIZE, trailer) ||
+	    !HasMagic(trailer, 8, TRAILER_MAGIC) || !GetU64(trailer, pos, indexOffset) ||
+	    indexOffset < HEADER_SIZE || indexOffset > size - TRAILER_SIZE)
+		return false;
+
+	if (!Seek(file, indexOffset) ||
+	    !ReadExactly(file, (size_t) (size - TRAILER_SIZE - indexOffset), index) ||
+	    !HasMagic(index, 0, INDEX_MAGIC))
+		return false;
+
+	pos = sizeof(INDEX_MAGIC);
+	unsigned count;
+	if (!GetU32(index, pos, count))
+		return false;
+
+	for (unsigned i = 0; i < count; i++) {
+		Segment::Block block;
+		if (!GetU64(index, pos, block.offset) || !GetBlockFields(index, pos, block) ||
+		    (version >= 2 && !GetRanges(index, pos, block.ranges)) || !BlockFits(block, indexOffset)) {
+			blocks.clear();
+			return false;
+		}
+		blocks.push_back(block);
+	}
+	return true;
+}
+
+void SegmentReader::ScanBlocks(FILE *file){
+	unsigned long long size;
+	if (!FileSize(file, size))
+		return;
+
+	unsigned long long offset = HEADER_SIZE;
+	string header;
+	while (offset + BLOCK_HEADER_SIZE <= size) {
+		size_t pos = sizeof(BLOCK_MAGIC);
+		Segment::Block block;
+		block.offset = offset;
+
+		if (!Seek(file, offset) || !ReadExactly(file, BLOCK_HEADER_SIZE, header) ||
+		    !HasMagic(header, 0, BLOCK_MAGIC) || !GetBlockFields(header, pos, block))
+			break;
+
+		/* A block cut short by a crash ends the segment. */
+		if (!BlockFits(block, size))
+			break;
+		unsigned long long next = offset + BLOCK_HEADER_SIZE + block.compressedSize;
+
+		blocks.push_back(block);
+		offset = next;
+	}
+}
+
+FILE *SegmentReader::OpenFile(string &error) const{
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL)
+		error = "Unable to open " + path;
+	return file;
+}
+
+bool SegmentReader::ReadBlock(FILE *file, size_t index, string &raw, string &error) const{
+	const Segment::Block &block = blocks[index];
+	size_t pos = BLOCK_HEADER_SIZE - 4;
+	unsigned crc;
+	string header, compressed;
+
+	if (!Seek(file, block.offset) || !ReadExactly(file, BLOCK_HEADER_SIZE, header) ||
+	    !HasMagic(header, 0, BLOCK_MAGIC) || !GetU32(header, pos, crc) ||
+	    !ReadExactly(file, block.compressedSize, compressed)) {
+		error = path + " is truncated";
+		return false;
+	}
+
+	if (crc != (unsigned) crc32(0L, (const Bytef*) compressed.data(), (uInt) compressed.size())) {
+		error = path + " has a corrupt block";
+		return false;
+	}
+
+	/* The size only sizes the buffer up front; a block whose header lies
+	 * still fails the size check below without a large reservation. */
+	raw.reserve(block.rawSize < MAX_RESERVE ? block.rawSize : MAX_RESERVE);
+	if (!FrameCompressor::Decompress(compressed.data(), compressed.size(), dictionary, raw) ||
+	    raw.size() != block.rawSize) {
+		error = path + " has a corrupt block";
+		return false;
+	}
+
+	return true;
+}
+
+bool SegmentReader::ReadBlocks(const vector<size_t> &indexes, vector<string> &raw, string &error) const{
+	FILE *file = OpenFile(error);
+	if (file == NULL)
+		return false;
+
+	raw.resize(indexes.size());
+
+	bool ok = true;
+	for (size_t i = 0; ok && i < indexes.size(); i++)
+		ok = ReadBlock(file, indexes[i], raw[i], error);
+
+	fclose(file);
+	return ok;
+}
+
+RecordingWriter::RecordingWriter(const Options &options)
+	: options(options),
+	  writer(options.dictionary, options.level),
+	  count(0),
+	  first(0),
+	  last(0),
+	  bloom(0),
+	  messages(0),
+	  segments(0){
+}
+
+bool RecordingWriter::Open(string &error){
+	return Segment::MakeDirectory(options.directory, error);
+}
+
+bool RecordingWriter::Append(const RecordedMessage &message, string &error){
+	if (count == 0 || message.time < first)
+		first = message.time;
+	if (count == 0 || message.time > last)
+		last = message.time;
+
+	Segment::AppendRecord(raw, message.time, message.subject, message.xml.data(), message.xml.size());
+	count++;
+	bloom |= Segment::SubjectBloom(message.subject);
+	messages++;
+
+	if (options.fieldRanges && record.FromXML(message.xml))
+		for (size_t i = 0; i < record.fields.size(); i++)
+			ranges.Add(record.fields[i]);
+
+	return raw.size() < options.blockBytes || Flush(error);
+}
+
+bool RecordingWriter::Flush(string &error){
+	if (count == 0)
+		return true;
+
+	if (writer.IsOpen() && writer.Size() >= options.segmentBytes && !writer.Close(error))
+		return false;
+
+	if (!writer.IsOpen()) {
+		if (!writer.Open(Segment::SegmentPath(options.directory, first, segments), error))
+			return false;
+		segments++;
+	}
+
+	vector<Segment::FieldRange> blockRanges;
+	ranges.Get(blockRanges);
+	if (!writer.WriteBlock(raw, count, first, last, bloom, blockRanges, error))
+		return false;
+
+	raw.clear();
+	count = 0;
+	bloom = 0;
+	ranges.Clear();
+	return true;
+}
+
+bool RecordingWriter::Close(string &error){
+	return Flush(error) && writer.Close(error);
+}
+
+SegmentSet::~SegmentSet(){
+	for (size_t i = 0; i < segments.size(); i++)
+		delete segments[i];
+}
+
+static bool FirstMessageBefore(const SegmentReader *a, const SegmentReader *b){
+	double first = a->Blocks().empty() ? 0 : a->Blocks().front().first;
+	double other = b->Blocks().empty() ? 0 : b->Blocks().front().first;
+	return first < other;
+}
+
+bool SegmentSet::Open(const string &path, string &error){
+	vector<string> paths;
+	if (!Segment::List(path, paths, error))
+		return false;
+
+	for (size_t i = 0; i < paths.size(); i++) {
+		SegmentReader *reader = new SegmentReader();
+		if (!reader->Open(paths[i], error)) {
+			delete reader;
+			return false;
+		}
+		segments.push_back(reader);
+	}
+
+	stable_sort(segments.begin(), segments.end(), FirstMessageBefore);
+	return true;
+}
+
+bool SegmentSet::Read(const Query &query, vector<RecordedMessage> &out, Stats &stats, string &error) const{
+	set<string> subjects(query.subjects.begin(), query.subjects.end());
+
+	stats.blocksRead = 0;
+	stats.blocksSkipped = 0;
+
+	vector<RecordedMessage> records;
+	for (size_t s = 0; s < segments.size(); s++) {
+		const vector<Segment::Block> &blocks = segments[s]->Blocks();
+
+		/* Only blocks that overlap the range and may hold one of the
+		 * subjects are inflated. */
+		vector<size_t> wanted;
+		for (size_t b = 0; b < blocks.size(); b++) {
+			bool overlaps = blocks[b].last >= query.from && blocks[b].first <= query.to;
+			bool mayMatch = subjects.empty();
+			for (set<string>::const_iterator it = subjects.begin(); !mayMatch && it != subjects.end(); ++it)
+				mayMatch = Segment::MayContain(blocks[b], *it);
+
+			if (overlaps && mayMatch)
+				wanted.push_back(b);
+			else
+				stats.blocksSkipped++;
+		}
+
+		if (wanted.empty())
+			continue;
+
+		vector<string> raw;
+		if (!segments[s]->ReadBlocks(wanted, raw, error))
+			return false;
+		stats.blocksRead += wanted.size();
+
+		for (size_t b = 0; b < raw.size(); b++) {
+			records.clear();
+			if (!Segment::ParseRecords(raw[b], records)) {
+				error = segments[s]->Path() + " has a malformed block";
+				return false;
+			}
+
+			for (size_t r = 0; r < records.size(); r++) {
+				const RecordedMessage &record = records[r];
+				if (record.time < query.from || record.time > query.to)
+					continue;
+				if (!subjects.empty() && subjects.find(record.subject) == subjects.end())
+					continue;
+				out.push_back(record);
+			}
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,242 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SEGMENT_H
+#define GMSECJS_SEGMENT_H
+
+#include <stdio.h>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "FrameCompressor.h"
+#include "MessageRecord.h"
+
+/*
+ * Recording segments: files of independently compressed blocks of
+ * messages with a block index at the end, so a reader only inflates the
+ * blocks whose time span and subjects it needs.
+ *
+ *   header  "GJSR" u32 version, u32 flags (1 = preset dictionary), u32 0
+ *   block   "GJSB" u32 compressed, u32 raw, u32 count, f64 first, f64 last,
+ *           u64 subject bloom, u32 crc32 of the compressed bytes,
+ *           then the raw-deflated records
+ *   index   "GJSI" u32 blocks, then per block u64 offset, the block
+ *           header fields and its field ranges: u16 count, then per field
+ *           u16 length, name, u8 numeric, and f64 min, f64 max or two
+ *           u16-length strings
+ *   trailer u64 index offset, "GJSE"
+ *
+ * A record is f64 receive time (ms since 1970), u16 subject length,
+ * subject, u32 XML length, XML. Every block header is self-describing so a
+ * segment whose writer died before the index was written can still be
+ * read by scanning; only the field ranges are lost.
+ *
+ * Version 1 segments have no field ranges. Versions 1 and 2 were
+ * compressed with FrameCompressor's hand-written dictionary rather than
+ * the generated one.
+ */
+struct RecordedMessage {
+	double time;
+	std::string subject;
+	std::string xml;
+};
+
+class Segment {
+public:
+	/* Smallest and largest value of a field within a block, so queries
+	 * can skip blocks their predicates rule out. */
+	struct FieldRange {
+		std::string name;
+		bool numeric;
+		double min;
+		double max;
+		std::string minText;
+		std::string maxText;
+	};
+
+	struct Block {
+		unsigned long long offset;
+		unsigned compressedSize;
+		unsigned rawSize;
+		unsigned count;
+		double first;
+		double last;
+		unsigned long long bloom;
+		std::vector<FieldRange> ranges;
+	};
+
+	static const char *EXTENSION;
+
+	/* Two bits of a 64-bit filter per subject. */
+	static unsigned long long SubjectBloom(const std::string &subject);
+	static bool MayContain(const Block &block, const std::string &subject);
+
+	static void AppendRecord(std::string &raw, double time, const std::string &subject, const char *xml, size_t length);
+	static bool ParseRecords(const std::string &raw, std::vector<RecordedMessage> &out);
+
+	/* A path is either one segment file or a directory of them. */
+	static bool List(const std::string &path, std::vector<std::string> &segments, std::string &error);
+	static bool MakeDirectory(const std::string &path, std::string &error);
+
+	/* directory/segment-<first ms>-<sequence>.gjsr */
+	static std::string SegmentPath(const std::string &directory, double first, unsigned long long sequence);
+};
+
+/*
+ * Collects the field ranges of the block being built. Binary fields,
+ * fields seen with both numeric and text values, text longer than 64
+ * characters and fields beyond the first 64 are not tracked.
+ */
+class FieldRangeBuilder {
+public:
+	void Add(const MessageRecord::Field &field);
+	void Get(std::vector<Segment::FieldRange> &out) const;
+	void Clear();
+
+private:
+	std::map<std::string, Segment::FieldRange> ranges;
+	std::set<std::string> untracked;
+};
+
+class SegmentWriter {
+public:
+	SegmentWriter(bool useDictionary, int level);
+	~SegmentWriter();
+
+	bool Open(const std::string &path, std::string &error);
+	bool WriteBlock(const std::string &raw, unsigned count, double first, double last,
+	                unsigned long long bloom, const std::vector<Segment::FieldRange> &ranges,
+	                std::string &error);
+	bool Close(std::string &error);
+
+	bool IsOpen() const { return file != NULL; }
+	unsigned long long Size() const { return offset; }
+	unsigned long long CompressedBytes() const { return compressedBytes; }
+
+private:
+	FILE *file;
+	std::string path;
+	bool useDictionary;
+	FrameCompressor compressor;
+	std::vector<Segment::Block> blocks;
+	unsigned long long offset;
+	unsigned long long compressedBytes;
+	std::string scratch;
+};
+
+class SegmentReader {
+public:
+	SegmentReader() : dictionary(NULL), recovered(false) {}
+
+	bool Open(const std::string &path, std::string &error);
+
+	/* Each reader of a segment opens its own handle, so any number of reads
+	 * may run at once. */
+	FILE *OpenFile(std::string &error) const;
+	bool ReadBlock(FILE *file, size_t index, std::string &raw, std::string &error) const;
+	bool ReadBlocks(const std::vector<size_t> &indexes, std::vector<std::string> &raw, std::string &error) const;
+
+	const std::string &Path() const { return path; }
+	const std::vector<Segment::Block> &Blocks() const { return blocks; }
+	bool Recovered() const { return recovered; }
+
+private:
+	bool ReadIndex(FILE *file, unsigned version);
+	void ScanBlocks(FILE *file);
+
+	std::string path;
+	const std::string *dictionary;    /* NULL for none */
+	bool recovered;      /* index rebuilt by scanning the blocks */
+	std::vector<Segment::Block> blocks;
+};
+
+/*
+ * Writes messages into a recording directory from a single thread,
+ * building blocks and starting new segments the way the recorder does.
+ * Messages need not be in receive time order; each block's span covers
+ * whatever it holds.
+ */
+class RecordingWriter {
+public:
+	struct Options {
+		Options() : blockBytes(256 * 1024), segmentBytes(256ULL * 1024 * 1024),
+		            level(6), dictionary(true), fieldRanges(true) {}
+
+		std::string directory;
+		size_t blockBytes;
+		unsigned long long segmentBytes;
+		int level;
+		bool dictionary;
+		bool fieldRanges;
+	};
+
+	RecordingWriter(const Options &options);
+
+	bool Open(std::string &error);
+	bool Append(const RecordedMessage &message, std::string &error);
+	bool Close(std::string &error);
+
+	unsigned long long Messages() const { return messages; }
+	unsigned long long Segments() const { return segments; }
+
+private:
+	bool Flush(std::string &error);
+
+	Options options;
+	SegmentWriter writer;
+	MessageRecord record;
+	FieldRangeBuilder ranges;
+	std::string raw;
+	unsigned count;
+	double first;
+	double last;
+	unsigned long long bloom;
+	unsigned long long messages;
+	unsigned long long segments;
+};
+
+/*
+ * All segments of a recording, ordered by their first message.
+ */
+class SegmentSet {
+public:
+	struct Query {
+		Query() : from(-1e300), to(1e300) {}
+		double from;
+		double to;
+		std::vector<std::string> subjects;   /* empty means all */
+	};
+
+	struct Stats {
+		size_t blocksRead;
+		size_t blocksSkipped;
+	};
+
+	~SegmentSet();
+
+	bool Open(const std::string &path, std::string &error);
+
+	/* Messages within [from, to] in recorded order. */
+	bool Read(const Query &query, std::vector<RecordedMessage> &out, Stats &stats, std::string &error) const;
+
+	const std::vector<SegmentReader*> &Segments() const { return segments; }
+
+private:
+	std::vector<SegmentReader*> segments;
+};
+
+#endif
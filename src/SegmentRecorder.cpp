@@ -0,0 +1,212 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "SegmentRecorder.h"
+
+using namespace std;
+
+void SegmentRecorder::RecordTarget::Deliver(Router::Delivery &delivery){
+	recorder->Record(delivery, MiddlewareApi::Get()->Time() * 1000.0);
+}
+
+SegmentRecorder::SegmentRecorder(const Options &options)
+	: options(options),
+	  writer(options.dictionary, options.level),
+	  current(NULL),
+	  condition(mutex),
+	  running(false),
+	  stopping(false){
+	memset(&stats, 0, sizeof(stats));
+}
+
+SegmentRecorder::~SegmentRecorder(){
+	Stop();
+}
+
+bool SegmentRecorder::Start(string &error){
+	if (running)
+		return true;
+
+	if (!Segment::MakeDirectory(options.directory, error))
+		return false;
+
+	stopping = false;
+	if (uv_thread_create(&thread, Run, this) != 0) {
+		error = "Unable to create recorder thread";
+		return false;
+	}
+
+	running = true;
+	return true;
+}
+
+void SegmentRecorder::Stop(){
+	if (!running)
+		return;
+
+	mutex.Enter();
+	stopping = true;
+	condition.Signal(Condition::USER);
+	mutex.Leave();
+
+	uv_thread_join(&thread);
+	running = false;
+
+	string error;
+	if (!writer.Close(error)) {
+		AutoMutex lock(mutex);
+		lastError = error;
+	}
+}
+
+void SegmentRecorder::Record(Router::Delivery &delivery, double timeMs){
+	string subjectStr = delivery.subject;
+	const string &xml = delivery.Xml();
+
+	if (options.fieldRanges) {
+		if (delivery.recorded != NULL)
+			record.FromXML(*delivery.recorded);
+		else
+			record.FromMessage(delivery.msg);
+	}
+
+	AutoMutex lock(mutex);
+	if (!running || stopping)
+		return;
+
+	if (current == NULL) {
+		current = new Block();
+		current->count = 0;
+		current->first = timeMs;
+		current->bloom = 0;
+		current->opened = uv_hrtime();
+		current->raw.reserve(options.blockBytes + options.blockBytes / 4);
+	}
+
+	Segment::AppendRecord(current->raw, timeMs, subjectStr, xml.data(), xml.size());
+	current->count++;
+	current->last = timeMs;
+	current->bloom |= Segment::SubjectBloom(subjectStr);
+	stats.messages++;
+
+	if (options.fieldRanges)
+		for (size_t i = 0; i < record.fields.size(); i++)
+			current->ranges.Add(record.fields[i]);
+
+	if (current->raw.size() >= options.blockBytes) {
+		Seal();
+		condition.Signal(Condition::USER);
+	}
+}
+
+/* Called with the mutex held. */
+void SegmentRecorder::Seal(){
+	if (current == NULL)
+		return;
+
+	if (sealed.size() >= options.maxQueuedBlocks) {
+		stats.dropped += current->count;
+		delete current;
+	}
+	else {
+		sealed.push_back(current);
+	}
+	current = NULL;
+}
+
+void SegmentRecorder::Run(void *arg){
+	SegmentRecorder *recorder = static_cast<SegmentRecorder*>(arg);
+	const uint64_t flushNs = (uint64_t) recorder->options.flushMs * 1000000;
+
+	AutoMutex lock(recorder->mutex);
+	for (;;) {
+		if (!recorder->sealed.empty()) {
+			Block *block = recorder->sealed.front();
+			recorder->sealed.pop_front();
+
+			lock.leave();
+			recorder->Write(block);
+			lock.enter();
+			continue;
+		}
+
+		if (recorder->stopping) {
+			if (recorder->current == NULL)
+				break;
+			recorder->Seal();
+			continue;
+		}
+
+		/* Quiet subjects still reach the disk within flushMs. */
+		if (recorder->current != NULL) {
+			uint64_t age = uv_hrtime() - recorder->current->opened;
+			if (age >= flushNs) {
+				recorder->Seal();
+				continue;
+			}
+			recorder->condition.Wait((long) ((flushNs - age + 999999) / 1000000));
+		}
+		else {
+			recorder->condition.Wait(recorder->options.flushMs);
+		}
+	}
+}
+
+/* Recorder thread only; the writer is not shared. */
+void SegmentRecorder::Write(Block *block){
+	string error;
+	bool rotated = false;
+
+	if (writer.IsOpen() && writer.Size() >= options.segmentBytes)
+		writer.Close(error);
+
+	if (error.empty() && !writer.IsOpen())
+		rotated = writer.Open(Segment::SegmentPath(options.directory, block->first, stats.segments), error);
+
+	vector<Segment::FieldRange> ranges;
+	block->ranges.Get(ranges);
+
+	unsigned long long before = writer.CompressedBytes();
+	bool written = error.empty() &&
+		writer.WriteBlock(block->raw, block->count, block->first, block->last, block->bloom, ranges, error);
+
+	AutoMutex lock(mutex);
+	if (rotated)
+		stats.segments++;
+	if (written) {
+		stats.blocks++;
+		stats.rawBytes += block->raw.size();
+		stats.compressedBytes += writer.CompressedBytes() - before;
+	}
+	else {
+		stats.dropped += block->count;
+		lastError = error;
+	}
+
+	delete block;
+}
+
+SegmentRecorder::Stats SegmentRecorder::GetStats(){
+	AutoMutex lock(mutex);
+	return stats;
+}
+
+string SegmentRecorder::LastError(){
+	AutoMutex lock(mutex);
+	return lastError;
+}
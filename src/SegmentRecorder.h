@@ -0,0 +1,123 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SEGMENTRECORDER_H
+#define GMSECJS_SEGMENTRECORDER_H
+
+#include <deque>
+#include <string>
+
+#include "uv.h"
+#include "Router.h"
+#include "Sync.h"
+
+#include "Segment.h"
+#include "MessageRecord.h"
+
+/*
+ * Records messages into compressed segments under a directory. The
+ * dispatch thread only appends the XML to the open block; sealed blocks
+ * are compressed and written by the recorder's own thread. Blocks are
+ * sealed when they reach blockBytes or have been open for flushMs, and a
+ * new segment is started once the current one passes segmentBytes.
+ *
+ * If the disk falls behind by more than maxQueuedBlocks, further blocks
+ * are dropped and counted rather than growing memory without bound.
+ *
+ * With fieldRanges on, the smallest and largest value of each field is
+ * kept per block for query pushdown.
+ */
+class SegmentRecorder {
+public:
+	struct Options {
+		Options() : blockBytes(256 * 1024), flushMs(1000), segmentBytes(256ULL * 1024 * 1024),
+		            level(6), dictionary(true), maxQueuedBlocks(64), fieldRanges(true) {}
+
+		std::string directory;
+		size_t blockBytes;
+		long flushMs;
+		unsigned long long segmentBytes;
+		int level;
+		bool dictionary;
+		size_t maxQueuedBlocks;
+		bool fieldRanges;
+	};
+
+	struct Stats {
+		unsigned long long messages;
+		unsigned long long dropped;
+		unsigned long long blocks;
+		unsigned long long segments;
+		unsigned long long rawBytes;
+		unsigned long long compressedBytes;
+	};
+
+	/* Routed messages of the recorded subject. */
+	class RecordTarget : public Router::Target {
+	public:
+		RecordTarget(SegmentRecorder *recorder) : recorder(recorder) {}
+		void Deliver(Router::Delivery &delivery);
+	private:
+		SegmentRecorder *recorder;
+	};
+
+	SegmentRecorder(const Options &options);
+	~SegmentRecorder();
+
+	bool Start(std::string &error);
+
+	/* Writes out everything recorded so far and closes the segment. */
+	void Stop();
+
+	void Record(Router::Delivery &delivery, double timeMs);
+
+	bool IsRunning() const { return running; }
+	Stats GetStats();
+	std::string LastError();
+
+private:
+	struct Block {
+		std::string raw;
+		unsigned count;
+		double first;
+		double last;
+		unsigned long long bloom;
+		uint64_t opened;
+		FieldRangeBuilder ranges;
+	};
+
+	static void Run(void *arg);
+	void Seal();
+	void Write(Block *block);
+
+	Options options;
+	SegmentWriter writer;
+
+	/* Dispatch thread scratch space. */
+	MessageRecord record;
+
+	Block *current;
+	std::deque<Block*> sealed;
+	Stats stats;
+	std::string lastError;
+
+	Mutex mutex;
+	Condition condition;
+	uv_thread_t thread;
+	bool running;
+	bool stopping;
+};
+
+#endif
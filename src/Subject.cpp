@@ -0,0 +1,50 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Subject.h"
+
+using namespace std;
+
+bool Subject::IsPattern(const string &pattern){
+	return pattern.find_first_of("*>") != string::npos;
+}
+
+bool Subject::Matches(const string &pattern, const string &subject){
+	size_t p = 0, s = 0;
+
+	for (;;) {
+		size_t pEnd = pattern.find('.', p);
+		size_t sEnd = subject.find('.', s);
+		if (pEnd == string::npos)
+			pEnd = pattern.size();
+		if (sEnd == string::npos)
+			sEnd = subject.size();
+
+		if (pEnd - p == 1 && pattern[p] == '>')
+			return pEnd == pattern.size() && s < subject.size();
+
+		bool any = pEnd - p == 1 && pattern[p] == '*';
+		if (!any && pattern.compare(p, pEnd - p, subject, s, sEnd - s) != 0)
+			return false;
+
+		bool pDone = pEnd == pattern.size();
+		bool sDone = sEnd == subject.size();
+		if (pDone || sDone)
+			return pDone && sDone;
+
+		p = pEnd + 1;
+		s = sEnd + 1;
+	}
+}
@@ -0,0 +1,32 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SUBJECT_H
+#define GMSECJS_SUBJECT_H
+
+#include <string>
+
+/*
+ * GMSEC subject patterns evaluated locally, for data that never passes
+ * through the middleware's own matching. Elements are separated by dots;
+ * '*' matches exactly one element and a trailing '>' one or more.
+ */
+class Subject {
+public:
+	static bool IsPattern(const std::string &pattern);
+	static bool Matches(const std::string &pattern, const std::string &subject);
+};
+
+#endif
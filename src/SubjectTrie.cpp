@@ -0,0 +1,188 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "SubjectTrie.h"
+
+using namespace std;
+
+/* Element starting at pos, and the start of the next one or npos. */
+static string Element(const string &pattern, size_t pos, size_t &next){
+	size_t dot = pattern.find('.', pos);
+	next = dot == string::npos ? string::npos : dot + 1;
+	return pattern.substr(pos, dot == string::npos ? string::npos : dot - pos);
+}
+
+SubjectTrie::Node::~Node(){
+	map<string, Node*>::iterator it;
+	for (it = children.begin(); it != children.end(); ++it)
+		delete it->second;
+	delete any;
+}
+
+SubjectTrie::SubjectTrie(){
+}
+
+SubjectTrie::~SubjectTrie(){
+}
+
+bool SubjectTrie::Empty() const{
+	return root.Empty();
+}
+
+void SubjectTrie::Insert(const string &pattern, void *value){
+	Node *node = &root;
+	size_t pos = 0;
+	while (pos != string::npos) {
+		size_t next;
+		string element = Element(pattern, pos, next);
+
+		/* A '>' anywhere but last never matches; it is kept as a literal. */
+		if (element == ">" && next == string::npos) {
+			node->tail = true;
+			node->tailEntry.pattern = pattern;
+			node->tailEntry.value = value;
+			return;
+		}
+
+		Node *&child = element == "*" ? node->any : node->children[element];
+		if (child == NULL)
+			child = new Node();
+		node = child;
+		pos = next;
+	}
+
+	node->end = true;
+	node->entry.pattern = pattern;
+	node->entry.value = value;
+}
+
+void SubjectTrie::Erase(const string &pattern){
+	Erase(&root, pattern, 0);
+}
+
+/* Returns whether node is left empty, so the caller can drop it. */
+bool SubjectTrie::Erase(Node *node, const string &pattern, size_t pos){
+	if (pos == string::npos) {
+		node->end = false;
+		node->entry = Entry();
+		return node->Empty();
+	}
+
+	size_t next;
+	string element = Element(pattern, pos, next);
+
+	if (element == ">" && next == string::npos) {
+		node->tail = false;
+		node->tailEntry = Entry();
+		return node->Empty();
+	}
+
+	if (element == "*") {
+		if (node->any != NULL && Erase(node->any, pattern, next)) {
+			delete node->any;
+			node->any = NULL;
+		}
+		return node->Empty();
+	}
+
+	map<string, Node*>::iterator it = node->children.find(element);
+	if (it != node->children.end() && Erase(it->second, pattern, next)) {
+		delete it->second;
+		node->children.erase(it);
+	}
+	return node->Empty();
+}
+
+void SubjectTrie::Covering(const string &pattern, vector<const Entry*> &entries) const{
+	Covering(&root, pattern, 0, entries);
+}
+
+void SubjectTrie::Covering(const Node *node, const string &pattern, size_t pos, vector<const Entry*> &entries){
+	if (pos == string::npos) {
+		if (node->end)
+			entries.push_back(&node->entry);
+		return;
+	}
+
+	/* '>' takes one or more elements of any kind. */
+	if (node->tail)
+		entries.push_back(&node->tailEntry);
+	if (node->children.empty() && node->any == NULL)
+		return;
+
+	size_t next;
+	string element = Element(pattern, pos, next);
+	if (element == ">" && next == string::npos)
+		return;
+
+	if (element != "*") {
+		map<string, Node*>::const_iterator it = node->children.find(element);
+		if (it != node->children.end())
+			Covering(it->second, pattern, next, entries);
+	}
+	if (node->any != NULL)
+		Covering(node->any, pattern, next, entries);
+}
+
+void SubjectTrie::Covered(const string &pattern, vector<const Entry*> &entries) const{
+	Covered(&root, pattern, 0, entries);
+}
+
+void SubjectTrie::Covered(const Node *node, const string &pattern, size_t pos, vector<const Entry*> &entries){
+	if (pos == string::npos) {
+		if (node->end)
+			entries.push_back(&node->entry);
+		return;
+	}
+
+	size_t next;
+	string element = Element(pattern, pos, next);
+
+	if (element == ">" && next == string::npos) {
+		Below(node, entries);
+		return;
+	}
+
+	if (element == "*") {
+		map<string, Node*>::const_iterator it;
+		for (it = node->children.begin(); it != node->children.end(); ++it)
+			Covered(it->second, pattern, next, entries);
+		if (node->any != NULL)
+			Covered(node->any, pattern, next, entries);
+		return;
+	}
+
+	map<string, Node*>::const_iterator it = node->children.find(element);
+	if (it != node->children.end())
+		Covered(it->second, pattern, next, entries);
+}
+
+/* Every pattern taking at least one element past node. */
+void SubjectTrie::Below(const Node *node, vector<const Entry*> &entries){
+	if (node->tail)
+		entries.push_back(&node->tailEntry);
+
+	map<string, Node*>::const_iterator it;
+	for (it = node->children.begin(); it != node->children.end(); ++it) {
+		if (it->second->end)
+			entries.push_back(&it->second->entry);
+		Below(it->second, entries);
+	}
+	if (node->any != NULL) {
+		if (node->any->end)
+			entries.push_back(&node->any->entry);
+		Below(node->any, entries);
+	}
+}
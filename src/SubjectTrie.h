@@ -0,0 +1,79 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SUBJECTTRIE_H
+#define GMSECJS_SUBJECTTRIE_H
+
+#include <map>
+#include <string>
+#include <vector>
+
+/*
+ * Subject patterns, each with a value, indexed element by element so
+ * finding the patterns that match a subject costs about the subject's
+ * depth rather than the number of patterns. Returned entries stay valid
+ * until their pattern is erased.
+ */
+class SubjectTrie {
+public:
+	struct Entry {
+		Entry() : value(NULL) {}
+		std::string pattern;
+		void *value;
+	};
+
+	SubjectTrie();
+	~SubjectTrie();
+
+	void Insert(const std::string &pattern, void *value);
+	void Erase(const std::string &pattern);
+	bool Empty() const;
+
+	/* Patterns matching everything the argument matches; for a plain
+	 * subject, the patterns that match it. */
+	void Covering(const std::string &pattern, std::vector<const Entry*> &entries) const;
+
+	/* Patterns matching nothing the argument does not. */
+	void Covered(const std::string &pattern, std::vector<const Entry*> &entries) const;
+
+private:
+	struct Node {
+		Node() : any(NULL), end(false), tail(false) {}
+		~Node();
+
+		bool Empty() const { return children.empty() && any == NULL && !end && !tail; }
+
+		std::map<std::string, Node*> children;
+		Node *any;                 /* '*' */
+		bool end;                  /* a pattern ends here */
+		bool tail;                 /* a pattern ends with '>' after here */
+		Entry entry;
+		Entry tailEntry;
+	};
+
+	static bool Erase(Node *node, const std::string &pattern, size_t pos);
+	static void Covering(const Node *node, const std::string &pattern, size_t pos,
+	                     std::vector<const Entry*> &entries);
+	static void Covered(const Node *node, const std::string &pattern, size_t pos,
+	                    std::vector<const Entry*> &entries);
+	static void Below(const Node *node, std::vector<const Entry*> &entries);
+
+	SubjectTrie(const SubjectTrie &);
+	SubjectTrie &operator=(const SubjectTrie &);
+
+	Node root;
+};
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+
+#include "SubscriptionSnapshot.h"
+#include "Bytes.h"
+
+using namespace std;
+
+static const char MAGIC[4] = { 'G', 'J', 'S', 'S' };
+static const unsigned VERSION = 1;
+
+/* Subject length, encoding, compression and keyframe interval. */
+static const size_t ENTRY_MIN_SIZE = 2 + 1 + 1 + 4;
+
+bool SubscriptionSnapshot::Write(const string &path, const vector<Entry> &entries, string &error){
+	string out(MAGIC, sizeof(MAGIC));
+	PutU32(out, VERSION);
+	PutU32(out, (unsigned) entries.size());
+
+	for (size_t i = 0; i < entries.size(); i++) {
+		const Entry &entry = entries[i];
+		if (entry.subject.size() > 0xffff) {
+			error = "Subject too long: " + entry.subject.substr(0, 64);
+			return false;
+		}
+		PutU16(out, (unsigned) entry.subject.size());
+		out += entry.subject;
+		out += (char) entry.encoding;
+		out += (char) entry.compression;
+		PutU32(out, entry.keyframeInterval);
+	}
+
+	/* Write to a temporary file and rename so a crash mid-write never
+	 * leaves a truncated snapshot in place of a good one. */
+	string temporary = path + ".tmp";
+	FILE *file = fopen(temporary.c_str(), "wb");
+	if (file == NULL) {
+		error = "Unable to open " + temporary;
+		return false;
+	}
+
+	bool written = fwrite(out.data(), 1, out.size(), file) == out.size();
+	written = fclose(file) == 0 && written;
+	if (!written) {
+		remove(temporary.c_str());
+		error = "Unable to write " + temporary;
+		return false;
+	}
+
+#ifdef _WIN32
+	/* rename() only replaces an existing file on POSIX. */
+	remove(path.c_str());
+#endif
+	if (rename(temporary.c_str(), path.c_str()) != 0) {
+		error = "Unable to replace " + path;
+		return false;
+	}
+
+	return true;
+}
+
+bool SubscriptionSnapshot::Read(const string &path, vector<Entry> &entries, string &error){
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		error = "Unable to open " + path;
+		return false;
+	}
+
+	string in;
+	char buffer[65536];
+	size_t n;
+	while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		in.append(buffer, n);
+	fclose(file);
+
+	size_t pos = sizeof(MAGIC);
+	unsigned version, count;
+	if (in.size() < sizeof(MAGIC) || in.compare(0, sizeof(MAGIC), MAGIC, sizeof(MAGIC)) != 0 ||
+	    !GetU32(in, pos, version) || !GetU32(in, pos, count)) {
+		error = path + " is not a subscription snapshot";
+		return false;
+	}
+
+	if (version != VERSION) {
+		error = path + " has an unsupported snapshot version";
+		return false;
+	}
+
+	/* Every entry takes at least ENTRY_MIN_SIZE bytes, so a count the file
+	 * cannot hold is rejected before anything is allocated for it. */
+	if (count > (in.size() - pos) / ENTRY_MIN_SIZE) {
+		error = path + " is truncated";
+		return false;
+	}
+
+	entries.clear();
+	entries.reserve(count);
+	for (unsigned i = 0; i < count; i++) {
+		Entry entry;
+		unsigned length;
+		if (!GetU16(in, pos, length) || pos + length + 2 > in.size()) {
+			error = path + " is truncated";
+			return false;
+		}
+		entry.subject.assign(in, pos, length);
+		pos += length;
+		entry.encoding = (unsigned char) in[pos++];
+		entry.compression = (unsigned char) in[pos++];
+		if (!GetU32(in, pos, entry.keyframeInterval)) {
+			error = path + " is truncated";
+			return false;
+		}
+		entries.push_back(entry);
+	}
+
+	return true;
+}
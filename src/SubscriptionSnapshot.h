@@ -0,0 +1,45 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SUBSCRIPTIONSNAPSHOT_H
+#define GMSECJS_SUBSCRIPTIONSNAPSHOT_H
+
+#include <string>
+#include <vector>
+
+/*
+ * Compact on-disk copy of a connection's subscription table so a restarted
+ * process can resubscribe everything in one batch. Callbacks cannot be
+ * saved; only subjects and delivery options are.
+ *
+ * Layout (little endian):
+ *
+ *     "GJSS" u32 version  u32 count
+ *     count x { u16 subjectLength  subject  u8 encoding  u8 compression  u32 keyframeInterval }
+ */
+class SubscriptionSnapshot {
+public:
+	struct Entry {
+		std::string subject;
+		unsigned char encoding;
+		unsigned char compression;
+		unsigned keyframeInterval;
+	};
+
+	static bool Write(const std::string &path, const std::vector<Entry> &entries, std::string &error);
+	static bool Read(const std::string &path, std::vector<Entry> &entries, std::string &error);
+};
+
+#endif
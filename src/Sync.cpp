@@ -0,0 +1,138 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <time.h>
+#ifndef _WIN32
+#include <sys/time.h>
+#endif
+
+#include "Sync.h"
+
+Mutex::Mutex(){
+	uv_mutex_init(&handle);
+}
+
+Mutex::~Mutex(){
+	uv_mutex_destroy(&handle);
+}
+
+void Mutex::Enter(){
+	uv_mutex_lock(&handle);
+}
+
+void Mutex::Leave(){
+	uv_mutex_unlock(&handle);
+}
+
+#ifdef _WIN32
+
+Condition::Condition(Mutex &mutex)
+	: mutex(mutex),
+	  reason(TIMEOUT)
+{
+	InitializeConditionVariable(&handle);
+}
+
+Condition::~Condition(){
+}
+
+int Condition::Wait(){
+	reason = TIMEOUT;
+	SleepConditionVariableCS(&handle, &mutex.handle, INFINITE);
+	return reason;
+}
+
+int Condition::Wait(long millis){
+	reason = TIMEOUT;
+	SleepConditionVariableCS(&handle, &mutex.handle, millis < 0 ? 0 : (DWORD) millis);
+	return reason;
+}
+
+int Condition::WaitMicros(long micros){
+	return Wait(micros < 0 ? 0 : (micros + 999) / 1000);
+}
+
+void Condition::Signal(int why){
+	reason = why;
+	WakeConditionVariable(&handle);
+}
+
+void Condition::Broadcast(int why){
+	reason = why;
+	WakeAllConditionVariable(&handle);
+}
+
+#else
+
+Condition::Condition(Mutex &mutex)
+	: mutex(mutex),
+	  reason(TIMEOUT)
+{
+	pthread_cond_init(&handle, NULL);
+}
+
+Condition::~Condition(){
+	pthread_cond_destroy(&handle);
+}
+
+int Condition::Wait(){
+	reason = TIMEOUT;
+	pthread_cond_wait(&handle, &mutex.handle);
+	return reason;
+}
+
+int Condition::Wait(long millis){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	if (millis < 0)
+		millis = 0;
+	struct timespec deadline;
+	long nsec = now.tv_usec * 1000 + (millis % 1000) * 1000000;
+	deadline.tv_sec = now.tv_sec + millis / 1000 + nsec / 1000000000;
+	deadline.tv_nsec = nsec % 1000000000;
+
+	reason = TIMEOUT;
+	pthread_cond_timedwait(&handle, &mutex.handle, &deadline);
+	return reason;
+}
+
+int Condition::WaitMicros(long micros){
+	struct timeval now;
+	gettimeofday(&now, NULL);
+
+	if (micros < 0)
+		micros = 0;
+	struct timespec deadline;
+	long usec = now.tv_usec + micros % 1000000;
+	deadline.tv_sec = now.tv_sec + micros / 1000000 + usec / 1000000;
+	deadline.tv_nsec = (usec % 1000000) * 1000;
+
+	reason = TIMEOUT;
+	pthread_cond_timedwait(&handle, &mutex.handle, &deadline);
+	return reason;
+}
+
+void Condition::Signal(int why){
+	reason = why;
+	pthread_cond_signal(&handle);
+}
+
+void Condition::Broadcast(int why){
+	reason = why;
+	pthread_cond_broadcast(&handle);
+}
+
+#endif
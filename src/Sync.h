@@ -0,0 +1,93 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_SYNC_H
+#define GMSECJS_SYNC_H
+
+#include "uv.h"
+
+/*
+ * Mutex and condition variable for the addon's own threads. These used to
+ * come from gmsec::util, which tied every recorder, replay and generator
+ * thread to the GMSEC library; keeping them here lets the library load on
+ * the first Connect instead of with the module (see Middleware.h).
+ *
+ * The interface follows gmsec::util: a Condition is bound to a Mutex that
+ * the caller holds around Wait, Signal and Broadcast.
+ */
+class Mutex {
+public:
+	Mutex();
+	~Mutex();
+
+	void Enter();
+	void Leave();
+
+private:
+	friend class Condition;
+
+	Mutex(const Mutex &);
+	Mutex &operator=(const Mutex &);
+
+	uv_mutex_t handle;
+};
+
+class AutoMutex {
+public:
+	explicit AutoMutex(Mutex &mutex) : mutex(mutex), held(true) { mutex.Enter(); }
+	~AutoMutex() { if (held) mutex.Leave(); }
+
+	void enter() { mutex.Enter(); held = true; }
+	void leave() { held = false; mutex.Leave(); }
+
+private:
+	AutoMutex(const AutoMutex &);
+	AutoMutex &operator=(const AutoMutex &);
+
+	Mutex &mutex;
+	bool held;
+};
+
+class Condition {
+public:
+	enum { TIMEOUT = 0, USER = 1 };
+
+	explicit Condition(Mutex &mutex);
+	~Condition();
+
+	/* Returns the reason passed to Signal or Broadcast, or TIMEOUT. */
+	int Wait();
+	int Wait(long millis);
+
+	/* Same with a finer timeout; Windows rounds it up to whole milliseconds. */
+	int WaitMicros(long micros);
+
+	void Signal(int reason);
+	void Broadcast(int reason);
+
+private:
+	Condition(const Condition &);
+	Condition &operator=(const Condition &);
+
+	Mutex &mutex;
+	int reason;
+#ifdef _WIN32
+	CONDITION_VARIABLE handle;
+#else
+	pthread_cond_t handle;
+#endif
+};
+
+#endif
@@ -0,0 +1,127 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Trace.h"
+#include "TraceBuffer.h"
+#include "common.h"
+
+using namespace std;
+using namespace node;
+using namespace v8;
+
+bool Trace::writing = false;
+
+void Trace::Init(Handle<Object> target){
+	HandleScope scope;
+
+	NODE_SET_METHOD(target, "StartTrace", Start);
+	NODE_SET_METHOD(target, "StopTrace", Stop);
+	NODE_SET_METHOD(target, "WriteTrace", Write);
+}
+
+Handle<Value> Trace::Start(const Arguments& args){
+	HandleScope scope;
+
+	OPT_OBJ_ARG(0, options);
+
+	double eventsPerThread = GetNumberOption(options, "eventsPerThread", 262144);
+	if (eventsPerThread < 1)
+		return ThrowException(Exception::RangeError(
+					  String::New("Option 'eventsPerThread' must be positive")));
+
+	/* Buffers are reset by the threads that own them, which must not happen
+	 * under a write in progress. */
+	if (writing)
+		return ThrowException(Exception::Error(
+					  String::New("A trace is still being written")));
+
+	TraceBuffer::Start((size_t) eventsPerThread);
+
+	return Undefined();
+}
+
+Handle<Value> Trace::Stop(const Arguments& args){
+	HandleScope scope;
+
+	TraceBuffer::Totals totals = TraceBuffer::Stop();
+
+	Local<Object> result = Object::New();
+	result->Set(String::NewSymbol("events"), Number::New((double) totals.events));
+	result->Set(String::NewSymbol("dropped"), Number::New((double) totals.dropped));
+	result->Set(String::NewSymbol("threads"), Number::New((double) totals.threads));
+
+	return scope.Close(result);
+}
+
+Handle<Value> Trace::Write(const Arguments& args){
+	HandleScope scope;
+
+	REQ_STR_ARG(0, pathV8Str);
+	REQ_FUN_ARG(1, cb);
+
+	if (writing)
+		return ThrowException(Exception::Error(
+					  String::New("A trace is already being written")));
+
+	TraceBuffer::Stop();
+	writing = true;
+
+	write_baton_t *baton = new write_baton_t();
+	baton->path = *String::Utf8Value(pathV8Str);
+	baton->events = 0;
+	baton->cb = Persistent<Function>::New(cb);
+
+	uv_work_t *req = new uv_work_t;
+	req->data = baton;
+
+	uv_queue_work(uv_default_loop(), req, EIO_Write, (uv_after_work_cb)EIO_AfterWrite);
+
+	return Undefined();
+}
+
+void Trace::EIO_Write(uv_work_t *req){
+	write_baton_t *baton = static_cast<write_baton_t*>(req->data);
+
+	TraceBuffer::Write(baton->path, baton->events, baton->error);
+}
+
+void Trace::EIO_AfterWrite(uv_work_t *req){
+	HandleScope scope;
+
+	write_baton_t *baton = static_cast<write_baton_t*>(req->data);
+	writing = false;
+
+	Local<Value> argv[2];
+	if (baton->error.empty()) {
+		Local<Object> result = Object::New();
+		result->Set(String::NewSymbol("events"), Number::New((double) baton->events));
+		argv[0] = Local<Value>::New(Null());
+		argv[1] = result;
+	}
+	else {
+		argv[0] = Exception::Error(String::New(baton->error.c_str()));
+		argv[1] = Local<Value>::New(Undefined());
+	}
+
+	TryCatch try_catch;
+	baton->cb->Call(Context::GetCurrent()->Global(), 2, argv);
+
+	if (try_catch.HasCaught())
+		FatalException(try_catch);
+
+	baton->cb.Dispose();
+	delete baton;
+	delete req;
+}
@@ -0,0 +1,56 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_TRACE_H
+#define GMSECJS_TRACE_H
+
+#include <string>
+
+#include "v8.h"
+#include "node.h"
+#include "uv.h"
+
+/*
+ * Module level control of span tracing (see TraceBuffer.h):
+ *
+ *     GMSEC.StartTrace([{eventsPerThread: 262144}])
+ *     GMSEC.StopTrace()               -> {events, dropped, threads}
+ *     GMSEC.WriteTrace(path, callback) // callback(err, {events})
+ *
+ * WriteTrace stops tracing if it is still running and writes Chrome
+ * trace-event JSON on the thread pool.
+ */
+class Trace {
+public:
+	static void Init(v8::Handle<v8::Object> target);
+
+private:
+	struct write_baton_t {
+		std::string path;
+		size_t events;
+		std::string error;
+		v8::Persistent<v8::Function> cb;
+	};
+
+	static bool writing;
+
+	static v8::Handle<v8::Value> Start(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Stop(const v8::Arguments& args);
+	static v8::Handle<v8::Value> Write(const v8::Arguments& args);
+	static void EIO_Write(uv_work_t *req);
+	static void EIO_AfterWrite(uv_work_t *req);
+};
+
+#endif
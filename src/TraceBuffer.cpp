@@ -0,0 +1,241 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#define THREAD_LOCAL __declspec(thread)
+#define PUBLISH_BARRIER() MemoryBarrier()
+#else
+#define THREAD_LOCAL __thread
+#define PUBLISH_BARRIER() __sync_synchronize()
+#endif
+
+#include "Sync.h"
+
+#include "TraceBuffer.h"
+
+using namespace std;
+
+static const size_t CHUNK_EVENTS = 4096;
+static const size_t SUBJECT_LENGTH = 47;
+
+static const char *SPAN_NAMES[TraceBuffer::SPAN_COUNT] = {
+	"dispatch", "toXML", "decode", "encode", "queue wait", "callback", "publish wait", "publish"
+};
+
+/* Threads are named after the kind of span they record first. */
+static const char *THREAD_ROLES[TraceBuffer::SPAN_COUNT] = {
+	"middleware dispatch", "delivery", "delivery", "delivery", "node", "node", "thread pool", "thread pool"
+};
+
+struct TraceEvent {
+	uint64_t start;
+	uint64_t duration;
+	double seq;
+	unsigned char span;
+	char subject[SUBJECT_LENGTH + 1];
+};
+
+/* Written only by its thread; read by Write() once recording has stopped. */
+struct ThreadBuffer {
+	ThreadBuffer(unsigned id) : id(id), generation(0), capacity(0), chunks(NULL), count(0), dropped(0), role(0) {}
+
+	/* A new trace: the owning thread drops what it kept from the last one. */
+	void Reset(unsigned newGeneration, size_t newCapacity){
+		if (newCapacity != capacity) {
+			for (size_t i = 0; i < ChunkCount(); i++)
+				delete[] chunks[i];
+			delete[] chunks;
+
+			capacity = newCapacity;
+			chunks = new TraceEvent*[ChunkCount()];
+			for (size_t i = 0; i < ChunkCount(); i++)
+				chunks[i] = NULL;
+		}
+		count = 0;
+		dropped = 0;
+		PUBLISH_BARRIER();
+		generation = newGeneration;
+	}
+
+	size_t ChunkCount() const { return (capacity + CHUNK_EVENTS - 1) / CHUNK_EVENTS; }
+
+	const TraceEvent &At(size_t i) const { return chunks[i / CHUNK_EVENTS][i % CHUNK_EVENTS]; }
+
+	unsigned id;
+	volatile unsigned generation;
+	size_t capacity;
+	TraceEvent **chunks;
+	volatile size_t count;
+	size_t dropped;
+	unsigned char role;
+};
+
+volatile bool TraceBuffer::enabled = false;
+
+static volatile unsigned generation = 0;
+static volatile size_t capacity = 0;
+
+static Mutex registryMutex;
+static vector<ThreadBuffer*> registry;
+
+static THREAD_LOCAL ThreadBuffer *threadBuffer = NULL;
+
+static ThreadBuffer *Register(){
+	AutoMutex lock(registryMutex);
+
+	ThreadBuffer *buffer = new ThreadBuffer((unsigned) registry.size() + 1);
+	registry.push_back(buffer);
+	return buffer;
+}
+
+void TraceBuffer::Start(size_t eventsPerThread){
+	enabled = false;
+	capacity = eventsPerThread;
+	PUBLISH_BARRIER();
+	generation++;
+	enabled = true;
+}
+
+TraceBuffer::Totals TraceBuffer::Stop(){
+	enabled = false;
+
+	AutoMutex lock(registryMutex);
+
+	Totals totals = { 0, 0, 0 };
+	for (size_t i = 0; i < registry.size(); i++) {
+		if (registry[i]->generation != generation)
+			continue;
+		totals.events += registry[i]->count;
+		totals.dropped += registry[i]->dropped;
+		totals.threads++;
+	}
+	return totals;
+}
+
+void TraceBuffer::Record(Span span, const char *subject, double seq, uint64_t start, uint64_t end){
+	ThreadBuffer *buffer = threadBuffer;
+	if (buffer == NULL)
+		buffer = threadBuffer = Register();
+
+	if (buffer->generation != generation)
+		buffer->Reset(generation, capacity);
+
+	size_t i = buffer->count;
+	if (i >= buffer->capacity) {
+		buffer->dropped++;
+		return;
+	}
+
+	TraceEvent *&chunk = buffer->chunks[i / CHUNK_EVENTS];
+	if (chunk == NULL)
+		chunk = new TraceEvent[CHUNK_EVENTS];
+
+	TraceEvent &event = chunk[i % CHUNK_EVENTS];
+	event.start = start;
+	event.duration = end - start;
+	event.seq = seq;
+	event.span = (unsigned char) span;
+	if (subject != NULL) {
+		strncpy(event.subject, subject, SUBJECT_LENGTH);
+		event.subject[SUBJECT_LENGTH] = '\0';
+	}
+	else {
+		event.subject[0] = '\0';
+	}
+
+	if (i == 0)
+		buffer->role = (unsigned char) span;
+
+	/* The event must be complete before a reader can count it. */
+	PUBLISH_BARRIER();
+	buffer->count = i + 1;
+}
+
+static void WriteString(FILE *file, const char *value){
+	fputc('"', file);
+	for (; *value != '\0'; value++) {
+		unsigned char c = *value;
+		if (c == '"' || c == '\\')
+			fprintf(file, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(file, "\\u%04x", c);
+		else
+			fputc(c, file);
+	}
+	fputc('"', file);
+}
+
+bool TraceBuffer::Write(const string &path, size_t &events, string &error){
+	FILE *file = fopen(path.c_str(), "w");
+	if (file == NULL) {
+		error = "Unable to open " + path;
+		return false;
+	}
+
+	vector<ThreadBuffer*> buffers;
+	{
+		AutoMutex lock(registryMutex);
+		for (size_t i = 0; i < registry.size(); i++)
+			if (registry[i]->generation == generation && registry[i]->count > 0)
+				buffers.push_back(registry[i]);
+	}
+
+	/* Timestamps are written relative to the first span, in microseconds. */
+	uint64_t base = (uint64_t) -1;
+	for (size_t b = 0; b < buffers.size(); b++)
+		for (size_t i = 0; i < buffers[b]->count; i++)
+			if (buffers[b]->At(i).start < base)
+				base = buffers[b]->At(i).start;
+
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"gmsec-js\"}}");
+
+	events = 0;
+	for (size_t b = 0; b < buffers.size(); b++) {
+		const ThreadBuffer &buffer = *buffers[b];
+		size_t count = buffer.count;
+		PUBLISH_BARRIER();
+
+		fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s %u\"}}",
+		        buffer.id, THREAD_ROLES[buffer.role], buffer.id);
+
+		for (size_t i = 0; i < count; i++) {
+			const TraceEvent &event = buffer.At(i);
+			fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"gmsec\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+			        SPAN_NAMES[event.span], buffer.id, (event.start - base) / 1e3, event.duration / 1e3);
+			fprintf(file, "\"subject\":");
+			WriteString(file, event.subject);
+			if (event.seq >= 0)
+				fprintf(file, ",\"seq\":%.0f", event.seq);
+			fprintf(file, "}}");
+		}
+		events += count;
+	}
+
+	fprintf(file, "\n]}\n");
+
+	if (fclose(file) != 0) {
+		error = "Unable to write " + path;
+		return false;
+	}
+	return true;
+}
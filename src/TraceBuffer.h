@@ -0,0 +1,94 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_TRACEBUFFER_H
+#define GMSECJS_TRACEBUFFER_H
+
+#include <string>
+
+#include "uv.h"
+
+/*
+ * Optional span recording along the message path, written out as Chrome
+ * trace-event JSON for Perfetto or chrome://tracing.
+ *
+ * Every thread that records owns its buffer, so recording takes no lock:
+ * the event is written first and the count published after it. Buffers
+ * grow in fixed chunks that never move, which lets Write() read them on
+ * another thread once tracing is stopped. A thread whose buffer is full
+ * counts the rest as dropped.
+ *
+ * While tracing is off a span costs one load of a flag.
+ */
+class TraceBuffer {
+public:
+	enum Span {
+		DISPATCH,        /* middleware callback through routing and fan-out */
+		TO_XML,          /* serializing the message for XML consumers and replay */
+		DECODE,          /* message to field records */
+		ENCODE,          /* JSON, delta and compressed payloads */
+		QUEUE_WAIT,      /* queued for the node thread */
+		CALLBACK,        /* one JS subscription callback */
+		PUBLISH_WAIT,    /* Publish() until its batch starts */
+		PUBLISH,         /* the middleware publish call */
+		SPAN_COUNT
+	};
+
+	struct Totals {
+		size_t events;
+		size_t dropped;
+		size_t threads;
+	};
+
+	static bool Enabled() { return enabled; }
+
+	/* Discards what was recorded before and starts recording. */
+	static void Start(size_t eventsPerThread);
+	static Totals Stop();
+
+	/* Call only while stopped. */
+	static bool Write(const std::string &path, size_t &events, std::string &error);
+
+	/* subject may be NULL; a negative seq is left out. */
+	static void Record(Span span, const char *subject, double seq, uint64_t start, uint64_t end);
+
+private:
+	static volatile bool enabled;
+};
+
+/*
+ * Records the span from construction to destruction if tracing was on at
+ * both ends.
+ */
+class TraceSpan {
+public:
+	TraceSpan(TraceBuffer::Span span, const char *subject, double seq = -1)
+		: span(span), subject(subject), seq(seq), start(TraceBuffer::Enabled() ? uv_hrtime() : 0) {}
+
+	~TraceSpan(){
+		if (start != 0 && TraceBuffer::Enabled())
+			TraceBuffer::Record(span, subject, seq, start, uv_hrtime());
+	}
+
+	void SetSeq(double value) { seq = value; }
+
+private:
+	TraceBuffer::Span span;
+	const char *subject;
+	double seq;
+	uint64_t start;
+};
+
+#endif
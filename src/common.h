@@ -0,0 +1,86 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_COMMON_H
+#define GMSECJS_COMMON_H
+
+#include <string.h>
+#include <string>
+
+#include "v8.h"
+#include "node.h"
+
+#define REQ_FUN_ARG(I, VAR)                                             \
+  if (args.Length() <= (I) || !args[I]->IsFunction())                   \
+    return ThrowException(Exception::TypeError(                         \
+                  String::New("Argument " #I " must be a function")));  \
+  Local<Function> VAR = Local<Function>::Cast(args[I]);
+
+#define REQ_STR_ARG(I, VAR)                                             \
+  if (args.Length() <= (I) || !args[I]->IsString())                     \
+	return ThrowException(Exception::TypeError(                         \
+				  String::New("Argument " #I " must be a string")));  \
+  Local<String> VAR = Local<String>::Cast(args[I]);
+
+#define REQ_NUM_ARG(I, VAR)                                             \
+  if (args.Length() <= (I) || !args[I]->IsNumber())                     \
+	return ThrowException(Exception::TypeError(                         \
+				  String::New("Argument " #I " must be a number")));  \
+  double VAR = args[I]->NumberValue();
+
+#define OPT_OBJ_ARG(I, VAR)                                             \
+  Local<Object> VAR;                                                    \
+  if (args.Length() > (I) && args[I]->IsObject())                       \
+	VAR = args[I]->ToObject();                                          \
+  else                                                                  \
+	VAR = Object::New();
+
+/*
+ * Option lookups on a plain JS object, falling back to a default when the
+ * key is missing or has the wrong type.
+ */
+inline double GetNumberOption(v8::Handle<v8::Object> options, const char *key, double defaultValue){
+	v8::Local<v8::Value> value = options->Get(v8::String::NewSymbol(key));
+	return value->IsNumber() ? value->NumberValue() : defaultValue;
+}
+
+inline std::string GetStringOption(v8::Handle<v8::Object> options, const char *key, const char *defaultValue){
+	v8::Local<v8::Value> value = options->Get(v8::String::NewSymbol(key));
+	return value->IsString() ? std::string(*v8::String::Utf8Value(value)) : std::string(defaultValue);
+}
+
+inline bool GetBoolOption(v8::Handle<v8::Object> options, const char *key, bool defaultValue){
+	v8::Local<v8::Value> value = options->Get(v8::String::NewSymbol(key));
+	return value->IsBoolean() ? value->BooleanValue() : defaultValue;
+}
+
+/*
+ * Builds a Float64Array through the global constructor and copies the data
+ * into its backing store.
+ */
+inline v8::Local<v8::Object> NewFloat64Array(const double *data, size_t length){
+	v8::Local<v8::Function> ctor = v8::Local<v8::Function>::Cast(
+		v8::Context::GetCurrent()->Global()->Get(v8::String::NewSymbol("Float64Array")));
+
+	v8::Local<v8::Value> argv[1] = { v8::Integer::NewFromUnsigned((uint32_t) length) };
+	v8::Local<v8::Object> array = ctor->NewInstance(1, argv);
+
+	if (length > 0)
+		memcpy(array->GetIndexedPropertiesExternalArrayData(), data, length * sizeof(double));
+
+	return array;
+}
+
+#endif
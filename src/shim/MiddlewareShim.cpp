@@ -0,0 +1,244 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "MiddlewareShim.h"
+#include "gmsec/util/timeutil.h"
+
+using namespace std;
+
+/* Hands a subscription's messages to the addon's callback. */
+class ShimSubscription : public gmsec::Callback {
+public:
+	ShimSubscription(const char *pattern, MiddlewareApi::Callback *target) : pattern(pattern), target(target) {}
+
+	void CALL_TYPE OnMessage(gmsec::Connection *conn, gmsec::Message *msg){
+		target->OnMessage(ToApiMessage(msg));
+	}
+
+	string pattern;
+
+private:
+	MiddlewareApi::Callback *target;
+};
+
+static void ReadField(gmsec::Field &source, MiddlewareApi::Field &field){
+	field.name = "";
+	field.type = GMSEC_TYPE_UNSET;
+	field.numeric = true;
+	field.number = 0;
+	field.text = NULL;
+
+	source.GetName(field.name);
+	if (source.GetType(field.type).isError())
+		field.type = GMSEC_TYPE_UNSET;
+
+	switch (field.type) {
+	case GMSEC_TYPE_CHAR:   { GMSEC_CHAR v;   source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_BOOL:   { GMSEC_BOOL v;   source.GetValue(v); field.number = v ? 1 : 0; break; }
+	case GMSEC_TYPE_I16:    { GMSEC_I16 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_U16:    { GMSEC_U16 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_I32:    { GMSEC_I32 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_U32:    { GMSEC_U32 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_F32:    { GMSEC_F32 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_F64:    { GMSEC_F64 v;    source.GetValue(v); field.number = v; break; }
+	case GMSEC_TYPE_STRING: {
+		GMSEC_STR v = NULL;
+		source.GetValue(v);
+		field.text = v != NULL ? v : "";
+		field.numeric = false;
+		break;
+	}
+	default:
+		field.numeric = false;
+		break;
+	}
+}
+
+class GMSECShim : public MiddlewareApi {
+public:
+	Connection *Connect(const char *server, string &error){
+		gmsec::Config config;
+		config.AddValue("connectiontype", "gmsec_mb");
+		config.AddValue("server", server);
+		config.AddValue("loglevel", "VERBOSE");
+
+		gmsec::Connection *connection = NULL;
+		gmsec::Status result = gmsec::ConnectionFactory::Create(&config, connection);
+		if (result.isError()) {
+			error = result.Get();
+			return NULL;
+		}
+
+		result = connection->Connect();
+		if (result.isError()) {
+			error = result.Get();
+			gmsec::ConnectionFactory::Destroy(connection);
+			return NULL;
+		}
+
+		result = connection->StartAutoDispatch();
+		if (result.isError()) {
+			error = result.Get();
+			connection->Disconnect();
+			gmsec::ConnectionFactory::Destroy(connection);
+			return NULL;
+		}
+
+		return reinterpret_cast<Connection*>(connection);
+	}
+
+	void StopDispatch(Connection *connection){
+		ToGMSECConnection(connection)->StopAutoDispatch();
+	}
+
+	void Disconnect(Connection *connection){
+		gmsec::Connection *gmsecConnection = ToGMSECConnection(connection);
+		gmsecConnection->Disconnect();
+		gmsec::ConnectionFactory::Destroy(gmsecConnection);
+	}
+
+	Subscription *Subscribe(Connection *connection, const char *pattern, Callback *cb, string &error){
+		ShimSubscription *subscription = new ShimSubscription(pattern, cb);
+		gmsec::Status result = ToGMSECConnection(connection)->Subscribe(pattern, subscription);
+		if (result.isError()) {
+			error = result.Get();
+			delete subscription;
+			return NULL;
+		}
+		return reinterpret_cast<Subscription*>(subscription);
+	}
+
+	bool Unsubscribe(Connection *connection, Subscription *subscription, string &error){
+		ShimSubscription *callback = reinterpret_cast<ShimSubscription*>(subscription);
+		gmsec::Status result = ToGMSECConnection(connection)->UnSubscribe(callback->pattern.c_str(), callback);
+		if (result.isError()) {
+			error = result.Get();
+			return false;
+		}
+		delete callback;
+		return true;
+	}
+
+	Message *CreateMessage(Connection *connection, const char *xml, string &error){
+		gmsec::Connection *gmsecConnection = ToGMSECConnection(connection);
+		gmsec::Message *msg = NULL;
+		gmsec::Status result = gmsecConnection->CreateMessage(msg);
+		if (result.isError()) {
+			error = result.Get();
+			return NULL;
+		}
+
+		result = msg->FromXML(xml);
+		if (result.isError()) {
+			error = result.Get();
+			gmsecConnection->DestroyMessage(msg);
+			return NULL;
+		}
+		return ToApiMessage(msg);
+	}
+
+	void DestroyMessage(Connection *connection, Message *msg){
+		ToGMSECConnection(connection)->DestroyMessage(ToGMSECMessage(msg));
+	}
+
+	bool Publish(Connection *connection, Message *msg, string &error){
+		gmsec::Status result = ToGMSECConnection(connection)->Publish(ToGMSECMessage(msg));
+		if (result.isError()) {
+			error = result.Get();
+			return false;
+		}
+		return true;
+	}
+
+	const char *Subject(Message *msg){
+		const char *subject = "";
+		ToGMSECMessage(msg)->GetSubject(subject);
+		return subject;
+	}
+
+	GMSEC_MSG_KIND Kind(Message *msg){
+		GMSEC_MSG_KIND kind = GMSEC_MSG_UNSET;
+		ToGMSECMessage(msg)->GetKind(kind);
+		return kind;
+	}
+
+	void ToXML(Message *msg, string &xml){
+		const char *contents = "";
+		ToGMSECMessage(msg)->ToXML(contents);
+		xml = contents;
+	}
+
+	size_t FieldCount(Message *msg){
+		GMSEC_I32 count = 0;
+		ToGMSECMessage(msg)->GetFieldCount(count);
+		return count > 0 ? (size_t) count : 0;
+	}
+
+	bool VisitField(Message *msg, const char *name, FieldVisitor &visitor){
+		gmsec::Field source;
+		if (ToGMSECMessage(msg)->GetField(name, source).isError())
+			return false;
+
+		Field field;
+		ReadField(source, field);
+		visitor.Visit(field);
+		return true;
+	}
+
+	void VisitFields(Message *msg, FieldVisitor &visitor){
+		gmsec::Message *gmsecMsg = ToGMSECMessage(msg);
+		gmsec::Field source;
+		Field field;
+		for (gmsec::Status status = gmsecMsg->GetFirstField(source); !status.isError(); status = gmsecMsg->GetNextField(source)) {
+			ReadField(source, field);
+			visitor.Visit(field);
+		}
+	}
+
+	bool SetField(Message *msg, const char *name, GMSEC_TYPE type, double number, const char *text){
+		gmsec::Field field;
+		field.SetName(name);
+		field.SetType(type);
+
+		switch (type) {
+		case GMSEC_TYPE_CHAR:   field.SetValue((GMSEC_CHAR) number); break;
+		case GMSEC_TYPE_BOOL:   field.SetValue((GMSEC_BOOL) (number != 0)); break;
+		case GMSEC_TYPE_I16:    field.SetValue((GMSEC_I16) number); break;
+		case GMSEC_TYPE_U16:    field.SetValue((GMSEC_U16) number); break;
+		case GMSEC_TYPE_I32:    field.SetValue((GMSEC_I32) number); break;
+		case GMSEC_TYPE_U32:    field.SetValue((GMSEC_U32) number); break;
+		case GMSEC_TYPE_F32:    field.SetValue((GMSEC_F32) number); break;
+		case GMSEC_TYPE_F64:    field.SetValue((GMSEC_F64) number); break;
+		case GMSEC_TYPE_STRING: field.SetValue((GMSEC_STR) text); break;
+		default:
+			return false;
+		}
+
+		return !ToGMSECMessage(msg)->AddField(field).isError();
+	}
+
+	double Time(){
+		return gmsec::util::getTime_s();
+	}
+
+	void FormatTime(double seconds, char *buffer){
+		gmsec::util::formatTime_s(seconds, buffer);
+	}
+};
+
+extern "C" MiddlewareApi *gmsecjs_middleware_api(int version){
+	static GMSECShim shim;
+	return version == GMSECJS_MIDDLEWARE_API_VERSION ? &shim : NULL;
+}
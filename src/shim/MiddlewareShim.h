@@ -0,0 +1,43 @@
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef GMSECJS_MIDDLEWARESHIM_H
+#define GMSECJS_MIDDLEWARESHIM_H
+
+#include "gmsec_cpp.h"
+#include "../MiddlewareApi.h"
+
+/*
+ * The GMSEC side of MiddlewareApi. On Linux it is a library of its own,
+ * linked against libGMSECAPI.so and opened by Middleware::Load; programs
+ * that link it in directly, the Windows addon and the stage benchmark,
+ * call the entry point themselves.
+ */
+extern "C" MiddlewareApi *gmsecjs_middleware_api(int version);
+
+/* The opaque handles are the GMSEC objects. */
+inline MiddlewareApi::Message *ToApiMessage(gmsec::Message *msg){
+	return reinterpret_cast<MiddlewareApi::Message*>(msg);
+}
+
+inline gmsec::Message *ToGMSECMessage(MiddlewareApi::Message *msg){
+	return reinterpret_cast<gmsec::Message*>(msg);
+}
+
+inline gmsec::Connection *ToGMSECConnection(MiddlewareApi::Connection *connection){
+	return reinterpret_cast<gmsec::Connection*>(connection);
+}
+
+#endif